@@ -37,6 +37,7 @@
 // $Log$
 
 #include <stdio.h>
+#include <math.h>
 #include <getopt.h>
 #include <fstream>
 
@@ -46,6 +47,7 @@
 #include "libraries/operaException.h"
 #include "libraries/Polynomial.h"	
 #include "libraries/operaWIRCamImage.h"	
+#include "libraries/operaSourceDetection.h"
 
 /* \file wirAstrometry.cpp */
 /* \package core_wircam */
@@ -67,108 +69,52 @@ using namespace std;
  * \ingroup core
  */
 /*
- *	For the mosaic, crunch the cube in a single deeper slice if need be.
- *	Run SExtractor in a fast mode picking only bright sources on full mosaic.
- *	Save that sex catalogue.
- *	Do some kind of SEx+2MASS star match using Terapix's WCS as a 
- *	  first very good approximation. Should use wircam_differencematch.
- *		i) x,y --> relative ra,dec using Terapix WCS
- *		ii) wircam_differencematch
- *	Output a matched catalogue with both SEx fluxes and 2MASS magnitudes
- *	Update the header WCS using:
- *		i) the matched catalogue with imwcs
- *		ii) the default Terapix WCS if nothing else worked
- *	Iterate on the SEx+2MASS matched catalogue.
+ *	Detect and centroid the sources of every slice of every chip in memory,
+ *	  the planes in parallel (operaSourceDetector).
+ *	Match them to a local 2MASS extract using the header WCS of each chip as a 
+ *	  first very good approximation:
+ *		i) x,y --> ra,dec --> tangent plane of the mosaic center using the header WCS
+ *		ii) most common offset to the stars within searchradius (a vote), then
+ *		    nearest star within matchradius of the shifted source (grid hash)
+ *	Output a matched catalogue with both the source fluxes and 2MASS magnitudes
+ *	Report for each chip the offset, the rms of the matches and the corrected CRVAL.
  */
 
-string default_config = 
-"CATALOG_TYPE		ASCII_HEAD\n"					// "ASCII_HEAD","ASCII","FITS_1.0" or "FITS_LDAC"
-"DETECT_TYPE		CCD\n"
-"DETECT_MINAREA		5.0\n"
-"THRESH_TYPE		RELATIVE\n"
-"DETECT_THRESH		1.5\n"
-"ANALYSIS_THRESH	1.5\n"
-"FILTER				Y\n"
-"FILTER_NAME		~/opera-1.0/config/default.conv\n"
-"FILTER_THRESH		0\n"
-"DEBLEND_NTHRESH	32\n"
-"DEBLEND_MINCONT	0.05\n"
-"CLEAN				Y\n"
-"CLEAN_PARAM		1.0\n"
-"MASK_TYPE			CORRECT\n"
-"WEIGHT_TYPE		NONE\n"
-"WEIGHT_IMAGE		weight.fits\n"
-"WEIGHT_GAIN		N\n"
-"FLAG_IMAGE			flag.fits\n"
-"FLAG_TYPE			OR\n"
-"PHOT_APERTURES		5\n"
-//"PHOT_AUTOPARAMS[0]	2.5\n"
-//"PHOT_AUTOPARAMS[1]	3.5\n"
-//"PHOT_PETROPARAMS[0] 2.0\n"
-//"PHOT_PETROPARAMS[1] 3.5\n"
-//"PHOT_AUTOAPERS[0]	0.0\n"
-//"PHOT_AUTOAPERS[1]	0.0\n"
-"PHOT_FLUXFRAC		0.5\n"
-"SATUR_LEVEL		50000.0\n"
-"SATUR_KEY			SATURATE\n"
-"MAG_ZEROPOINT		0.0\n"
-"MAG_GAMMA			4.0\n"
-"GAIN				0.0\n"
-"GAIN_KEY			GAIN\n"
-"PIXEL_SCALE		1.0\n"
-"SEEING_FWHM		1.2\n"
-"STARNNW_NAME		~/opera-1.0/config/default.nnw\n"
-"BACK_TYPE			AUTO\n"
-"BACK_VALUE			0.0\n"
-"BACK_SIZE			64\n"
-"BACK_FILTERSIZE	3\n"
-"BACKPHOTO_TYPE		GLOBAL\n"
-"BACKPHOTO_THICK	24\n"
-"BACK_FILTTHRESH	0.0\n"
-"CHECKIMAGE_TYPE	NONE\n"
-"CHECKIMAGE_NAME	check.fits\n"
-"MEMORY_OBJSTACK	3000\n"
-"MEMORY_PIXSTACK	300000\n"
-"MEMORY_BUFSIZE		1024\n"
-//"ASSOC_NAME			sky.list\n"
-//"ASSOC_DATA[0]		2\n"
-//"ASSOC_DATA[1]		3\n"
-//"ASSOC_DATA[2]		4\n"
-//"ASSOC_PARAMS[0]	2\n"
-//"ASSOC_PARAMS[1]	3\n"
-//"ASSOC_PARAMS[2]	4\n"
-"ASSOC_RADIUS		2.0\n"
-"ASSOC_TYPE			NEAREST\n"
-"ASSOCSELEC_TYPE	MATCHED\n"
-"VERBOSE_TYPE		NORMAL\n"
-"WRITE_XML			N\n"
-"XML_NAME			sex.xml\n"
-"XSL_URL			~/opera-1.0/config/sextractor.xsl\n"
-"NTHREADS			0\n"
-"FITS_UNSIGNED		N\n"
-"INTERP_MAXXLAG		16\n"
-"INTERP_MAXYLAG		16\n"
-"INTERP_TYPE		ALL\n"
-;
-
-string default_parameters = 
-"X_IMAGE\n"
-"Y_IMAGE\n"
-"MAG_BEST\n"
-;
+/*
+ * operaTangentPlaneWCS readChipWCS(operaWIRCamImage &image, unsigned extension)
+ * \brief the TAN WCS of a chip from the CRPIX, CRVAL and CD keywords of its extension.
+ */
+static operaTangentPlaneWCS readChipWCS(operaWIRCamImage &image, unsigned extension) {
+	operaTangentPlaneWCS wcs;
+	wcs.crpix1 = atof(image.operaFITSGetHeaderValue("CRPIX1", extension).c_str());
+	wcs.crpix2 = atof(image.operaFITSGetHeaderValue("CRPIX2", extension).c_str());
+	wcs.crval1 = atof(image.operaFITSGetHeaderValue("CRVAL1", extension).c_str());
+	wcs.crval2 = atof(image.operaFITSGetHeaderValue("CRVAL2", extension).c_str());
+	wcs.cd11 = atof(image.operaFITSGetHeaderValue("CD1_1", extension).c_str());
+	wcs.cd12 = atof(image.operaFITSGetHeaderValue("CD1_2", extension).c_str());
+	wcs.cd21 = atof(image.operaFITSGetHeaderValue("CD2_1", extension).c_str());
+	wcs.cd22 = atof(image.operaFITSGetHeaderValue("CD2_2", extension).c_str());
+	if (wcs.cd11*wcs.cd22 - wcs.cd12*wcs.cd21 == 0.0) {
+		throw operaException("wirAstrometry: no CD matrix in extension ", operaErrorHeaderProblem, __FILE__, __FUNCTION__, __LINE__);	
+	}
+	return wcs;
+}
 
 int main(int argc, char *argv[])
 {
 	int opt;
 	string name_output;
 	string name_input;
-	string configfilename = "/tmp/config.sex";
-	string twomasscatalogname = "/tmp/twomass.cat";
-	string sexcatalogname = "/tmp/sex.cat";
-	string parametersfilename = "/tmp/sex.param";
-	string tmc_path_string = "/data/polena/catalogs/2mass.wcs";
+	string twomasscatalogname;
+	string matchedcatalogname;
 	string param_iiwiversion = "3.0";
 	string param_procdate;
+	float detect_threshold = 1.5;		// sigmas
+	unsigned detect_minarea = 5;		// pixels
+	float saturation = WIRCAM_SATURATION;
+	float searchradius = 10.0;			// arcsec, for the offset of the header WCS
+	float matchradius = 1.5;			// arcsec, once the offset is applied
+	float catalogradius = 700.0;		// arcsec, half the side of the catalog box, as scat -r 700,700 queried
 	    
 	int debug=0, verbose=0, trace=0, plot=0;
     
@@ -179,11 +125,14 @@ int main(int argc, char *argv[])
 	struct option longopts[] = {
 		{"name_input",			optional_argument, NULL, 'i'},	
 		{"name_output",			optional_argument, NULL, 'o'},	
-		{"configfilename",		optional_argument, NULL, 'c'},
 		{"twomasscatalogname",  optional_argument, NULL, 'w'},
-		{"sexcatalogname",		optional_argument, NULL, 'x'},
-		{"parametersfilename",	optional_argument, NULL, 'a'},
-		{"tmc_path",			optional_argument, NULL, 'm'},
+		{"name_matchedcat",		optional_argument, NULL, 'e'},	
+		{"detect_threshold",	optional_argument, NULL, '0'},	
+		{"detect_minarea",		optional_argument, NULL, '1'},	
+		{"saturation",			optional_argument, NULL, 's'},	
+		{"searchradius",		optional_argument, NULL, 'r'},	
+		{"matchradius",			optional_argument, NULL, 'm'},	
+		{"catalogradius",		optional_argument, NULL, 'c'},	
 		
 		{"plotfilename",		optional_argument, NULL, 'P'},
 		{"datafilename",		optional_argument, NULL, 'F'},
@@ -195,7 +144,7 @@ int main(int argc, char *argv[])
 		{"help",				0, NULL, 'h'},
 		{0,0,0,0}};
 	
-	while((opt = getopt_long(argc, argv, "i:o:c:w:x:a:m:v::d::t::p::h", 
+	while((opt = getopt_long(argc, argv, "i:o:w:e:0:1:s:r:m:c:P:F:S:v::d::t::p::h", 
 							 longopts, NULL))  != -1)
 	{
 		switch(opt) 
@@ -206,20 +155,40 @@ int main(int argc, char *argv[])
 			case 'o':
 				name_output = optarg;
 				break;
-			case 'c':
-				configfilename = optarg;
-				break;
 			case 'w':
 				twomasscatalogname = optarg;
 				break;
-			case 'x':
-				sexcatalogname = optarg;
+			case 'e':
+				matchedcatalogname = optarg;
+				break;
+			case '0':
+				detect_threshold = atof(optarg);
+				break;
+			case '1':
+				detect_minarea = atoi(optarg);
+				break;
+			case 's':
+				saturation = atof(optarg);
+				break;
+			case 'r':
+				searchradius = atof(optarg);
 				break;
 			case 'm':
-				tmc_path_string = optarg;
+				matchradius = atof(optarg);
 				break;
-			case 'a':
-				parametersfilename = optarg;
+			case 'c':
+				catalogradius = atof(optarg);
+				break;
+				
+			case 'P':
+				plotfilename = optarg;
+				plot = 1;
+				break;
+			case 'F':
+				datafilename = optarg;
+				break;
+			case 'S':
+				scriptfilename = optarg;
 				break;
 				
 			case 'v':
@@ -246,15 +215,21 @@ int main(int argc, char *argv[])
 		if (name_input.empty()) {
 			throw operaException("wirAstrometry: ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);	
 		}
+		if (twomasscatalogname.empty()) {
+			throw operaException("wirAstrometry: a local 2MASS extract is required ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);	
+		}
 		
 		if (verbose) {
 			cerr << "wirAstrometry: input image = " << name_input << endl; 
 			cerr << "wirAstrometry: output image = " << name_output << endl; 
-			cout << "wirAstrometry: config file name = " << configfilename << endl;
-			cout << "wirAstrometry: parameters file name = " << parametersfilename << endl;
-			cout << "wirAstrometry: two mass file name = " << twomasscatalogname << endl;
-			cout << "wirAstrometry: sextractor file name = " << sexcatalogname << endl;
-			cout << "wirAstrometry: tmc_path = " << tmc_path_string << endl;			
+			cerr << "wirAstrometry: two mass file name = " << twomasscatalogname << endl;
+			cerr << "wirAstrometry: matched catalog name = " << matchedcatalogname << endl;
+			cerr << "wirAstrometry: detect_threshold = " << detect_threshold << endl; 
+			cerr << "wirAstrometry: detect_minarea = " << detect_minarea << endl; 
+			cerr << "wirAstrometry: saturation = " << saturation << endl; 
+			cerr << "wirAstrometry: searchradius = " << searchradius << endl; 
+			cerr << "wirAstrometry: matchradius = " << matchradius << endl; 
+			cerr << "wirAstrometry: catalogradius = " << catalogradius << endl; 
 			if (plot) {
                 cerr << "wirAstrometry: plotfilename = " << plotfilename << endl;
                 cerr << "wirAstrometry: datafilename = " << datafilename << endl;
@@ -264,113 +239,122 @@ int main(int argc, char *argv[])
 		
         ofstream *fdata = NULL;
         
-		char *tmc_path = getenv("TMC_PATH");		// The environment variable TMC_PATH must be defined for the 2MASS catalogue to be queried.
-		if (tmc_path == NULL) {
-			throw operaException("wirAstrometry: The environment variable TMC_PATH must be defined for the 2MASS catalogue to be queried ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);	
-		} else if (tmc_path_string.empty()) {
-			tmc_path_string = string(tmc_path);
-		}
-		
-        if (verbose) {
-			cout << "wirAstrometry: writing default configuration file: " << configfilename << endl;
-		}
-		ofstream fout(configfilename.c_str());
-		fout << default_config;
-		fout.close();
-		
-        if (verbose) {
-			cout << "wirAstrometry: writing default parameters file: " << parametersfilename << endl;
-		}
-		ofstream pout(parametersfilename.c_str());
-		pout << default_parameters;
-		pout.close();
-		
-        if (verbose) {
-			cout << "wirAstrometry: Calling sextractor." << endl;
-		}
-		string basename = name_input;
-		if (name_input.find("/") != string::npos) {
-			basename = name_input.substr(name_input.find_last_of("/")+1);
-		}
-		sexcatalogname = basename.substr(0, basename.find(".fits")) + ".cat";
-		if (verbose) {
-			printf("%s/sex %s -c %s -PARAMETERS_NAME %s -CATALOG_NAME %s -FILTER_NAME %s -THRESH_TYPE RELATIVE -WEIGHT_TYPE NONE -SATUR_LEVEL %d -CHECKIMAGE_TYPE NONE >/tmp/sex.log\n",
-				   "/usr/local/bin/",
-				   name_input.c_str(),
-				   configfilename.c_str(), 
-				   parametersfilename.c_str(), 
-				   sexcatalogname.c_str(),
-				   "~/opera-1.0/config/default.conv",
-				   35000);			
-		}
-		systemf("%s/sex %s -c %s -PARAMETERS_NAME %s -CATALOG_NAME %s -FILTER_NAME %s -THRESH_TYPE RELATIVE -WEIGHT_TYPE NONE -SATUR_LEVEL %d -CHECKIMAGE_TYPE NONE >/tmp/sex.log",
-				"/usr/local/bin/",
-				name_input.c_str(),
-				configfilename.c_str(), 
-				parametersfilename.c_str(), 
-				sexcatalogname.c_str(),
-				"~/opera-1.0/config/default.conv",
-				35000);
-		
-		if (verbose) {
-			cout << "wirAstrometry: sex catalog:" << endl;
-			ifstream sexcat(sexcatalogname.c_str());
-			if (sexcat.is_open()) {
-				string dataline;
-				while (sexcat.good()) {
-					getline(sexcat, dataline);
-					cout << dataline << endl;
-				} 
-				sexcat.close();
-			}
-		}
-		
-		if (verbose) {
-			cout << "wirAstrometry: Calling scat." << endl;
-		}
 		operaWIRCamImage image(name_input, tfloat, READONLY, cNone, false); 
-		float absra_center = image.operaFITSGetFloatHeaderValue("RA_DEG");
-		float absdec_center = image.operaFITSGetFloatHeaderValue("DEC_DEG");
+		unsigned nextensions = image.getNExtensions();
+		unsigned naxis1 = image.getnaxis1();
+		unsigned naxis2 = image.getnaxis2();
+		unsigned nslices = image.getnaxis3() > 1 ? image.getnaxis3() : 1;
+		
+		double absra_center = atof(image.operaFITSGetHeaderValue("RA_DEG").c_str());
+		double absdec_center = atof(image.operaFITSGetHeaderValue("DEC_DEG").c_str());
 		// Apply the ra-dec offset between the science target (RA_DEG,DEC_DEG) and the instrument mosaic center
-		float instzra = image.operaFITSGetFloatHeaderValue("INSTZRA"); // Should be 52.0 arcsec	NOTE: the signs are inconsistent!
-		float instzdec = image.operaFITSGetFloatHeaderValue("INSTZDEC"); // Should be -52.0 arcsec
+		double instzra = atof(image.operaFITSGetHeaderValue("INSTZRA").c_str()); // Should be 52.0 arcsec	NOTE: the signs are inconsistent!
+		double instzdec = atof(image.operaFITSGetHeaderValue("INSTZDEC").c_str()); // Should be -52.0 arcsec
 		
 		absra_center = absra_center - instzra/3600.0;			// The header interprets this as the instrument center
 		absdec_center = absdec_center + instzdec/3600.0;		// Yes, the header signs are inconsistent!
 		
+		/*
+		 * Detect the sources of every slice of every chip, the planes in parallel.
+		 */
 		if (verbose) {
-			printf("export TMC_PATH=%s ; %s/scat -c tmc -j -d -r 700,700 -n 2000 %f %f >%s\n",
-				   tmc_path_string.c_str(),
-				   "/usr/local/bin/",
-				   absra_center,
-				   absdec_center, 
-				   twomasscatalogname.c_str());				
+			cout << "wirAstrometry: detecting sources in " << nextensions << " extensions of " << nslices << " slices." << endl;
+		}
+		operaSourceDetector detector(detect_threshold, detect_minarea, saturation);
+		std::vector< std::vector<operaSource> > sources;
+		// the planes are read whole (isLazy false), extension after extension and slice after slice in one buffer
+		if (image.getnpixels() != (unsigned long)naxis1*naxis2*nslices*nextensions) {
+			throw operaException("wirAstrometry: "+name_input+" planes are not contiguous in memory ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 		}
-		systemf("export TMC_PATH=%s ; %s/scat -c tmc -j -d -r 700,700 -n 2000 %f %f >%s",
-				tmc_path_string.c_str(),
-				"/usr/local/bin/",
-				absra_center,
-				absdec_center, 
-				twomasscatalogname.c_str());
+		detector.detect((float *)image.getpixels(), naxis1, naxis2, nextensions*nslices, sources);
 		
-		if (verbose) {
-			cout << "wirAstrometry: scat catalog:" << endl;
-			ifstream twomass(twomasscatalogname.c_str());
-			if (twomass.is_open()) {
-				string dataline;
-				while (twomass.good()) {
-					getline(twomass, dataline);
-					cout << dataline << endl;
-				}
-				twomass.close();
+		/*
+		 * The 2MASS stars in the box about the mosaic center, on its tangent plane in arcsec.
+		 */
+		std::vector<operaCatalogStar> stars;
+		readTwoMassExtract(twomasscatalogname, stars);
+		std::vector<operaCatalogStar> fieldstars;
+		std::vector<double> starxi, stareta;
+		for (unsigned k=0; k<stars.size(); k++) {
+			double xi, eta;
+			if (skyToTangentPlane(stars[k].ra, stars[k].dec, absra_center, absdec_center, xi, eta) 
+				&& fabs(xi*3600.0) <= catalogradius && fabs(eta*3600.0) <= catalogradius) {
+				fieldstars.push_back(stars[k]);
+				starxi.push_back(xi*3600.0);
+				stareta.push_back(eta*3600.0);
 			}
 		}
-
+		if (verbose) {
+			cout << "wirAstrometry: " << fieldstars.size() << " of " << stars.size() << " 2MASS stars in the field." << endl;
+		}
+		operaSourceMatcher matcher(starxi, stareta, searchradius);
+		
         if (!datafilename.empty()) {
             fdata = new ofstream();
             fdata->open(datafilename.c_str());  
         }          
+		FILE *fmatched = NULL;
+		if (!matchedcatalogname.empty()) {
+			fmatched = fopen(matchedcatalogname.c_str(), "w");
+			if (fmatched == NULL) {
+				throw operaException("wirAstrometry: "+matchedcatalogname+" ", operaErrorNoOutput, __FILE__, __FUNCTION__, __LINE__);	
+			}
+			fprintf(fmatched, "# extension slice x y ra dec J H K flux\n");
+		}
 		
+		/*
+		 * Match each chip through its header WCS, all its slices at once, and move its WCS by the most common offset.
+		 */
+		for (unsigned extension=1; extension<=nextensions; extension++) {
+			operaTangentPlaneWCS wcs = readChipWCS(image, extension);
+			std::vector<double> xi, eta;
+			std::vector<const operaSource *> chipsources;
+			std::vector<unsigned> chipslices;
+			for (unsigned slice=1; slice<=nslices; slice++) {
+				const std::vector<operaSource> &planesources = sources[(extension-1)*nslices + slice-1];
+				for (unsigned i=0; i<planesources.size(); i++) {
+					double ra, dec, x, y;
+					wcs.pixelToSky(planesources[i].x, planesources[i].y, ra, dec);
+					if (skyToTangentPlane(ra, dec, absra_center, absdec_center, x, y)) {
+						xi.push_back(x*3600.0);
+						eta.push_back(y*3600.0);
+						chipsources.push_back(&planesources[i]);
+						chipslices.push_back(slice);
+					}
+				}
+			}
+			std::vector<int> matches;
+			double dxi, deta;
+			unsigned matched = matcher.match(xi, eta, searchradius, matchradius, matches, dxi, deta);
+			
+			double sumsquares = 0.0;
+			for (unsigned i=0; i<xi.size(); i++) {
+				if (matches[i] < 0) {
+					continue;
+				}
+				const operaCatalogStar &star = fieldstars[matches[i]];
+				double residualxi = starxi[matches[i]] - xi[i] - dxi;
+				double residualeta = stareta[matches[i]] - eta[i] - deta;
+				sumsquares += residualxi*residualxi + residualeta*residualeta;
+				if (fdata != NULL) {
+					*fdata << extension << ' ' << chipslices[i] << ' ' << chipsources[i]->x << ' ' << chipsources[i]->y << ' ' << residualxi << ' ' << residualeta << endl;
+				}
+				if (fmatched != NULL) {
+					fprintf(fmatched, "%u %u %.3f %.3f %.7f %.7f %.3f %.3f %.3f %.2f\n", extension, chipslices[i], chipsources[i]->x, chipsources[i]->y, star.ra, star.dec, star.J, star.H, star.K, chipsources[i]->flux);
+				}
+			}
+			double rms = matched ? sqrt(sumsquares/matched) : 0.0;
+			
+			double crval1 = wcs.crval1, crval2 = wcs.crval2, crxi, creta;
+			if (matched && skyToTangentPlane(wcs.crval1, wcs.crval2, absra_center, absdec_center, crxi, creta)) {
+				tangentPlaneToSky(crxi + dxi/3600.0, creta + deta/3600.0, absra_center, absdec_center, crval1, crval2);
+			}
+			printf("wirAstrometry: extension %u: %u of %u sources matched, offset %.3f %.3f arcsec, rms %.3f arcsec, CRVAL1 %.8f CRVAL2 %.8f\n",
+				   extension, matched, (unsigned)xi.size(), dxi, deta, rms, crval1, crval2);
+		}
+		if (fmatched != NULL) {
+			fclose(fmatched);
+		}
 		
         if (fdata != NULL) {
             fdata->close();
@@ -395,6 +379,15 @@ static void printUsageSyntax(char * modulename) {
 	cerr <<
 	"\n"
 	" Usage: "+string(modulename)+"  [-vdth]" + 
+	"  -i, --name_input=<FITS_CUBE>\n"
+	"  -w, --twomasscatalogname=<2MASS_EXTRACT>, one \"ra dec J H K\" star per line\n"
+	"  -e, --name_matchedcat=<MATCHED_CATALOG>\n"
+	"  -0, --detect_threshold=<SIGMAS>\n"
+	"  -1, --detect_minarea=<PIXELS>\n"
+	"  -s, --saturation=<ADU>\n"
+	"  -r, --searchradius=<ARCSEC>\n"
+	"  -m, --matchradius=<ARCSEC>\n"
+	"  -c, --catalogradius=<ARCSEC>\n"
 	"  -P, --plotfilename=<EPS_FILE>\n"
 	"  -F, --datafilename=<DATA_FILE>\n"
 	"  -S, --scriptfilename=<GNUPLOT_FILE>\n" 
@@ -37,6 +37,8 @@
 // $Log$
 
 #include <stdio.h>
+#include <math.h>
+#include <ctype.h>
 #include <getopt.h>
 #include <fstream>
 
@@ -46,6 +48,8 @@
 #include "libraries/operaException.h"
 #include "libraries/Polynomial.h"	
 #include "libraries/operaWIRCamImage.h"	
+#include "libraries/operaStats.h"
+#include "libraries/operaSourceDetection.h"
 
 /* \file wirPhotometry.cpp */
 /* \package core_wircam */
@@ -70,23 +74,28 @@ using namespace std;
  * This program creates a matched catalogue for every slice of a cube assuming
  * the WCS in the header is good and determines zero point and measure the
  * absorption. This program is used in conjonction with wirAstrometry.pro
- * which does the WCS.
+ * which does the WCS. The sources are detected in memory and matched to a
+ * local 2MASS extract, the magnitudes of the band of the FILTER keyword.
  */
-string default_config = 
-" -DETECT_MINAREA 3"
-" -THRESH_TYPE RELATIVE"
-" -DETECT_THRESH 2.0"
-" -ANALYSIS_THRESH 2.0"
-" -WEIGHT_TYPE NONE"
-" -SEEING_FWHM 0.7"
-" -CHECKIMAGE_TYPE NONE"
-;
-
-string default_parameters = 
-"X_IMAGE\n"
-"Y_IMAGE\n"
-"MAG_BEST\n"
-;
+/*
+ * operaTangentPlaneWCS readChipWCS(operaWIRCamImage &image, unsigned extension)
+ * \brief the TAN WCS of a chip from the CRPIX, CRVAL and CD keywords of its extension.
+ */
+static operaTangentPlaneWCS readChipWCS(operaWIRCamImage &image, unsigned extension) {
+	operaTangentPlaneWCS wcs;
+	wcs.crpix1 = atof(image.operaFITSGetHeaderValue("CRPIX1", extension).c_str());
+	wcs.crpix2 = atof(image.operaFITSGetHeaderValue("CRPIX2", extension).c_str());
+	wcs.crval1 = atof(image.operaFITSGetHeaderValue("CRVAL1", extension).c_str());
+	wcs.crval2 = atof(image.operaFITSGetHeaderValue("CRVAL2", extension).c_str());
+	wcs.cd11 = atof(image.operaFITSGetHeaderValue("CD1_1", extension).c_str());
+	wcs.cd12 = atof(image.operaFITSGetHeaderValue("CD1_2", extension).c_str());
+	wcs.cd21 = atof(image.operaFITSGetHeaderValue("CD2_1", extension).c_str());
+	wcs.cd22 = atof(image.operaFITSGetHeaderValue("CD2_2", extension).c_str());
+	if (wcs.cd11*wcs.cd22 - wcs.cd12*wcs.cd21 == 0.0) {
+		throw operaException("wirPhotometry: no CD matrix in extension ", operaErrorHeaderProblem, __FILE__, __FUNCTION__, __LINE__);	
+	}
+	return wcs;
+}
 
 int main(int argc, char *argv[])
 {
@@ -96,24 +105,21 @@ int main(int argc, char *argv[])
 	string param_iiwiversion = "3.0";
 	string param_procdate;
 
-	string sextractor_configuration_parameters = default_config;
-	string matchedcatalogname = "/tmp/sex.matchedcat";
-	string configfilename = "/tmp/config.sex";
-	string twomasscatalogname = "/tmp/twomass.cat";
-	string sexcatalogname = "/tmp/sex.cat";
-	string parametersfilename = "/tmp/sex.param";
-	string tmc_path_string = "/data/polena/catalogs/2mass.wcs";
+	string matchedcatalogname;
+	string twomasscatalogname;
+	string band;
 	bool linearize = false;
 	float zp_base  = 0.0;
 	float zp_err   = 0.0;
 	float zp_wonlc = 0.0;
-	float zp_ext1  = 0.0;
-	float zp_ext2  = 0.0;
-	float zp_ext3  = 0.0;
-	float zp_ext4  = 0.0;
+	float zp_ext[WIRCAM_EXTENSIONS] = {0.0, 0.0, 0.0, 0.0};
 	float detect_threshold = 2.0;
-	float detect_minarea = 3.0;
-	float analysis_thresh = 2.0;
+	unsigned detect_minarea = 3;
+	float saturation = WIRCAM_SATURATION;
+	float apertureradius = 5.0;		// pixels
+	float searchradius = 10.0;		// arcsec, for the offset of the header WCS
+	float matchradius = 1.5;		// arcsec, once the offset is applied
+	float catalogradius = 700.0;	// arcsec, half the side of the catalog box
 
 	int debug=0, verbose=0, trace=0, plot=0;
     
@@ -124,16 +130,16 @@ int main(int argc, char *argv[])
 	struct option longopts[] = {
 		{"name_input",			1, NULL, 'i'},	
 		{"name_output",			1, NULL, 'o'},	
-		{"name_sexcat",			1, NULL, 's'},	
-		{"configfilename",		1, NULL, 'c'},
 		{"twomasscatalogname",  1, NULL, 'w'},
-		{"sexcatalogname",		1, NULL, 'x'},
-		{"parametersfilename",	1, NULL, 'a'},
-		{"tmc_path",			1, NULL, 'm'},
 		{"name_matchedcat",		1, NULL, 'e'},	
+		{"band",				1, NULL, 'b'},	
 		{"detect_threshold",	1, NULL, '0'},	
 		{"detect_minarea",		1, NULL, '1'},	
-		{"analysis_thresh",		1, NULL, '2'},	
+		{"saturation",			1, NULL, 'u'},	
+		{"apertureradius",		1, NULL, 'A'},	
+		{"searchradius",		1, NULL, 'r'},	
+		{"matchradius",			1, NULL, 'm'},	
+		{"catalogradius",		1, NULL, 'c'},	
 		{"zp_base",				1, NULL, '3'},	
 		{"zp_err",				1, NULL, '4'},	
 		{"zp_wonlc",			1, NULL, '5'},	
@@ -153,7 +159,7 @@ int main(int argc, char *argv[])
 		{"help",				0, NULL, 'h'},
 		{0,0,0,0}};
 	
-	while((opt = getopt_long(argc, argv, "i:o:s:c:w:x:a:m:e:0:1:2:3:4:5:6:7:8:9:l:v::d::t::p::h", 
+	while((opt = getopt_long(argc, argv, "i:o:w:e:b:0:1:u:A:r:m:c:3:4:5:6:7:8:9:l:P:F:S:v::d::t::p::h", 
 							 longopts, NULL))  != -1)
 	{
 		switch(opt) 
@@ -164,38 +170,35 @@ int main(int argc, char *argv[])
 			case 'o':
 				name_output = optarg;
 				break;
-			case 's':
-				sexcatalogname = optarg;
+			case 'w':
+				twomasscatalogname = optarg;
 				break;
 			case 'e':
 				matchedcatalogname = optarg;
 				break;
-			case 'c':
-				configfilename = optarg;
+			case 'b':
+				band = optarg;
 				break;
-			case 'w':
-				twomasscatalogname = optarg;
+			case '0':
+				detect_threshold = atof(optarg);
 				break;
-			case 'x':
-				sexcatalogname = optarg;
+			case '1':
+				detect_minarea = atoi(optarg);
 				break;
-			case 'm':
-				tmc_path_string = optarg;
+			case 'u':
+				saturation = atof(optarg);
 				break;
-			case 'a':
-				parametersfilename = optarg;
+			case 'A':
+				apertureradius = atof(optarg);
 				break;
-			case '0':
-				detect_threshold = atof(optarg);
-				sextractor_configuration_parameters += " -DETECT_THRESH "+string(optarg);
+			case 'r':
+				searchradius = atof(optarg);
 				break;
-			case '1':
-				detect_minarea = atof(optarg);
-				sextractor_configuration_parameters += " -DETECT_MINAREA "+string(optarg);
+			case 'm':
+				matchradius = atof(optarg);
 				break;
-			case '2':
-				analysis_thresh = atof(optarg);
-				sextractor_configuration_parameters += " -ANALYSIS_THRESH "+string(optarg);
+			case 'c':
+				catalogradius = atof(optarg);
 				break;
 			case '3':
 				zp_base = atof(optarg);
@@ -207,20 +210,31 @@ int main(int argc, char *argv[])
 				zp_wonlc = atof(optarg);
 				break;
 			case '6':
-				zp_ext1 = atof(optarg);
+				zp_ext[0] = atof(optarg);
 				break;
 			case '7':
-				zp_ext2 = atof(optarg);
+				zp_ext[1] = atof(optarg);
 				break;
 			case '8':
-				zp_ext3 = atof(optarg);
+				zp_ext[2] = atof(optarg);
 				break;
 			case '9':
-				zp_ext4 = atof(optarg);
+				zp_ext[3] = atof(optarg);
 				break;
 			case 'l':
 				linearize = atoi(optarg) == 1;
 				break;
+				
+			case 'P':
+				plotfilename = optarg;
+				plot = 1;
+				break;
+			case 'F':
+				datafilename = optarg;
+				break;
+			case 'S':
+				scriptfilename = optarg;
+				break;
 				 
 			case 'v':
 				verbose = 1;
@@ -246,27 +260,30 @@ int main(int argc, char *argv[])
 		if (name_input.empty()) {
 			throw operaException("wirPhotometry: ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);	
 		}
+		if (twomasscatalogname.empty()) {
+			throw operaException("wirPhotometry: a local 2MASS extract is required ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);	
+		}
 		
 		if (verbose) {
 			cerr << "wirPhotometry: input image = " << name_input << endl; 
 			cerr << "wirPhotometry: output image = " << name_output << endl; 
-			cerr << "wirPhotometry: sexcatalogname = " << sexcatalogname << endl; 
 			cerr << "wirPhotometry: matchedcatalogname = " << matchedcatalogname << endl; 
-			cout << "wirPhotometry: config file name = " << configfilename << endl;
-			cout << "wirPhotometry: parameters file name = " << parametersfilename << endl;
-			cout << "wirPhotometry: two mass file name = " << twomasscatalogname << endl;
-			cout << "wirPhotometry: sextractor file name = " << sexcatalogname << endl;
-			cout << "wirPhotometry: tmc_path = " << tmc_path_string << endl;			
+			cerr << "wirPhotometry: two mass file name = " << twomasscatalogname << endl;
+			cerr << "wirPhotometry: band = " << band << endl; 
 			cerr << "wirPhotometry: detect_threshold = " << detect_threshold << endl; 
 			cerr << "wirPhotometry: detect_minarea = " << detect_minarea << endl; 
-			cerr << "wirPhotometry: analysis_thresh = " << analysis_thresh << endl; 
+			cerr << "wirPhotometry: saturation = " << saturation << endl; 
+			cerr << "wirPhotometry: apertureradius = " << apertureradius << endl; 
+			cerr << "wirPhotometry: searchradius = " << searchradius << endl; 
+			cerr << "wirPhotometry: matchradius = " << matchradius << endl; 
+			cerr << "wirPhotometry: catalogradius = " << catalogradius << endl; 
 			cerr << "wirPhotometry: zp_base = " << zp_base << endl; 
 			cerr << "wirPhotometry: zp_err = " << zp_err << endl; 
 			cerr << "wirPhotometry: zp_wonlc = " << zp_wonlc << endl; 
-			cerr << "wirPhotometry: zp_ext1 = " << zp_ext1 << endl; 
-			cerr << "wirPhotometry: zp_ext2 = " << zp_ext2 << endl; 
-			cerr << "wirPhotometry: zp_ext3 = " << zp_ext3 << endl; 
-			cerr << "wirPhotometry: zp_ext4 = " << zp_ext4 << endl; 
+			cerr << "wirPhotometry: zp_ext1 = " << zp_ext[0] << endl; 
+			cerr << "wirPhotometry: zp_ext2 = " << zp_ext[1] << endl; 
+			cerr << "wirPhotometry: zp_ext3 = " << zp_ext[2] << endl; 
+			cerr << "wirPhotometry: zp_ext4 = " << zp_ext[3] << endl; 
 			cerr << "wirPhotometry: linearize = " << linearize << endl; 
             if (plot) {
                 cerr << "wirPhotometry: plotfilename = " << plotfilename << endl;
@@ -282,62 +299,137 @@ int main(int argc, char *argv[])
             fdata->open(datafilename.c_str());  
         }          
 		
-		char *tmc_path = getenv("TMC_PATH");		// The environment variable TMC_PATH must be defined for the 2MASS catalogue to be queried.
-		if (tmc_path == NULL) {
-			throw operaException("wirPhotometry: The environment variable TMC_PATH must be defined for the 2MASS catalogue to be queried ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);	
-		} else if (tmc_path_string.empty()) {
-			tmc_path_string = string(tmc_path);
-		}
+		operaWIRCamImage image(name_input, tfloat, READONLY, cNone, false); 
+		unsigned nextensions = image.getNExtensions();
+		unsigned naxis1 = image.getnaxis1();
+		unsigned naxis2 = image.getnaxis2();
+		unsigned nslices = image.getnaxis3() > 1 ? image.getnaxis3() : 1;
 		
-        if (verbose) {
-			cout << "wirPhotometry: writing default configuration file: " << configfilename << endl;
+		if (band.empty()) {
+			band = image.operaFITSGetHeaderValue("FILTER");
 		}
-		ofstream fout(configfilename.c_str());
-		fout << default_config;
-		fout.close();
-		
-        if (verbose) {
-			cout << "wirPhotometry: writing default parameters file: " << parametersfilename << endl;
+		char bandletter = band.empty() ? ' ' : toupper(band[0]);
+		if (bandletter != 'J' && bandletter != 'H' && bandletter != 'K') {
+			throw operaException("wirPhotometry: no 2MASS band for filter "+band+", use --band ", operaErrorHeaderProblem, __FILE__, __FUNCTION__, __LINE__);	
 		}
-		ofstream pout(parametersfilename.c_str());
-		pout << default_parameters;
-		pout.close();
-
-		string basename = name_input;
-		if (name_input.find("/") != string::npos) {
-			basename = name_input.substr(name_input.find_last_of("/")+1);
+		double exptime = atof(image.operaFITSGetHeaderValue("EXPTIME").c_str());
+		if (exptime <= 0.0) {
+			exptime = 1.0;
 		}
-		sexcatalogname = basename.substr(0, basename.find(".fits")) + ".cat";
+		
+		double absra_center = atof(image.operaFITSGetHeaderValue("RA_DEG").c_str());
+		double absdec_center = atof(image.operaFITSGetHeaderValue("DEC_DEG").c_str());
+		// Apply the ra-dec offset between the science target (RA_DEG,DEC_DEG) and the instrument mosaic center
+		double instzra = atof(image.operaFITSGetHeaderValue("INSTZRA").c_str());
+		double instzdec = atof(image.operaFITSGetHeaderValue("INSTZDEC").c_str());
+		absra_center = absra_center - instzra/3600.0;
+		absdec_center = absdec_center + instzdec/3600.0;
+		
+		/*
+		 * Detect the sources of every slice of every chip, the planes in parallel.
+		 */
 		if (verbose) {
-			printf("%s/sex %s -c %s -PARAMETERS_NAME %s -CATALOG_NAME %s -FILTER_NAME %s -THRESH_TYPE RELATIVE -WEIGHT_TYPE NONE -SATUR_LEVEL %d -CHECKIMAGE_TYPE NONE >/tmp/sex.log\n",
-				   "/usr/local/bin/",
-				   name_input.c_str(),
-				   configfilename.c_str(), 
-				   parametersfilename.c_str(), 
-				   sexcatalogname.c_str(),
-				   "~/opera-1.0/config/default.conv",
-				   35000);			
+			cout << "wirPhotometry: detecting sources in " << nextensions << " extensions of " << nslices << " slices." << endl;
 		}
-		systemf("%s/sex %s -c %s -PARAMETERS_NAME %s -CATALOG_NAME %s -FILTER_NAME %s -THRESH_TYPE RELATIVE -WEIGHT_TYPE NONE -SATUR_LEVEL %d -CHECKIMAGE_TYPE NONE >/tmp/sex.log",
-				"/usr/local/bin/",
-				name_input.c_str(),
-				configfilename.c_str(), 
-				parametersfilename.c_str(), 
-				sexcatalogname.c_str(),
-				"~/opera-1.0/config/default.conv",
-				35000);
+		operaSourceDetector detector(detect_threshold, detect_minarea, saturation, apertureradius);
+		std::vector< std::vector<operaSource> > sources;
+		// the planes are read whole (isLazy false), extension after extension and slice after slice in one buffer
+		if (image.getnpixels() != (unsigned long)naxis1*naxis2*nslices*nextensions) {
+			throw operaException("wirPhotometry: "+name_input+" planes are not contiguous in memory ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
+		}
+		detector.detect((float *)image.getpixels(), naxis1, naxis2, nextensions*nslices, sources);
 		
+		/*
+		 * The 2MASS stars in the box about the mosaic center, on its tangent plane in arcsec.
+		 */
+		std::vector<operaCatalogStar> stars;
+		readTwoMassExtract(twomasscatalogname, stars);
+		std::vector<operaCatalogStar> fieldstars;
+		std::vector<double> starxi, stareta;
+		for (unsigned k=0; k<stars.size(); k++) {
+			double xi, eta;
+			if (skyToTangentPlane(stars[k].ra, stars[k].dec, absra_center, absdec_center, xi, eta) 
+				&& fabs(xi*3600.0) <= catalogradius && fabs(eta*3600.0) <= catalogradius) {
+				fieldstars.push_back(stars[k]);
+				starxi.push_back(xi*3600.0);
+				stareta.push_back(eta*3600.0);
+			}
+		}
 		if (verbose) {
-			cout << "wirPhotometry: sex catalog:" << endl;
-			ifstream sexcat(sexcatalogname.c_str());
-			if (sexcat.is_open()) {
-				string dataline;
-				while (sexcat.good()) {
-					getline(sexcat, dataline);
-					cout << dataline << endl;
-				} 
-				sexcat.close();
+			cout << "wirPhotometry: " << fieldstars.size() << " of " << stars.size() << " 2MASS stars in the field." << endl;
+		}
+		operaSourceMatcher matcher(starxi, stareta, searchradius);
+		
+		FILE *fmatched = NULL;
+		if (!matchedcatalogname.empty()) {
+			fmatched = fopen(matchedcatalogname.c_str(), "w");
+			if (fmatched == NULL) {
+				throw operaException("wirPhotometry: "+matchedcatalogname+" ", operaErrorNoOutput, __FILE__, __FUNCTION__, __LINE__);	
 			}
+			fprintf(fmatched, "# extension slice x y ra dec %c instrumental_mag\n", bandletter);
+		}
+		
+		/*
+		 * The zero point of each slice is the median of 2MASS minus instrumental magnitudes of its matched sources,
+		 * and the absorption its difference to the expected zero point of the chip.
+		 */
+		for (unsigned extension=1; extension<=nextensions; extension++) {
+			operaTangentPlaneWCS wcs = readChipWCS(image, extension);
+			float zp_expected = extension <= WIRCAM_EXTENSIONS && zp_ext[extension-1] != 0.0 ? zp_ext[extension-1] : zp_base;
+			for (unsigned slice=1; slice<=nslices; slice++) {
+				const std::vector<operaSource> &planesources = sources[(extension-1)*nslices + slice-1];
+				std::vector<double> xi, eta;
+				std::vector<const operaSource *> slicesources;
+				for (unsigned i=0; i<planesources.size(); i++) {
+					double ra, dec, x, y;
+					if (planesources[i].apertureFlux <= 0.0) {
+						continue;
+					}
+					wcs.pixelToSky(planesources[i].x, planesources[i].y, ra, dec);
+					if (skyToTangentPlane(ra, dec, absra_center, absdec_center, x, y)) {
+						xi.push_back(x*3600.0);
+						eta.push_back(y*3600.0);
+						slicesources.push_back(&planesources[i]);
+					}
+				}
+				std::vector<int> matches;
+				double dxi, deta;
+				matcher.match(xi, eta, searchradius, matchradius, matches, dxi, deta);
+				
+				std::vector<double> zeropoints;
+				for (unsigned i=0; i<xi.size(); i++) {
+					if (matches[i] < 0) {
+						continue;
+					}
+					const operaCatalogStar &star = fieldstars[matches[i]];
+					double catalogmag = bandletter == 'J' ? star.J : (bandletter == 'H' ? star.H : star.K);
+					double instrumentalmag = -2.5*log10(slicesources[i]->apertureFlux/exptime);
+					zeropoints.push_back(catalogmag - instrumentalmag);
+					if (fmatched != NULL) {
+						fprintf(fmatched, "%u %u %.3f %.3f %.7f %.7f %.3f %.4f\n", extension, slice, slicesources[i]->x, slicesources[i]->y, star.ra, star.dec, catalogmag, instrumentalmag);
+					}
+				}
+				unsigned nmatched = zeropoints.size();
+				double zp = 0.0, zperror = 0.0;
+				if (nmatched) {
+					zp = operaArrayMedian_d(nmatched, &zeropoints[0]);
+					for (unsigned i=0; i<nmatched; i++) {
+						zeropoints[i] = fabs(zeropoints[i] - zp);
+					}
+					zperror = 1.4826*operaArrayMedian_d(nmatched, &zeropoints[0])/sqrt((double)nmatched);
+				}
+				if (zp_expected != 0.0 && nmatched) {
+					printf("wirPhotometry: extension %u slice %u: %u stars, zero point %.4f +/- %.4f, absorption %.4f\n", extension, slice, nmatched, zp, zperror, zp_expected - zp);
+				} else {
+					printf("wirPhotometry: extension %u slice %u: %u stars, zero point %.4f +/- %.4f\n", extension, slice, nmatched, zp, zperror);
+				}
+				if (fdata != NULL) {
+					*fdata << extension << ' ' << slice << ' ' << nmatched << ' ' << zp << ' ' << zperror << endl;
+				}
+			}
+		}
+		if (fmatched != NULL) {
+			fclose(fmatched);
 		}
 
         if (fdata != NULL) {
@@ -363,6 +455,19 @@ static void printUsageSyntax(char * modulename) {
 	cerr <<
 	"\n"
 	" Usage: "+string(modulename)+"  [-vdth]" + 
+	"  -i, --name_input=<FITS_CUBE>\n"
+	"  -w, --twomasscatalogname=<2MASS_EXTRACT>, one \"ra dec J H K\" star per line\n"
+	"  -e, --name_matchedcat=<MATCHED_CATALOG>\n"
+	"  -b, --band=<J|H|K>, defaults to the FILTER keyword\n"
+	"  -0, --detect_threshold=<SIGMAS>\n"
+	"  -1, --detect_minarea=<PIXELS>\n"
+	"  -u, --saturation=<ADU>\n"
+	"  -A, --apertureradius=<PIXELS>\n"
+	"  -r, --searchradius=<ARCSEC>\n"
+	"  -m, --matchradius=<ARCSEC>\n"
+	"  -c, --catalogradius=<ARCSEC>\n"
+	"  -3, --zp_base=<MAG>\n"
+	"  -6..9, --zp_ext1..4=<MAG>\n"
 	"  -P, --plotfilename=<EPS_FILE>\n"
 	"  -F, --datafilename=<DATA_FILE>\n"
 	"  -S, --scriptfilename=<GNUPLOT_FILE>\n" 
@@ -45,10 +45,6 @@
 #define MAXNUMBEROFPOINTSINTELLURICSPECTRUM 2400000
 #define MAXNUMBEROFLINESINTELLURICDATABASE 100000
 #define MAXLENGTHOFLINEINTELLURICDATABASE 160
-#define TYPICAL_PRESSURE_AT_MAUNAKEA 61000  // Pa
-#define TYPICAL_TEMPERATURE_AT_MAUNAKEA 273 // K
-#define k_BOLTZMANN_CONSTANT 1.3806503e23 // m2 kg s-2 K-1
-#define TYPICAL_ATMOSPHERE_PATH_LENGTH  843500 // cm
 
 enum ProfileMethod { GAUSSIAN, LORENTZ, VOIGT };
 
@@ -45,10 +45,6 @@
 #define MAXNUMBEROFPOINTSINTELLURICSPECTRUM 2400000
 #define MAXNUMBEROFLINESINTELLURICDATABASE 100000
 #define MAXLENGTHOFLINEINTELLURICDATABASE 160
-#define TYPICAL_PRESSURE_AT_MAUNAKEA 61000  // Pa
-#define TYPICAL_TEMPERATURE_AT_MAUNAKEA 273 // K
-#define k_BOLTZMANN_CONSTANT 1.3806503e23 // m2 kg s-2 K-1
-#define TYPICAL_ATMOSPHERE_PATH_LENGTH  843500 // cm
 
 enum ProfileMethod { GAUSSIAN, LORENTZ, VOIGT };
 
@@ -56,11 +52,9 @@ operaSpectrum readTelluricLinesHITRAN(string telluric_database_file);
 
 operaSpectrum readTelluricLinesRaw(string telluric_database_file);
 
-operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, const operaVector& wavelengthVector, double resolution, ProfileMethod profile);
+operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, operaTelluricTransmission& telluricTransmission, const operaVector& wavelengthVector, double resolution, ProfileMethod profile);
 
-void getWavelengthSubrange(const operaVector& wavelength, double wl0, double wlf, unsigned& startindex, unsigned& endindex);
-
-bool calculateRVShiftByXCorr(const operaSpectrum& telluricLines, const operaSpectrum& objectSpectrum, double radialVelocityRange, double radialVelocityStep, double threshold, double& maxRV, double& sigRV, double& maxcorr, ofstream& fxcorrdata, ofstream& fxcorrfitdata, double spectralResolution, bool useFitToFindMaximum, double& chisqr);
+bool calculateRVShiftByXCorr(operaTelluricTransmission& telluricTransmission, const operaSpectrum& objectSpectrum, double radialVelocityRange, double radialVelocityStep, double threshold, double& maxRV, double& sigRV, double& maxcorr, ofstream& fxcorrdata, ofstream& fxcorrfitdata, double spectralResolution, bool useFitToFindMaximum, double& chisqr);
 
 void GenerateTelluricXCorrelationPlot(string gnuScriptFileName, string outputPlotEPSFileName, string dataFileName, string cleanDataFileName);
 
@@ -50,13 +50,15 @@
 class PixelSet {
 private:
     unsigned nPixels;                   // number of subpixels
-    std::vector<float> xcenter;         // subpixel x-center positions
-    std::vector<float> ycenter;         // subpixel y-center positions
-    std::vector<int> iIndex;            // original image pixel i-index (col) from which the subpixel was obtained
-    std::vector<int> jIndex;            // original image pixel j-index (row) from which the subpixel was obtained
-    std::vector<unsigned> redundancy;   // redundancy  
-    std::vector<float> pixelValue;      // pixel value
+    std::vector<float> coordinates;     // xcenter, ycenter and pixel value blocks of nPixels each
+    std::vector<int> indices;           // iIndex (col), jIndex (row) of the image pixel the subpixel was obtained from, and redundancy blocks of nPixels each
     float subpixelArea;                 // area of subpixel in pixel^2, value depends on pixelation
+    
+    // Compiled placement template, see compileTemplate
+    bool compiled;                      // false once a center changes after compileTemplate
+    std::vector<float> xoffsets;        // distinct subpixel x-centers, sorted
+    std::vector<float> yoffsets;        // distinct subpixel y-centers, sorted
+    std::vector<unsigned> offsetKeys;   // per subpixel index into xoffsets, then per subpixel index into yoffsets
 public:
 	
 	/*
@@ -93,6 +95,23 @@ public:
     float getMaxXcoord(void) const;
     float getMinYcoord(void) const;
     float getMaxYcoord(void) const;
+    
+    /*!
+     * \sa method void compileTemplate(void);
+     * \brief index the subpixel centers by their distinct x and y values.
+     * \details The subpixels of a rasterized aperture lie on a grid, so they only take a few distinct
+     * x and y centers. Placing the set at a new origin then costs one floor per distinct value
+     * instead of two per subpixel, see placeSubpixels. Changing a center drops the template.
+     */
+    void compileTemplate(void);
+    
+    /*!
+     * \sa method void placeSubpixels(double xorigin, double yorigin, unsigned *cols, unsigned *rows, std::vector<unsigned> &placed) const;
+     * \brief the image column and row (unsigned)floor(origin + center) of each subpixel of the set placed at xorigin, yorigin.
+     * \param cols, rows - arrays of getNPixels() values.
+     * \param placed - scratch for the placed template, kept by the caller so that placing element after element does not allocate.
+     */
+    void placeSubpixels(double xorigin, double yorigin, unsigned *cols, unsigned *rows, std::vector<unsigned> &placed) const;
 };
 
 #endif
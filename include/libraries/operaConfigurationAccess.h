@@ -53,6 +53,7 @@ extern "C" {
 
 operaErrorCode operaConfigurationAccessSetConfigurationFilepath(const char *filepath);
 operaErrorCode operaConfigurationAccessGet(const char *name, char **value);
+operaErrorCode operaConfigurationAccessGetValues(const char **names, char **values, unsigned count);
 operaErrorCode operaConfigurationAccessSet(const char *name, const char *value);
 operaErrorCode operaConfigurationAccessAdd(const char *name, const char *value);
 operaErrorCode operaConfigurationAccessDelete(const char *name, const char *value);
@@ -116,7 +116,7 @@ public:
 	 * \brief Return a string containing a fully formatted error message.
 	 * \return string
 	 */
-	string getFormattedMessage();
+	string getFormattedMessage() const;
 	
 	/*! 
 	 * operaException::setErrorCode(const operaErrorCode errcode)
@@ -130,7 +130,7 @@ public:
 	 * \param errcode const operaErrorCode
 	 * \return string
 	 */
-	operaErrorCode getErrorCode();
+	operaErrorCode getErrorCode() const;
 	
 	/*! 
 	 * string operaException::getMessage()
@@ -144,7 +144,7 @@ public:
 	 * \brief Return the string part of an error message.
 	 * \return string
 	 */
-	string getMessage();
+	string getMessage() const;
 	
 	/*! 
 	 * operaException::setLine((int l)
@@ -158,7 +158,7 @@ public:
 	 * \brief Return the line number part of an error message.
 	 * \return int
 	 */
-	int getLine();
+	int getLine() const;
 	
 	/*! 
 	 * operaException::setFunction(string func)
@@ -172,7 +172,7 @@ public:
 	 * \brief Return the function name part of an error message.
 	 * \return string
 	 */
-	string getFunction();
+	string getFunction() const;
 	
 	/*! 
 	 * operaException::setFile(string func)
@@ -186,7 +186,7 @@ public:
 	 * \brief Return the file name part of an error message.
 	 * \return string
 	 */
-	string getFile();
+	string getFile() const;
 	
 };
 
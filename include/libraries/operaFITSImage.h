@@ -84,6 +84,7 @@ enum edatatype {tbyte=TBYTE, tshort=TSHORT, tushort=TUSHORT, tstring=TSTRING, tf
 enum eCompression {cNone=0, cGZIP=GZIP_1, cRICE=RICE_1, cHCOMPRESS=HCOMPRESS_1, cPLIO=PLIO_1};
 
 enum eImageType {UNK, MEF, MEFCube, FITSCube, FITS};
+enum eMapAdvice {mapSequential, mapRandom};	// madvise hint for memory-mapped images
 class operaImageVector;
 class operaFITSImage;
 
@@ -116,6 +117,23 @@ private:
 	void openFITSfile(string Filename, int Mode=READWRITE/*READONLY*/);
 	void readFITSHeaderInfo();
 	void readFITSArray();
+	bool writeTileCompressedHDU(fitsfile *newfptr);
+	bool convertImageInPlaceParallel(edatatype fromdatatype, edatatype todatatype);
+	template <class T> float nativePixel(unsigned long offset) const { return (float)((const T *)pixptr)[offset]; }
+	bool mapFITSDataUnit(eMapAdvice Advice);
+	/*
+	 * pixel of a mapped big-endian data unit, BITPIX -32 or 16 with BSCALE 1
+	 */
+	float mappedPixel(unsigned long offset) const {
+		if (bitpix == float_img) {
+			const unsigned char *p = (const unsigned char *)mappedPixels + 4*offset;
+			union { unsigned int i; float f; } value;
+			value.i = ((unsigned int)p[0]<<24) | ((unsigned int)p[1]<<16) | ((unsigned int)p[2]<<8) | (unsigned int)p[3];
+			return value.f;
+		}
+		const unsigned char *p = (const unsigned char *)mappedPixels + 2*offset;
+		return (float)(short)((p[0]<<8) | p[1]) + bzero;
+	};
     
 protected:	
 	string filename;					// filename
@@ -155,6 +173,10 @@ protected:
 	bool extensionHasBeenRead[MAXFITSEXTENSIONS+1];		// in the case of a lazy extension by extension read, have we read in that extension yet?
 	bool extensionHasBeenWritten[MAXFITSEXTENSIONS+1];	// in the case of a lazy extension by extension read, have we saved that extension yet?
     operaFITSImage *super;				// the super class that created this instance
+	void *mapping;						// mmap'ed file when the data unit is mapped rather than read
+	size_t mappingLength;				// length of the mapping
+	bool bigEndianPixels;				// pixptr points at the mapped data unit, still in FITS byte order
+	const void *mappedPixels;			// the mapped data unit, read by mappedPixel() even after the conversion to host order
 	
 public:
 	/*!
@@ -190,6 +212,18 @@ public:
 	 * \brief Constructor to create a FITSImage from a FITS file.
 	 */
 	operaFITSImage(string Filename, edatatype Datatype, int Mode/*READWRITE/READONLY*/, unsigned Compression = 0, bool isLazy = false);		// read an existing FITSImage from file
+	/*!
+	 * \brief operaFITSImage(string Filename, eMapAdvice Advice)
+	 * \brief Open an existing FITS image read-only with its data unit memory-mapped rather than read.
+	 * \details Uncompressed single-HDU 2D images with BITPIX -32, or 16 and BSCALE 1, are mapped shared,
+	 * so a master opened by several processes at once sits once in the page cache. Pixels stay in FITS
+	 * (big-endian) order: getpixelvalue() reads them as they are, while operator[], getpixels(), the clone
+	 * constructor, save, the assignment and arithmetic operators and the other users of the raw pixels convert
+	 * them to host order first (operaFITSImageToHostOrder), making a private copy. The conversion is done once,
+	 * by whichever thread needs it first.
+	 * Other images are read as operaFITSImage(Filename) does, in their stored type.
+	 */
+	operaFITSImage(string Filename, eMapAdvice Advice);
 	/*! 
 	 * operaFITSImage* operaFITSImage(operaFITSImage &imageIn, bool ViewOnly)
 	 * \brief Clone a FITSImage object.
@@ -211,6 +245,9 @@ public:
 			throw operaException("operaFITSImage: ", MatrixInvalidDimensions, __FILE__, __FUNCTION__, __LINE__);	
 		}
 #endif
+		if (bigEndianPixels) {
+			operaFITSImageToHostOrder();
+		}
 		// in the case of a lazy read, we must check in the FITSImage [] operator
 		// if the extension has been read... This is the case of a reference without an assignment
 		if (isLazy) {
@@ -248,6 +285,33 @@ public:
 			return ((float *)pixptr+(current_extension-1)*naxis1*naxis2*naxis3)+(current_slice-1)*naxis1*naxis2+(naxis1*i);
 #endif
 	};
+	/*! 
+	 * float getpixelvalue(unsigned row, unsigned col)
+	 * \brief the pixel at row, col of the current extension and slice, promoted to float whatever the storage type.
+	 * \note Read-only kernels use this so that frames can be kept at their native width (e.g. raw tushort)
+	 * rather than converted to tfloat on open, or left memory-mapped in FITS byte order.
+	 * operator[] still requires tfloat storage.
+	 */
+	float getpixelvalue(unsigned row, unsigned col) {
+		if (bigEndianPixels) {
+			return mappedPixel((unsigned long)naxis1*row + col);
+		}
+		if (datatype == tfloat || isLazy) {
+			return (*this)[row][col];
+		}
+		unsigned long offset = (unsigned long)naxis1*row + col;
+		if (!(current_extension == 1 && current_slice == 1)) {
+			offset += (unsigned long)(current_extension-1)*naxis1*naxis2*naxis3 + (unsigned long)(current_slice-1)*naxis1*naxis2;
+		}
+		switch (datatype) {
+			case tushort: return nativePixel<unsigned short>(offset);
+			case tshort: return nativePixel<short>(offset);
+			case tbyte: return nativePixel<unsigned char>(offset);
+			case tdouble: return nativePixel<double>(offset);
+			default:
+				throw operaException("operaFITSImage: ", operaErrorCodeDatatypeNotSupported, __FILE__, __FUNCTION__, __LINE__);	
+		}
+	};
 	/*! 
 	 * \brief operator []
 	 * \brief indexing operator to return an ImageVector.
@@ -274,6 +338,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b; copies the pixel values from b to a
 	 */	
 	operaFITSImage& operator=(operaFITSImage* b) {
+		operaFITSImageToHostOrder();
+		b->operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		float *bp = (float *)b->pixptr;
 		unsigned long n = npixels; 
@@ -324,6 +390,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b; copies the pixel values from b to a
 	 */	
 	operaFITSImage& operator=(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		float *bp = (float *)b.pixptr; 
 		unsigned long n = npixels; 
@@ -375,6 +443,7 @@ public:
 	 * \note usage: operaFITSImage a = 0.0; copies the float value to every pixel in = a
 	 */	
 	operaFITSImage& operator=(float f) {
+		operaFITSImageToHostOrder();
 		float *p = (float *)pixptr;
 		unsigned long n = npixels;
         if (isLazy) {
@@ -449,6 +518,8 @@ public:
 	 * \note usage:
 	 */
 	operaFITSImage& operator==(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -478,6 +549,7 @@ public:
 	 * \note usage:
 	 */
 	operaFITSImage& operator==(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -496,6 +568,8 @@ public:
 	 * \note usage: operaFITSImage a += operaFITSImage b; adds the pixel values from b to a
 	 */	
 	operaFITSImage& operator+=(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		float *bp = (float *)b.pixptr; 
 		if (!isLazy) {
@@ -515,6 +589,7 @@ public:
 	 * \note usage: operaFITSImage a += 100.0; adds the float value to a
 	 */	
 	operaFITSImage& operator+=(float f) {
+		operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		if (!isLazy) {
 			if (current_extension > 1 || current_slice > 1)
@@ -530,6 +605,8 @@ public:
 	 * \note usage: operaFITSImage a -= operaFITSImage b; subtracts the pixel values from b to a
 	 */	
 	operaFITSImage& operator-=(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		float *bp = (float *)b.pixptr; 
 		if (!isLazy) {
@@ -549,6 +626,7 @@ public:
 	 * \note usage: operaFITSImage a -= 100.0; subtracts the float value from a
 	 */	
 	operaFITSImage& operator-=(float f) {
+		operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		if (!isLazy) {
 			if (current_extension > 1 || current_slice > 1)
@@ -564,6 +642,8 @@ public:
 	 * \note usage: operaFITSImage a *= operaFITSImage b; multiplies the pixel values from b to a
 	 */	
 	operaFITSImage& operator*=(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		float *bp = (float *)b.pixptr; 
 		if (!isLazy) {
@@ -583,6 +663,7 @@ public:
 	 * \note usage: operaFITSImage a *= 100.0; multiplies the float value times a
 	 */	
 	operaFITSImage& operator*=(float f) {
+		operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		if (!isLazy) {
 			if (current_extension > 1 || current_slice > 1)
@@ -598,6 +679,8 @@ public:
 	 * \note usage: operaFITSImage a /= operaFITSImage b; divides the pixel values from b into a
 	 */	
 	operaFITSImage& operator/=(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		float *bp = (float *)b.pixptr; 
 		if (!isLazy) {
@@ -617,6 +700,7 @@ public:
 	 * \note usage: operaFITSImage a /= 100.0; divides the float value from a
 	 */	
 	operaFITSImage& operator/=(float f) {
+		operaFITSImageToHostOrder();
 		float *p = (float *)pixptr; 
 		if (!isLazy) {
 			if (current_extension > 1 || current_slice > 1)
@@ -632,6 +716,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b * operaFITSImage c; multiplies the pixel values  b * c and assigns to a
 	 */	
 	operaFITSImage& operator*(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -661,6 +747,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b * 10.0; multiplies the pixel values  b * 10.0 and assigns to a
 	 */	
 	operaFITSImage& operator*(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -679,6 +766,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b / operaFITSImage c; divides the pixel values  b / c and assigns to a
 	 */	
 	operaFITSImage& operator/(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -708,6 +797,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b / 100.0; divides the pixel values  b / 100.0 and assigns to a
 	 */	
 	operaFITSImage& operator/(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -725,6 +815,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b + operaFITSImage c; adds the pixel values  b + c and assigns to a
 	 */	
 	operaFITSImage& operator+(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -754,6 +846,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b + 100.0; adds the pixel values  b + 100.0 and assigns to a
 	 */	
 	operaFITSImage& operator+(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -772,6 +865,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b - operaFITSImage c; subtracts the pixel values  b - c and assigns to a
 	 */	
 	operaFITSImage& operator-(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -801,6 +896,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b - 100.0; subtracts the pixel values  b - 100.0 and assigns to a
 	 */	
 	operaFITSImage& operator-(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -819,6 +915,7 @@ public:
 	 * \note usage: operaFITSImage a = !operaFITSImage b; inverts the pixel values of b and assigns to a (0.0 becomes 1.0, non-zero becomes 0.0)
 	 */	
 	operaFITSImage& operator!() {
+		operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -844,6 +941,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b > operaFITSImage c; creates a mask of 1.0 if b > c or 0.0 if b <= c and assigns to a
 	 */	
 	operaFITSImage& operator>(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -873,6 +972,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b > 100.0; creates a mask of 1.0 if b > 100.0 or 0.0 if b <= 100.0 and assigns to a
 	 */	
 	operaFITSImage& operator>(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -891,6 +991,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b >= operaFITSImage c; creates a mask of 1.0 if b >= c or 0.0 if b < c and assigns to a
 	 */	
 	operaFITSImage& operator>=(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -920,6 +1022,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b >= 100.0; creates a mask of 1.0 if b >= 100.0 or 0.0 if b < 100.0 and assigns to a
 	 */	
 	operaFITSImage& operator>=(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -938,6 +1041,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b < operaFITSImage c; creates a mask of 1.0 if b < c or 0.0 if b >= c and assigns to a
 	 */	
 	operaFITSImage& operator<(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -967,6 +1072,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b < operaFITSImage c; creates a mask of 1.0 if b < c or 0.0 if b >= c and assigns to a
 	 */	
 	operaFITSImage& operator<(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -985,6 +1091,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b <= operaFITSImage c; creates a mask of 1.0 if b <= c or 0.0 if b > c and assigns to a
 	 */	
 	operaFITSImage& operator<=(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -1014,6 +1122,7 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b <= 100.0; creates a mask of 1.0 if b <= 100.0 or 0.0 if b > 100.0 and assigns to a
 	 */	
 	operaFITSImage& operator<=(float f) {
+		operaFITSImageToHostOrder();
 		operaFITSImage *t = new operaFITSImage(*this);
 		t->istemp = true;
 		float *tp = (float *)t->pixptr; 
@@ -1032,6 +1141,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b && operaFITSImage c; creates a mask of 1.0 where b && c != 0.0
 	 */	
 	operaFITSImage& operator&&(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -1061,6 +1172,8 @@ public:
 	 * \note usage: operaFITSImage a = operaFITSImage b && operaFITSImage c; creates a mask of 1.0 where b && c != 0.0
 	 */	
 	operaFITSImage& operator||(operaFITSImage& b) {
+		operaFITSImageToHostOrder();
+		b.operaFITSImageToHostOrder();
 		float *tp;
 		operaFITSImage *t = NULL;
 		if (this->istemp) {
@@ -1249,6 +1362,16 @@ public:
 	 * \note - this assumes enough storage is available for the target type.
 	 */
 	void operaFITSImageConvertImageInPlace(edatatype fromdatatype, edatatype todatatype);
+	/*!
+	 * void operaFITSImageToHostOrder()
+	 * \brief Replace the pixels of a memory-mapped image by a private copy in host byte order, no-op otherwise.
+	 */
+	void operaFITSImageToHostOrder();
+	/*!
+	 * bool isMapped()
+	 * \brief are the pixels still the shared, memory-mapped FITS data unit?
+	 */
+	bool isMapped() const { return bigEndianPixels; };
 	/*! 
 	 * operaFITSImage::rotate90()
 	 * \brief rotate 90 degrees.
@@ -1287,7 +1410,7 @@ public:
 	 * getpixelUSHORT(unsigned x, unsigned y, unsigned long naxis1)
 	 * \brief get an unsigned short pixel value at coordinates x,y.
 	 */
-	inline unsigned short getpixelUSHORT(unsigned x, unsigned y, unsigned long naxis1) {return ((unsigned short *)pixptr)[(naxis1*y)+x];};
+	inline unsigned short getpixelUSHORT(unsigned x, unsigned y, unsigned long naxis1) {if (bigEndianPixels) operaFITSImageToHostOrder(); return ((unsigned short *)pixptr)[(naxis1*y)+x];};
 	
 	/*! 
 	 * getpixelUSHORT(unsigned short*p, unsigned x, unsigned y, unsigned long naxis1)
@@ -1299,13 +1422,13 @@ public:
 	 * getpixelUSHORT(unsigned x, unsigned y)
 	 * \brief get an unsigned short pixel value at coordinates x,y.
 	 */
-	inline unsigned short getpixelUSHORT(unsigned x, unsigned y) {return ((unsigned short *)pixptr)[(naxis1*y)+x];};
+	inline unsigned short getpixelUSHORT(unsigned x, unsigned y) {if (bigEndianPixels) operaFITSImageToHostOrder(); return ((unsigned short *)pixptr)[(naxis1*y)+x];};
 	
 	/*! 
 	 * getpixel(unsigned x, unsigned y, unsigned long naxis1)
 	 * \brief get a pixel value at coordinates x,y.
 	 */
-	inline float getpixel(unsigned x, unsigned y, unsigned long naxis1) {return ((float *)pixptr)[(naxis1*y)+x];};
+	inline float getpixel(unsigned x, unsigned y, unsigned long naxis1) {if (bigEndianPixels) operaFITSImageToHostOrder(); return ((float *)pixptr)[(naxis1*y)+x];};
 	
 	/*! 
 	 * getpixel(float *p, unsigned x, unsigned y, unsigned long naxis1)
@@ -1317,17 +1440,17 @@ public:
 	 * getpixel(unsigned x, unsigned y)
 	 * \brief get a pixel value at coordinates x,y.
 	 */
-	inline float getpixel(unsigned x, unsigned y) {return ((float *)pixptr)[(naxis1*y)+x];};
+	inline float getpixel(unsigned x, unsigned y) {if (bigEndianPixels) operaFITSImageToHostOrder(); return ((float *)pixptr)[(naxis1*y)+x];};
 	
 	/*! 
 	 * setpixel(float value, unsigned x, unsigned y)
 	 * \brief get a pixel value at coordinates x,y.
 	 */
-	inline void setpixel(unsigned short value, unsigned x, unsigned y) {((unsigned short *)pixptr)[(naxis1*y)+x] = value;};
-	inline void setpixel(unsigned short value, unsigned x, unsigned y, unsigned long naxis1) {((unsigned short *)pixptr)[(naxis1*y)+x] = value;};
+	inline void setpixel(unsigned short value, unsigned x, unsigned y) {if (bigEndianPixels) operaFITSImageToHostOrder(); ((unsigned short *)pixptr)[(naxis1*y)+x] = value;};
+	inline void setpixel(unsigned short value, unsigned x, unsigned y, unsigned long naxis1) {if (bigEndianPixels) operaFITSImageToHostOrder(); ((unsigned short *)pixptr)[(naxis1*y)+x] = value;};
 	inline void setpixel(unsigned short *p, unsigned short value, unsigned x, unsigned y, unsigned long naxis1) {((unsigned short *)p)[(naxis1*y)+x] = value;};
-	inline void setpixel(float value, unsigned x, unsigned y) {((float *)pixptr)[(naxis1*y)+x] = value;};
-	inline void setpixel(float value, unsigned x, unsigned y, unsigned long naxis1) {((float *)pixptr)[(naxis1*y)+x] = value;};
+	inline void setpixel(float value, unsigned x, unsigned y) {if (bigEndianPixels) operaFITSImageToHostOrder(); ((float *)pixptr)[(naxis1*y)+x] = value;};
+	inline void setpixel(float value, unsigned x, unsigned y, unsigned long naxis1) {if (bigEndianPixels) operaFITSImageToHostOrder(); ((float *)pixptr)[(naxis1*y)+x] = value;};
 	inline void setpixel(float  *p, float value, unsigned x, unsigned y, unsigned long naxis1) {((float *)p)[(naxis1*y)+x] = value;};
 	
 	/*! 
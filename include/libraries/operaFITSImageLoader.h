@@ -0,0 +1,154 @@
+#ifndef OPERAFITSIMAGELOADER_H
+#define OPERAFITSIMAGELOADER_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaFITSImageLoader
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <pthread.h>
+
+#include "libraries/operaException.h"
+#include "libraries/operaFITSImage.h"
+#include "libraries/operaThreadPool.h"
+
+/*!
+ * \file operaFITSImageLoader.h
+ */
+
+/*!
+ * \brief An operaFITSImage that is being read in the background.
+ * \details Returned by operaFITSImageLoader::load. get() blocks until the image is
+ * in memory and hands it over to the caller, who deletes it as usual.
+ * \ingroup libraries
+ * \sa class operaFITSImageLoader
+ */
+class operaFITSImageFuture {
+
+	friend class operaFITSImageLoader;
+
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t ready;
+	string filename;
+	edatatype datatype;
+	int mode;
+	bool mapped;						// open with operaFITSImage(Filename, Advice)
+	eMapAdvice advice;
+	bool done;
+	bool failed;
+	bool taken;							// get() has handed the image to the caller
+	operaException exception;
+	operaFITSImage *image;
+
+	operaFITSImageFuture(string Filename, edatatype Datatype, int Mode);
+	operaFITSImageFuture(string Filename, eMapAdvice Advice);
+	operaFITSImageFuture(const operaFITSImageFuture &);	// not copyable
+	operaFITSImageFuture &operator=(const operaFITSImageFuture &);
+
+	static void loadTask(void *argument);
+
+public:
+	/*!
+	 * \sa ~operaFITSImageFuture()
+	 * \brief waits for the read to finish, deletes the image if get() was never called.
+	 */
+	~operaFITSImageFuture();
+
+	/*!
+	 * \sa method string getFilename(void);
+	 * \brief returns the file being read
+	 */
+	string getFilename(void) const { return filename; };
+
+	/*!
+	 * \sa method bool isReady(void);
+	 * \brief true once the image is in memory or the read has failed, never blocks
+	 */
+	bool isReady(void);
+
+	/*!
+	 * \sa method void wait(void);
+	 * \brief block until the image is in memory or the read has failed
+	 */
+	void wait(void);
+
+	/*!
+	 * \sa method operaFITSImage *get(void);
+	 * \brief block until the image is read and return it, the caller owns the image.
+	 * \note if a get() throws, delete the other futures: that waits for their reads and frees the images not taken.
+	 * \throws operaException the exception raised while reading the file
+	 */
+	operaFITSImage *get(void);
+};
+
+/*!
+ * \brief Reads several FITS images concurrently.
+ * \details Each load() is queued on the loader's own I/O threads, which open, read,
+ * decompress and convert the file exactly as operaFITSImage(Filename, Datatype, Mode) does.
+ * The type conversion of large images is further split into chunks on the shared operaThreadPool.
+ * A module can therefore queue all of its frames, parse its text inputs while they load,
+ * and pay roughly the time of the largest single read.
+ * \note Concurrent reads of different files need a cfitsio built with --enable-reentrant.
+ * Without it (fits_is_reentrant() is false) the loader uses a single I/O thread.
+ * \ingroup libraries
+ * \sa class operaFITSImageFuture
+ */
+class operaFITSImageLoader {
+
+private:
+	operaThreadPool ioThreads;
+
+public:
+	/*!
+	 * \sa operaFITSImageLoader(unsigned IOThreads)
+	 * \brief create a loader reading up to IOThreads files at a time, one if cfitsio is not reentrant.
+	 */
+	operaFITSImageLoader(unsigned IOThreads = 4);
+
+	/*!
+	 * \sa ~operaFITSImageLoader()
+	 * \brief waits for every queued read to finish.
+	 */
+	~operaFITSImageLoader();
+
+	/*!
+	 * \sa method operaFITSImageFuture *load(string Filename, edatatype Datatype, int Mode);
+	 * \brief queue the read of Filename and return at once.
+	 * \return a future the caller deletes once it has called get()
+	 */
+	operaFITSImageFuture *load(string Filename, edatatype Datatype = tfloat, int Mode = READONLY);
+
+	/*!
+	 * \sa method operaFITSImageFuture *map(string Filename, eMapAdvice Advice);
+	 * \brief queue operaFITSImage(Filename, Advice), which memory-maps the data unit when it can and reads it otherwise.
+	 * \return a future the caller deletes once it has called get()
+	 */
+	operaFITSImageFuture *map(string Filename, eMapAdvice Advice = mapRandom);
+};
+
+#endif
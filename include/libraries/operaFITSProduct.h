@@ -36,6 +36,8 @@
 // $Locker$
 // $Log$
 
+#include <vector>
+
 #include "libraries/operaFITSImage.h"
 
 /*! 
@@ -49,6 +51,8 @@
 class operaFITSProduct : public operaFITSImage {
 private:
 	unsigned headercolumns;
+	std::vector<string> columnnames;
+	std::vector<string> columndescriptions;
 public:
 	/*! 
 	 * \brief Creates a FITS product in memory.
@@ -105,6 +109,16 @@ public:
 	 * \return The number of times AddColumnToHeader has been called.
 	 */
 	unsigned HeaderColumnCount();
+	
+	/*! 
+	 * \brief Appends the columns of the product to the saved file as a FITS binary table extension.
+	 * \details Each column of the product image is written as one 1E table column, in a single call per column.
+	 * Table columns are named after the header columns; a repeated name is suffixed with its occurrence, e.g. Wavelength_2.
+	 * \param extname The EXTNAME of the table
+	 * \note The file must have been saved with operaFITSImageSave first.
+	 * \throws operaException cfitsio error code
+	 */
+	void AppendBinaryTable(string extname = "SPECTRUM");
 };
 
 #endif
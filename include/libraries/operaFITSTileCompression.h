@@ -0,0 +1,75 @@
+#ifndef OPERAFITSTILECOMPRESSION_H
+#define OPERAFITSTILECOMPRESSION_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaFITSTileCompression
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include "libraries/operaFITSImage.h"	// for edatatype, eCompression
+
+/*!
+ * \file operaFITSTileCompression.h
+ * \brief Parallel tile compression and decompression of FITS images.
+ * \details cfitsio compresses and decompresses a tiled image one tile after the other.
+ * These routines leave the HDU layout (ZIMAGE, ZTILEn, ZCMPTYPE, the table rows) to cfitsio
+ * and only take over the tile payloads: every tile is coded on the shared operaThreadPool
+ * and the rows are then written, or were read, in order by the calling thread,
+ * so the file is an ordinary tile-compressed FITS image readable by any FITS reader.
+ *
+ * Lossless integer images (tbyte, tshort, tushort) compressed with RICE_1, GZIP_1 or
+ * HCOMPRESS_1 (scale 0) are handled. Anything else (quantized floats, PLIO_1, cubes)
+ * makes the routines return false without touching the file, and the caller
+ * should go through fits_write_img / fits_read_pix as before.
+ * \ingroup libraries
+ */
+
+/*!
+ * bool operaWriteTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels)
+ * \brief Compress pixels tile by tile in parallel into the empty compressed image HDU at fptr.
+ * \param fptr positioned on a compressed image HDU created by fits_create_img with a compression type set
+ * \param Datatype the in-memory type of pixels
+ * \param pixels the image, naxis1*naxis2 values
+ * \param npixels number of values in pixels
+ * \throws operaException cfitsio error code
+ * \return false if this HDU can not be handled here and nothing was written
+ */
+bool operaWriteTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels);
+
+/*!
+ * bool operaReadTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels)
+ * \brief Decompress the tile-compressed image HDU at fptr into pixels, tiles decoded in parallel.
+ * \param fptr positioned on a compressed image HDU
+ * \param Datatype the in-memory type of pixels, must match the stored type
+ * \param pixels output, naxis1*naxis2 values
+ * \param npixels number of values in pixels
+ * \throws operaException cfitsio error code
+ * \return false if this HDU can not be handled here and nothing was read
+ */
+bool operaReadTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels);
+
+#endif
@@ -53,6 +53,24 @@ extern "C" {
 	
 #include "libraries/operaLibCommon.h"	// definition of a CMatrix
 	
+	/*!
+	 * \brief A cubic spline through fixed knots, kept as per-interval polynomials for repeated evaluation.
+	 * \details Interval i covers [x[i], x[i+1]) and holds y = c0 + t*(c1 + t*(c2 + t*c3)), t = x - x[i],
+	 * in coeffs[4i..4i+3]. Queries before x[1] use interval 0 and queries from x[n-2] on use interval n-2,
+	 * as splineinterpolate does. A query is located by walking forward from the previous one, so a sorted
+	 * batch is a merge of the queries with the knots; other queries start from a bucket table that
+	 * divides [x[0], x[n-1]] evenly. The spline is not modified by evaluations and can be shared by threads.
+	 */
+	typedef struct operaSpline {
+		unsigned n;				// knots, at least 2, strictly increasing
+		double *x;
+		double *coeffs;			// 4 per interval
+		double *y2;				// second derivatives, scratch for operaSplineSetValues
+		unsigned nbuckets;
+		unsigned *buckets;		// last interval starting in an earlier bucket
+		double bucketscale;		// buckets per unit x
+	} operaSpline_t;
+	
 	/*
 	 * The functions below uses operaLMFit library (LMFIT)
 	 */
@@ -76,6 +94,13 @@ extern "C" {
 	 * The functions below uses nr library, although all necessary functions to make them work are in operaFit.c
 	 */
 	// spline and 2D-spline interpolation and related functions
+	operaSpline_t *operaSplineCreate(unsigned n, const double *x, const double *y, double yp1, double ypn);
+	operaSpline_t *operaSplineCreateFloat(unsigned n, const float *x, const float *y, float yp1, float ypn);
+	void operaSplineSetValues(operaSpline_t *spline, const double *y, double yp1, double ypn);
+	void operaSplineEvaluate(const operaSpline_t *spline, unsigned nout, const double *xout, double *yout);
+	void operaSplineEvaluateFloat(const operaSpline_t *spline, unsigned nout, const float *xout, float *yout);
+	double operaSplineValue(const operaSpline_t *spline, double x);
+	void operaSplineDelete(operaSpline_t *spline);
 	void operaFitSpline(unsigned nin, const float *xin, const float *yin, unsigned nout, const float *xout, float *yout);
 	void operaFitSplineDouble(unsigned nin, const double *xin, const double *yin, unsigned nout, const double *xout, double *yout);
 	int cubicspline(const float *x, const float *y, unsigned n, float yp1, float ypn, float *y2);
@@ -0,0 +1,113 @@
+#ifndef OPERAGAUSSIANFIT_H
+#define OPERAGAUSSIANFIT_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaGaussianFit
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+/*!
+ * \file operaGaussianFit.h
+ * \brief Levenberg-Marquardt fitting of a few Gaussians, optionally on a linear baseline.
+ * \details Spectral lines are fitted one small feature at a time, thousands of them per
+ * calibration frame. This fitter is specialized for that case: the Jacobian of the model is
+ * computed in closed form, the normal equations are accumulated point by point into fixed
+ * size arrays on the stack, so a fit allocates nothing, and operaGaussianFitLMBatch fits
+ * many independent problems on the shared operaThreadPool.
+ *
+ * The model and the parameter layout are those of GaussianFunction / GaussianWithBaseline
+ * in operaFit: (a, x0, sig) per peak, then (intercept, slope) if there is a baseline.
+ * Status codes are the mpfit ones (MP_OK_CHI, MP_ERR_DOF, ...).
+ * \ingroup libraries
+ */
+
+#define MAXGAUSSFITPEAKS 10
+#define MAXGAUSSFITPARAMETERS (3*MAXGAUSSFITPEAKS+2)
+
+/*!
+ * \brief One independent fit: the data, the initial guess and constraints, and the results.
+ * \details Data arrays are not copied and must outlive the fit.
+ * \ingroup libraries
+ */
+class operaGaussianFitProblem {
+public:
+	unsigned nDataPoints;
+	const double *x;
+	const double *y;
+	const double *yerrors;
+
+	unsigned nPeaks;
+	bool useBaseline;
+
+	double par[MAXGAUSSFITPARAMETERS];			// initial guess in, best fit out
+	double epar[MAXGAUSSFITPARAMETERS];			// 1-sigma errors out, 0 for fixed parameters
+	bool fixed[MAXGAUSSFITPARAMETERS];
+	bool lowerLimited[MAXGAUSSFITPARAMETERS];
+	bool upperLimited[MAXGAUSSFITPARAMETERS];
+	double lowerLimit[MAXGAUSSFITPARAMETERS];
+	double upperLimit[MAXGAUSSFITPARAMETERS];
+
+	unsigned maxIterations;
+	double chisqr;								// reduced chi-square out
+	int status;									// mpfit status code out
+
+	operaGaussianFitProblem();
+
+	/*!
+	 * \brief point the problem at the data, no copy is made.
+	 */
+	void setData(unsigned NDataPoints, const double *X, const double *Y, const double *YErrors);
+
+	/*!
+	 * \brief set the initial guess of peak k and make its parameters free and unconstrained.
+	 */
+	void setPeak(unsigned k, double Amplitude, double Center, double Sigma);
+
+	/*!
+	 * \brief add a linear baseline, initially Intercept + Slope*x, free and unconstrained.
+	 */
+	void setBaseline(double Intercept, double Slope);
+
+	unsigned getNumberOfParameters(void) const { return 3*nPeaks + (useBaseline ? 2 : 0); };
+};
+
+/*!
+ * int operaGaussianFitLM(operaGaussianFitProblem &problem)
+ * \brief Fit one problem in the calling thread.
+ * \details Parameters at a limit stay there while the gradient pushes them outwards.
+ * On an error status (negative, or MP_ERR_INITBOUNDS) par and epar are left untouched.
+ * \return the status, also stored in problem.status
+ */
+int operaGaussianFitLM(operaGaussianFitProblem &problem);
+
+/*!
+ * void operaGaussianFitLMBatch(unsigned nProblems, operaGaussianFitProblem *problems)
+ * \brief Fit nProblems independent problems, spread over the shared operaThreadPool.
+ */
+void operaGaussianFitLMBatch(unsigned nProblems, operaGaussianFitProblem *problems);
+
+#endif
@@ -56,6 +56,38 @@ namespace operaIOFormats {
 	 * \return none.
 	 */
 	void ReadIntoSpectralOrders(operaSpectralOrderVector& orders, string filename);
+
+	/*!
+	 * \sa method void SelectLibreEspritFluxAndWavelength(operaSpectralOrder *spectralOrder, operaFluxType_t fluxType, operaWavelengthType_t wavelengthType, bool removePolarContinuum);
+	 * \brief copy the flux type and apply the wavelength corrections a Libre-Esprit spectrum is written with into the order's flux and wavelength vectors.
+	 * \note the wavelength corrections accumulate, so restore the wavelengths before selecting again.
+	 * \return none.
+	 */
+	void SelectLibreEspritFluxAndWavelength(operaSpectralOrder *spectralOrder, operaFluxType_t fluxType, operaWavelengthType_t wavelengthType, bool removePolarContinuum);
+
+	/*!
+	 * \sa method unsigned LibreEspritColumns(operaSpectralOrder_t format);
+	 * \brief the number of values per row of a Libre-Esprit spectrum, wavelength included: 3 (sp2, pol), 7 (sp1) or 6 (polarimetry).
+	 * \return 0 for other formats.
+	 */
+	unsigned LibreEspritColumns(operaSpectralOrder_t format);
+
+	/*!
+	 * \sa method unsigned LibreEspritRows(const operaSpectralOrderVector& orders, operaSpectralOrder_t format);
+	 * \brief the number of rows writeLibreEsprit would write, blank lines excluded.
+	 * \return the row count.
+	 */
+	unsigned LibreEspritRows(const operaSpectralOrderVector& orders, operaSpectralOrder_t format);
+
+	/*!
+	 * \sa method unsigned WriteLibreEspritColumns(const operaSpectralOrderVector& orders, operaSpectralOrder_t format, float *const *columns);
+	 * \brief write the rows of a Libre-Esprit spectrum column by column, columns[c] receiving the values of column c.
+	 * \details The rows and their order are those of the text file, orders from max to min, but each column of an order
+	 * is filled as one block, so a FITS product can be built without formatting and parsing the text.
+	 * \param columns - LibreEspritColumns(format) arrays of at least LibreEspritRows(orders, format) floats.
+	 * \return the number of rows written.
+	 */
+	unsigned WriteLibreEspritColumns(const operaSpectralOrderVector& orders, operaSpectralOrder_t format, float *const *columns);
 }
 
 template <typename T> void FormatData::insert(const T& value) {
@@ -72,13 +72,23 @@ private:
 	
 	unsigned nDataPoints;
 	unsigned maxnDataPoints;
-	DCube dataCube;
+	operaVector dataCube;			// maxnDataPoints slices of NYPoints rows of NXPoints, value (i,j,index) at (index*NYPoints+j)*NXPoints+i
 	
 	operaVector distd;
 	
-	PolynomialMatrix ipPolyModel;
+	/*
+	 * The polynomial model of each point, packed coefficient-major: coefficient k of point (i,j) is at
+	 * k*NTotalPoints+j*NXPoints+i. Points with fewer coefficients than ipPolyNCoefficients are padded
+	 * with zeros, which leaves their Horner evaluation unchanged, so a whole IP is evaluated plane by
+	 * plane in contiguous, vectorizable loops.
+	 */
+	unsigned ipPolyNCoefficients;
+	operaVector ipPolyCoefficients;
+	std::vector<unsigned> ipPolyOrders;		// coefficients of each point
     DMatrix chisqrMatrix;
 	
+	void setipPolyNCoefficients(unsigned NCoefficients);
+	
 public:
 	
 	/*
@@ -150,9 +160,9 @@ public:
 	
 	void setipPolyModel(const PolynomialMatrix& IPPolyModel);
 	
-	const PolynomialMatrix& getipPolyModel(void);
+	PolynomialMatrix getipPolyModel(void) const;
 	
-	const Polynomial& getipPolyModelCoefficients(unsigned i,unsigned j) const;
+	Polynomial getipPolyModelCoefficients(unsigned i,unsigned j) const;
     
 	void setipPolyModelCoefficients(const Polynomial& PolyModelCoeffs,unsigned i,unsigned j);
     
@@ -160,6 +170,16 @@ public:
     
     double getipDataFromPolyModel(double d, unsigned i, unsigned j) const;
 	
+	/*!
+	 * \brief the model IP at distance d, NTotalPoints values into ipdata with point (i,j) at j*NXPoints+i.
+	 */
+	void getipDataFromPolyModel(double d, double *ipdata) const;
+	
+	/*!
+	 * \brief the model IP at each of the nd distances d, ipdata[n*NTotalPoints+j*NXPoints+i] for distance n.
+	 */
+	void getipDataFromPolyModel(const double *d, unsigned nd, double *ipdata) const;
+	
 	void FitPolyMatrixtoIPDataVector(unsigned coeffs, bool witherrors);
     
     void FitMediantoIPDataVector(void);
@@ -0,0 +1,91 @@
+#ifndef OPERAKEYVALUESTORE_H
+#define OPERAKEYVALUESTORE_H
+
+/*******************************************************************
+ ****                LIBRARY FOR OPERA v1.0                     ****
+ *******************************************************************
+ Library name: operaKeyValueStore
+ Version: 1.0
+ Description: In-memory hashed name := value store of a harness file.
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope 
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+ 
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+ 
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+/*! 
+ * operaKeyValueStore
+ * \brief The name := value entries of a parameter or configuration file, hashed by name.
+ * \details The file is read once into the store. It is read again only when its name,
+ * modification time or size changes, so each lookup is a hash probe instead of a file scan.
+ * An entry is a line "name := value" or "name ?= value", the value ending at a '#' or at the end
+ * of the line. The first entry of a name is the one kept.
+ * \file operaKeyValueStore.h
+ * \ingroup libraries
+ */
+
+#include <sys/types.h>
+#include <time.h>
+
+#define KEYVALUESTORE_MAXFILENAME 1024	// not PATH_MAX, which C and C++ callers may see differently
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct operaKeyValueStore {
+	char filename[KEYVALUESTORE_MAXFILENAME];	// the file the entries were read from, empty if none
+	time_t mtime;				// its modification time and size when read
+	off_t size;
+	unsigned count;				// number of entries
+	char **names;				// entry names and values
+	char **values;
+	unsigned *table;			// open addressing hash table of entry index + 1, 0 if free
+	unsigned tablesize;			// a power of 2
+} operaKeyValueStore;
+
+/*
+ * operaErrorCode operaKeyValueStoreLoad(operaKeyValueStore *store, const char *filename, unsigned maxlinelength)
+ * \brief read filename into the store unless it already holds this unchanged file.
+ * \param store - a zero initialized store, or one previously loaded.
+ * \param maxlinelength - lines are read in chunks of this length.
+ * \return operaErrorCode or errno
+ */
+operaErrorCode operaKeyValueStoreLoad(operaKeyValueStore *store, const char *filename, unsigned maxlinelength);
+
+/*
+ * const char *operaKeyValueStoreFind(const operaKeyValueStore *store, const char *name)
+ * \brief the value of name, NULL if the store has no such entry.
+ */
+const char *operaKeyValueStoreFind(const operaKeyValueStore *store, const char *name);
+
+/*
+ * void operaKeyValueStoreFree(operaKeyValueStore *store)
+ * \brief release the entries, leaving an empty store.
+ */
+void operaKeyValueStoreFree(operaKeyValueStore *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -190,4 +190,18 @@ string upperCase(string &in);
  */
 int mkpath(const char *path, mode_t mode);
 
+/*
+ * unsigned formatFixed(char *buffer, unsigned size, double value, unsigned width, unsigned precision)
+ * Write value as snprintf(buffer, size, "%*.*f", width, precision, value) does, without the
+ * locale and format parsing of the stdio and iostream formatters. Returns the length written.
+ * Values that are floats are rounded exactly in integer arithmetic, anything else goes to snprintf.
+ */
+unsigned formatFixed(char *buffer, unsigned size, double value, unsigned width, unsigned precision);
+
+/*
+ * unsigned formatScientific(char *buffer, unsigned size, double value, unsigned width, unsigned precision)
+ * Write value as snprintf(buffer, size, "%*.*e", width, precision, value) does, see formatFixed.
+ */
+unsigned formatScientific(char *buffer, unsigned size, double value, unsigned width, unsigned precision);
+
 #endif
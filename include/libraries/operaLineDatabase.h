@@ -0,0 +1,193 @@
+#ifndef OPERALINEDATABASE_H
+#define OPERALINEDATABASE_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaLineDatabase
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <string>
+
+#include "libraries/operaSpectralTools.h"
+
+/*!
+ * \file operaLineDatabase.h
+ * \brief Reference line lists and atlas spectra, as sorted binary tables that are memory-mapped.
+ * \details The telluric (HITRAN), ThAr and atlas reference files are large text files that every
+ * module used to parse line by line at startup. operaBuildLineDatabase converts them once into a
+ * table of wavelengths, intensities and optionally variances, sorted by wavelength, which is then
+ * mapped read-only: opening it costs no parsing, and a wavelength range is found by bisection.
+ *
+ * File layout: a 32 byte header (magic "OPERALDB", version, byte order mark, number of columns,
+ * number of rows), followed by the wavelength column, the intensity column and, with 3 columns,
+ * the variance column, each an array of doubles in host byte order. Wavelengths are in nm.
+ * \ingroup libraries
+ */
+
+/*
+ * HITRAN intensities are converted to an optical depth for the typical atmosphere above Maunakea.
+ */
+#define TYPICAL_PRESSURE_AT_MAUNAKEA 61000  // Pa
+#define TYPICAL_TEMPERATURE_AT_MAUNAKEA 273 // K
+#define k_BOLTZMANN_CONSTANT 1.3806503e23 // m2 kg s-2 K-1
+#define TYPICAL_ATMOSPHERE_PATH_LENGTH  843500 // cm
+
+#define LINEDATABASE_EXTENSION ".ldb"
+
+/*!
+ * \brief the text formats a line database can be built from.
+ */
+typedef enum {
+	LineFormatHITRAN,			// "id wavenumber(cm-1) intensity ...", vacuum, converted to air wavelength and optical depth
+	LineFormatRaw,				// "wavelength(nm) intensity"
+	LineFormatThAr,				// "wavenumber wavelength(A) log10(intensity) Th|Ar ...", other species are skipped
+	LineFormatAtlasSpectrum		// "wavelength(A) intensity x x variance"
+} operaLineFormat_t;
+
+/*!
+ * \brief A read-only, wavelength sorted table of reference lines or atlas spectrum samples.
+ * \details open() maps the binary table built next to the text file when it is at least as recent
+ * as the text, and otherwise parses the text into memory, so modules work with either.
+ * \ingroup libraries
+ */
+class operaLineDatabase {
+
+private:
+	void *mapping;						// mmap'ed table, NULL when parsed from text
+	size_t mappingLength;
+	operaSpectrum parsed;				// the table when it was read from text
+	const double *wavelengths;
+	const double *intensities;
+	const double *variances;			// NULL without a variance column
+	unsigned count;
+
+	operaLineDatabase(const operaLineDatabase &);	// not copyable
+	operaLineDatabase &operator=(const operaLineDatabase &);
+
+	void openBinary(string Filename);
+
+public:
+	/*
+	 * Constructors / Destructors
+	 */
+	operaLineDatabase();
+
+	/*!
+	 * \sa operaLineDatabase(string Filename, operaLineFormat_t Format)
+	 * \brief same as open(Filename, Format).
+	 */
+	operaLineDatabase(string Filename, operaLineFormat_t Format);
+
+	~operaLineDatabase();
+
+	/*!
+	 * \sa method void open(string Filename, operaLineFormat_t Format);
+	 * \brief open a binary table, or the text file Filename in Format through its binary table when that is current.
+	 * \throws operaException operaErrorLineDatabaseFormat for a table that can not be used
+	 * \throws operaException operaErrorNoInput if neither the table nor the text file can be read
+	 */
+	void open(string Filename, operaLineFormat_t Format);
+
+	/*!
+	 * \sa method void close(void);
+	 * \brief unmap or free the table.
+	 */
+	void close(void);
+
+	bool isMapped(void) const { return mapping != NULL; };
+	unsigned size(void) const { return count; };
+	bool empty(void) const { return count == 0; };
+	bool hasVariances(void) const { return variances != NULL; };
+
+	double getwavelength(unsigned i) const { return wavelengths[i]; };
+	double getintensity(unsigned i) const { return intensities[i]; };
+	double getvariance(unsigned i) const { return variances ? variances[i] : 0.0; };
+
+	/*!
+	 * \sa method void getRange(double wl0, double wlf, unsigned &first, unsigned &last);
+	 * \brief the rows with wl0 <= wavelength <= wlf are [first, last), found in O(log n).
+	 */
+	void getRange(double wl0, double wlf, unsigned &first, unsigned &last) const;
+
+	/*!
+	 * \sa method operaSpectrum getSpectrum(void);
+	 * \brief a copy of the whole table, wavelength and intensity (and variance).
+	 */
+	operaSpectrum getSpectrum(void) const;
+
+	/*!
+	 * \sa method operaSpectrum getSpectrum(operaWavelengthRange range);
+	 * \brief a copy of the rows within range.
+	 */
+	operaSpectrum getSpectrum(operaWavelengthRange range) const;
+
+	/*!
+	 * \sa method operaSpectralLineList getLineList(void);
+	 * \brief the whole table as line centers and amplitudes.
+	 */
+	operaSpectralLineList getLineList(void) const;
+
+	/*!
+	 * \sa method operaSpectralLineList getLineList(operaWavelengthRange range);
+	 * \brief the rows within range as line centers and amplitudes.
+	 */
+	operaSpectralLineList getLineList(operaWavelengthRange range) const;
+
+	/*!
+	 * \sa method operaSpectrum readText(string Filename, operaLineFormat_t Format);
+	 * \brief parse a text (or gzipped text) reference file, the result is sorted by wavelength.
+	 * \throws operaException operaErrorNoInput if the file can not be read
+	 */
+	static operaSpectrum readText(string Filename, operaLineFormat_t Format);
+
+	/*!
+	 * \sa method void write(string Filename, const operaSpectrum &Table, bool WithVariances);
+	 * \brief write Table, which must be sorted by wavelength, as a binary table.
+	 * \throws operaException operaErrorNoOutput
+	 */
+	static void write(string Filename, const operaSpectrum &Table, bool WithVariances);
+
+	/*!
+	 * \sa method string getBinaryFilename(string TextFilename);
+	 * \brief where the binary table of a text file lives: the text file name without .gz, plus .ldb
+	 */
+	static string getBinaryFilename(string TextFilename);
+
+	/*!
+	 * \sa method bool isBinary(string Filename);
+	 * \brief does Filename start with the line database magic?
+	 */
+	static bool isBinary(string Filename);
+
+	/*!
+	 * \sa method bool hasVarianceColumn(operaLineFormat_t Format);
+	 * \brief does a table built from Format carry variances?
+	 */
+	static bool hasVarianceColumn(operaLineFormat_t Format) { return Format == LineFormatAtlasSpectrum; };
+};
+
+#endif
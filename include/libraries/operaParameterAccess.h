@@ -53,6 +53,7 @@ extern "C" {
 
 operaErrorCode operaParameterAccessSetParamaterFilepath(const char *filepath);
 operaErrorCode operaParameterAccessGet(const char *name, char **value);
+operaErrorCode operaParameterAccessGetValues(const char **names, char **values, unsigned count);
 operaErrorCode operaParameterAccessSet(const char *name, const char *value);
 operaErrorCode operaParameterAccessAdd(const char *name, const char *value);
 operaErrorCode operaParameterAccessDelete(const char *name, const char *value);
@@ -0,0 +1,158 @@
+#ifndef OPERARADIALVELOCITYLINEFIT_H
+#define OPERARADIALVELOCITYLINEFIT_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaRadialVelocityLineFit
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <vector>
+
+/*!
+ * \file operaRadialVelocityLineFit.h
+ * \brief Joint Levenberg-Marquardt fit of a radial velocity shared by many Gaussian absorption lines.
+ * \details Every data point belongs to one line l and is modelled as
+ *
+ *   f = 1 + level_l - a_l * exp(-d^2/(2 sig_l^2)),  d = wl - wl0_l - (rv + velocityOffset)*wl/c
+ *
+ * with rv (m/s) common to all lines and (level, a, sig) free for each line. The velocity offset
+ * (telluric plus heliocentric correction) is held constant. Since a line only couples to its own
+ * parameters and to rv, the normal equations are an arrow matrix: a 3x3 block per line bordered by
+ * the rv row. An iteration eliminates the blocks into the 1x1 Schur complement of rv, so it costs one
+ * pass over the data plus a 3x3 solve per line, however many lines there are, and the rv error is
+ * the inverse of that complement. The Jacobian is computed in closed form.
+ *
+ * The optional robust pass reweights the points by the Huber or Tukey biweight function of their
+ * normalized residuals, scaled by the median absolute deviation, and refits until rv settles.
+ * Status codes are the mpfit ones (MP_OK_CHI, MP_ERR_DOF, ...).
+ * \ingroup libraries
+ */
+
+#define RVLINEFIT_MINPOINTS 4				// lines with fewer points are left out of the fit
+
+typedef enum {
+	RobustWeightingNone=0,
+	RobustWeightingHuber,
+	RobustWeightingTukey
+} operaRobustWeighting_t;
+
+/*!
+ * \brief The lines, their data points, and the shared radial velocity.
+ * \ingroup libraries
+ */
+class operaRadialVelocityLineFit {
+private:
+	double radialVelocity;					// m/s
+	double radialVelocityError;
+	double velocityOffset;					// m/s, held constant
+	double chisqr;
+	int status;
+	unsigned maxIterations;
+
+	std::vector<double> wl0;				// per line
+	std::vector<double> lineParameters;		// 3 per line: level, amplitude, sigma
+
+	std::vector<unsigned> pointLine;		// per data point
+	std::vector<double> wavelength;
+	std::vector<double> flux;
+	std::vector<double> inverseVariance;
+	std::vector<double> weight;				// inverseVariance times the robust weight
+
+	class lineBlock {					// the normal equations of one line
+	public:
+		double alpha[3][3];					// J^T W J of the line parameters
+		double coupling[3];					// J^T W J between the line parameters and rv
+		double beta[3];						// J^T W r
+	};
+
+	double lineFitModel(unsigned point, double rv, const double *par, double *deriv) const;
+	double lineFitChisqr(double rv, const std::vector<double> &par, const std::vector<bool> &active) const;
+	double lineFitNormalEquations(double rv, const std::vector<double> &par, const std::vector<bool> &active, std::vector<lineBlock> &blocks, double &alphaRV, double &betaRV) const;
+	int fitWeighted(const std::vector<bool> &active, unsigned nActive, unsigned nPoints);
+
+public:
+	/*
+	 * Constructors / Destructors
+	 */
+	operaRadialVelocityLineFit();
+
+	/*!
+	 * \brief initial guess of the radial velocity (m/s), also its best fit after fit().
+	 */
+	void setRadialVelocity(double RadialVelocity) { radialVelocity = RadialVelocity; };
+
+	/*!
+	 * \brief constant velocity (m/s) added to rv in the Doppler shift, the telluric and heliocentric corrections.
+	 */
+	void setVelocityOffset(double VelocityOffset) { velocityOffset = VelocityOffset; };
+
+	void setMaxIterations(unsigned MaxIterations) { maxIterations = MaxIterations; };
+
+	/*!
+	 * \brief add a line at rest wavelength Wavelength with its initial parameters.
+	 * \return the line index.
+	 */
+	unsigned addLine(double Wavelength, double Level, double Amplitude, double Sigma);
+
+	/*!
+	 * \brief add a data point of line Line. Points of non-positive or non-finite variance are ignored.
+	 */
+	void addDataPoint(unsigned Line, double Wavelength, double Flux, double Variance);
+
+	/*!
+	 * int fit(operaRobustWeighting_t robustWeighting)
+	 * \brief fit rv and the parameters of every line with at least RVLINEFIT_MINPOINTS points.
+	 * \details With a robust weighting, the least-squares fit is followed by iteratively reweighted fits.
+	 * On an error status (negative) the parameters are left untouched.
+	 * \return the status, also returned by getStatus().
+	 */
+	int fit(operaRobustWeighting_t robustWeighting = RobustWeightingNone);
+
+	double getRadialVelocity(void) const { return radialVelocity; };
+	double getRadialVelocityError(void) const { return radialVelocityError; };
+	double getChisqr(void) const { return chisqr; };			// reduced chi-square
+	int getStatus(void) const { return status; };
+
+	unsigned getNumberOfLines(void) const { return (unsigned)wl0.size(); };
+	unsigned getNumberOfDataPoints(void) const { return (unsigned)wavelength.size(); };
+
+	double getLevel(unsigned Line) const { return lineParameters[3*Line]; };
+	double getAmplitude(unsigned Line) const { return lineParameters[3*Line+1]; };
+	double getSigma(unsigned Line) const { return lineParameters[3*Line+2]; };
+
+	unsigned getDataPointLine(unsigned Point) const { return pointLine[Point]; };
+	double getDataPointWavelength(unsigned Point) const { return wavelength[Point]; };
+	double getDataPointFlux(unsigned Point) const { return flux[Point]; };
+	double getDataPointVariance(unsigned Point) const { return 1.0/inverseVariance[Point]; };
+
+	/*!
+	 * \brief the model at data point Point for the current parameters.
+	 */
+	double getModel(unsigned Point) const;
+};
+
+#endif
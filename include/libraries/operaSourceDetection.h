@@ -0,0 +1,209 @@
+#ifndef OPERASOURCEDETECTION_H
+#define OPERASOURCEDETECTION_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaSourceDetection
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <string>
+#include <vector>
+
+/*!
+ * \file operaSourceDetection.h
+ * \brief Point source detection and centroiding in image planes, and matching to a 2MASS extract.
+ * \details The detector works on float planes in memory, such as the extensions and slices of an
+ * operaWIRCamImage read with isLazy=false, which lie one after the other in getpixels().
+ * A plane is processed as SExtractor did for the WIRCam modules:
+ *
+ *   - the background and its sigma are the median and the scaled MAD of meshes of
+ *     backgroundMeshSize pixels, median filtered over 3x3 meshes, the background bilinearly
+ *     interpolated between mesh centers and the sigma taken from the nearest mesh;
+ *   - sources are the 8-connected groups of at least minArea pixels more than threshold sigmas
+ *     above the background, found by a flood fill on an explicit stack, without deblending;
+ *   - groups with a pixel at or above the saturation level are dropped;
+ *   - the position is the flux-weighted centroid of the group, and the aperture flux the
+ *     background subtracted sum within apertureRadius of it.
+ *
+ * The planes of a cube are independent and are detected in parallel on the shared thread pool.
+ * Matching projects catalog stars and sources on a common tangent plane and hashes the stars
+ * into a grid of square cells, so finding the nearest star of a source looks at a few cells.
+ * \ingroup libraries
+ */
+
+#define SOURCEDETECTION_MAD_TO_SIGMA 1.4826			// sigma of a Gaussian over its median absolute deviation
+#define SOURCEDETECTION_MIN_MESH_PIXELS 16			// meshes with fewer usable pixels take their background from their neighbours
+#define SOURCEMATCHER_CELLS_PER_POINT 16			// the matcher grid grows its cells beyond this many cells per point
+#define SOURCEMATCHER_MAX_VOTE_BINS 512				// bins a side of the offset histogram of match()
+
+/*!
+ * \brief A detected source.
+ * \ingroup libraries
+ */
+class operaSource {
+public:
+	double x, y;						// flux-weighted centroid in FITS pixels, the first pixel center is 1
+	double flux;						// background subtracted flux of the pixels above the threshold
+	double apertureFlux;				// background subtracted flux within the aperture
+	double peak;						// highest background subtracted pixel
+	double background;					// background at the peak
+	unsigned area;						// pixels above the threshold
+};
+
+/*!
+ * \brief Detection parameters and the detector itself.
+ * \ingroup libraries
+ */
+class operaSourceDetector {
+private:
+	double threshold;					// in background sigmas
+	unsigned minArea;					// pixels
+	double saturation;					// raw pixel value
+	double apertureRadius;				// pixels
+	unsigned backgroundMeshSize;		// pixels
+
+	void measureBackground(const float *pixels, unsigned naxis1, unsigned naxis2, float *residual, std::vector<float> &sigma, unsigned &nmeshx) const;
+
+public:
+	/*
+	 * Constructors / Destructors
+	 */
+	operaSourceDetector(double Threshold = 2.0, unsigned MinArea = 3, double Saturation = 35000.0, double ApertureRadius = 5.0, unsigned BackgroundMeshSize = 64);
+
+	void setThreshold(double Threshold) { threshold = Threshold; };
+	void setMinArea(unsigned MinArea) { minArea = MinArea; };
+	void setSaturation(double Saturation) { saturation = Saturation; };
+	void setApertureRadius(double ApertureRadius) { apertureRadius = ApertureRadius; };
+	void setBackgroundMeshSize(unsigned BackgroundMeshSize) { backgroundMeshSize = BackgroundMeshSize; };
+
+	/*!
+	 * \sa method void detect(const float *pixels, unsigned naxis1, unsigned naxis2, std::vector<operaSource> &sources) const;
+	 * \brief detect the sources of one plane of naxis1 x naxis2 pixels, replacing the contents of sources.
+	 * \details Non-finite pixels are ignored. The sources are in the order of their first pixel, row by row.
+	 */
+	void detect(const float *pixels, unsigned naxis1, unsigned naxis2, std::vector<operaSource> &sources) const;
+
+	/*!
+	 * \sa method void detect(const float *pixels, unsigned naxis1, unsigned naxis2, unsigned nplanes, std::vector< std::vector<operaSource> > &sources) const;
+	 * \brief detect the sources of nplanes consecutive planes in parallel, sources[p] receiving those of plane p.
+	 */
+	void detect(const float *pixels, unsigned naxis1, unsigned naxis2, unsigned nplanes, std::vector< std::vector<operaSource> > &sources) const;
+};
+
+/*!
+ * \brief A star of the 2MASS point source catalog.
+ * \ingroup libraries
+ */
+class operaCatalogStar {
+public:
+	double ra, dec;						// degrees, J2000
+	double J, H, K;						// magnitudes
+};
+
+/*!
+ * \sa method void readTwoMassExtract(std::string filename, std::vector<operaCatalogStar> &stars);
+ * \brief read a local 2MASS extract into stars, replacing its contents.
+ * \details One star per line, "ra dec J H K" in degrees and magnitudes, blank separated. Lines that do not
+ * start with five numbers, such as comments or headers, are skipped.
+ * \throws operaException operaErrorNoInput if the file can not be read.
+ */
+void readTwoMassExtract(std::string filename, std::vector<operaCatalogStar> &stars);
+
+/*!
+ * \sa method bool skyToTangentPlane(double ra, double dec, double ra0, double dec0, double &xi, double &eta);
+ * \brief gnomonic projection of (ra, dec) about (ra0, dec0), all in degrees, to standard coordinates in degrees.
+ * \return false if the point is 90 degrees or more from the tangent point.
+ */
+bool skyToTangentPlane(double ra, double dec, double ra0, double dec0, double &xi, double &eta);
+
+/*!
+ * \sa method void tangentPlaneToSky(double xi, double eta, double ra0, double dec0, double &ra, double &dec);
+ * \brief inverse of skyToTangentPlane.
+ */
+void tangentPlaneToSky(double xi, double eta, double ra0, double dec0, double &ra, double &dec);
+
+/*!
+ * \brief The TAN world coordinate system of an image, from its CRPIX, CRVAL and CD keywords.
+ * \ingroup libraries
+ */
+class operaTangentPlaneWCS {
+public:
+	double crpix1, crpix2;
+	double crval1, crval2;				// degrees
+	double cd11, cd12, cd21, cd22;		// degrees per pixel
+
+	/*!
+	 * \brief sky position in degrees of pixel (x, y), in FITS pixels.
+	 */
+	void pixelToSky(double x, double y, double &ra, double &dec) const;
+};
+
+/*!
+ * \brief Grid hash of points in a plane for nearest neighbour queries.
+ * \ingroup libraries
+ */
+class operaSourceMatcher {
+private:
+	double cellSize;
+	double xmin, ymin;
+	unsigned ncellsx, ncellsy;
+	std::vector<double> px, py;
+	std::vector<unsigned> cellStart;	// points of cell c are cellPoints[cellStart[c]..cellStart[c+1])
+	std::vector<unsigned> cellPoints;
+
+	bool cellRange(double x, double y, double radius, unsigned &cxfirst, unsigned &cxlast, unsigned &cyfirst, unsigned &cylast) const;
+
+public:
+	/*
+	 * Constructors / Destructors
+	 */
+
+	/*!
+	 * \sa operaSourceMatcher(const std::vector<double> &x, const std::vector<double> &y, double CellSize)
+	 * \brief hash the points (x[i], y[i]) into cells of CellSize, best set to the largest match radius.
+	 * \details Sparse points get larger cells, so the grid has at most about 3*SOURCEMATCHER_CELLS_PER_POINT cells per point.
+	 */
+	operaSourceMatcher(const std::vector<double> &x, const std::vector<double> &y, double CellSize);
+
+	/*!
+	 * \sa method int nearest(double x, double y, double radius) const;
+	 * \return the index of the point nearest to (x, y) within radius, -1 if there is none.
+	 */
+	int nearest(double x, double y, double radius) const;
+
+	/*!
+	 * \sa method unsigned match(const std::vector<double> &x, const std::vector<double> &y, double searchRadius, double matchRadius, std::vector<int> &matches, double &dx, double &dy) const;
+	 * \brief match the positions (x[i], y[i]) to the points, allowing for a common offset.
+	 * \details The offset (dx, dy), point minus position, is the most common one over all the pairs within
+	 * searchRadius, found by a vote in a histogram of bins of matchRadius. Each shifted position is then matched to its nearest point within matchRadius, matches[i] receiving the
+	 * index of the point or -1. Without any point within searchRadius the offset is zero.
+	 * \return the number of positions matched.
+	 */
+	unsigned match(const std::vector<double> &x, const std::vector<double> &y, double searchRadius, double matchRadius, std::vector<int> &matches, double &dx, double &dy) const;
+};
+
+#endif
@@ -46,6 +46,8 @@
 #include "libraries/GainBiasNoise.h" // for GainBiasNoise
 #include "libraries/operaSpectralTools.h"
 
+#define OPTIMAL_EXTRACTION_CONVERGENCE 1e-3	// flux change, in units of its error, below which an element needs no further rejection pass
+
 using namespace std;
 
 /*! 
@@ -116,6 +118,9 @@ private:
 	bool hasWavelengthRange;
 	double snrSpectralBinSize;
 	
+	std::vector<unsigned> subpixelCols, subpixelRows;	// extractSubpixelFlux buffers, reused from element to element
+	std::vector<unsigned> subpixelPlaced;				// scratch of PixelSet::placeSubpixels
+	
 public:
 	
 	/*
@@ -349,6 +354,10 @@ public:
     
     void measureOptimalSpectrum(operaFITSImage &inputImage, operaFITSImage &nflatImage, operaFITSImage &biasImage, operaFITSImage &badpix, GainBiasNoise &gainBiasNoise, double minSigmaClip, double sigmaClipRange);
     
+    void measureOptimalSpectrum(operaFITSImage &inputImage, operaFITSImage &nflatImage, operaFITSImage &biasImage, operaFITSImage &badpix, GainBiasNoise &gainBiasNoise, double minSigmaClip, double sigmaClipRange, unsigned iterations);
+    
+    unsigned measureOptimalElement(unsigned indexElem, const operaVector &pixelFlux, const operaVector &pixelVariance, double BackgroundFlux, double minSigmaClip, double sigmaClipRange);
+    
     void calculateXCorrBetweenIPandImage(operaFITSImage &Image, operaFITSImage &badpix, ostream *pout);
 	
 	operaSpectralOrder_t getSpectrumType(void) const;
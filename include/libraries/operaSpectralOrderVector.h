@@ -30,6 +30,7 @@
  ********************************************************************/
 
 #include <vector>
+#include <pthread.h>
 #include "operaError.h"
 #include "libraries/operaSpectralElements.h"		// for operaSpectralElements
 #include "libraries/operaSpectralTools.h"			// for operaSpectrum
@@ -56,13 +57,15 @@ using namespace std;
 class operaSpectralOrderVector {
 	
 private:
-	std::vector<operaSpectralOrder*> vector; // a vector of spectral order pointers
-	Polynomial *orderSpacingPolynomial; // captures the spacing between orders
+	// a vector of spectral order pointers, NULL until the order is first accessed. The vector is never
+	// resized and the getters create orders under lazyMutex, so order-parallel loops may allocate them.
+	mutable std::vector<operaSpectralOrder*> vector;
+	mutable Polynomial *orderSpacingPolynomial; // captures the spacing between orders
 	
 	string object;					// for Libre-Esprit output
     
     unsigned numberOfDispersionPolynomials;
-	LaurentPolynomial *dispersionPolynomial[MAXORDEROFWAVELENGTHPOLYNOMIAL]; // captures the dispersion polynomials
+	mutable LaurentPolynomial *dispersionPolynomial[MAXORDEROFWAVELENGTHPOLYNOMIAL]; // captures the dispersion polynomials
 	
     unsigned length;				// total length of vector
 	unsigned minorder;				// lowest order number with a value
@@ -71,7 +74,17 @@ private:
 	instrumentmode_t instrumentmode;	// instrumentmode
 	unsigned count;					// Note that this count is the count of actual orders, 
 									// not the length of the vector (which will be MAXORDERS)
-	GainBiasNoise *gainBiasNoise;	// flat stats
+	mutable GainBiasNoise *gainBiasNoise;	// flat stats
+	unsigned orderMaxdatapoints;	// sizes of the orders to allocate, 0 for empty orders
+	unsigned orderMaxValues;
+	unsigned orderNElements;
+	
+	mutable pthread_mutex_t lazyMutex;	// held while the const getters look up or create the members above
+	
+	operaSpectralOrder *allocateSpectralOrder(unsigned order) const;
+	
+	operaSpectralOrderVector(const operaSpectralOrderVector &);	// not copyable
+	operaSpectralOrderVector &operator=(const operaSpectralOrderVector &);
 	
 public:
 	/*
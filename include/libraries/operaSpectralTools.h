@@ -219,6 +219,21 @@ operaVector convolveSpectrumWithGaussian(const operaVector& wavelength, const op
  */
 operaVector convolveSpectrumWithGaussianByResolution(const operaVector& wavelength, const operaVector& flux, double spectralResolution);
 
+/*
+ * convolveSpectrumWithGaussianByResolution(const operaVector& wavelength, const operaVector& flux, const operaVector& spectralResolution)
+ * \brief As above for a resolution varying along the spectrum, spectralResolution[i] giving the line width wavelength[i]/spectralResolution[i] at point i
+ * \note The Gaussian weights come from a tabulated kernel, within a relative error of 1.6e-10 of exp.
+ * \return operaVector
+ */
+operaVector convolveSpectrumWithGaussianByResolution(const operaVector& wavelength, const operaVector& flux, const operaVector& spectralResolution);
+
+/*
+ * convolveSpectraWithGaussianByResolution(const operaVector& wavelength, const std::vector<operaVector>& fluxes, const operaVector& spectralResolution)
+ * \brief Convolve several spectra sampled on the same wavelengths at once, the kernel weights being computed once for all of them
+ * \return the convolved spectra, in the order of fluxes
+ */
+std::vector<operaVector> convolveSpectraWithGaussianByResolution(const operaVector& wavelength, const std::vector<operaVector>& fluxes, const operaVector& spectralResolution);
+
 /*
  * normalizeSpectrum(unsigned nLines, double *lineflux)
  * \brief This function normalize an input vector of fluxes by the maximum value in the array
@@ -342,6 +357,17 @@ T getSpectrumWithinRange(W wlrange, const T& inputSpectrum) {
     return outputSpectrum;
 }
 
+/*!
+ * \brief Finds the first and one past the last index with wl0 <= wavelength <= wlf, by bisection. Assumes wavelength vector is in increasing order.
+ */
+void getWavelengthSubrange(const operaVector& wavelength, double wl0, double wlf, unsigned& startindex, unsigned& endindex);
+
+/*!
+ * \brief Same as getSpectrumWithinRange for a spectrum or line list sorted by wavelength, in O(log n) plus the size of the output.
+ */
+operaSpectrum getSortedSpectrumWithinRange(operaWavelengthRange wlrange, const operaSpectrum& inputSpectrum);
+operaSpectralLineList getSortedSpectrumWithinRange(operaWavelengthRange wlrange, const operaSpectralLineList& inputLines);
+
 operaSpectralLineList getAllSpectralLines(const operaSpectralLines& spectralLines);
 
 operaSpectralLineList getSpectralLinesInWavelengthRange(const operaSpectralLines& spectralLines, operaWavelengthRange wlrange);
@@ -0,0 +1,109 @@
+#ifndef OPERASPECTRUMSTACK_H
+#define OPERASPECTRUMSTACK_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaSpectrumStack
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <vector>
+
+#include "libraries/operaSpectralTools.h"		// for operaSpectrum
+
+/*!
+ * \file operaSpectrumStack.h
+ */
+
+/*!
+ * \brief how the points falling in one output bin are combined.
+ */
+typedef enum {
+	StackWeightedMean=0,
+	StackSum=1,
+	StackMean=2,
+	StackMedian=3
+} operaStackMethod_t;
+
+/*!
+ * \brief Combines many spectra onto a common grid of constant radial velocity bins.
+ * \details Each input is sorted by wavelength once when added, and kept as compact
+ * wavelength/flux/variance arrays. stack() splits the output grid into chunks that are
+ * filled in parallel on the shared operaThreadPool. Within a chunk the inputs are merged
+ * in wavelength order through a heap (k-way merge), so every input point is visited once
+ * and each bin is finished as soon as the merged stream moves past it.
+ * \ingroup libraries
+ * \sa class operaSpectrumStack
+ */
+class operaSpectrumStack {
+
+private:
+	class stackInput {
+	public:
+		std::vector<double> wavelength;
+		std::vector<float> flux;
+		std::vector<float> variance;
+	};
+	std::vector<stackInput> inputs;
+
+	static void stackChunk(unsigned long chunk, void *context);
+
+public:
+	/*
+	 * Constructors / Destructors
+	 */
+
+	/*!
+	 * \sa operaSpectrumStack()
+	 * \brief an empty stack.
+	 */
+	operaSpectrumStack();
+
+	/*!
+	 * \sa method unsigned size(void);
+	 * \brief number of spectra added so far
+	 */
+	unsigned size(void) const { return (unsigned)inputs.size(); };
+
+	/*!
+	 * \sa method void addSpectrum(const operaSpectrum &spectrum);
+	 * \brief copy the first flux vector of spectrum into the stack, sorted by wavelength.
+	 * \note points with a NaN wavelength are dropped.
+	 */
+	void addSpectrum(const operaSpectrum &spectrum);
+
+	/*!
+	 * \sa method operaSpectrum stack(double FirstWavelength, double LastWavelength, double RadialVelocityBin, operaStackMethod_t Method);
+	 * \brief combine all spectra on bins of RadialVelocityBin km/s starting at FirstWavelength, up to LastWavelength.
+	 * \details A point at wavelength w goes to the first bin [wl, wl+dwl] containing it. NaN fluxes are skipped,
+	 * and for all methods but StackSum so are zero fluxes. Bins that receive no point, or whose sum is zero for StackSum,
+	 * are left out. The output wavelength is the bin center.
+	 * \return the stacked spectrum
+	 */
+	operaSpectrum stack(double FirstWavelength, double LastWavelength, double RadialVelocityBin, operaStackMethod_t Method) const;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef OPERATELLURICTRANSMISSION_H
+#define OPERATELLURICTRANSMISSION_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaTelluricTransmission
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <pthread.h>
+#include <vector>
+
+#include "libraries/operaSpectralTools.h"
+
+/*!
+ * \file operaTelluricTransmission.h
+ */
+
+#define TELLURIC_SAMPLES_PER_SIGMA 8
+#define TELLURIC_TRUNCATION_IN_SIGMAS 5.0
+#define TELLURIC_GRID_PADDING 1e-3		// relative, about 300 km/s each side, covers the shifted grids of a RV scan
+
+/*!
+ * \brief Synthetic telluric transmission from a line list, broadened by a Gaussian of sigma wavelength/resolution.
+ * \details The model is that of generateSyntheticTelluricSpectrumUsingLineProfile in the telluric and RV modules:
+ * transmission(wl) = exp(-airmass * sum_j depth_j * G(wl_j - wl, wl/resolution)), G a normalized Gaussian truncated
+ * at TELLURIC_TRUNCATION_IN_SIGMAS. Since the width is proportional to the wavelength, the Gaussian has a constant
+ * width 1/resolution in ln(wl). The optical depth is therefore rasterized once per resolution on a uniform ln(wl)
+ * grid of TELLURIC_SAMPLES_PER_SIGMA nodes per sigma, and every request is a cubic interpolation of that grid
+ * followed by one exp per output point. Rasters are cached by resolution and coverage; the airmass only scales
+ * the optical depth and needs no raster of its own.
+ * \note The line list must be sorted by wavelength, as operaLineDatabase tables are.
+ * \ingroup libraries
+ */
+class operaTelluricTransmission {
+
+private:
+	class telluricRaster {
+	public:
+		double resolution;
+		double lnwl0;					// ln(wl) of node 0
+		double step;					// node spacing in ln(wl)
+		double wlmin, wlmax;			// output wavelengths this raster can serve
+		operaVector opticalDepth;		// per unit airmass
+	};
+
+	operaSpectrum lines;
+	std::vector<telluricRaster *> rasters;
+	pthread_mutex_t mutex;
+
+	operaTelluricTransmission(const operaTelluricTransmission &);	// not copyable
+	operaTelluricTransmission &operator=(const operaTelluricTransmission &);
+
+	const telluricRaster *getRaster(double resolution, double wlmin, double wlmax);
+	telluricRaster *buildRaster(double resolution, double wlmin, double wlmax) const;
+
+public:
+	/*
+	 * Constructors / Destructors
+	 */
+
+	/*!
+	 * \sa operaTelluricTransmission(const operaSpectrum &TelluricLines)
+	 * \brief TelluricLines holds the line wavelengths (nm) and integrated optical depths, sorted by wavelength.
+	 */
+	operaTelluricTransmission(const operaSpectrum &TelluricLines);
+
+	~operaTelluricTransmission();
+
+	/*!
+	 * \sa method operaVector getTransmission(const operaVector &Wavelength, double Resolution, double Airmass);
+	 * \brief the transmission at each of Wavelength, in any order, for a spectral resolution and an airmass.
+	 */
+	operaVector getTransmission(const operaVector &Wavelength, double Resolution, double Airmass = 1.0);
+
+	/*!
+	 * \sa method void clearCache(void);
+	 * \brief drop every raster.
+	 */
+	void clearCache(void);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef OPERATHREADPOOL_H
+#define OPERATHREADPOOL_H
+
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                 ****
+ *******************************************************************
+ Library name: operaThreadPool
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+/*!
+ * \file operaThreadPool.h
+ */
+
+/*!
+ * \brief a unit of work handed to the pool: a function and its argument.
+ */
+typedef void (*operaTaskFunction)(void *argument);
+
+/*!
+ * \brief the body of a parallel loop, called once per index in [0, count).
+ */
+typedef void (*operaParallelForFunction)(unsigned long index, void *context);
+
+typedef struct operaTask {
+	operaTaskFunction function;
+	void *argument;
+} operaTask_t;
+
+/*!
+ * \brief A fixed set of pthread workers fed from a shared queue.
+ * \details The workers are created once and reused for every submitted task,
+ * so that libraries can split work into many small pieces (image tiles, orders, lines)
+ * without paying a pthread_create per piece. A process-wide pool sized to the number of
+ * online processors is available through getSharedPool().
+ * \ingroup libraries
+ * \sa class operaThreadPool
+ */
+class operaThreadPool {
+
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t workAvailable;
+	pthread_cond_t workDone;
+	std::deque<operaTask_t> queue;
+	std::vector<pthread_t> workers;
+	unsigned long pending;				// tasks queued or running
+	bool shuttingDown;
+
+	static void *workerThread(void *argument);
+
+public:
+	/*
+	 * Constructors / Destructors
+	 */
+
+	/*!
+	 * \sa operaThreadPool(unsigned NThreads)
+	 * \brief create a pool of NThreads workers, 0 means one per online processor.
+	 */
+	operaThreadPool(unsigned NThreads = 0);
+
+	/*!
+	 * \sa ~operaThreadPool()
+	 * \brief drains the queue and joins all workers.
+	 */
+	~operaThreadPool();
+
+	/*!
+	 * \sa method unsigned getNThreads(void);
+	 * \brief returns the number of worker threads
+	 */
+	unsigned getNThreads(void) const { return (unsigned)workers.size(); };
+
+	/*!
+	 * \sa method void submit(operaTaskFunction Function, void *Argument);
+	 * \brief queue a task, returns immediately
+	 */
+	void submit(operaTaskFunction Function, void *Argument);
+
+	/*!
+	 * \sa method void waitForAll(void);
+	 * \brief block until every submitted task has completed
+	 */
+	void waitForAll(void);
+
+	/*!
+	 * \sa method void parallelFor(unsigned long Count, operaParallelForFunction Body, void *Context);
+	 * \brief call Body(i, Context) for i in [0, Count) on the workers and the calling thread, returns when all are done.
+	 * \note Called from a worker thread of this pool the loop runs serially, so nested loops can not deadlock the pool.
+	 * \note An operaException thrown by Body is rethrown in the calling thread.
+	 */
+	void parallelFor(unsigned long Count, operaParallelForFunction Body, void *Context);
+
+	/*!
+	 * \sa method bool isWorkerThread(void);
+	 * \brief is the calling thread one of the workers of any pool?
+	 */
+	static bool isWorkerThread(void);
+
+	/*!
+	 * \sa method unsigned getNumberOfProcessors(void);
+	 * \brief returns the number of online processors
+	 */
+	static unsigned getNumberOfProcessors(void);
+
+	/*!
+	 * \sa method operaThreadPool &getSharedPool(void);
+	 * \brief returns the process-wide pool, created on first use
+	 */
+	static operaThreadPool &getSharedPool(void);
+};
+
+#endif
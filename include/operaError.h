@@ -104,6 +104,8 @@ typedef int operaErrorCode;
 #define operaErrorDifferingLaziness 711
 #define operaErrorExtensionOutOfRange 712
 #define operaErrorSliceOutOfRange 713
+#define operaErrorThreadFailure 714
+#define operaErrorLineDatabaseFormat 715
 
 /*
  * matrix
@@ -287,6 +289,12 @@ static string operaStrError(const operaErrorCode errcode) {
 		case operaErrorSliceOutOfRange:
 			operaErrorString = string("slice out of range");
 			break;
+		case operaErrorThreadFailure:
+			operaErrorString = string("thread creation or join failed");
+			break;
+		case operaErrorLineDatabaseFormat:
+			operaErrorString = string("not a line database or built for another byte order");
+			break;
 																							
 		/* Modules */
 			
@@ -507,6 +515,12 @@ static char *operaStrError(const operaErrorCode errcode) {
 		case operaErrorSliceOutOfRange:
 			strncpy(operaErrorString, "slice out of range", sizeof(operaErrorString));
 			break;
+		case operaErrorThreadFailure:
+			strncpy(operaErrorString, "thread creation or join failed", sizeof(operaErrorString));
+			break;
+		case operaErrorLineDatabaseFormat:
+			strncpy(operaErrorString, "not a line database or built for another byte order", sizeof(operaErrorString));
+			break;
 			
 		/* reductionset */
 		case operaErrorReductionSetEtypeNotDefined:
@@ -40,6 +40,8 @@
 #include "libraries/operaIOFormats.h"
 #include "libraries/operaSpectralFeature.h"
 #include "libraries/operaSpectralTools.h"
+#include "libraries/operaLineDatabase.h"				// for operaLineDatabase
+#include "libraries/operaTelluricTransmission.h"		// for operaTelluricTransmission
 #include "libraries/operaStats.h"
 #include "libraries/operaCCD.h"							// for MAXORDERS
 #include "libraries/operaFit.h"							// for operaFitSplineDouble
@@ -56,9 +58,8 @@
 
 using namespace std;
 
-operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, const operaVector& wavelengthVector, double resolution, ProfileMethod profile);
+operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, operaTelluricTransmission& telluricTransmission, const operaVector& wavelengthVector, double resolution, ProfileMethod profile);
 bool calculateRVShiftByXCorr(const operaSpectrum& objectSpectrum, const operaSpectrum& templateSpectrum, const operaSpectrum& telluricLines, double radialVelocityRange, double radialVelocityStep, double threshold, double& maxRV, double& sigRV, double& maxcorr, ofstream& frvcorrdata, ofstream& frvcorrfitdata, double spectralResolution, bool useFitToFindMaximum, double& chisqr, double heliocentricRV_mps);
-void getWavelengthSubrange(const operaVector& wavelength, double wl0, double wlf, unsigned& startindex, unsigned& endindex);
 
 void matchTelluricLines(const operaSpectrum& telluricLinesFromAtlas, const operaSpectrum& telluricLinesFromObject, operaVector& telluricMatchedWavelengths, operaSpectrum& objectMatchedLines, operaVector& radialVelocities, double spectralResolution, double radialVelocityRange);
 operaVector selectWavelengthsInRange(operaWavelengthRange wlrange, operaVector wavelengths);
@@ -262,7 +263,7 @@ int main(int argc, char *argv[])
             /*
              *  Collect telluric lines within chunk
              */
-            operaSpectrum telluricChunk = getSpectrumWithinRange(wlranges.getrange(chunk),telluricLines);
+            operaSpectrum telluricChunk = getSortedSpectrumWithinRange(wlranges.getrange(chunk),telluricLines);
 
             bool xcorrect = calculateRVShiftByXCorr(spectrumChunk,templateChunk,telluricChunk,radialVelocityRange,radialVelocityStep,threshold,rvshift,rvshifterror,maxcorr,frvcorrdata,frvcorrfitdata,spectralResolution,useFitToFindMaximum,chisqr,heliocentricRV_mps);
 
@@ -311,28 +312,11 @@ int main(int argc, char *argv[])
     return EXIT_SUCCESS;
 }
 
-// Read the entire set of telluric lines in HITRAN database
+// Read the entire set of telluric lines in HITRAN database, through its prebuilt line database when there is one
 operaSpectrum readTelluricLines(string telluric_database_file)
 {
-    const double N_OVER_V = TYPICAL_PRESSURE_AT_MAUNAKEA/(TYPICAL_TEMPERATURE_AT_MAUNAKEA*k_BOLTZMANN_CONSTANT);
-    
-    operaSpectrum telluricLines;
-    igzstream astream(telluric_database_file.c_str());
-    if (astream.is_open()) {
-        string dataline;
-        while (getline(astream, dataline)) {
-            if (!dataline.empty() && dataline[0] != '#') { // skip blank lines and comments
-                double wave_number;
-                float intensity;
-                if(!sscanf(dataline.c_str(), "%*d %lf %G %*[^\n]", &wave_number, &intensity)) continue; //skip over bad line
-                //if (intensity < 1.15e-26) continue; //skip over lines below a certain threshold
-                double wavelength_in_nm = 1e7/wave_number;
-                telluricLines.insert(convertVacuumToAirWavelength(wavelength_in_nm*10)/10, ((double)intensity/(N_OVER_V*1e-6))/TYPICAL_ATMOSPHERE_PATH_LENGTH);
-            }
-        }
-        astream.close();
-    }
-    telluricLines.reverse();
+    operaLineDatabase telluricDatabase(telluric_database_file, LineFormatHITRAN);
+    operaSpectrum telluricLines = telluricDatabase.getSpectrum();
     if (args.verbose) {
         if (telluricLines.empty()) printf("          [Telluric] no lines found in telluric database.\n");
         else printf("          [Telluric] %d lines found wl0=%.2f wlc=%.2f wlf=%.2f\n", telluricLines.size(), telluricLines.firstwl(), telluricLines.midwl(), telluricLines.lastwl());
@@ -394,8 +378,12 @@ operaVector selectWavelengthsInRange(operaWavelengthRange wlrange, operaVector w
 }
 
 // Generates a spectrum along the points in wavelengthVector by using a Gaussian profile to fit telluricLines.
-operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, const operaVector& wavelengthVector, double resolution, ProfileMethod profile)
+// A Gaussian profile comes from telluricTransmission, the caller's engine for telluricLines, which keeps its rasters between calls.
+operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, operaTelluricTransmission& telluricTransmission, const operaVector& wavelengthVector, double resolution, ProfileMethod profile)
 {
+    if (profile == GAUSSIAN) {
+        return telluricTransmission.getTransmission(wavelengthVector, resolution);
+    }
     operaVector outputSpectrum(wavelengthVector.size());
     outputSpectrum.fill(1.0); //Initialize outputSpectrum to uniform 1.0
     for(unsigned i=0; i<wavelengthVector.size(); i++) {
@@ -419,19 +407,6 @@ operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectru
     return outputSpectrum;
 }
 
-// Finds the first and last index between wl0 and wlf. Assumes wavelength vector is in increasing order.
-void getWavelengthSubrange(const operaVector& wavelength, double wl0, double wlf, unsigned& startindex, unsigned& endindex)
-{
-    endindex = startindex = 0;
-    operaWavelengthRange wlrange(wl0, wlf);
-    for (unsigned i = 0; i < wavelength.size(); i++) {
-        if (wlrange.contains(wavelength[i])) {
-            if (endindex == 0) endindex = startindex = i;
-            endindex++;
-        }
-    }
-}
-
 /*
  * Read template spectrum from file. Data format must be lambda, flux, fluxvar
  */
@@ -510,6 +485,10 @@ bool calculateRVShiftByXCorr(const operaSpectrum& objectSpectrum, const operaSpe
     operaVector templateIntensityVector = convolveSpectrum(templateSpectrum, spectralResolution);
     //operaVector templateIntensityVector = (templateSpectrum.getintensity()).getflux();
     
+    // Generate a spectrum in telluricSpectrumFlux along points in wavelength vector using the provided telluricLines, it does not depend on the velocity step
+    operaTelluricTransmission telluricTransmission(telluricLines);
+    operaVector telluricSpectrumFlux = telluricTransmission.getTransmission(objectSpectrum.wavelengthvector(), spectralResolution);
+    
     for(double deltaRV = -radialVelocityRange/2.0; deltaRV <= radialVelocityRange/2.0; deltaRV+=radialVelocityStep) {
         operaVector syntheticSpectrumWavelength;
         // Initalize synthetic wavelength with wavelength of objectSpectrum shifted by deltaRV
@@ -518,9 +497,6 @@ bool calculateRVShiftByXCorr(const operaSpectrum& objectSpectrum, const operaSpe
             syntheticSpectrumWavelength.insert(objectSpectrum.getwavelength(i) - DWavelength);
         }
         
-        // Generate a spectrum in telluricSpectrumFlux along points in wavelength vector using the provided telluricLines
-        operaVector telluricSpectrumFlux = generateSyntheticTelluricSpectrumUsingLineProfile(telluricLines, objectSpectrum.wavelengthvector(), spectralResolution, GAUSSIAN);
-        
         // Generate a spectrum in templateSpectrumFlux along points in wavelength vector using the provided templateSpectrum
         operaVector templateSpectrumFlux = fitSpectrum(templateSpectrum.wavelengthvector(), templateIntensityVector, syntheticSpectrumWavelength);
         
@@ -40,9 +40,11 @@
 #include "libraries/operaIOFormats.h"
 #include "libraries/operaSpectralFeature.h"
 #include "libraries/operaSpectralTools.h"
+#include "libraries/operaLineDatabase.h"				// for operaLineDatabase
 #include "libraries/operaStats.h"
 #include "libraries/operaCCD.h"							// for MAXORDERS
 #include "libraries/operaFit.h"							// for operaFitSplineDouble
+#include "libraries/operaRadialVelocityLineFit.h"
 #include "libraries/gzstream.h"							// for gzstream - read compressed reference spectra
 #include "libraries/operaArgumentHandler.h"
 #include "libraries/operaCommonModuleElements.h"
@@ -52,12 +54,8 @@
 
 using namespace std;
 
-void writegaussfitenv(string envfile, string datafile, string paramfile, string rvparamfile, bool robust);
-void writegaussfitdata(string datafile, operaWavelengthRanges linesranges, operaSpectrum spectrum, operaSpectrum sourceLines);
-void writegaussfitmodel(string modelfile);
-void writegaussfitpars(string paramfile, operaSpectrum lines);
-void writegaussfitrvpars(string rvparamfile, double telluricRV, double helioRV, double sourceRV);
-void readgaussfitrvpars(string rvparamfile, double *rv, double *rverr);
+void fitSelectedLines(operaRadialVelocityLineFit &linefit, operaSpectrum spectrum, operaSpectrum sourceLines, double sourceLineWidthResolution, double nsigwidth);
+void writeSelectedLinesPlotData(string datafile, const operaRadialVelocityLineFit &linefit, operaSpectrum sourceLines);
 void GenerateSelectedLinesPlot(string gnuScriptFileName, string outputPlotEPSFileName, string datafile, operaSpectrum sourceLines);
 
 operaArgumentHandler args;
@@ -111,6 +109,7 @@ int main(int argc, char *argv[])
     double initialRVguess=0.0;
 
     bool robustFit = false;
+    string robustWeighting = "huber";
 
     double sourceLineWidthResolution = 2500;
     
@@ -144,6 +143,7 @@ int main(int argc, char *argv[])
     args.AddOrderLimitArguments(ordernumber, minorder, maxorder, NOTPROVIDED);
     args.AddSwitch("StarPlusSky", StarPlusSky, "star plus sky mode");
     args.AddSwitch("robustFit", robustFit, "Used for robust fit");
+    args.AddOptionalArgument("robustWeighting", robustWeighting, "huber", "Weighting function of the robust fit, huber or tukey");
 
     args.AddOptionalArgument("sourceLineWidthResolution", sourceLineWidthResolution, 2500, "Source line resolution -- usually much smaller than instrument resolution");
 
@@ -178,6 +178,12 @@ int main(int argc, char *argv[])
         if (inputWavelengthMaskForTelluric.empty()) {
             throw operaException("operaRadialVelocityFromSelectedLines: ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
         }
+        operaRobustWeighting_t robustWeightingFunction = RobustWeightingNone;
+        if (robustFit) {
+            if (robustWeighting == "huber") robustWeightingFunction = RobustWeightingHuber;
+            else if (robustWeighting == "tukey") robustWeightingFunction = RobustWeightingTukey;
+            else throw operaException("operaRadialVelocityFromSelectedLines: "+robustWeighting+" ", operaErrorInvalidParameter, __FILE__, __FUNCTION__, __LINE__);
+        }
         
 		if (args.verbose) {
 			cout << "operaRadialVelocityFromSelectedLines: inputWaveFile = " << inputWaveFile << endl;
@@ -195,6 +201,7 @@ int main(int argc, char *argv[])
             cout << "operaRadialVelocityFromSelectedLines: inputTelluricCorrection = " << inputTelluricCorrection << endl;
             cout << "operaRadialVelocityFromSelectedLines: initialRVguess = " << initialRVguess << endl;
             cout << "operaRadialVelocityFromSelectedLines: robustFit = " << robustFit << endl;
+            cout << "operaRadialVelocityFromSelectedLines: robustWeighting = " << robustWeighting << endl;
             cout << "operaRadialVelocityFromSelectedLines: sourceLineWidthResolution = " << sourceLineWidthResolution << endl;            
             if(ordernumber != NOTPROVIDED) cout << "operaRadialVelocityFromSelectedLines: ordernumber = " << ordernumber << endl;
 		}
@@ -269,8 +276,6 @@ int main(int argc, char *argv[])
         double numberOfPointsToCutInOrderEnds = 400;
         double nsigwidth = 5.0;  // extract +- nsig around line
         
-        operaWavelengthRanges linesranges = getWavelengthMaskAroundLines(sourceLines,sourceLineWidthResolution,nsigwidth);
-
         operaSpectrum spectrumAroundLines = spectralOrders.getSpectrumAroundLines(sourceLines, minorder, maxorder, true, normalizationBinsize, sourceLineWidthResolution, nsigwidth, snrClip, numberOfPointsToCutInOrderEnds);
 
         if(args.debug){
@@ -280,53 +285,25 @@ int main(int argc, char *argv[])
         }
     
         /*
-         * GaussFit files:
-         */
-        string envfile = "envfile";
-        string datafile = "datafile";
-        string modelfile = "modelfile";
-        string paramfile = "paramfile";
-        string rvparamfile = "rvparamfile";
-        
-        // -> Create command line to run gaussfit
-        string command = "/Users/edermartioli/Local/gaussfit/gaussfit " + modelfile + " " + envfile;
-        // -> Print command line on screen
-        if(args.verbose) cout << endl << command << endl << endl;
-
-        /*
-         * First iteration to fit calibration parameters
+         * Fit all lines at once: a common RV shift plus the level, depth and width of each line,
+         * on top of the telluric and heliocentric corrections.
          */
-        bool robustFitForFirstPass = false;
-        
-        // -> Write gaussfit environment file
-        writegaussfitenv(envfile, datafile, paramfile, rvparamfile, robustFitForFirstPass);
-        
-        // -> Write gaussfit data file
-        writegaussfitdata(datafile, linesranges, spectrumAroundLines, sourceLines);
-        
-        // -> Write gaussfit model file
-        writegaussfitmodel(modelfile);
-        
-        // -> Write gaussfit parameter files
-        writegaussfitpars(paramfile, sourceLines);
-        
-        double initialRVguess_mps = initialRVguess*1000;
-        writegaussfitrvpars(rvparamfile, telluricRV_mps, heliocentricRV_mps, initialRVguess_mps);
-        
-        //***********************
-        // -> Run gaussfit
-        system(command.c_str());
-        //***********************
-    
-        if (robustFit) {
-            writegaussfitenv(envfile, datafile, paramfile, rvparamfile, robustFit);
-            
-            //***********************
-            // -> Run gaussfit
-            system(command.c_str());
-            //***********************
+        operaRadialVelocityLineFit linefit;
+        linefit.setVelocityOffset(telluricRV_mps + heliocentricRV_mps);
+        linefit.setRadialVelocity(initialRVguess*1000);
+        fitSelectedLines(linefit, spectrumAroundLines, sourceLines, sourceLineWidthResolution, nsigwidth);
+        
+        int fitstatus = linefit.fit(robustWeightingFunction);
+        if (fitstatus > 0) {
+            rvshift = linefit.getRadialVelocity();
+            rvshifterror = linefit.getRadialVelocityError();
+        } else {
+            // a failed fit has no velocity, write NaN rather than a zero that reads as a measurement
+            rvshift = NAN;
+            rvshifterror = NAN;
+            cerr << "operaRadialVelocityFromSelectedLines: line fit failed (status=" << fitstatus << "), writing NaN radial velocity to " << outputRVFile << endl;
         }
-        readgaussfitrvpars(rvparamfile, &rvshift, &rvshifterror);
+        if (args.verbose) cout << "operaRadialVelocityFromSelectedLines: fit status=" << fitstatus << " rv=" << rvshift << " +/- " << rvshifterror << " m/s reduced chi2=" << linefit.getChisqr() << endl;
         
         FormatHeader outputheader("Source Radial Velocity");
         outputheader << "MJD" << "HJD_UTC" << "HJD_TT" << "radialvelocity (m/s)" << "radialvelocityerror (m/s)" << newline;
@@ -335,6 +312,8 @@ int main(int argc, char *argv[])
         operaIOFormats::WriteCustomFormat("rv", outputheader, outputdata, outputRVFile);
         
         if (!gnuScriptFileName.empty()) {
+            string datafile = gnuScriptFileName + ".dat";
+            writeSelectedLinesPlotData(datafile, linefit, sourceLines);
             GenerateSelectedLinesPlot(gnuScriptFileName,outputPlotEPSFileName,datafile,sourceLines);
         }
         
@@ -350,28 +329,11 @@ int main(int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
-// Read the entire set of telluric lines in HITRAN database
+// Read the entire set of telluric lines in HITRAN database, through its prebuilt line database when there is one
 operaSpectrum readTelluricLines(string telluric_database_file)
 {
-	const double N_OVER_V = TYPICAL_PRESSURE_AT_MAUNAKEA/(TYPICAL_TEMPERATURE_AT_MAUNAKEA*k_BOLTZMANN_CONSTANT);
-	
-    operaSpectrum telluricLines;
-    igzstream astream(telluric_database_file.c_str());
-	if (astream.is_open()) {
-		string dataline;
-		while (getline(astream, dataline)) {
-			if (!dataline.empty() && dataline[0] != '#') { // skip blank lines and comments
-				double wave_number;
-				float intensity;
-				if(!sscanf(dataline.c_str(), "%*d %lf %G %*[^\n]", &wave_number, &intensity)) continue; //skip over bad line
-				//if (intensity < 1.15e-26) continue; //skip over lines below a certain threshold
-				double wavelength_in_nm = 1e7/wave_number;
-				telluricLines.insert(convertVacuumToAirWavelength(wavelength_in_nm*10)/10, ((double)intensity/(N_OVER_V*1e-6))/TYPICAL_ATMOSPHERE_PATH_LENGTH);
-			}
-		}
-		astream.close();
-	}
-	telluricLines.reverse();
+	operaLineDatabase telluricDatabase(telluric_database_file, LineFormatHITRAN);
+	operaSpectrum telluricLines = telluricDatabase.getSpectrum();
     if (args.verbose) {
 		if (telluricLines.empty()) printf("          [Telluric] no lines found in telluric database.\n");
 		else printf("          [Telluric] %d lines found wl0=%.2f wlc=%.2f wlf=%.2f\n", telluricLines.size(), telluricLines.firstwl(), telluricLines.midwl(), telluricLines.lastwl());
@@ -420,180 +382,63 @@ operaSpectrum readInputListOfLines(string inputListOfLines) {
 }
 
 
-void writegaussfitenv(string envfile, string datafile, string paramfile, string rvparamfile, bool robust) {
-    /*
-     * Create env file
-     */
-    ofstream *fenv = NULL;
+/*
+ * Hand the points around the source lines to the fit, each point to the nearest line whose
+ * +/- nsigwidth window holds it. The lines start as flat-bottomed as the data: no level offset,
+ * the depth of the deepest point and the width of the source line resolution.
+ */
+void fitSelectedLines(operaRadialVelocityLineFit &linefit, operaSpectrum spectrum, operaSpectrum sourceLines, double sourceLineWidthResolution, double nsigwidth) {
     
-    if (!envfile.empty()) {
-        fenv = new ofstream();
-        fenv->open(envfile.c_str());
-        
-        *fenv << "data1 = '" << datafile << "'" << endl;
-        *fenv << "param1 = '" << rvparamfile << "'" << endl;
-        *fenv << "param2 = '" << paramfile << "'" << endl;
-        
-        *fenv <<"iters   =	 30.0" << endl;
-        *fenv <<"prmat   =	 0.0" << endl;
-        *fenv <<"prvar   =	 1.0" << endl;
-        *fenv <<"results =	'res'" << endl;
-        *fenv <<"tol     =	 0.0001" << endl;
-        *fenv <<"triang  =	 0.0" << endl;
-        
-        if(robust == true)
-            *fenv << "fair   =	 0.9" << endl;
-        
-        *fenv <<"END" << endl;
-        
-        fenv->close();
+    unsigned nlines = sourceLines.size();
+    vector<pair<double, unsigned> > sortedLines(nlines);
+    for (unsigned l=0; l<nlines; l++) {
+        sortedLines[l] = make_pair(sourceLines.getwavelength(l), l);
     }
-}
-
-
-void writegaussfitdata(string datafile, operaWavelengthRanges linesranges, operaSpectrum spectrum, operaSpectrum sourceLines) {
-    
-    ofstream *fdata = NULL;
+    sort(sortedLines.begin(), sortedLines.end());
     
-    if (!datafile.empty()) {
-        fdata = new ofstream();
-        fdata->open(datafile.c_str());
-        
-        // write data header containing data symbols
-        *fdata << "line wlc wavelength flux flux_flux" << endl;
-        //----
-        
-        // write data type (double, float, int, etc)
-        *fdata << "double double double double double" << endl;
-        //----
-        
-        // write data
-        for (unsigned l=0; l<linesranges.size(); l++) {
-            for (unsigned i=0; i<spectrum.size(); i++) {
-                if (linesranges.contains(spectrum.getwavelength(i),l) ) {
-                    *fdata << l << " " << sourceLines.getwavelength(l) << " " << spectrum.getwavelength(i) << " " << spectrum.getflux(i) << " " << spectrum.getvariance(i) << endl;
-                }
-            }
+    vector<unsigned> pointLine(spectrum.size(), nlines);
+    vector<double> minflux(nlines, BIG);
+    for (unsigned i=0; i<spectrum.size(); i++) {
+        double wl = spectrum.getwavelength(i);
+        vector<pair<double, unsigned> >::iterator next = lower_bound(sortedLines.begin(), sortedLines.end(), make_pair(wl, 0u));
+        vector<pair<double, unsigned> >::iterator nearest = next;
+        if (next == sortedLines.end() || (next != sortedLines.begin() && wl - (next-1)->first < next->first - wl)) {
+            if (next == sortedLines.begin()) continue;
+            nearest = next-1;
+        }
+        if (fabs(wl - nearest->first) <= nsigwidth*nearest->first/sourceLineWidthResolution) {
+            unsigned l = nearest->second;
+            pointLine[i] = l;
+            if (spectrum.getflux(i) < minflux[l]) minflux[l] = spectrum.getflux(i);
         }
-        
-        fdata->close();
     }
     
-}
-
-void writegaussfitmodel(string modelfile) {
-    
-    ofstream *fmodel = NULL;
-    
-    if (!modelfile.empty()) {
-        fmodel = new ofstream();
-        fmodel->open(modelfile.c_str());
-        
-        *fmodel << "parameter rv;" << endl;
-        *fmodel << "constant telluricRV;" << endl;
-        *fmodel << "constant helioRV;" << endl;
-        *fmodel << "parameter level[line];" << endl;
-        *fmodel << "parameter a[line];" << endl;
-        *fmodel << "parameter sig[line];" << endl;
-        *fmodel << "constant wl0[line];" << endl;
-        
-        *fmodel << "data wavelength;" << endl;
-        *fmodel << "observation flux;" << endl;
-        
-        *fmodel << "variable c = 299792458;" << endl;
-        *fmodel << "variable f;" << endl;
-        
-        *fmodel << endl;
-        
-        *fmodel << "main()"  << endl;
-        *fmodel << "{"  << endl;
-        *fmodel << " while(import())"  << endl;
-        *fmodel << " {"  << endl;
-        *fmodel << "    gaussianModel();"  << endl;
-        *fmodel << " }"  << endl;
-        *fmodel << "}"  << endl;
-        
-        *fmodel << endl;
-        
-        *fmodel << "gaussianModel() {" << endl;
-        *fmodel << "    f = level + (1.0 - a*exp(-(wavelength - wl0 - (rv + telluricRV + helioRV)*wavelength/c)*(wavelength - wl0 - rv*wavelength/c)/(2*sig*sig)));" << endl;
-        *fmodel << "    export(flux - f);" << endl;
-        *fmodel << "}" << endl;
-        
-        fmodel->close();
+    for (unsigned l=0; l<nlines; l++) {
+        double depth = (minflux[l] < 1.0 ? 1.0 - minflux[l] : 0.2);
+        linefit.addLine(sourceLines.getwavelength(l), 0.0, depth, sourceLines.getwavelength(l)/sourceLineWidthResolution);
     }
-}
-
-
-void writegaussfitpars(string paramfile, operaSpectrum lines) {
-    ofstream *fpars = NULL;
-    
-    if (!paramfile.empty()) {
-        fpars = new ofstream();
-        fpars->open(paramfile.c_str());
-        
-        *fpars << "line wl0 level a sig" << endl;
-        *fpars << "double double double double double" << endl;
-        for (unsigned l=0; l<lines.size(); l++) {
-            *fpars << l << " " << lines.getwavelength(l) << " 0.1 0.2 0.2" << endl;
+    for (unsigned i=0; i<spectrum.size(); i++) {
+        if (pointLine[i] < nlines) {
+            linefit.addDataPoint(pointLine[i], spectrum.getwavelength(i), spectrum.getflux(i), spectrum.getvariance(i));
         }
-        
-        fpars->close();
-    }
-}
-
-
-void writegaussfitrvpars(string rvparamfile, double telluricRV, double helioRV, double sourceRV) {
-    ofstream *fpars = NULL;
-    
-    if (!rvparamfile.empty()) {
-        fpars = new ofstream();
-        fpars->open(rvparamfile.c_str());
-        
-        *fpars << "rv telluricRV helioRV" << endl;
-        *fpars << "double double double" << endl;
-        *fpars << sourceRV << " " << telluricRV << " " << helioRV << endl;
-        
-        fpars->close();
     }
 }
 
-
-void readgaussfitrvpars(string rvparamfile, double *rv, double *rverr) {
+/*
+ * Write the fitted points for the plot: line index, line center, wavelength, flux, variance and the residual flux - model.
+ */
+void writeSelectedLinesPlotData(string datafile, const operaRadialVelocityLineFit &linefit, operaSpectrum sourceLines) {
     
-    operaistream fpars(rvparamfile.c_str());
+    ofstream fdata(datafile.c_str());
     
-    if (fpars.is_open()) {
-        unsigned line = 0;
-        string dataline;
-        double buff=0;
-        
-        while (fpars.good()) {
-            getline(fpars, dataline);
-            if (strlen(dataline.c_str())) {
-                stringstream ss (stringstream::in | stringstream::out);
-                ss << dataline.c_str();
-                
-                if (line==0 || line==1) {
-                    line++;
-                } else {
-                    ss >> *rv;
-                    ss >> buff;
-                    ss >> buff;
-
-                    ss >> buff;
-                    ss >> *rverr;
-                    
-                    line++;
-                }
-            }
-        }
-        fpars.close();
+    for (unsigned i=0; i<linefit.getNumberOfDataPoints(); i++) {
+        unsigned l = linefit.getDataPointLine(i);
+        fdata << l << " " << sourceLines.getwavelength(l) << " " << linefit.getDataPointWavelength(i) << " " << linefit.getDataPointFlux(i) << " " << linefit.getDataPointVariance(i) << " " << linefit.getDataPointFlux(i) - linefit.getModel(i) << endl;
     }
+    
+    fdata.close();
 }
 
-
-
 /*
  * Generate plot
  */
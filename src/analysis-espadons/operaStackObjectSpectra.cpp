@@ -42,6 +42,7 @@
 #include "libraries/operaArgumentHandler.h"
 #include "libraries/operaCommonModuleElements.h"
 #include "libraries/operaSpectralTools.h"
+#include "libraries/operaSpectrumStack.h"
 
 #define MAXNUMBEROFSPECTRUMFILES 1000
 
@@ -182,7 +183,9 @@ int main(int argc, char *argv[])
             if(ordernumber != NOTPROVIDED) cout << "operaStackObjectSpectra: ordernumber = " << ordernumber << endl;
 		}
         
-        operaSpectrum spectrum[MAXNUMBEROFSPECTRUMFILES];
+        operaSpectrumStack stack;
+        double firstInputWavelength = 0;
+        double lastInputWavelength = 0;
         
         double avg_mjdate = 0;
         double avg_HJD_UTC = 0;
@@ -216,7 +219,12 @@ int main(int argc, char *argv[])
             operaIOFormats::ReadIntoSpectralOrders(spectralOrderVector, inputspectra[index]);
             UpdateOrderLimits(ordernumber, minorder, maxorder, spectralOrderVector);
             
-            spectrum[index] = spectralOrderVector.getExtendedSpectrum(minorder,maxorder,spectrumTypeToExtract,applyTelluricWaveCorrection,applyHeliocentricRVCorrection,snrClip,numberOfPointsToCutInOrderEnds,RV_KPS);
+            operaSpectrum spectrum = spectralOrderVector.getExtendedSpectrum(minorder,maxorder,spectrumTypeToExtract,applyTelluricWaveCorrection,applyHeliocentricRVCorrection,snrClip,numberOfPointsToCutInOrderEnds,RV_KPS);
+            if (index == 0) {
+                firstInputWavelength = spectrum.firstwl();
+                lastInputWavelength = spectrum.lastwl();
+            }
+            stack.addSpectrum(spectrum);
         }
         
         avg_mjdate /= (double)np; // average MJD
@@ -228,166 +236,13 @@ int main(int argc, char *argv[])
          *  either one of these quantities are not provided
          */
         if (firstWavelength==0) {
-            firstWavelength = spectrum[0].firstwl();
+            firstWavelength = firstInputWavelength;
         }
         if (lastWavelength==0) {
-            lastWavelength = spectrum[0].lastwl();
+            lastWavelength = lastInputWavelength;
         }
         
-        double wl = firstWavelength;
-        
-        unsigned firsti[MAXNUMBEROFSPECTRUMFILES];
-        for (unsigned index=0; index<inputIndex; index++) {
-            firsti[index] = 0;
-        }
-        
-        float *fluxdata = new float[MAX_ESPADONS_VECTOR_LENGTH];
-        
-        operaSpectrum outspectrum;
-        
-        while (wl<lastWavelength) {
-            double dwl = (RadialVelocityBin * wl)/SPEED_OF_LIGHT_KMS;
-            double wlend = wl + dwl;
-            
-            operaWavelengthRange wlrange(wl,wlend);
-            
-            double flux = 0;
-            double variance = 0;
-            unsigned nin = 0;
-
-            switch (combineMethod) {
-                case 1: // Sum
-                    
-                    for (unsigned index=0; index<inputIndex; index++) {
-                        for (unsigned i=firsti[index]; i<spectrum[index].size(); i++) {
-                            if (spectrum[index].getwavelength(i) < wl) {
-                                continue;
-                            } else {
-                                
-                                if (wlrange.contains(spectrum[index].getwavelength(i))) {
-                                    if (!isnan(spectrum[index].getflux(i))) {
-                                        variance += spectrum[index].getvariance(i);
-                                        flux += spectrum[index].getflux(i);
-                                    }
-                                } else {
-                                    firsti[index] = i;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if (flux) {
-                        double wlc = wl + dwl/2.0;
-                        outspectrum.insert(wlc, flux, variance);
-                    }
-
-                    break;  // end of case 1
-                    
-                case 2: // Mean
-                    
-                    for (unsigned index=0; index<inputIndex; index++) {
-                        for (unsigned i=firsti[index]; i<spectrum[index].size(); i++) {
-                            if (spectrum[index].getwavelength(i) < wl) {
-                                continue;
-                            } else {
-                                if (wlrange.contains(spectrum[index].getwavelength(i))) {
-                                    if (spectrum[index].getflux(i) && !isnan(spectrum[index].getflux(i))) {
-                                        variance += spectrum[index].getvariance(i);
-                                        flux += spectrum[index].getflux(i);
-                                        nin++;
-                                    }
-                                } else {
-                                    firsti[index] = i;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if (nin) {
-                        flux /= (double)nin;
-                        variance /= (double)nin;
-                        double wlc = wl + dwl/2.0;
-                        outspectrum.insert(wlc, flux, variance);
-                    }
-
-                    break;  // end of case 2
-                    
-                case 3: // Median
-                    
-                    for (unsigned index=0; index<inputIndex; index++) {
-                        for (unsigned i=firsti[index]; i<spectrum[index].size(); i++) {
-                            if (spectrum[index].getwavelength(i) < wl) {
-                                continue;
-                            } else {
-                                if (wlrange.contains(spectrum[index].getwavelength(i))) {
-                                    if (spectrum[index].getflux(i) && !isnan(spectrum[index].getflux(i))) {
-                                        fluxdata[nin] = (float)spectrum[index].getflux(i);
-                                        nin++;
-                                    }
-                                } else {
-                                    firsti[index] = i;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if (nin) {
-                        
-                        if (nin > 2) {
-                            flux = (double)operaArrayMedian(nin,fluxdata);
-                            float flux_err = operaArrayMedianSigma(nin, fluxdata, flux);
-                            variance = (double)(flux_err*flux_err);
-                        } else {
-                            flux = (double)operaArrayMean(nin,fluxdata);
-                            float flux_err = operaArraySigma(nin, fluxdata);
-                            variance = (double)(flux_err*flux_err);
-                        }
-
-                        double wlc = wl + dwl/2.0;
-                        outspectrum.insert(wlc, flux, variance);
-                    }
-
-                    
-                    break;  // end of case 3
-                    
-                default: // Weighted Mean
-                    
-                    double weightsum = 0;
-                    for (unsigned index=0; index<inputIndex; index++) {
-                        
-                        for (unsigned i=firsti[index]; i<spectrum[index].size(); i++) {
-                            if (spectrum[index].getwavelength(i) < wl) {
-                                continue;
-                            } else {
-                                if (wlrange.contains(spectrum[index].getwavelength(i))) {
-                                    double weight = 1.0;
-                                    if (spectrum[index].getflux(i) && !isnan(spectrum[index].getflux(i))) {
-                                        if (spectrum[index].getvariance(i)) {
-                                            weight = 1.0/(spectrum[index].getvariance(i))*(spectrum[index].getvariance(i));
-                                            variance += spectrum[index].getvariance(i)*weight;
-                                        }
-                                        flux += spectrum[index].getflux(i)*weight;
-                                        weightsum += weight;
-                                    }
-                                } else {
-                                    firsti[index] = i;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if (weightsum) {
-                        flux /= weightsum;
-                        variance /= weightsum;
-                        double wlc = wl + dwl/2.0;
-                        outspectrum.insert(wlc, flux, variance);
-                    }
-                    
-                    break; // end of Default case
-            } // end of switch
-    
-            wl = wlend;
-        }
+        operaSpectrum outspectrum = stack.stack(firstWavelength, lastWavelength, RadialVelocityBin, (operaStackMethod_t)combineMethod);
         
         /*
          * write output
@@ -49,6 +49,9 @@ using namespace std;
  * operaCreateProduct
  * \author Doug Teeple
  * \brief Bundle files into an i.fits, p.fits, m.fits Product.
+ * \details The Libre-Esprit product is either read from the four u/n/uw/nw text spectra or, with --libreesprit,
+ * written directly from the orders of the extended spectrum (.spc or .pol), one column block at a time.
+ * With --bintable the same columns are also written as a FITS binary table extension.
  * \arg argc
  * \arg argv
  * \throws operaException operaErrorNoInput
@@ -57,33 +60,18 @@ using namespace std;
  * \ingroup core
  */
 
-template <typename T>
-class DataRow {
-private:
-	std::vector<T> data;
-public:
-	unsigned Size() const { return data.size(); }
-	void Insert(const T& element) { data.push_back(element); }
-	const T& operator[](unsigned index) const { return data[index]; }
-};
+typedef std::vector<std::vector<float> > DataColumns;
 
-template <typename T>
-class DataMatrix {
-private:
-	std::vector<DataRow<T> > data;
-public:
-	unsigned Rows() const { return data.size(); }
-	unsigned Cols() const { return data.empty() ? 0 : data[0].Size(); }
-	void Insert(const DataRow<T>& datarow) { data.push_back(datarow); }
-	const DataRow<T>& operator[](unsigned index) const { return data[index]; }
-};
+// Reads in a table from a file, one vector per column, skipping the first skiplines of the file.
+// The number of columns is that of the first row, missing values are NaN.
+void GetColumnsFromDataFile(string filename, DataColumns& columns, unsigned skiplines);
 
-// Reads in a table from a file into matrix, skipping the first skiplines of the file.
-void GetMatrixFromDataFile(string filename, DataMatrix<float>& matrix, unsigned skiplines);
+// Updates the FITS product to contain the values in columns. Starts at coloffset.
+// Product must have at least as many rows as columns and at least coloffset more columns than columns.
+void UpdateProductFromColumns(operaFITSProduct& Product, const DataColumns& columns, unsigned coloffset = 0);
 
-// Updates the FITS product to contain the values in matrix. Starts at coloffset.
-// Product must have at least as many rows as matrix and at least coloffset more columns than matrix.
-void UpdateProductFromMatrix(operaFITSProduct& Product, const DataMatrix<float>& matrix, unsigned coloffset = 0);
+// Sizes the FITS product and fills it with the four Libre-Esprit spectra of spectralOrders, as the n, u, nw and uw files would hold them.
+void UpdateProductFromSpectralOrders(operaFITSProduct& Product, operaSpectralOrderVector& spectralOrders, operaSpectralOrder_t spectralOrderType, bool removePolarContinuum);
 
 void SetHeaderColumnsLE(operaFITSProduct& Product, operaSpectralOrder_t spectralOrderType);
 
@@ -213,6 +201,9 @@ int main(int argc, char *argv[])
 	string object;
 	unsigned spectralOrderType_val = LibreEspritsp2Spectrum;
 	int compressionVal;
+	bool libreesprit = false;
+	bool removePolarContinuum = false;
+	bool bintable = false;
 	args.AddOptionalArgument("version", version, "", "");
 	args.AddOptionalArgument("date", date, "", "");
 	args.AddRequiredArgument("input", inputfilename, "input file (o.fits)");
@@ -229,6 +220,9 @@ int main(int argc, char *argv[])
 	args.AddOptionalArgument("sres", sresfilename, "", ".sres");
 	args.AddOptionalArgument("object", object, "", "object name, needed for Libre-Esprit output");
 	args.AddOptionalArgument("compressiontype", compressionVal, cNone, "compression type");
+	args.AddSwitch("libreesprit", libreesprit, "build the Libre-Esprit product from the spectrumfile orders, without the u/n/uw/nw files");
+	args.AddOptionalArgument("removePolarContinuum", removePolarContinuum, false, "Use continuum polarization removal, with --libreesprit");
+	args.AddSwitch("bintable", bintable, "also write the columns as a FITS binary table extension");
 		
 	try {
 		args.Parse(argc, argv);
@@ -259,6 +253,8 @@ int main(int argc, char *argv[])
 			cout << "operaCreateProduct: Reduction date= " << date << endl;
 			cout << "operaCreateProduct: compression= " << compression << endl;
 			cout << "operaCreateProduct: spectrumtype= " << spectralOrderType << endl;
+			cout << "operaCreateProduct: libreesprit= " << libreesprit << endl;
+			cout << "operaCreateProduct: bintable= " << bintable << endl;
 		}
 		
 		operaFITSProduct Product(outputfilename, 0, 0, compression);
@@ -322,24 +318,32 @@ int main(int argc, char *argv[])
 		if (!ufile.empty() && !nfile.empty() && ! uwfile.empty() && !nwfile.empty()) {
 			string inputfiles[4] = {nfile, ufile, nwfile, uwfile};
 			for(unsigned i = 0; i < 4; i++) {
-				DataMatrix<float> readdata;
-				GetMatrixFromDataFile(inputfiles[i], readdata, 2);
+				DataColumns readdata;
+				GetColumnsFromDataFile(inputfiles[i], readdata, 2);
 				if(i == 0) {
-					Product.resize(readdata.Rows(), readdata.Cols()*4);
+					Product.resize(readdata.empty() ? 0 : readdata[0].size(), readdata.size()*4);
 					SetHeaderColumnsLE(Product, spectralOrderType);
 				}
-				UpdateProductFromMatrix(Product, readdata, readdata.Cols()*i);
+				UpdateProductFromColumns(Product, readdata, readdata.size()*i);
 			}
         }
+        else if (!spectrumfile.empty() && libreesprit) {
+			operaSpectralOrderVector spectralOrders;
+			operaIOFormats::ReadIntoSpectralOrders(spectralOrders, spectrumfile);
+			UpdateProductFromSpectralOrders(Product, spectralOrders, spectralOrderType, removePolarContinuum);
+		}
         else if (!spectrumfile.empty()) {
-			DataMatrix<float> readdata;
-			GetMatrixFromDataFile(spectrumfile, readdata, 1);
-			Product.resize(readdata.Rows(), readdata.Cols());
-			SetHeaderColumnsExtended(Product, spectralOrderType, readdata.Cols());
-			UpdateProductFromMatrix(Product, readdata);
+			DataColumns readdata;
+			GetColumnsFromDataFile(spectrumfile, readdata, 1);
+			Product.resize(readdata.empty() ? 0 : readdata[0].size(), readdata.size());
+			SetHeaderColumnsExtended(Product, spectralOrderType, readdata.size());
+			UpdateProductFromColumns(Product, readdata);
 		}
 		
 		Product.operaFITSImageSave();
+		if (bintable) {
+			Product.AppendBinaryTable();
+		}
 		Product.operaFITSImageClose();
 		
 		if (args.verbose && spectralOrderType == LibreEspritpolarimetry) cout << "operaCreateProduct: done polarimetry " << endl;
@@ -356,18 +360,24 @@ int main(int argc, char *argv[])
     return EXIT_SUCCESS;
 }
 
-void GetMatrixFromDataFile(const string filename, DataMatrix<float>& matrix, const unsigned skiplines) {
+void GetColumnsFromDataFile(const string filename, DataColumns& columns, const unsigned skiplines) {
 	operaistream fin(filename.c_str());
 	if (fin.is_open()) {
 		string dataline;
 		unsigned line = 0;
+		vector<float> values;
 		while (getline(fin, dataline)) {
 			if (!dataline.empty() && dataline[0] != '#') {
 				if (line >= skiplines) {
 					istringstream ss (dataline);
-					DataRow<float> datarow;
-					for (Float NanTolerantFloat = 0.0; ss >> NanTolerantFloat; datarow.Insert(NanTolerantFloat.f));
-					matrix.Insert(datarow);
+					values.clear();
+					for (Float NanTolerantFloat = 0.0; ss >> NanTolerantFloat; values.push_back(NanTolerantFloat.f));
+					if (columns.empty()) {
+						columns.resize(values.size());
+					}
+					for (unsigned col = 0; col < columns.size(); col++) {
+						columns[col].push_back(col < values.size() ? values[col] : NAN);
+					}
 				}
 				line++;
 			}
@@ -376,11 +386,56 @@ void GetMatrixFromDataFile(const string filename, DataMatrix<float>& matrix, con
 	}
 }
 
-void UpdateProductFromMatrix(operaFITSProduct& Product, const DataMatrix<float>& matrix, const unsigned coloffset) {
-	for (unsigned row = 0; row < matrix.Rows(); row++) {
-		for (unsigned col = 0; col < matrix.Cols(); col++) {
-			Product[col+coloffset][row] = matrix[row][col];
+void UpdateProductFromColumns(operaFITSProduct& Product, const DataColumns& columns, const unsigned coloffset) {
+	for (unsigned col = 0; col < columns.size(); col++) {
+		if (!columns[col].empty()) {
+			unsigned rows = columns[col].size() < Product.getnaxis1() ? columns[col].size() : Product.getnaxis1();
+			memcpy(Product[col+coloffset], &columns[col][0], rows*sizeof(float));
+		}
+	}
+}
+
+void UpdateProductFromSpectralOrders(operaFITSProduct& Product, operaSpectralOrderVector& spectralOrders, operaSpectralOrder_t spectralOrderType, bool removePolarContinuum) {
+	// the groups in the order of the nfile, ufile, nwfile and uwfile columns
+	const operaFluxType_t fluxTypes[4] = {NormalizedFluxToContinuum, CalibratedFluxNormalizedToRefWavelength, NormalizedFluxToContinuum, CalibratedFluxNormalizedToRefWavelength};
+	const operaWavelengthType_t wavelengthTypes[4] = {RVAndTelluricCorrectedWavelengthInNM, RVAndTelluricCorrectedWavelengthInNM, RVCorrectedWavelengthInNM, RVCorrectedWavelengthInNM};
+	const unsigned cols = operaIOFormats::LibreEspritColumns(spectralOrderType);
+	if (cols == 0) {
+		throw operaException("operaCreateProduct: ", operaErrorCodeBadInstrumentModeError, __FILE__, __FUNCTION__, __LINE__);
+	}
+	const unsigned minorder = spectralOrders.getMinorder();
+	const unsigned maxorder = spectralOrders.getMaxorder();
+	
+	// the wavelength corrections accumulate, each group starts again from the calibrated wavelengths
+	vector<operaVector> wavelengths(maxorder+1);
+	for (unsigned order = minorder; order <= maxorder; order++) {
+		operaSpectralOrder *spectralOrder = spectralOrders.GetSpectralOrder(order);
+		if (spectralOrder->gethasSpectralElements()) wavelengths[order] = spectralOrder->getSpectralElements()->getWavelength();
+	}
+	
+	// the rows of a group depend on the flux type only, size the product for the longest
+	unsigned maxrows = 0;
+	for (unsigned group = 0; group < 2; group++) {
+		for (unsigned order = minorder; order <= maxorder; order++) {
+			operaIOFormats::SelectLibreEspritFluxAndWavelength(spectralOrders.GetSpectralOrder(order), fluxTypes[group], ThArCalibratedInNM, removePolarContinuum);
+		}
+		unsigned rows = operaIOFormats::LibreEspritRows(spectralOrders, spectralOrderType);
+		if (rows > maxrows) maxrows = rows;
+	}
+	Product.resize(maxrows, cols*4);
+	SetHeaderColumnsLE(Product, spectralOrderType);
+	
+	vector<float *> columns(cols);
+	for (unsigned group = 0; group < 4; group++) {
+		for (unsigned order = minorder; order <= maxorder; order++) {
+			operaSpectralOrder *spectralOrder = spectralOrders.GetSpectralOrder(order);
+			if (spectralOrder->gethasSpectralElements()) spectralOrder->getSpectralElements()->setWavelength(wavelengths[order]);
+			operaIOFormats::SelectLibreEspritFluxAndWavelength(spectralOrder, fluxTypes[group], wavelengthTypes[group], removePolarContinuum);
+		}
+		for (unsigned col = 0; col < cols; col++) {
+			columns[col] = Product[group*cols + col];
 		}
+		operaIOFormats::WriteLibreEspritColumns(spectralOrders, spectralOrderType, &columns[0]);
 	}
 }
 
@@ -41,6 +41,7 @@
 #include "libraries/operaCCD.h"						// for MAXORDERS
 #include "libraries/operaArgumentHandler.h"
 #include "libraries/operaCommonModuleElements.h"
+#include "libraries/operaFITSImageLoader.h"
 
 /*! \file operaExtraction.cpp */
 
@@ -305,40 +306,69 @@ int main(int argc, char *argv[])
         ofstream fdata;
         if (!datafilename.empty()) fdata.open(datafilename.c_str());
         
-        object = new operaFITSImage(inputImage, tfloat, READONLY);
+        /*
+         * Queue the frames, and parse the geometry, aperture and profile while they are read.
+         */
+        operaFITSImageLoader loader;
+        // object and flats are only read through getpixelvalue(), so they are mapped (or read at their native width)
+        operaFITSImageFuture *objectRead = loader.map(inputImage, mapRandom);
+        operaFITSImageFuture *flatRead = masterflat.empty() ? NULL : loader.map(masterflat, mapRandom);
+        operaFITSImageFuture *biasRead = masterbias.empty() ? NULL : loader.load(masterbias, tfloat, READONLY);
+        operaFITSImageFuture *badpixRead = badpixelmask.empty() ? NULL : loader.load(badpixelmask, tfloat, READONLY);
+        operaFITSImageFuture *normalizedflatRead = normalizedflatfile.empty() ? NULL : loader.map(normalizedflatfile, mapRandom);
+        
+        operaFITSImageFuture *reads[5] = {objectRead, flatRead, biasRead, badpixRead, normalizedflatRead};
+        try {
+			operaIOFormats::ReadIntoSpectralOrders(spectralOrders, inputgeom);
+            operaIOFormats::ReadIntoSpectralOrders(spectralOrders, inputaper);
+            operaIOFormats::ReadIntoSpectralOrders(spectralOrders, inputprof);
+        
+            object = objectRead->get();
 		
-        if (!masterflat.empty()){
-            flat = new operaFITSImage(masterflat, tfloat, READONLY);
-        } else {
-            flat = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
-            *flat = 1.0;
-        }
+            if (flatRead){
+                flat = flatRead->get();
+            } else {
+                flat = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
+                *flat = 1.0;
+            }
         
-		if (!masterbias.empty()){
-			bias = new operaFITSImage(masterbias, tfloat, READONLY);
-            *bias = *bias - (float)biasConstantToAdd;
-		} else {
-            bias = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
-            *bias = 0.0;
-        }
+			if (biasRead){
+				bias = biasRead->get();
+                *bias = *bias - (float)biasConstantToAdd;
+			} else {
+                bias = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
+                *bias = 0.0;
+            }
         
-		if (!badpixelmask.empty()){
-			badpix = new operaFITSImage(badpixelmask, tfloat, READONLY);
-		} else {
-            badpix = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
-            *badpix = 1.0;
-        }
+			if (badpixRead){
+				badpix = badpixRead->get();
+			} else {
+                badpix = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
+                *badpix = 1.0;
+            }
         
-		if (!normalizedflatfile.empty()){
-			normalizedflat = new operaFITSImage(normalizedflatfile, tfloat, READONLY);
-		} else {
-            normalizedflat = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
-            *normalizedflat = 1.0;
+			if (normalizedflatRead){
+				normalizedflat = normalizedflatRead->get();
+			} else {
+                normalizedflat = new operaFITSImage(object->getnaxis1(),object->getnaxis2(),tfloat);
+                *normalizedflat = 1.0;
+            }
+        }
+        catch (...) {
+            // wait for the reads still queued, free what they and get() produced, then pass the error on
+            for (unsigned r=0; r<5; r++) {
+                delete reads[r];
+            }
+            delete object; object = NULL;
+            delete flat; flat = NULL;
+            delete bias; bias = NULL;
+            delete badpix; badpix = NULL;
+            delete normalizedflat; normalizedflat = NULL;
+            throw;
+        }
+        for (unsigned r=0; r<5; r++) {
+            delete reads[r];
         }
-
-		operaIOFormats::ReadIntoSpectralOrders(spectralOrders, inputgeom);
-        operaIOFormats::ReadIntoSpectralOrders(spectralOrders, inputaper);
-        operaIOFormats::ReadIntoSpectralOrders(spectralOrders, inputprof);
 
         UpdateOrderLimits(ordernumber, minorder, maxorder, spectralOrders);
 		if (args.verbose) cout << "operaExtraction: minorder ="<< minorder << " maxorder=" << maxorder << endl;
@@ -144,49 +144,7 @@ int main(int argc, char *argv[])
 		}
 
 		for (int order=minorder; order<=maxorder; order++) {
-			operaSpectralOrder *spectralOrder = spectralOrders.GetSpectralOrder(order);
-            
-			if (spectralOrder->gethasSpectralElements()) {
-                operaSpectralElements *spectralElements = spectralOrder->getSpectralElements();
-				
-                if (spectralElements->getHasExtendedBeamFlux()){
-                    switch (fluxType) {
-                        case RawFluxInElectronsPerElement:
-							spectralOrder->CopyRawFluxIntoFluxVector();
-                            break;
-                        case NormalizedFluxToContinuum:
-							spectralOrder->CopyNormalizedFluxIntoFluxVector();
-                            break;
-                        case CalibratedFluxNormalizedToRefWavelength:
-							spectralOrder->CopyFcalFluxIntoFluxVector();
-                            break;
-                        default:
-                            break;
-                    }
-                    switch (wavelengthType) {
-                        case ThArCalibratedInNM:
-                            break;
-                        case TelluricCorrectedWavelengthInNM:
-                            spectralElements->copyFROMtell();
-                            break;
-                        case RVCorrectedWavelengthInNM:
-                            spectralOrder->applyWavelengthCorrectionFromExtendedRvel();
-                            break;
-                        case RVAndTelluricCorrectedWavelengthInNM:
-                            spectralElements->copyFROMtell();
-                            spectralOrder->applyWavelengthCorrectionFromExtendedRvel();
-                            break;
-                        default:
-                            break;
-                    }
-                }
-			}
-			if (spectralOrder->gethasPolarimetry() && removePolarContinuum) {
-				operaPolarimetry *polarimetry = spectralOrder->getPolarimetry();
-				if (polarimetry->getHasContinuumRemoved()) {
-					polarimetry->copyFROMcontinuumremoved();
-				}
-			}
+			operaIOFormats::SelectLibreEspritFluxAndWavelength(spectralOrders.GetSpectralOrder(order), fluxType, wavelengthType, removePolarContinuum);
 		}        
  		// output wavelength/flux calibrated spectrum...
 		spectralOrders.setObject(object);
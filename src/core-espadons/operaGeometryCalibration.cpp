@@ -39,10 +39,13 @@
 #include "libraries/operaIOFormats.h"
 #include "libraries/operaCCD.h"
 #include "libraries/operaFFT.h"
+#include "libraries/operaThreadPool.h"
 #include "libraries/operaArgumentHandler.h"
 #include "libraries/operaCommonModuleElements.h"
+#include "libraries/operaStats.h"
 
 #define MINIMUMORDERTOCONSIDER 15
+#define ROWBIN_TILE_COLUMNS 64	// columns of a row sample transposed at a time
 
 /*! \file operaGeometryCalibration.cpp */
 
@@ -85,6 +88,44 @@ unsigned getRowBinnedData(operaFITSImage& flat,unsigned x1,unsigned x2,unsigned
 
 unsigned geometryDetectOrders(unsigned np,float *fx,float *fy,unsigned uslit,float *ipfunc, unsigned binsize, float noise,float gain,float *xmean,float *ymean,float *xmeanerr,int detectionMethod, bool witherrors, bool graces);
 
+/*
+ * The binned cut of one row sample and the orders detected in it.
+ */
+class rowSample {
+public:
+	bool used;
+	unsigned firstY;
+	unsigned lastY;
+	unsigned np;
+	unsigned nords;
+	float ypos;
+	float *fx;
+	float *fy;
+	float xmean[MAXORDERS];
+	float ymean[MAXORDERS];
+	float xmeanerr[MAXORDERS];
+};
+
+/*
+ * Everything needed to bin and search the row samples, shared by the pool tasks.
+ */
+class rowSampleSet {
+public:
+	operaFITSImage *flat;
+	unsigned x1, nx, ny;
+	unsigned uslit;
+	float *ipfunc;
+	unsigned binsize;
+	float noise, gain;
+	int detectionMethod;
+	bool witherrors, graces;
+	rowSample *samples;
+};
+
+void binRowSample(unsigned long k, void *context);
+
+void detectRowSampleOrders(unsigned long k, void *context);
+
 int main(int argc, char *argv[])
 {
 	operaArgumentHandler args;
@@ -315,9 +356,6 @@ int main(int argc, char *argv[])
         if(args.debug) for (unsigned i=0;i<nrefs;i++) cout << AbsRefOrdNumber[i] << " " << xref[i] << " " << yref[i] << " " << xreferr[i] << endl;
         
         // Allocate memory to save data obtained from samples
-        float *fx = new float[nx];
-        float *fy = new float[ny];
-        
         float *xord_tmp = new float[MAXORDERS];
         float *yord_tmp = new float[MAXORDERS];
         float *xerrord_tmp = new float[MAXORDERS];
@@ -348,6 +386,49 @@ int main(int argc, char *argv[])
         // Figure out which bin contains the reference order
         unsigned kref = (unsigned)round(float(referenceOrderSamplePosition - y1)/(float)NumberofPointsToBinInYDirection);
         
+        /*
+         * Binning a sample and detecting its orders does not depend on the other samples,
+         * so it is done for all the samples used below at once, on the thread pool.
+         * Only the FFT filter runs serially, as fftw planning is not thread safe.
+         */
+        rowSample *samples = new rowSample[NumberOfySamples];
+        for(unsigned k=0;k<NumberOfySamples;k++){
+            samples[k].firstY = y1 + NumberofPointsToBinInYDirection*(k);
+            samples[k].lastY =  y1 + NumberofPointsToBinInYDirection*(k+1);
+            samples[k].used = samples[k].lastY < ny && (k >= kref || k > 0);
+            samples[k].np = samples[k].nords = 0;
+            samples[k].ypos = 0;
+            samples[k].fx = samples[k].used ? new float[nx] : NULL;
+            samples[k].fy = samples[k].used ? new float[nx] : NULL;
+        }
+        rowSampleSet sampleSet;
+        sampleSet.flat = &flat;
+        sampleSet.x1 = x1;
+        sampleSet.nx = nx;
+        sampleSet.ny = ny;
+        sampleSet.uslit = (unsigned)slit;
+        sampleSet.ipfunc = ipfunc;
+        sampleSet.binsize = binsize;
+        sampleSet.noise = (float)noise;
+        sampleSet.gain = (float)gain;
+        sampleSet.detectionMethod = detectionMethod;
+        sampleSet.witherrors = witherrors;
+        sampleSet.graces = graces;
+        sampleSet.samples = samples;
+        
+        operaThreadPool::getSharedPool().parallelFor(NumberOfySamples, binRowSample, (void *)&sampleSet);
+        if(FFTfilter) {
+            float *fytmp = new float[nx];
+            for(unsigned k=0;k<NumberOfySamples;k++){
+                if(samples[k].used) {
+                    memcpy(fytmp, samples[k].fy, sizeof(float)*samples[k].np);
+                    operaFFTLowPass(samples[k].np,fytmp,samples[k].fy,0.1);
+                }
+            }
+            delete[] fytmp;
+        }
+        operaThreadPool::getSharedPool().parallelFor(NumberOfySamples, detectRowSampleOrders, (void *)&sampleSet);
+        
         // Start detecting orders in samples ABOVE reference row
         for (unsigned i=0;i<nrefs;i++) {
             xord_tmp[i] = xref[i];
@@ -356,14 +437,12 @@ int main(int argc, char *argv[])
             AbsOrdNumber_tmp[i] = AbsRefOrdNumber[i];
         }
         for(unsigned k=kref;k<NumberOfySamples;k++){
-            unsigned firstY = y1 + NumberofPointsToBinInYDirection*(k);
             unsigned lastY =  y1 + NumberofPointsToBinInYDirection*(k+1);
             if(lastY >= ny) break;
             
-            unsigned np = getRowBinnedData(flat,x1,nx,nx,firstY,lastY,ny,fx,fy,&ypos[k],FFTfilter);
-            unsigned nords = geometryDetectOrders(np,fx,fy,slit,ipfunc,binsize,(float)noise,(float)gain,xmean,ymean,xmeanerr,detectionMethod, witherrors, graces);
-            
-            newnords[k] = operaCCDDetectMissingOrdersUsingNearMap(np,fx,fy,uslit,ipfunc,ipx,slit,(float)noise,(float)gain,npars,par,nords,xmean,ymean,xmeanerr,nrefs,xord_tmp,yord_tmp,AbsOrdNumber_tmp,xords[k],yords[k],xerrords[k],AbsOrdNumbers[k]);
+            rowSample &sample = samples[k];
+            ypos[k] = sample.ypos;
+            newnords[k] = operaCCDDetectMissingOrdersUsingNearMap(sample.np,sample.fx,sample.fy,uslit,ipfunc,ipx,slit,(float)noise,(float)gain,npars,par,sample.nords,sample.xmean,sample.ymean,sample.xmeanerr,nrefs,xord_tmp,yord_tmp,AbsOrdNumber_tmp,xords[k],yords[k],xerrords[k],AbsOrdNumbers[k]);
             
             if(args.debug) {
                 for (unsigned i=0;i<newnords[k];i++) {
@@ -387,15 +466,13 @@ int main(int argc, char *argv[])
             xerrord_tmp[i] = xreferr[i];
             AbsOrdNumber_tmp[i] = AbsRefOrdNumber[i];
         }
-        for(unsigned k=kref-1;k>0;k--){
-            unsigned firstY = y1 + NumberofPointsToBinInYDirection*(k);
+        for(unsigned k=kref-1;k>0 && k<NumberOfySamples;k--){
             unsigned lastY =  y1 + NumberofPointsToBinInYDirection*(k+1);
             if(lastY >= ny) break;
             
-            unsigned np = getRowBinnedData(flat,x1,nx,nx,firstY,lastY,ny,fx,fy,&ypos[k],FFTfilter);
-            unsigned nords = geometryDetectOrders(np,fx,fy,slit,ipfunc,binsize,(float)noise,(float)gain,xmean,ymean,xmeanerr,detectionMethod, witherrors, graces);
-        
-            newnords[k] = operaCCDDetectMissingOrdersUsingNearMap(np,fx,fy,uslit,ipfunc,ipx,slit,(float)noise,(float)gain,npars,par,nords,xmean,ymean,xmeanerr,nrefs,xord_tmp,yord_tmp,AbsOrdNumber_tmp,xords[k],yords[k],xerrords[k],AbsOrdNumbers[k]);
+            rowSample &sample = samples[k];
+            ypos[k] = sample.ypos;
+            newnords[k] = operaCCDDetectMissingOrdersUsingNearMap(sample.np,sample.fx,sample.fy,uslit,ipfunc,ipx,slit,(float)noise,(float)gain,npars,par,sample.nords,sample.xmean,sample.ymean,sample.xmeanerr,nrefs,xord_tmp,yord_tmp,AbsOrdNumber_tmp,xords[k],yords[k],xerrords[k],AbsOrdNumbers[k]);
             
             // Save current sample in the tmp to be used in the next loop around
             for (unsigned i=0;i<nrefs;i++) {
@@ -498,8 +575,11 @@ int main(int argc, char *argv[])
         delete[] yref;
         delete[] xreferr;
         delete[] AbsRefOrdNumber;
-        delete[] fx;
-        delete[] fy;
+        for(unsigned k=0;k<NumberOfySamples;k++){
+            delete[] samples[k].fx;
+            delete[] samples[k].fy;
+        }
+        delete[] samples;
 		delete[] xord_tmp;
         delete[] yord_tmp;
         delete[] xerrord_tmp;
@@ -610,48 +690,54 @@ float calculatePhotoCenter(unsigned np, float *ipx, float *ipfunc, float *iperr,
 }
 
 
+/*
+ * Median-bin rows y1 to y2 of columns x1 to x2. The rows are read ROWBIN_TILE_COLUMNS columns at a time into a
+ * transposed tile, so the image is read along its rows and each column median is taken in place, on contiguous
+ * memory, without a copy.
+ */
 unsigned getRowBinnedData(operaFITSImage& flat,unsigned x1,unsigned x2,unsigned nx,unsigned y1,unsigned y2,unsigned ny,float *fx,float *fy,float *yout, bool FFTfilter) {
     
-    unsigned ybinsize = (unsigned)fabs(y2 - y1);
+    unsigned ybinsize = y2 - y1;
+    
+    float *tile = new float[ROWBIN_TILE_COLUMNS*ybinsize];
+    float *fytmp = FFTfilter ? new float[x2 > x1 ? x2 - x1 : 1] : NULL;
+    float *fybin = FFTfilter ? fytmp : fy;
+    
+    float ysample=0.0;
+    for (unsigned yy=y1; yy<y2 ; yy++) {
+        ysample += (float)yy + 0.5;
+    }
+    ysample /= (float)ybinsize;
     
-    float *fytmp = new float[ny];
-    float *fysample = new float[ybinsize];
-
     unsigned np = 0;
     
-    for (unsigned xx=x1; xx<x2; xx++) {
-        unsigned ns=0;
-        float ysample=0.0;
-        
+    for (unsigned xstart=x1; xstart<x2; xstart+=ROWBIN_TILE_COLUMNS) {
+        unsigned ncols = x2 - xstart < ROWBIN_TILE_COLUMNS ? x2 - xstart : ROWBIN_TILE_COLUMNS;
         for (unsigned yy=y1; yy<y2 ; yy++) {
-            fysample[ns++] = flat[yy][xx];
-            ysample += (float)yy + 0.5;
-        }
-        ysample /= (float)ns;
-        fx[np] = (float)xx + 0.5;
-        
-        if(FFTfilter){
-            fytmp[np] = operaArrayMedian(ns,fysample);
-        } else {
-            fy[np] = operaArrayMedian(ns,fysample);
+            const float *row = flat[yy] + xstart;
+            float *column = tile + (yy - y1);
+            for (unsigned c=0; c<ncols; c++) {
+                column[c*ybinsize] = row[c];
+            }
         }
-        
+        for (unsigned c=0; c<ncols; c++) {
+            fx[np] = (float)(xstart + c) + 0.5;
+            fybin[np] = operaArrayMedianQuick(ybinsize, tile + c*ybinsize);
 #ifdef PRINT_DEBUG
-        if(FFTfilter){
-            cout << fx[np]  << " " << fytmp[np] << endl;
-        } else {
-            cout << fx[np]  << " " << fy[np] << endl;
-        }
+            cout << fx[np]  << " " << fybin[np] << endl;
 #endif
+            np++;
+        }
+    }
+    if (np) {
         *yout = ysample;
-        np++;
     }
     
     if(FFTfilter){
         operaFFTLowPass(np,fytmp,fy,0.1);
     }
     
-    delete[] fysample;
+    delete[] tile;
     delete[] fytmp;
     
     return np;
@@ -700,3 +786,25 @@ unsigned geometryDetectOrders(unsigned np,float *fx,float *fy,unsigned uslit,flo
 #endif
     return nords;
 }
+
+/*
+ * Median-bin the rows of sample k, unfiltered.
+ */
+void binRowSample(unsigned long k, void *context) {
+    rowSampleSet *set = (rowSampleSet *)context;
+    rowSample &sample = set->samples[k];
+    if (sample.used) {
+        sample.np = getRowBinnedData(*set->flat,set->x1,set->nx,set->nx,sample.firstY,sample.lastY,set->ny,sample.fx,sample.fy,&sample.ypos,false);
+    }
+}
+
+/*
+ * Detect the orders in the binned cut of sample k.
+ */
+void detectRowSampleOrders(unsigned long k, void *context) {
+    rowSampleSet *set = (rowSampleSet *)context;
+    rowSample &sample = set->samples[k];
+    if (sample.used) {
+        sample.nords = geometryDetectOrders(sample.np,sample.fx,sample.fy,set->uslit,set->ipfunc,set->binsize,set->noise,set->gain,sample.xmean,sample.ymean,sample.xmeanerr,set->detectionMethod,set->witherrors,set->graces);
+    }
+}
@@ -293,16 +293,16 @@ int main(int argc, char *argv[])
 				throw operaException("operaReductionSet: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);	
 			}
 			snprintf(qualiopt_headerkey[i],strlen(qualiopts[i])+11,"%s_HEADERKEY",qualiopts[i]);
-			errorcode = operaConfigurationAccessGet(qualiopt_headerkey[i], &qualioptkeys[i]);
-			if (errorcode) {
-				throw operaException("operaReductionSet: ", operaErrorReductionSetQualiKeyNotDefined, __FILE__, __FUNCTION__, __LINE__);	
-			}	
 		}
+		errorcode = operaConfigurationAccessGetValues((const char **)qualiopt_headerkey, qualioptkeys, nqualiopts);
+		if (errorcode) {
+			throw operaException("operaReductionSet: ", operaErrorReductionSetQualiKeyNotDefined, __FILE__, __FUNCTION__, __LINE__);	
+		}	
 		
 		// search default selected choice for each qualifier option	
 		char *qualioptchoice_default[MAXCONFIGVALUES];
+		errorcode = operaConfigurationAccessGetValues((const char **)qualiopts, qualioptchoice_default, nqualiopts);	
 		for (i=0;i<nqualiopts;i++) {		
-			errorcode = operaConfigurationAccessGet(qualiopts[i], &qualioptchoice_default[i]);	
 			if (qualioptchoice_default[i] == NULL) {
 				if (verbose)
 					cout << "operaReductionSet: Warning: could not find default value for qualifier: "<< qualiopts[i] << "\n";
@@ -343,11 +343,11 @@ int main(int argc, char *argv[])
 				throw operaException("operaReductionSet: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);	
 			}
 			snprintf(qualioptchoice_headervalue[i],strlen(qualioptchoice[i])+13,"%s_HEADERVALUE",qualioptchoice[i]);		
-			errorcode = operaConfigurationAccessGet(qualioptchoice_headervalue[i],&qualioptchoice_value[i]);
-			if (errorcode) {
-				throw operaException("operaReductionSet: ", operaErrorReductionSetQualiValNotDefined, __FILE__, __FUNCTION__, __LINE__);	
-			}		
 		}	 
+		errorcode = operaConfigurationAccessGetValues((const char **)qualioptchoice_headervalue, qualioptchoice_value, nqualiopts);
+		if (errorcode) {
+			throw operaException("operaReductionSet: ", operaErrorReductionSetQualiValNotDefined, __FILE__, __FUNCTION__, __LINE__);	
+		}		
 #ifdef PRINT_DEBUG    
 		if (debug) {
 			for (i=0;i<nqualiopts;i++) {
@@ -40,6 +40,8 @@
 #include "libraries/operaIOFormats.h"
 #include "libraries/operaSpectralFeature.h"
 #include "libraries/operaSpectralTools.h"
+#include "libraries/operaLineDatabase.h"				// for operaLineDatabase
+#include "libraries/operaTelluricTransmission.h"		// for operaTelluricTransmission
 #include "libraries/operaStats.h"
 #include "libraries/operaCCD.h"							// for MAXORDERS
 #include "libraries/operaFit.h"							// for operaFitSplineDouble
@@ -339,6 +341,8 @@ int main(int argc, char *argv[])
                 
                 // Get the object spectrum within telluric regions defined in inputWavelengthMaskForTelluric (used for method 2)
 				operaSpectrum objectSpectrum = spectralOrders.getSpectrumWithinTelluricMask(inputWavelengthMaskForTelluric, minorder, maxorder, true, normalizationBinsize);
+				// one engine for the line list, so the plot and every velocity step share its rasters
+				operaTelluricTransmission telluricTransmission(telluricLines);
 				if(args.debug){
 					for (unsigned l=0; l<objectSpectrum.size(); l++) {
 						cout << objectSpectrum.getwavelength(l) << " " << objectSpectrum.getflux(l) << " " << objectSpectrum.getvariance(l) << endl;
@@ -348,7 +352,7 @@ int main(int argc, char *argv[])
 				// Spectrum plot: plot observed and reference telluric spectra.
 				if (!specdatafilename.empty()) {
 					//Use HITRAN lines to generate synthetic spectrum sampled to the same points as the object spectrum
-					operaVector hitranTelluricSpectrum = generateSyntheticTelluricSpectrumUsingLineProfile(telluricLines, objectSpectrum.wavelengthvector(), spectralResolution, GAUSSIAN);
+					operaVector hitranTelluricSpectrum = generateSyntheticTelluricSpectrumUsingLineProfile(telluricLines, telluricTransmission, objectSpectrum.wavelengthvector(), spectralResolution, GAUSSIAN);
 					
 					ofstream fspecdata(specdatafilename.c_str());
 					for(unsigned i=0; i<objectSpectrum.size(); i++) fspecdata << objectSpectrum.getwavelength(i) << " " << objectSpectrum.getflux(i) << " " << hitranTelluricSpectrum[i] << endl;
@@ -362,7 +366,7 @@ int main(int argc, char *argv[])
                 if (args.verbose) cout << "operaTelluricWavelengthCorrection: calculating cross-correlation for radialVelocityRange=" << radialVelocityRange << " km/s and radialVelocityStep=" << radialVelocityStep << " km/s" << endl;
                 double maxcorr=-BIG, chisqr=0;
                 
-                bool validXCorrelation = calculateRVShiftByXCorr(telluricLines, objectSpectrum, radialVelocityRange, radialVelocityStep, XCorrelationThreshold, rvshift, rvshifterror, maxcorr, frvcorrdata, frvcorrfitdata, spectralResolution, useFitToFindMaximum, chisqr);
+                bool validXCorrelation = calculateRVShiftByXCorr(telluricTransmission, objectSpectrum, radialVelocityRange, radialVelocityStep, XCorrelationThreshold, rvshift, rvshifterror, maxcorr, frvcorrdata, frvcorrfitdata, spectralResolution, useFitToFindMaximum, chisqr);
                 
                 if(!validXCorrelation) {
                     rvshift = 0;
@@ -659,27 +663,11 @@ void GenerateTelluricSpecPlot(string gnuScriptFileName, string outputPlotEPSFile
     if(!outputPlotEPSFileName.empty()) systemf("gnuplot %s",gnuScriptFileName.c_str());
 }
 
+// Read the entire set of telluric lines in HITRAN database, through its prebuilt line database when there is one
 operaSpectrum readTelluricLinesHITRAN(string telluric_database_file)
 {
-	const double N_OVER_V = TYPICAL_PRESSURE_AT_MAUNAKEA/(TYPICAL_TEMPERATURE_AT_MAUNAKEA*k_BOLTZMANN_CONSTANT);
-	
-    operaSpectrum telluricLines;
-    igzstream astream(telluric_database_file.c_str());
-	if (astream.is_open()) {
-		string dataline;
-		while (getline(astream, dataline)) {
-			if (!dataline.empty() && dataline[0] != '#') { // skip blank lines and comments
-				double wave_number;
-				float intensity;
-				if(!sscanf(dataline.c_str(), "%*d %lf %G %*[^\n]", &wave_number, &intensity)) continue; //skip over bad line
-				//if (intensity < 1.15e-26) continue; //skip over lines below a certain threshold
-				double wavelength_in_nm = 1e7/wave_number;
-				telluricLines.insert(convertVacuumToAirWavelength(wavelength_in_nm*10)/10, ((double)intensity/(N_OVER_V*1e-6))/TYPICAL_ATMOSPHERE_PATH_LENGTH);
-			}
-		}
-		astream.close();
-	}
-	telluricLines.reverse();
+	operaLineDatabase telluricDatabase(telluric_database_file, LineFormatHITRAN);
+	operaSpectrum telluricLines = telluricDatabase.getSpectrum();
     if (args.verbose) {
 		if (telluricLines.empty()) printf("          [Telluric] no lines found in telluric database.\n");
 		else printf("          [Telluric] %d lines found wl0=%.2f wlc=%.2f wlf=%.2f\n", telluricLines.size(), telluricLines.firstwl(), telluricLines.midwl(), telluricLines.lastwl());
@@ -687,23 +675,11 @@ operaSpectrum readTelluricLinesHITRAN(string telluric_database_file)
 	return telluricLines;
 }
 
-// Read the entire set of telluric lines in HITRAN database
+// Read the entire set of telluric lines in a wavelength, intensity list
 operaSpectrum readTelluricLinesRaw(string telluric_database_file)
 {
-	operaSpectrum telluricLines;
-    igzstream astream(telluric_database_file.c_str());
-	if (astream.is_open()) {
-		string dataline;
-		while (getline(astream, dataline)) {
-			if (!dataline.empty() && dataline[0] != '#') { // skip blank lines and comments
-				double wavelength, intensity;
-				istringstream ss(dataline);
-				ss >> wavelength >> intensity;
-				telluricLines.insert(wavelength, intensity);
-			}
-		}
-		astream.close();
-	}
+	operaLineDatabase telluricDatabase(telluric_database_file, LineFormatRaw);
+	operaSpectrum telluricLines = telluricDatabase.getSpectrum();
     if (args.verbose) {
 		if (telluricLines.empty()) printf("          [Telluric] no lines found in telluric database.\n");
 		else printf("          [Telluric] %d lines found wl0=%.2f wlc=%.2f wlf=%.2f\n", telluricLines.size(), telluricLines.firstwl(), telluricLines.midwl(), telluricLines.lastwl());
@@ -711,22 +687,13 @@ operaSpectrum readTelluricLinesRaw(string telluric_database_file)
 	return telluricLines;
 }
 
-// Finds the first and last index between wl0 and wlf. Assumes wavelength vector is in increasing order.
-void getWavelengthSubrange(const operaVector& wavelength, double wl0, double wlf, unsigned& startindex, unsigned& endindex)
-{
-    endindex = startindex = 0;
-    operaWavelengthRange wlrange(wl0, wlf);
-	for (unsigned i = 0; i < wavelength.size(); i++) {
-		if (wlrange.contains(wavelength[i])) {
-			if (endindex == 0) endindex = startindex = i;
-			endindex++;
-		}
-	}
-}
-
 // Generates a spectrum along the points in wavelengthVector by using a Gaussian profile to fit telluricLines.
-operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, const operaVector& wavelengthVector, double resolution, ProfileMethod profile)
+// A Gaussian profile comes from telluricTransmission, the caller's engine for telluricLines, which keeps its rasters between calls.
+operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectrum& telluricLines, operaTelluricTransmission& telluricTransmission, const operaVector& wavelengthVector, double resolution, ProfileMethod profile)
 {
+	if (profile == GAUSSIAN) {
+		return telluricTransmission.getTransmission(wavelengthVector, resolution);
+	}
 	operaVector outputSpectrum(wavelengthVector.size());
 	outputSpectrum.fill(1.0); //Initialize outputSpectrum to uniform 1.0
 	for(unsigned i=0; i<wavelengthVector.size(); i++) {
@@ -750,7 +717,7 @@ operaVector generateSyntheticTelluricSpectrumUsingLineProfile(const operaSpectru
 	return outputSpectrum;
 }
 
-bool calculateRVShiftByXCorr(const operaSpectrum& telluricLines, const operaSpectrum& objectSpectrum, double radialVelocityRange, double radialVelocityStep, double threshold, double& maxRV, double& sigRV, double& maxcorr, ofstream& frvcorrdata, ofstream& frvcorrfitdata, double spectralResolution, bool useFitToFindMaximum, double& chisqr)
+bool calculateRVShiftByXCorr(operaTelluricTransmission& telluricTransmission, const operaSpectrum& objectSpectrum, double radialVelocityRange, double radialVelocityStep, double threshold, double& maxRV, double& sigRV, double& maxcorr, ofstream& frvcorrdata, ofstream& frvcorrfitdata, double spectralResolution, bool useFitToFindMaximum, double& chisqr)
 {
     int jmax = -1;
 	maxcorr = 0;
@@ -771,8 +738,8 @@ bool calculateRVShiftByXCorr(const operaSpectrum& telluricLines, const operaSpec
             double DWavelength = deltaRV * objectSpectrum.getwavelength(i) / SPEED_OF_LIGHT_KMS;
             telluricSpectrumWavelength.insert(objectSpectrum.getwavelength(i) + DWavelength);
         }
-        // Generate a spectrum in telluricSpectrum along points in wavelength vector using the provided telluricLines
-        operaVector telluricSpectrumFlux = generateSyntheticTelluricSpectrumUsingLineProfile(telluricLines, telluricSpectrumWavelength, spectralResolution, GAUSSIAN);
+        // Generate a spectrum in telluricSpectrum along points in wavelength vector, from the rasters telluricTransmission already holds
+        operaVector telluricSpectrumFlux = telluricTransmission.getTransmission(telluricSpectrumWavelength, spectralResolution);
         
         // Calculate the x-corr between the generated shifted telluric spectrum and the object spectrum
         double xcorr = operaCrossCorrelation(telluricSpectrumFlux.size(), objectSpectrum.flux_ptr(), telluricSpectrumFlux.datapointer());
@@ -39,6 +39,7 @@
 #include "libraries/operaIOFormats.h"
 #include "libraries/operaSpectralFeature.h"
 #include "libraries/operaSpectralTools.h"
+#include "libraries/operaLineDatabase.h"				// for operaLineDatabase
 #include "libraries/operaCCD.h"							// for MAXORDERS
 #include "libraries/gzstream.h"							// for gzstream - read compressed reference spectra
 #include "libraries/operaArgumentHandler.h"
@@ -474,54 +475,25 @@ int main(int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
-// Read the entire thorium argon atlas and normalize the results
+// Read the entire thorium argon atlas and normalize the results, through its prebuilt line database when there is one
 operaSpectralLineList readThoriumArgonAtlas(string atlas_lines) {
-	operaSpectralLineList tharAtlas;
-	igzstream astream(atlas_lines.c_str());
-	if (astream.is_open()) {
-		string dataline;
-		while (getline(astream, dataline)) {
-			if (!dataline.empty() && dataline[0] != '#') {
-				istringstream ss(dataline);
-				double wn, wl, intensity;
-				string marker;
-				ss >> wn >> wl >> intensity >> marker;
-				if (marker == "Th" || marker == "Ar") {
-					tharAtlas.center.insert(wl * 0.1);
-					tharAtlas.amplitude.insert(pow(10, intensity));
-				} else {
-					if (args.debug) printf("Skipping non-thorium-argon atlas entry %s.\n", marker.c_str());
-				}
-			}
-		}
-		unsigned lines = tharAtlas.size();
-		if (args.verbose) {
-			if (lines > 0) printf("          [Atlas] %d lines found wl0=%.2f wlc=%.2f wlf=%.2f\n", lines, tharAtlas.center[0], tharAtlas.center[lines / 2], tharAtlas.center[lines - 1]);
-			else printf("          [Atlas] no lines found in atlas.\n");
-		}
-		astream.close();
+	operaLineDatabase atlasDatabase(atlas_lines, LineFormatThAr);
+	operaSpectralLineList tharAtlas = atlasDatabase.getLineList();
+	unsigned lines = tharAtlas.size();
+	if (args.verbose) {
+		if (lines > 0) printf("          [Atlas] %d lines found wl0=%.2f wlc=%.2f wlf=%.2f\n", lines, tharAtlas.center[0], tharAtlas.center[lines / 2], tharAtlas.center[lines - 1]);
+		else printf("          [Atlas] no lines found in atlas.\n");
 	}
 	return tharAtlas;
 }
 
-// Read the the full atlas spectrum
+// Read the the full atlas spectrum, through its prebuilt line database when there is one
 operaSpectrum readAtlasSpectrum(string atlas_spectrum) {
-	operaSpectrum atlasSpectrum;
-	igzstream astream(atlas_spectrum.c_str());
-	if (astream.is_open()) {
-		string dataline;
-		while (getline(astream, dataline)) {
-			if (!dataline.empty() && dataline[0] != '#') {
-				double tmpwl, tmpi, tmpvar, tmp1, tmp2;
-				sscanf(dataline.c_str(), "%lf %lf %lf %lf %lf", &tmpwl, &tmpi, &tmp1, &tmp2, &tmpvar);
-				atlasSpectrum.insert(0.1*tmpwl, tmpi, tmpvar);
-            }
-		}
-		if (args.verbose) {
-			if(atlasSpectrum.size() > 0) printf("          [Atlas] %d points found wl0=%.2f wlc=%.2f wlf=%.2f\n", atlasSpectrum.size(), atlasSpectrum.firstwl(), atlasSpectrum.midwl(), atlasSpectrum.lastwl());
-			else printf("          [Atlas] no points found in atlas.\n");
-		}
-		astream.close();
+	operaLineDatabase atlasDatabase(atlas_spectrum, LineFormatAtlasSpectrum);
+	operaSpectrum atlasSpectrum = atlasDatabase.getSpectrum();
+	if (args.verbose) {
+		if(atlasSpectrum.size() > 0) printf("          [Atlas] %d points found wl0=%.2f wlc=%.2f wlf=%.2f\n", atlasSpectrum.size(), atlasSpectrum.firstwl(), atlasSpectrum.midwl(), atlasSpectrum.lastwl());
+		else printf("          [Atlas] no points found in atlas.\n");
 	}
 	return atlasSpectrum;
 }
@@ -750,7 +722,7 @@ operaSpectralLineList WavelengthCalibration::GetLinesFromUncalSpectrum(Detection
 
 operaSpectralLineList WavelengthCalibration::GetAtlasLinesInRange(operaWavelengthRange wlrange, double rawLineWidth) {
 	if (args.verbose) cout << "operaWavelengthCalibration: using atlas lines " << endl;
-	operaSpectralLineList atlasLines = getSpectrumWithinRange(wlrange, atlasLinesFull);
+	operaSpectralLineList atlasLines = getSortedSpectrumWithinRange(wlrange, atlasLinesFull);
 	atlasLines.centerError = wavelength->convertPixelToWavelength(rawLineWidth);
 	return atlasLines;
 }
@@ -795,7 +767,7 @@ void WavelengthCalibration::SetAtlasLines(const operaSpectralLineList& atlasLine
 }
 
 operaSpectralLineList WavelengthCalibration::DetectAtlasLines(operaWavelengthRange wlrange, DetectionParameters detection) {
-	operaSpectrum atlasRegion = getSpectrumWithinRange(wlrange, atlasSpectrumFull);
+	operaSpectrum atlasRegion = getSortedSpectrumWithinRange(wlrange, atlasSpectrumFull);
 
 	WritePlotAtlasData(atlasRegion);
 
@@ -45,6 +45,7 @@
 #include "libraries/operaLibCommon.h"
 #include "libraries/operaFit.h"
 #include "libraries/mpfit.h"
+#include "libraries/operaGaussianFit.h"
 #include "libraries/operaLib.h"     // for itos
 
 /*
@@ -473,6 +474,37 @@ void Gaussian::MPFitModeltoData(unsigned nPeaks, unsigned NumberOfDataPoints, do
 		throw operaException("Gaussian: invalid DOF (npars="+itos(npar)+") >= (nDataPoints="+itos(NumberOfDataPoints)+").",operaErrorCodeNOTIMPLEMENTED, __FILE__, __FUNCTION__, __LINE__);
     }
     
+    // small features go through the analytic-derivative fitter, same passes and constraints as below
+    if (getNumberOfPeaks() <= MAXGAUSSFITPEAKS) {
+        operaGaussianFitProblem problem;
+        problem.setData(NumberOfDataPoints, Xdata, Ydata, Yerrors);
+        for(unsigned i=0;i<getNumberOfPeaks();i++) {
+            problem.setPeak(i, amplitudeVector[i], centerVector[i], sigmaVector[i]);
+            problem.epar[0+i*3] = amplitudeErrors[i];
+            problem.epar[1+i*3] = centerErrors[i];
+            problem.epar[2+i*3] = sigmaErrors[i];
+            problem.fixed[1+i*3] = true;            // keep center fixed for the 1st fit
+            problem.lowerLimited[2+i*3] = true;     // force positive sigma
+            problem.lowerLimit[2+i*3] = 0.0;
+        }
+        operaGaussianFitLM(problem);
+        for(unsigned i=0;i<getNumberOfPeaks();i++) {
+            problem.fixed[1+i*3] = false;           // free center for 2nd fit
+        }
+        operaGaussianFitLM(problem);
+        for(unsigned i=0;i<getNumberOfPeaks();i++) {
+            amplitudeVector[i] = problem.par[0+i*3];
+            centerVector[i] = problem.par[1+i*3];
+            sigmaVector[i] = problem.par[2+i*3];
+            
+            amplitudeErrors[i] = problem.epar[0+i*3];
+            centerErrors[i] = problem.epar[1+i*3];
+            sigmaErrors[i] = problem.epar[2+i*3];
+        }
+        gausschisqr = problem.chisqr;
+        return;
+    }
+    
 	double *par = (double*) malloc(npar * sizeof(double));
     double *epar = (double*) malloc(npar * sizeof(double));	
     
@@ -572,6 +604,50 @@ void Gaussian::MPFitModeltoData(unsigned nPeaks, double BaselineIntercept, doubl
 		throw operaException("Gaussian: invalid DOF (npars="+itos(npar)+") >= (nDataPoints="+itos(NumberOfDataPoints)+").",operaErrorCodeNOTIMPLEMENTED, __FILE__, __FUNCTION__, __LINE__);
     }
     
+    // small features go through the analytic-derivative fitter, same passes and constraints as below
+    if (getNumberOfPeaks() <= MAXGAUSSFITPEAKS) {
+        operaGaussianFitProblem problem;
+        problem.setData(NumberOfDataPoints, Xdata, Ydata, Yerrors);
+        for(unsigned i=0;i<getNumberOfPeaks();i++) {
+            problem.setPeak(i, amplitudeVector[i], centerVector[i], sigmaVector[i]);
+            problem.epar[0+i*3] = amplitudeErrors[i];
+            problem.epar[1+i*3] = centerErrors[i];
+            problem.epar[2+i*3] = sigmaErrors[i];
+            // keep centers, sigma and amplitudes fixed for the 1st fit
+            problem.fixed[0+i*3] = problem.fixed[1+i*3] = problem.fixed[2+i*3] = true;
+        }
+        problem.setBaseline(BaselineIntercept, BaselineSlope);
+        problem.epar[npar-2] = BaselineIntercept*0.2;
+        problem.epar[npar-1] = BaselineSlope*0.2;
+        
+        operaGaussianFitLM(problem);
+        for(unsigned i=0;i<getNumberOfPeaks();i++) {
+            problem.fixed[0+i*3] = problem.fixed[1+i*3] = problem.fixed[2+i*3] = false;
+            problem.lowerLimited[2+i*3] = problem.upperLimited[2+i*3] = true;
+            problem.lowerLimit[2+i*3] = 0.0;
+            problem.upperLimit[2+i*3] = problem.par[2+i*3]*3;
+            problem.lowerLimited[0+i*3] = true;
+            problem.lowerLimit[0+i*3] = 0.0;
+        }
+        operaGaussianFitLM(problem);
+        
+        for(unsigned i=0;i<getNumberOfPeaks();i++) {
+            amplitudeVector[i] = problem.par[0+i*3];
+            centerVector[i] = problem.par[1+i*3];
+            sigmaVector[i] = problem.par[2+i*3];
+            
+            amplitudeErrors[i] = problem.epar[0+i*3];
+            centerErrors[i] = problem.epar[1+i*3];
+            sigmaErrors[i] = problem.epar[2+i*3];
+        }
+        baselineIntercept = problem.par[npar-2];
+        baselineSlope = problem.par[npar-1];
+        baselineInterceptError = problem.epar[npar-2];
+        baselineSlopeError = problem.epar[npar-1];
+        gausschisqr = problem.chisqr;
+        return;
+    }
+    
 	double *par = (double*) malloc(npar * sizeof(double));
     double *epar = (double*) malloc(npar * sizeof(double));	
     
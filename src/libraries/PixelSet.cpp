@@ -27,12 +27,14 @@
  http://www.gnu.org/licenses/gpl-3.0.html
  ********************************************************************/
 
+#include <algorithm>
+#include <math.h>
+
 #include "globaldefines.h"
 #include "operaError.h"
 #include "libraries/operaLib.h"		// for itos
 #include "libraries/operaException.h"
 #include "libraries/PixelSet.h"
-#include "libraries/operaVectorOperations.h"
 
 /*! 
  * PixelSet
@@ -56,19 +58,16 @@ using namespace std;
  * PixelSet Constructor
  */
 
-PixelSet::PixelSet(void) : nPixels(0), subpixelArea(1) { }
+PixelSet::PixelSet(void) : nPixels(0), subpixelArea(1), compiled(false) { }
 
-PixelSet::PixelSet(float SubPixelArea) : nPixels(0), subpixelArea(SubPixelArea) { }
+PixelSet::PixelSet(float SubPixelArea) : nPixels(0), subpixelArea(SubPixelArea), compiled(false) { }
 
 PixelSet::PixelSet(unsigned NPixels, float SubPixelArea) :
 nPixels(NPixels),
-xcenter(NPixels),
-ycenter(NPixels),
-iIndex(NPixels),
-jIndex(NPixels),
-redundancy(NPixels),
-pixelValue(NPixels),
-subpixelArea(SubPixelArea)
+coordinates(3*NPixels),
+indices(3*NPixels),
+subpixelArea(SubPixelArea),
+compiled(false)
 {
 }
 
@@ -86,7 +85,7 @@ float PixelSet::getXcenter(unsigned index) const {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    return xcenter[index];
+    return coordinates[index];
 }
 float PixelSet::getYcenter(unsigned index) const {
 #ifdef RANGE_CHECK
@@ -94,7 +93,7 @@ float PixelSet::getYcenter(unsigned index) const {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    return ycenter[index];
+    return coordinates[nPixels+index];
 }
 int PixelSet::getiIndex(unsigned index) const {
 #ifdef RANGE_CHECK
@@ -102,7 +101,7 @@ int PixelSet::getiIndex(unsigned index) const {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    return iIndex[index];    
+    return indices[index];    
 }
 int PixelSet::getjIndex(unsigned index) const {
 #ifdef RANGE_CHECK
@@ -110,7 +109,7 @@ int PixelSet::getjIndex(unsigned index) const {
 		throw operaException("PixelSet: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    return jIndex[index];    
+    return indices[nPixels+index];    
 }
 unsigned PixelSet::getredundancy(unsigned index) const {
 #ifdef RANGE_CHECK
@@ -118,7 +117,7 @@ unsigned PixelSet::getredundancy(unsigned index) const {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    return redundancy[index];    
+    return (unsigned)indices[2*nPixels+index];    
 }     
 float PixelSet::getPixelValue(unsigned index) const {
 #ifdef RANGE_CHECK
@@ -126,7 +125,7 @@ float PixelSet::getPixelValue(unsigned index) const {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    return pixelValue[index];
+    return coordinates[2*nPixels+index];
 }
 float PixelSet::getSubpixelArea(void) const {
     return subpixelArea;
@@ -138,7 +137,8 @@ void PixelSet::setXcenter(float Xcenter, unsigned index) {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    xcenter[index] = Xcenter;
+    coordinates[index] = Xcenter;
+    compiled = false;
 }
 
 void PixelSet::setYcenter(float Ycenter, unsigned index) {
@@ -147,7 +147,8 @@ void PixelSet::setYcenter(float Ycenter, unsigned index) {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    ycenter[index] = Ycenter;
+    coordinates[nPixels+index] = Ycenter;
+    compiled = false;
 }
 
 void PixelSet::setiIndex(int iindex, unsigned k) {
@@ -156,7 +157,7 @@ void PixelSet::setiIndex(int iindex, unsigned k) {
 		throw operaException("PixelSet: k="+itos(k)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    iIndex[k] = iindex;
+    indices[k] = iindex;
 }
 
 void PixelSet::setjIndex(int jindex, unsigned k) {
@@ -165,7 +166,7 @@ void PixelSet::setjIndex(int jindex, unsigned k) {
 		throw operaException("PixelSet: k="+itos(k)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    jIndex[k] = jindex;
+    indices[nPixels+k] = jindex;
 }
 
 void PixelSet::setredundancy(unsigned Redundancy, unsigned k) {
@@ -174,7 +175,7 @@ void PixelSet::setredundancy(unsigned Redundancy, unsigned k) {
 		throw operaException("PixelSet: k="+itos(k)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    redundancy[k] = Redundancy;
+    indices[2*nPixels+k] = (int)Redundancy;
 }
 
 void PixelSet::setPixelValue(float PixelValue, unsigned index) {
@@ -183,7 +184,7 @@ void PixelSet::setPixelValue(float PixelValue, unsigned index) {
 		throw operaException("PixelSet: index="+itos(index)+" nPixels="+itos(nPixels)+"  ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-	pixelValue[index] = PixelValue;
+	coordinates[2*nPixels+index] = PixelValue;
 }
 
 void PixelSet::setSubpixelArea(float SubpixelArea) {
@@ -194,28 +195,93 @@ void PixelSet::setSubpixelArea(float SubpixelArea) {
  * PixelSet Methods
  */
 
+/*
+ * void resize(unsigned newsize)
+ * \brief keep the first min(nPixels, newsize) subpixels of each block, the added ones are zero.
+ */
 void PixelSet::resize(unsigned newsize) {
-	xcenter.resize(newsize);
-    ycenter.resize(newsize);
-    iIndex.resize(newsize);
-    jIndex.resize(newsize);
-    redundancy.resize(newsize);
-    pixelValue.resize(newsize);
+	unsigned keep = newsize < nPixels ? newsize : nPixels;
+	if (newsize < nPixels) {
+		for (unsigned block=1; block<3; block++) {
+			copy(coordinates.begin()+block*nPixels, coordinates.begin()+block*nPixels+keep, coordinates.begin()+block*newsize);
+			copy(indices.begin()+block*nPixels, indices.begin()+block*nPixels+keep, indices.begin()+block*newsize);
+		}
+		coordinates.resize(3*newsize);
+		indices.resize(3*newsize);
+	} else if (newsize > nPixels) {
+		coordinates.resize(3*newsize);
+		indices.resize(3*newsize);
+		for (unsigned block=2; block>0; block--) {
+			copy_backward(coordinates.begin()+block*nPixels, coordinates.begin()+block*nPixels+keep, coordinates.begin()+block*newsize+keep);
+			copy_backward(indices.begin()+block*nPixels, indices.begin()+block*nPixels+keep, indices.begin()+block*newsize+keep);
+		}
+		// the added subpixels still hold what the blocks were moved from
+		for (unsigned block=0; block<3; block++) {
+			fill(coordinates.begin()+block*newsize+keep, coordinates.begin()+(block+1)*newsize, 0.0f);
+			fill(indices.begin()+block*newsize+keep, indices.begin()+(block+1)*newsize, 0);
+		}
+	}
     nPixels = newsize;
+    compiled = false;
 }
 
-float PixelSet::getMinXcoord(void) const {    
-    return Min(xcenter);
+float PixelSet::getMinXcoord(void) const {
+    return *min_element(coordinates.begin(), coordinates.begin()+nPixels);
 }
 
 float PixelSet::getMaxXcoord(void) const {
-    return Max(xcenter);               
+    return *max_element(coordinates.begin(), coordinates.begin()+nPixels);
 }
 
 float PixelSet::getMinYcoord(void) const {
-    return Min(ycenter);               
+    return *min_element(coordinates.begin()+nPixels, coordinates.begin()+2*nPixels);
 }
 
 float PixelSet::getMaxYcoord(void) const {
-    return Max(ycenter);               
+    return *max_element(coordinates.begin()+nPixels, coordinates.begin()+2*nPixels);
+}
+
+/*
+ * void compileTemplate(void)
+ * \brief build the distinct x and y centers and the index of each subpixel into them.
+ */
+void PixelSet::compileTemplate(void) {
+	xoffsets.assign(coordinates.begin(), coordinates.begin()+nPixels);
+	yoffsets.assign(coordinates.begin()+nPixels, coordinates.begin()+2*nPixels);
+	sort(xoffsets.begin(), xoffsets.end());
+	xoffsets.erase(unique(xoffsets.begin(), xoffsets.end()), xoffsets.end());
+	sort(yoffsets.begin(), yoffsets.end());
+	yoffsets.erase(unique(yoffsets.begin(), yoffsets.end()), yoffsets.end());
+	offsetKeys.resize(2*nPixels);
+	for (unsigned pix=0; pix<nPixels; pix++) {
+		offsetKeys[pix] = lower_bound(xoffsets.begin(), xoffsets.end(), coordinates[pix]) - xoffsets.begin();
+		offsetKeys[nPixels+pix] = lower_bound(yoffsets.begin(), yoffsets.end(), coordinates[nPixels+pix]) - yoffsets.begin();
+	}
+	compiled = true;
+}
+
+/*
+ * void placeSubpixels(double xorigin, double yorigin, unsigned *cols, unsigned *rows, std::vector<unsigned> &placed) const
+ * \brief floor the distinct centers once through the template when there is one, each subpixel otherwise.
+ */
+void PixelSet::placeSubpixels(double xorigin, double yorigin, unsigned *cols, unsigned *rows, std::vector<unsigned> &placed) const {
+	if (nPixels == 0) return;
+	if (!compiled) {
+		for (unsigned pix=0; pix<nPixels; pix++) {
+			cols[pix] = (unsigned)floor(xorigin + coordinates[pix]);
+			rows[pix] = (unsigned)floor(yorigin + coordinates[nPixels+pix]);
+		}
+		return;
+	}
+	placed.resize(xoffsets.size() + yoffsets.size());
+	unsigned *xplaced = &placed[0];
+	unsigned *yplaced = xplaced + xoffsets.size();
+	for (unsigned k=0; k<xoffsets.size(); k++) xplaced[k] = (unsigned)floor(xorigin + xoffsets[k]);
+	for (unsigned k=0; k<yoffsets.size(); k++) yplaced[k] = (unsigned)floor(yorigin + yoffsets[k]);
+	const unsigned *xkeys = &offsetKeys[0];
+	const unsigned *ykeys = xkeys + nPixels;
+	for (unsigned pix=0; pix<nPixels; pix++) {
+		cols[pix] = xplaced[xkeys[pix]];
+		rows[pix] = yplaced[ykeys[pix]];
+	}
 }
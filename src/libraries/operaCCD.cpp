@@ -49,6 +49,7 @@
 #include "libraries/operaStats.h"
 #include "libraries/ladfit.h"	
 #include "libraries/operaFit.h"
+#include "libraries/operaGaussianFit.h"
 #include "libraries/operaStats.h"
 
 /*!
@@ -1316,578 +1317,219 @@ int operaCCDRecenterOrderWithIP(unsigned np, float *x,float *y,unsigned nip, flo
 }
 
 
-/*** Algorithm to detect orders using an IP function ***/
-unsigned operaCCDDetectPeaksWithErrorsUsingIP(unsigned np, float *x,float *y,unsigned nip, float *ipfunc, float noise, float gain, float threshold,float *xmean, float *ymean, float *xmeanerr)
+/*
+ * The order detectors below share one matched filter. The binned cut is correlated with
+ * a kernel of slit points (the IP, a Gaussian or a top hat), the flux weighted photocenter
+ * and, optionally, its error are measured in the same window, then the positions that are a
+ * local maximum of the filtered cut, stand above the noise and rise then fall over the
+ * window are reported as peaks.
+ */
+typedef enum {
+	PeakKernelIP,
+	PeakKernelGaussian,
+	PeakKernelTopHat
+} operaCCDPeakKernel_t;
+
+/*
+ * Gaussian weights depend on the sampling, they are only recomputed (exp is most of the
+ * cost) for windows that are not sampled like the previous one, i.e. never for row cuts.
+ * The arithmetic is kept as it was in each of the former detectors, so results are unchanged.
+ */
+template <typename T>
+static unsigned operaCCDMatchedFilterPeaks(unsigned np, const T *x, const T *y, operaCCDPeakKernel_t kernel, unsigned slit, const T *slitfunc, T sigma, T noise, T gain, T threshold, T *xmean, T *ymean, T *xmeanerr)
 {
-	/* the algorithm below detects the orders, their photocenter and mean values */
-	unsigned i,j,nords=0;
-	
-	float *my = (float *) malloc (np * sizeof(float));
-	memset(my, 0, sizeof(float)*np);
-	
-	float *mx = (float *) malloc (np * sizeof(float));	
-	memset(mx, 0, sizeof(float)*np);	
-	
-	float *mxerr = (float *) malloc (np * sizeof(float));	
-	memset(mxerr, 0, sizeof(float)*np);		
-	
-	unsigned slit=0;
-	for(i=0;i<nip;i++) {
-		if(ipfunc[i]) {
-			slit++;
-		}	
+	if (slit == 0 || np < slit) {
+		return 0;
 	}
-	float *slitfunc = (float *) malloc (slit * sizeof(float));	
-	slit=0;
-	for(i=0;i<nip;i++) {
-		if(ipfunc[i]) {
-			slitfunc[slit] = ipfunc[i];
-			//			printf("%d\t%f\n",slit,slitfunc[slit]);			
-			slit++;
-		}	
+	unsigned i, j, nords = 0;
+	unsigned half = slit/2;
+	
+	/* one extra point, the rise/fall count reads one past the last window */
+	T *my = (T *) calloc (np+1, sizeof(T));
+	T *mx = (T *) calloc (np+1, sizeof(T));
+	T *mxerr = xmeanerr ? (T *) calloc (np+1, sizeof(T)) : NULL;
+	T *offsets = NULL;
+	T *gaussian = NULL;
+	bool haveGaussian = false;
+	const double norm = sqrt(2*M_PI)*sigma;
+	if (kernel == PeakKernelGaussian) {
+		offsets = (T *) malloc (slit * sizeof(T));
+		gaussian = (T *) malloc (slit * sizeof(T));
 	}
-	float intflux;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		intflux=0;
-        
-        float *yvar = (float *) malloc (slit * sizeof(float));
-        float yvarsum = 0;
+	const T noisevariance = (noise/gain)*(noise/gain);
+	
+	for(i=half;i<(np-half);i++) {
+		const T *xw = x + i - half;
+		const T *yw = y + i - half;
+		T filtered = 0;
+		T intflux = 0;
+		
+		switch (kernel) {
+			case PeakKernelIP:
+				for(j=0;j<slit;j++) {
+					filtered += yw[j]*slitfunc[j];
+				}
+				break;
+			case PeakKernelGaussian:
+				if (haveGaussian) {
+					for(j=0;j<slit;j++) {
+						if (xw[j] - x[i] != offsets[j]) {
+							haveGaussian = false;
+							break;
+						}
+					}
+				}
+				if (!haveGaussian) {
+					for(j=0;j<slit;j++) {
+						offsets[j] = xw[j] - x[i];
+						gaussian[j] = exp(-((offsets[j])*(offsets[j])/(2*sigma*sigma)));
+					}
+					haveGaussian = true;
+				}
+				for(j=0;j<slit;j++) {
+					filtered += yw[j]*gaussian[j]/norm;
+				}
+				break;
+			case PeakKernelTopHat:
+				for(j=0;j<slit;j++) {
+					filtered += yw[j]/(T)slit;
+				}
+				break;
+		}
 		for(j=0;j<slit;j++) {
-			my[i] += y[i-slit/2+j]*slitfunc[j];
-			intflux += y[i-slit/2+j];
-            yvar[j] = (noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain;
-            yvarsum += yvar[j];
+			intflux += yw[j];
 		}
+		my[i] = filtered;
 		
-		float avgx = 0;
-		
+		T photocenter = 0;
 		for(j=0;j<slit;j++) {
-			mx[i] += x[i-slit/2+j]*y[i-slit/2+j]/intflux;
-			avgx += x[i-slit/2+j]/(float)slit;
-			mxerr[i] += ((noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain); // method 1
-			//			mxerr[i] += ((intflux-y[i-slit/2+j])/(intflux*intflux))*((intflux-y[i-slit/2+j])/(intflux*intflux))*yvar[j] + (y[i-slit/2+j]/(intflux*intflux))*(y[i-slit/2+j]/(intflux*intflux))*yvarsum; // method 2	
-		}		
-		
-		float avgy = intflux/(float)slit;
-		
-        mxerr[i] = sqrt(mxerr[i]*(fabs(avgx - mx[i])/avgy));  // method 1
-		//		mxerr[i] = sqrt(mxerr[i]); // method 2
-		
-		//		printf("%d\t%f\t%f\t%f\t%f\t%f\n",i,x[i],y[i],mx[i],my[i],mxerr[i]);
+			photocenter += xw[j]*yw[j]/intflux;
+		}
+		mx[i] = photocenter;
+		
+		if (mxerr) {
+			T avgx = 0;
+			T variance = 0;
+			for(j=0;j<slit;j++) {
+				avgx += xw[j]/(T)slit;
+				variance += (noisevariance + fabs(yw[j])/gain);
+			}
+			T avgy = intflux/(T)slit;
+			mxerr[i] = sqrt(variance*(fabs(avgx - photocenter)/avgy));
+		}
 	}
 	
-	unsigned npts=0, isitmax=1;
-	float rate, depth;
-	float detectprob,peakprob;
-	
-	float x0,y0,xf,yf,slope0,slope1;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		
-		x0 = mx[i-slit/2];
-		y0 = my[i-slit/2];
-		xf = mx[i+slit/2];
-		yf = my[i+slit/2];
+	for(i=half;i<(np-half);i++) {
 		
-		npts=0;
-		isitmax=1;
+		T depth = my[i] - ((my[i+half] + my[i-half])/2);
+		T detectprob = (depth > noise/gain) ? 1 : 0;
 		
+		// peakprob below is zero unless this is a local maximum above the noise
+		if (threshold >= 0 && detectprob == 0) {
+			continue;
+		}
+		unsigned isitmax = 1;
 		for(j=0;j<slit;j++) {
-			
-			slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j] - x0); 
-			slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j+1] - x0);
-			
-			//check whether it is a local maximum
-			if(my[i-slit/2+j] > my[i])
+			if(my[i-half+j] > my[i]) {
 				isitmax = 0;
-			
-			//calculate the growth rate
-			rate = (my[i-slit/2+j+1]-slope0) - (my[i-slit/2+j]-slope1);
-			
-			//count points whenever it grows before center and it decreases after center
-			if(j<slit/2) {
-				if(rate > 0) {
-					npts++;
-				}
-			} else if (j>=slit/2) {
-				if(rate < 0) {
-					npts++;
-				} 
+				break;
 			}
-		}	
-		
-		depth = my[i] - ((my[i+slit/2] + my[i-slit/2])/2);
-		
-		if(depth > noise/gain) {
-			detectprob = 1;
-		} else {
-			detectprob = 0;
-		}	
-		
-		peakprob = isitmax*detectprob*((float)npts/(float)(slit));
-		
-		if(peakprob > threshold) {
-			xmean[nords] = mx[i];
-			xmeanerr[nords] = sqrt(mxerr[i]*mxerr[i] + (1/(float)slit)*(1/(float)slit));			
-			ymean[nords] = my[i];
-			nords++;
 		}
-		//		printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%u\t%u\n",i,mx[i],my[i],peakprob, depth, noise/gain, npts, slit);
-	}	
-	free(my);
-	free(mx);
-	free(mxerr);
-	return nords;
-}
-
-/*** Algorithm to detect orders using a Gaussian function ***/
-unsigned operaCCDDetectPeaksWithErrorsUsingGaussian(unsigned np, float *x,float *y,float sigma, float noise, float gain, float threshold,float *xmean, float *ymean, float *xmeanerr)
-{
-	/* the algorithm below detects the orders, their photocenter and mean values */
-	unsigned i,j,nords=0;
-	
-	float *my = (float *) malloc (np * sizeof(float));
-	memset(my, 0, sizeof(float)*np);
-	
-	float *mx = (float *) malloc (np * sizeof(float));	
-	memset(mx, 0, sizeof(float)*np);	
-	
-	float *mxerr = (float *) malloc (np * sizeof(float));	
-	memset(mxerr, 0, sizeof(float)*np);		
-	
-	unsigned slit;
-	
-	slit = 4.0*(unsigned)sigma;
-	
-	float intflux;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		intflux=0;
-        
-        float *yvar = (float *) malloc (slit * sizeof(float));
-        float yvarsum = 0;
-		for(j=0;j<slit;j++) {
-			my[i] += y[i-slit/2+j]*exp(-((x[i-slit/2+j] - x[i])*(x[i-slit/2+j] - x[i])/(2*sigma*sigma)))/(sqrt(2*M_PI)*sigma); 
-			intflux += y[i-slit/2+j];
-            yvar[j] = (noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain;
-            yvarsum += yvar[j];
+		if (threshold >= 0 && isitmax == 0) {
+			continue;
 		}
 		
-		float avgx = 0;
-		
-		for(j=0;j<slit;j++) {
-			mx[i] += x[i-slit/2+j]*y[i-slit/2+j]/intflux;
-			avgx += x[i-slit/2+j]/(float)slit;
-			mxerr[i] += ((noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain); // method 1
-			//			mxerr[i] += ((intflux-y[i-slit/2+j])/(intflux*intflux))*((intflux-y[i-slit/2+j])/(intflux*intflux))*yvar[j] + (y[i-slit/2+j]/(intflux*intflux))*(y[i-slit/2+j]/(intflux*intflux))*yvarsum; // method 2	
-		}		
-        
-		float avgy = intflux/(float)slit;
-		
-        mxerr[i] = sqrt(mxerr[i]*(fabs(avgx - mx[i])/avgy));  // method 1
-		//		mxerr[i] = sqrt(mxerr[i]); // method 2
-        
-		//		printf("%d\t%f\t%f\t%f\t%f\t%f\n",i,x[i],y[i],mx[i],my[i],mxerr[i]);
-		
-	}
-	
-	unsigned npts=0, isitmax=1;
-	float rate, depth;
-	float detectprob,peakprob;
-	
-	float x0,y0,xf,yf,slope0,slope1;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		
-		x0 = mx[i-slit/2];
-		y0 = my[i-slit/2];
-		xf = mx[i+slit/2];
-		yf = my[i+slit/2];
-		
-		npts=0;
-		isitmax=1;
+		T x0 = mx[i-half];
+		T y0 = my[i-half];
+		T xf = mx[i+half];
+		T yf = my[i+half];
 		
+		unsigned npts = 0;
 		for(j=0;j<slit;j++) {
-			
-			slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j] - x0); 
-			slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j+1] - x0);
-			
-			//check whether it is a local maximum
-			if(my[i-slit/2+j] > my[i])
-				isitmax = 0;
+			T slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-half+j] - x0);
+			T slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-half+j+1] - x0);
 			
 			//calculate the growth rate
-			rate = (my[i-slit/2+j+1]-slope0) - (my[i-slit/2+j]-slope1);
+			T rate = (my[i-half+j+1]-slope0) - (my[i-half+j]-slope1);
 			
-			//count points whenever it grows before center or decreases after center
-			if(j<slit/2) {
+			//count points whenever it grows before center and it decreases after center
+			if(j<half) {
 				if(rate > 0) {
 					npts++;
 				}
-			} else if (j>=slit/2) {
-				if(rate < 0) {
-					npts++;
-				} 
+			} else if(rate < 0) {
+				npts++;
 			}
-			
-		}	
-		
-		depth = my[i] - ((my[i+slit/2] + my[i-slit/2])/2);
-		
-		if(depth > noise/gain) {
-			detectprob = 1;
-		} else {
-			detectprob = 0;
-		}	
+		}
 		
-		peakprob = isitmax*detectprob*((float)npts/(float)(slit));
+		T peakprob = isitmax*detectprob*((T)npts/(T)(slit));
 		
-		if(peakprob > threshold) {
+		if(peakprob > threshold && nords < MAXORDERS) {
 			xmean[nords] = mx[i];
-			xmeanerr[nords] = sqrt(mxerr[i]*mxerr[i] + (1/(float)slit)*(1/(float)slit));			
 			ymean[nords] = my[i];
+			if (xmeanerr) {
+				xmeanerr[nords] = sqrt(mxerr[i]*mxerr[i] + (1/(T)slit)*(1/(T)slit));
+			}
 			nords++;
 		}
-		//		printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%u\t%u\n",i,mx[i],my[i],peakprob, depth, noise/gain, npts, slit);
-	}	
+	}
 	free(my);
 	free(mx);
 	free(mxerr);
+	free(offsets);
+	free(gaussian);
 	return nords;
 }
 
-unsigned operaCCDDetectPeaksWithErrorsUsingGaussianDouble(unsigned np, double *x,double *y,double sigma, double noise, double gain, double threshold,double *xmean, double *ymean, double *xmeanerr)
-{
-	/* the algorithm below detects the orders, their photocenter and mean values */
-	unsigned i,j,nords=0;
-	
-	double *my = (double *) malloc (np * sizeof(double));
-	memset(my, 0, sizeof(double)*np);
-	
-	double *mx = (double *) malloc (np * sizeof(double));	
-	memset(mx, 0, sizeof(double)*np);	
-	
-	double *mxerr = (double *) malloc (np * sizeof(double));	
-	memset(mxerr, 0, sizeof(double)*np);		
-	
-	unsigned slit;
-	
-	slit = 4.0*(unsigned)sigma;
-	
-	double intflux;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		intflux=0;
-        
-        double *yvar = (double *) malloc (slit * sizeof(double));
-        double yvarsum = 0;
-		for(j=0;j<slit;j++) {
-			my[i] += y[i-slit/2+j]*exp(-((x[i-slit/2+j] - x[i])*(x[i-slit/2+j] - x[i])/(2*sigma*sigma)))/(sqrt(2*M_PI)*sigma); 
-			intflux += y[i-slit/2+j];
-            yvar[j] = (noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain;
-            yvarsum += yvar[j];
+/*
+ * The nonzero points of an IP function are the slit of the filter.
+ */
+static unsigned operaCCDSlitFromIP(unsigned nip, const float *ipfunc, float *slitfunc) {
+	unsigned slit = 0;
+	for(unsigned i=0;i<nip;i++) {
+		if(ipfunc[i]) {
+			slitfunc[slit++] = ipfunc[i];
 		}
-		
-		double avgx = 0;
-		
-		for(j=0;j<slit;j++) {
-			mx[i] += x[i-slit/2+j]*y[i-slit/2+j]/intflux;
-			avgx += x[i-slit/2+j]/(double)slit;
-			mxerr[i] += ((noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain); // method 1
-			//			mxerr[i] += ((intflux-y[i-slit/2+j])/(intflux*intflux))*((intflux-y[i-slit/2+j])/(intflux*intflux))*yvar[j] + (y[i-slit/2+j]/(intflux*intflux))*(y[i-slit/2+j]/(intflux*intflux))*yvarsum; // method 2	
-		}		
-        
-		double avgy = intflux/(double)slit;
-		
-        mxerr[i] = sqrt(mxerr[i]*(fabs(avgx - mx[i])/avgy));  // method 1
-		//		mxerr[i] = sqrt(mxerr[i]); // method 2
-        
-		//		printf("%d\t%f\t%f\t%f\t%f\t%f\n",i,x[i],y[i],mx[i],my[i],mxerr[i]);
-		
 	}
-	
-	unsigned npts=0, isitmax=1;
-	double rate, depth;
-	double detectprob,peakprob;
-	
-	double x0,y0,xf,yf,slope0,slope1;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		
-		x0 = mx[i-slit/2];
-		y0 = my[i-slit/2];
-		xf = mx[i+slit/2];
-		yf = my[i+slit/2];
-		
-		npts=0;
-		isitmax=1;
-		
-		for(j=0;j<slit;j++) {
-			
-			slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j] - x0); 
-			slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j+1] - x0);
-			
-			//check whether it is a local maximum
-			if(my[i-slit/2+j] > my[i])
-				isitmax = 0;
-			
-			//calculate the growth rate
-			rate = (my[i-slit/2+j+1]-slope0) - (my[i-slit/2+j]-slope1);
-			
-			//count points whenever it grows before center or decreases after center
-			if(j<slit/2) {
-				if(rate > 0) {
-					npts++;
-				}
-			} else if (j>=slit/2) {
-				if(rate < 0) {
-					npts++;
-				} 
-			}
-			
-		}	
-		
-		depth = my[i] - ((my[i+slit/2] + my[i-slit/2])/2);
-		
-		if(depth > noise/gain) {
-			detectprob = 1;
-		} else {
-			detectprob = 0;
-		}	
-		
-		peakprob = isitmax*detectprob*((double)npts/(double)(slit));
-		
-		if(peakprob > threshold) {
-			xmean[nords] = mx[i];
-			xmeanerr[nords] = sqrt(mxerr[i]*mxerr[i] + (1/(double)slit)*(1/(double)slit));			
-			ymean[nords] = my[i];
-			nords++;
-		}
-		//		printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%u\t%u\n",i,mx[i],my[i],peakprob, depth, noise/gain, npts, slit);
-	}	
-	free(my);
-	free(mx);
-	free(mxerr);
+	return slit;
+}
+
+/*** Algorithm to detect orders using an IP function ***/
+unsigned operaCCDDetectPeaksWithErrorsUsingIP(unsigned np, float *x,float *y,unsigned nip, float *ipfunc, float noise, float gain, float threshold,float *xmean, float *ymean, float *xmeanerr)
+{
+	float *slitfunc = (float *) malloc (nip * sizeof(float));
+	unsigned slit = operaCCDSlitFromIP(nip, ipfunc, slitfunc);
+	unsigned nords = operaCCDMatchedFilterPeaks<float>(np, x, y, PeakKernelIP, slit, slitfunc, 0, noise, gain, threshold, xmean, ymean, xmeanerr);
+	free(slitfunc);
 	return nords;
 }
 
+/*** Algorithm to detect orders using a Gaussian function ***/
+unsigned operaCCDDetectPeaksWithErrorsUsingGaussian(unsigned np, float *x,float *y,float sigma, float noise, float gain, float threshold,float *xmean, float *ymean, float *xmeanerr)
+{
+	unsigned slit = 4.0*(unsigned)sigma;
+	return operaCCDMatchedFilterPeaks<float>(np, x, y, PeakKernelGaussian, slit, NULL, sigma, noise, gain, threshold, xmean, ymean, xmeanerr);
+}
+
+unsigned operaCCDDetectPeaksWithErrorsUsingGaussianDouble(unsigned np, double *x,double *y,double sigma, double noise, double gain, double threshold,double *xmean, double *ymean, double *xmeanerr)
+{
+	unsigned slit = 4.0*(unsigned)sigma;
+	return operaCCDMatchedFilterPeaks<double>(np, x, y, PeakKernelGaussian, slit, NULL, sigma, noise, gain, threshold, xmean, ymean, xmeanerr);
+}
+
 /*** Algorithm to detect orders using a flat top hat function ***/
 unsigned operaCCDDetectPeaksWithErrorsUsingTopHat(unsigned np, float *x,float *y,unsigned width, float noise, float gain, float threshold,float *xmean, float *ymean, float *xmeanerr)
 {
-	/* the algorithm below detects the orders, their photocenter and mean values */
-	unsigned i,j,nords=0;
-	
-	float *my = (float *) malloc (np * sizeof(float));
-	memset(my, 0, sizeof(float)*np);
-	
-	float *mx = (float *) malloc (np * sizeof(float));	
-	memset(mx, 0, sizeof(float)*np);	
-	
-	float *mxerr = (float *) malloc (np * sizeof(float));	
-	memset(mxerr, 0, sizeof(float)*np);		
-	
-	unsigned slit;
-	
-	slit = width;
-	
-	float intflux;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		intflux=0;
-        
-        float *yvar = (float *) malloc (slit * sizeof(float));
-        float yvarsum = 0;
-		for(j=0;j<slit;j++) {
-			my[i] += y[i-slit/2+j]/(float)slit; 
-			intflux += y[i-slit/2+j];
-            yvar[j] = (noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain;
-            yvarsum += yvar[j];
-		}
-		
-		float avgx = 0;
-		
-		for(j=0;j<slit;j++) {
-			mx[i] += x[i-slit/2+j]*y[i-slit/2+j]/intflux;
-			avgx += x[i-slit/2+j]/(float)slit;
-			mxerr[i] += ((noise/gain)*(noise/gain) + fabs(y[i-slit/2+j])/gain); // method 1
-            //			mxerr[i] += ((intflux-y[i-slit/2+j])/(intflux*intflux))*((intflux-y[i-slit/2+j])/(intflux*intflux))*yvar[j] + (y[i-slit/2+j]/(intflux*intflux))*(y[i-slit/2+j]/(intflux*intflux))*yvarsum; // method 2	
-		}		
-        
-		float avgy = intflux/(float)slit;
-		
-        mxerr[i] = sqrt(mxerr[i]*(fabs(avgx - mx[i])/avgy));  // method 1
-        //		mxerr[i] = sqrt(mxerr[i]); // method 2
-		
-		//		printf("%d\t%f\t%f\t%f\t%f\t%f\n",i,x[i],y[i],mx[i],my[i],mxerr[i]);		
-	}
-	
-	unsigned npts=0, isitmax=1;
-	float rate, depth;
-	float detectprob,peakprob;
-	
-	float x0,y0,xf,yf,slope0,slope1;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		
-		x0 = mx[i-slit/2];
-		y0 = my[i-slit/2];
-		xf = mx[i+slit/2];
-		yf = my[i+slit/2];
-		
-		npts=0;
-		isitmax=1;
-		
-		for(j=0;j<slit;j++) {
-			
-			slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j] - x0); 
-			slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j+1] - x0);
-			
-			//check whether it is a local maximum
-			if(my[i-slit/2+j] > my[i])
-				isitmax = 0;
-			
-			//calculate the growth rate
-			rate = (my[i-slit/2+j+1]-slope0) - (my[i-slit/2+j]-slope1);
-			
-			//count points whenever it grows before center or decreases after center
-			if(j<slit/2) {
-				if(rate > 0) {
-					npts++;
-				}
-			} else if (j>=slit/2) {
-				if(rate < 0) {
-					npts++;
-				} 
-			}
-		}	
-		
-		depth = my[i] - ((my[i+slit/2] + my[i-slit/2])/2);
-		
-		if(depth > noise/gain) {
-			detectprob = 1;
-		} else {
-			detectprob = 0;
-		}	
-		
-		peakprob = isitmax*detectprob*((float)npts/(float)(slit));
-		
-		if(peakprob > threshold) {
-			xmean[nords] = mx[i];
-			xmeanerr[nords] = sqrt(mxerr[i]*mxerr[i] + (1/(float)slit)*(1/(float)slit));			
-			ymean[nords] = my[i];
-			nords++;
-		}
-		//		printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%u\t%u\n",i,mx[i],my[i],peakprob, depth, noise/gain, npts, slit);
-	}	
-	free(my);
-	free(mx);
-	free(mxerr);
-	return nords;
+	return operaCCDMatchedFilterPeaks<float>(np, x, y, PeakKernelTopHat, width, NULL, 0, noise, gain, threshold, xmean, ymean, xmeanerr);
 }
 
 /*** Algorithm to detect orders using an IP function ***/
 unsigned operaCCDDetectPeaksWithIP(unsigned np, float *x,float *y,unsigned nip, float *ipfunc, float noise, float gain, float threshold,float *xmean, float *ymean)
 {
-	/* the algorithm below detects the orders, their photocenter and mean values */
-	unsigned i,j,nords=0;
-	
-	float *my = (float *) malloc (np * sizeof(float));
-	memset(my, 0, sizeof(float)*np);
-	
-	float *mx = (float *) malloc (np * sizeof(float));	
-	memset(mx, 0, sizeof(float)*np);	
-	
-	unsigned slit=0;
-	for(i=0;i<nip;i++) {
-		if(ipfunc[i]) {
-			slit++;
-		}	
-	}
-	float *slitfunc = (float *) malloc (slit * sizeof(float));	
-	slit=0;
-	for(i=0;i<nip;i++) {
-		if(ipfunc[i]) {
-			slitfunc[slit] = ipfunc[i];
-			//			printf("%d\t%f\n",slit,slitfunc[slit]);			
-			slit++;
-		}	
-	}
-	float intflux;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		intflux=0;
-		for(j=0;j<slit;j++) {
-			my[i] += y[i-slit/2+j]*slitfunc[j];
-			intflux += y[i-slit/2+j];
-		}
-		
-		for(j=0;j<slit;j++) {
-			mx[i] += x[i-slit/2+j]*y[i-slit/2+j]/intflux; 
-		}		
-		
-//		printf("%d\t%f\t%f\t%f\t%f\n",i,x[i],y[i],mx[i],my[i]);
-	}
-	
-	unsigned npts=0, isitmax=1;
-	float rate, depth;
-	float detectprob,peakprob;
-	
-	float x0,y0,xf,yf,slope0,slope1;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		
-		x0 = mx[i-slit/2];
-		y0 = my[i-slit/2];
-		xf = mx[i+slit/2];
-		yf = my[i+slit/2];
-		
-		npts=0;
-		isitmax=1;
-		
-		for(j=0;j<slit;j++) {
-			
-			slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j] - x0); 
-			slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j+1] - x0);
-			
-			//check whether it is a local maximum
-			if(my[i-slit/2+j] > my[i])
-				isitmax = 0;
-			
-			//calculate the growth rate
-			rate = (my[i-slit/2+j+1]-slope0) - (my[i-slit/2+j]-slope1);
-			
-			//count points whenever it grows before center and it decreases after center
-			if(j<slit/2) {
-				if(rate > 0) {
-					npts++;
-				}
-			} else if (j>=slit/2) {
-				if(rate < 0) {
-					npts++;
-				} 
-			}
-		}	
-		
-		depth = my[i] - ((my[i+slit/2] + my[i-slit/2])/2);
-
-		if(depth > noise/gain) {
-			detectprob = 1;
-		} else {
-			detectprob = 0;
-		}	
-		
-		peakprob = isitmax*detectprob*((float)npts/(float)(slit));
-		
-		if(peakprob > threshold) {
-			xmean[nords] = mx[i];
-			ymean[nords] = my[i];
-			nords++;
-		}
-        //printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%u\t%u\n",i,x[i],y[i],mx[i],my[i],peakprob, depth, noise/gain, npts, slit);
-	}
-	free(my);
-	free(mx);
+	float *slitfunc = (float *) malloc (nip * sizeof(float));
+	unsigned slit = operaCCDSlitFromIP(nip, ipfunc, slitfunc);
+	unsigned nords = operaCCDMatchedFilterPeaks<float>(np, x, y, PeakKernelIP, slit, slitfunc, 0, noise, gain, threshold, xmean, ymean, NULL);
+	free(slitfunc);
 	return nords;
 }
 
@@ -1976,190 +1618,14 @@ unsigned operaCCDDetectPeaksByXCorrWithIP(unsigned np, float *x,float *y,unsigne
 /*** Algorithm to detect orders using a Gaussian function ***/
 unsigned operaCCDDetectPeaksWithGaussian(unsigned np, float *x,float *y,float sigma, float noise, float gain, float threshold,float *xmean, float *ymean)
 {
-	/* the algorithm below detects the orders, their photocenter and mean values */
-	unsigned i,j,nords=0;
-	
-	float *my = (float *) malloc (np * sizeof(float));
-	memset(my, 0, sizeof(float)*np);
-	
-	float *mx = (float *) malloc (np * sizeof(float));	
-	memset(mx, 0, sizeof(float)*np);	
-	
-	unsigned slit;
-	
-	slit = 4.0*(unsigned)sigma;
-	
-	float intflux;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		intflux=0;
-		for(j=0;j<slit;j++) {
-			my[i] += y[i-slit/2+j]*exp(-((x[i-slit/2+j] - x[i])*(x[i-slit/2+j] - x[i])/(2*sigma*sigma)))/(sqrt(2*M_PI)*sigma); 
-			intflux += y[i-slit/2+j];
-		}
-		
-		for(j=0;j<slit;j++) {
-			mx[i] += x[i-slit/2+j]*y[i-slit/2+j]/intflux; 
-		}		
-		
-		//	printf("%d\t%lf\t%lf\n",i,mx[i],my[i]);
-	}
-	
-	unsigned npts=0, isitmax=1;
-	float rate, depth;
-	float detectprob,peakprob;
-	
-	float x0,y0,xf,yf,slope0,slope1;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		
-		x0 = mx[i-slit/2];
-		y0 = my[i-slit/2];
-		xf = mx[i+slit/2];
-		yf = my[i+slit/2];
-		
-		npts=0;
-		isitmax=1;
-		
-		for(j=0;j<slit;j++) {
-			
-			slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j] - x0); 
-			slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j+1] - x0);
-			
-			//check whether it is a local maximum
-			if(my[i-slit/2+j] > my[i])
-				isitmax = 0;
-			
-			//calculate the growth rate
-			rate = (my[i-slit/2+j+1]-slope0) - (my[i-slit/2+j]-slope1);
-			
-			//count points whenever it grows before center or decreases after center
-			if(j<slit/2) {
-				if(rate > 0) {
-					npts++;
-				}
-			} else if (j>=slit/2) {
-				if(rate < 0) {
-					npts++;
-				} 
-			}
-			
-		}	
-		
-		depth = my[i] - ((my[i+slit/2] + my[i-slit/2])/2);
-		
-		if(depth > noise/gain) {
-			detectprob = 1;
-		} else {
-			detectprob = 0;
-		}	
-		
-		peakprob = isitmax*detectprob*((float)npts/(float)(slit));
-		
-		if(peakprob > threshold) {
-			xmean[nords] = mx[i];
-			ymean[nords] = my[i];
-			nords++;
-		}
-		//	printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%u\t%u\n",i,mx[i],my[i],peakprob, depth, noise/gain, npts, slit);
-	}	
-	free(my);
-	free(mx);
-	return nords;
+	unsigned slit = 4.0*(unsigned)sigma;
+	return operaCCDMatchedFilterPeaks<float>(np, x, y, PeakKernelGaussian, slit, NULL, sigma, noise, gain, threshold, xmean, ymean, NULL);
 }
 
 /*** Algorithm to detect orders using a flat top hat function ***/
 unsigned operaCCDDetectPeaksWithTopHat(unsigned np, float *x,float *y,unsigned width, float noise, float gain, float threshold,float *xmean, float *ymean)
 {
-	/* the algorithm below detects the orders, their photocenter and mean values */
-	unsigned i,j,nords=0;
-	
-	float *my = (float *) malloc (np * sizeof(float));
-	memset(my, 0, sizeof(float)*np);
-	
-	float *mx = (float *) malloc (np * sizeof(float));	
-	memset(mx, 0, sizeof(float)*np);	
-	
-	unsigned slit;
-	
-	slit = width;
-	
-	float intflux;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		intflux=0;
-		for(j=0;j<slit;j++) {
-			my[i] += y[i-slit/2+j]/(float)slit; 
-			intflux += y[i-slit/2+j];
-		}
-		
-		for(j=0;j<slit;j++) {
-			mx[i] += x[i-slit/2+j]*y[i-slit/2+j]/intflux; 
-		}		
-		
-		//	printf("%d\t%lf\t%lf\n",i,mx[i],my[i]);
-	}
-	
-	unsigned npts=0, isitmax=1;
-	float rate, depth;
-	float detectprob,peakprob;
-	
-	float x0,y0,xf,yf,slope0,slope1;
-	
-	for(i=slit/2;i<(np-slit/2);i++) {
-		
-		x0 = mx[i-slit/2];
-		y0 = my[i-slit/2];
-		xf = mx[i+slit/2];
-		yf = my[i+slit/2];
-		
-		npts=0;
-		isitmax=1;
-		
-		for(j=0;j<slit;j++) {
-			
-			slope0 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j] - x0); 
-			slope1 = y0 + ((yf-y0)/(xf-x0))*(mx[i-slit/2+j+1] - x0);
-			
-			//check whether it is a local maximum
-			if(my[i-slit/2+j] > my[i])
-				isitmax = 0;
-			
-			//calculate the growth rate
-			rate = (my[i-slit/2+j+1]-slope0) - (my[i-slit/2+j]-slope1);
-			
-			//count points whenever it grows before center or decreases after center
-			if(j<slit/2) {
-				if(rate > 0) {
-					npts++;
-				}
-			} else if (j>=slit/2) {
-				if(rate < 0) {
-					npts++;
-				} 
-			}
-		}	
-		
-		depth = my[i] - ((my[i+slit/2] + my[i-slit/2])/2);
-		
-		if(depth > noise/gain) {
-			detectprob = 1;
-		} else {
-			detectprob = 0;
-		}	
-		
-		peakprob = isitmax*detectprob*((float)npts/(float)(slit));
-		
-		if(peakprob > threshold) {
-			xmean[nords] = mx[i];
-			ymean[nords] = my[i];
-			nords++;
-		}
-		//	printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%u\t%u\n",i,mx[i],my[i],peakprob, depth, noise/gain, npts, slit);
-	}	
-	free(my);
-	free(mx);
-	return nords;
+	return operaCCDMatchedFilterPeaks<float>(np, x, y, PeakKernelTopHat, width, NULL, 0, noise, gain, threshold, xmean, ymean, NULL);
 }
 
 
@@ -2220,11 +1686,18 @@ void operaMedianWidthFromSetOfLines(unsigned np, float *mx, float *my, float *my
 	 ladfit(xbkg,bkg,nbkg,&a,&b,&abdev);
 	 
 	 */
+	/*
+	 * The lines are fitted independently of each other: gather them, fit them in one batch, then report.
+	 */
+    operaGaussianFitProblem *problems = new operaGaussianFitProblem[nlines];
+    unsigned *fitmin = (unsigned *) malloc (nlines * sizeof(unsigned));
+    unsigned *fitmax = (unsigned *) malloc (nlines * sizeof(unsigned));
+    double *x = (double *) malloc (nlines * (slit+1) * sizeof(double));
+    double *y = (double *) malloc (nlines * (slit+1) * sizeof(double));
+    double *ey = (double *) malloc (nlines * (slit+1) * sizeof(double));
+    unsigned nfits = 0;
+    
 	for(unsigned j=0;j<nlines;j++) {
-        double a=ylines[j],x0=xlines[j],sig=(*medianWidth);
-        double ea,ex0,esig;
-        double chisqr;
-        
         unsigned imin = ii[j] - slit/2;
         unsigned imax = ii[j] + slit/2;
         
@@ -2236,27 +1709,36 @@ void operaMedianWidthFromSetOfLines(unsigned np, float *mx, float *my, float *my
             continue;
         }
         
-        double *x = (double *) malloc (slit * sizeof(double));
-        double *y = (double *) malloc (slit * sizeof(double));
-        double *ey = (double *) malloc (slit * sizeof(double));
+        double *xfit = x + nfits*(slit+1);
+        double *yfit = y + nfits*(slit+1);
+        double *eyfit = ey + nfits*(slit+1);
         
         unsigned npts = 0;
 		for(unsigned i=imin;i<imax;i++) {
-			x[npts] = (double)mx[i];
-            y[npts] = (double)my[i];
-            ey[npts] = (double)myerr[i];            
+			xfit[npts] = (double)mx[i];
+            yfit[npts] = (double)my[i];
+            eyfit[npts] = (double)myerr[i];            
             if(npts == slit) {
                 break;
             }
             npts++;
 		}
-		
-        operaMPFitGaussian(npts, x, y, ey,&a,&ea,&x0,&ex0,&sig,&esig,&chisqr);
+        problems[nfits].setData(npts, xfit, yfit, eyfit);
+        problems[nfits].setPeak(0, ylines[j], xlines[j], *medianWidth);
+        fitmin[nfits] = imin;
+        fitmax[nfits] = imax;
+        nfits++;
+	}
+    
+    operaGaussianFitLMBatch(nfits, problems);
+    
+	for(unsigned k=0;k<nfits;k++) {
+        double a = problems[k].par[0], x0 = problems[k].par[1], sig = problems[k].par[2];
         
-		//printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\n",j,a,ea,x0,ex0,sig,esig,chisqr);
+		//printf("%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\n",k,a,problems[k].epar[0],x0,problems[k].epar[1],sig,problems[k].epar[2],problems[k].chisqr);
         
-        npts = 0;
-		for(unsigned i=imin;i<imax;i++) {
+        unsigned npts = 0;
+		for(unsigned i=fitmin[k];i<fitmax[k];i++) {
             double ymodel = a*exp(-((double)mx[i]-x0)*((double)mx[i]-x0)/(2*sig*sig));
             printf("%u\t%f\t%f\t%f\t%f\n",i,(double)mx[i],(double)my[i],ymodel,(double)myerr[i]);
             if(npts == slit) {
@@ -2266,4 +1748,11 @@ void operaMedianWidthFromSetOfLines(unsigned np, float *mx, float *my, float *my
 		}        
 	}    
 	
+    free(ey);
+    free(y);
+    free(x);
+    free(fitmax);
+    free(fitmin);
+    delete[] problems;
+    free(ii);
 }
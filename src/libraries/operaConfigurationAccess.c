@@ -44,7 +44,6 @@
 #include "globaldefines.h"
 #include "operaError.h"
 #include <stdlib.h>
-#include <regex.h>
 
 /*!
  * operaConfigurationAccess
@@ -69,13 +68,13 @@
 #define OPERAERRRORCODESONLY
 #include "operaError.h"
 #include "libraries/operaConfigurationAccess.h"
-#include "libraries/operaLibCommon.h"	// for startsWith
+#include "libraries/operaKeyValueStore.h"
 
 #ifndef PATH_MAX
 #define PATH_MAX 1024
 #endif
 static char configurationfilename[PATH_MAX];	// known to be all NULLs
-static FILE *stream = NULL;					// the stream pointer to the file
+static operaKeyValueStore store;			// the entries of the file, read once
 // the default location of the configuration file. Now how did we find this?
 const char *configurationfilebasename = "/harness/espadons/Makefile.configuration";
 
@@ -111,53 +110,53 @@ operaErrorCode operaConfigurationAccessSetConfigurationFilepath(const char *file
  * \return value = value of name or NULL if not known
  */
 operaErrorCode operaConfigurationAccessGet(const char *name, char **value) {
-	regex_t regex;
-	char scanbuff[MAXCONFIGURATIONVALUELENGTH];
-	char namebuff[MAXCONFIGURATIONVALUELENGTH];
-	
 	if (name == NULL || value == NULL)
 		return operaErrorCodeNULL;
 	if (*name == '\0')
 		return operaErrorCodeNULLString;
 	
+	return operaConfigurationAccessGetValues(&name, value, 1);
+}
+
+/* 
+ * operaErrorCode operaConfigurationAccessGetValues(const char **names, char **values, unsigned count)
+ * \brief This function gets the value [list] of each of count names, reading the configuration file at most once.
+ * \note Note that this function allocates storage for each value found, which must be freed by the caller.
+ * On operaErrorCodeNoMemory no storage is left allocated and all values are NULL.
+ * \param names is an array of count char pointers to the names
+ * \param values is an array of count char pointers set to the value [list] of each name or NULL if not known
+ * \return operaErrorCode or errno
+ */
+operaErrorCode operaConfigurationAccessGetValues(const char **names, char **values, unsigned count) {
+	if (names == NULL || values == NULL)
+		return operaErrorCodeNULL;
+	
 	// check to see that we have a filepath set
 	if (configurationfilename[0] == '\0') 
 		operaConfigurationAccessSetConfigurationFilepath(NULL);	// set in the default
 	
-	if (stream == NULL) {
-		if ((stream = fopen(configurationfilename, "r")) == NULL) 
-			return errno;
-	}
-	
-	*value = NULL;
-	snprintf(namebuff, sizeof(namebuff), "%s[[:space:]]*[?:]=[[:space:]]*[[:print:]]*", name);
-	regcomp(&regex, namebuff, 0);
-	while (fgets(scanbuff, MAXCONFIGURATIONVALUELENGTH, stream) != NULL) {
-		if (!regexec(&regex, scanbuff, 0, NULL, 0)) 
-			if (startsWith(scanbuff, name) > 0) {						// we got the name
-				*value = (char *)malloc(MAXCONFIGURATIONVALUELENGTH);
-				char *start = strstr(scanbuff, "=")+1;							// after the "="
-				while (*start == ' ' || *start == '\t') {						// get rid of the ":="
-					start++;
-				}
-				char *end = start;
-				while (*end != '\n' && *end != '#') {							// get rid of the "\n"
-					end++;
-				}
-				*end-- = '\0';
-				while (*end == '\t' || *end == ' ') {							// get rid of trailing ws
-					*end-- = '\0';
+	operaErrorCode errorcode = operaKeyValueStoreLoad(&store, configurationfilename, MAXCONFIGURATIONVALUELENGTH);
+	if (errorcode != operaErrorCodeOK)
+		return errorcode;
+	for (unsigned i=0; i<count; i++) {
+		values[i] = NULL;
+		if (names[i] == NULL)
+			continue;
+		const char *found = operaKeyValueStoreFind(&store, names[i]);
+		if (found) {
+			values[i] = (char *)malloc(MAXCONFIGURATIONVALUELENGTH);
+			if (values[i] == NULL) {
+				// leave no value half answered: free the ones already found
+				for (unsigned j=0; j<i; j++) {
+					free(values[j]);
+					values[j] = NULL;
 				}
-				strncpy(*value, start, sizeof(scanbuff)-1); 
-				break;
+				return operaErrorCodeNoMemory;
 			}
-		if (feof(stream))
-			break;
+			strncpy(values[i], found, MAXCONFIGURATIONVALUELENGTH-1);
+			values[i][MAXCONFIGURATIONVALUELENGTH-1] = '\0';
+		}
 	}
-	if (stream)
-		fclose(stream);
-	stream = NULL;
-	regfree(&regex);
 	return operaErrorCodeOK;
 }
 /* 
@@ -129,7 +129,7 @@ operaException::operaException(string Message, operaErrorCode Errorcode, string
  * \brief Return a string containing a fully formatted error message.
  * \return string
  */
-string operaException::getFormattedMessage() {
+string operaException::getFormattedMessage() const {
 	string output;
 
 	if (!file.empty()) {
@@ -162,7 +162,7 @@ void operaException::setMessage(string m) {
  * \brief Return the string part of an error message.
  * \return string
  */
-string operaException::getMessage(){
+string operaException::getMessage() const {
 	return message;
 }
 
@@ -181,7 +181,7 @@ void operaException::setErrorCode(const operaErrorCode errcode) {
  * \brief Return the error code part of an error message.
  * \return operaErrorCode
  */
-operaErrorCode operaException::getErrorCode() {
+operaErrorCode operaException::getErrorCode() const {
 	return errorcode;
 }
 
@@ -200,7 +200,7 @@ void operaException::setLine(int l){
  * \brief Return the line number part of an error message.
  * \return int
  */
-int operaException::getLine(){
+int operaException::getLine() const {
 	return line;
 }
 
@@ -219,7 +219,7 @@ void operaException::setFunction(string func){
  * \brief Return the function name part of an error message.
  * \return string
  */
-string operaException::getFunction(){
+string operaException::getFunction() const {
 	return function;
 }
 
@@ -238,7 +238,7 @@ void operaException::setFile(string func){
  * \brief Return the file name part of an error message.
  * \return string
  */
-string operaException::getFile(){
+string operaException::getFile() const {
 	return function;
 }
 
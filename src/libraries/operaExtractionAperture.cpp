@@ -216,6 +216,7 @@ void operaExtractionAperture<Shape>::setSubpixelPositions(PixelBox pixelrange) {
 		}
 	}
 	subpixels.resize(nPixels);
+	subpixels.compileTemplate();
 }
 
 template <class Shape>
@@ -243,6 +244,7 @@ void operaExtractionAperture<Shape>::setSubpixelPositionsWithRedundancy(PixelBox
 		}
 	}
 	subpixels.resize(nPixels);
+	subpixels.compileTemplate();
 }
 
 template <class Shape>
@@ -264,6 +266,7 @@ void operaExtractionAperture<Shape>::setSubpixelPositions(PixelBox pixelrange, o
 		}
 	}
 	subpixels.resize(nPixels);
+	subpixels.compileTemplate();
 }
 
 template <class Shape>
@@ -279,10 +282,13 @@ void operaExtractionAperture<Shape>::setSubpixelValues(operaFITSImage &Image) {
 template <class Shape>
 void operaExtractionAperture<Shape>::setSubpixelValues(operaInstrumentProfile *instrumentProfile, float d) {
 	unsigned nPixels = subpixels.getNPixels();
+	unsigned NXPoints = instrumentProfile->getNXPoints();
+	operaVector ipdata(instrumentProfile->getNTotalPoints());
+	instrumentProfile->getipDataFromPolyModel(d, ipdata.datapointer());
 	for(unsigned pix=0; pix<nPixels; pix++) {
 		int i = subpixels.getiIndex(pix);
 		int j = subpixels.getjIndex(pix);
-		subpixels.setPixelValue(instrumentProfile->getipDataFromPolyModel(d,(unsigned)i,(unsigned)j), pix);
+		subpixels.setPixelValue(ipdata[(unsigned)j*NXPoints+(unsigned)i], pix);
 	}
 }
 
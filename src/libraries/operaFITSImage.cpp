@@ -36,6 +36,11 @@
 // $Log$
 
 #include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include "fitsio.h"
 #include "globaldefines.h"
@@ -43,6 +48,8 @@
 #include "libraries/operaImage.h"
 #include "libraries/operaLib.h"					// trimFITSKeyword
 #include "libraries/operaFITSImage.h"
+#include "libraries/operaFITSTileCompression.h"
+#include "libraries/operaThreadPool.h"
 #include "libraries/operaFITSSubImage.h"
 #include "libraries/operaImageVector.h"
 #include "libraries/operaGeometricShapes.h"		// Box
@@ -89,7 +96,11 @@ isClone(false),		// is this a clone of somebody else's fptr? If so do not close!
 AllExtensions(false), // all extensions in memory
 AllSlices(true),	// all slices in memory
 imageType(FITS),	// Kind of image
-super(NULL)			// the super class that created this instance
+super(NULL),		// the super class that created this instance
+mapping(NULL),		// mmap'ed file, when the data unit is mapped rather than read
+mappingLength(0),	// length of the mapping
+bigEndianPixels(false),	// pixptr points at the mapped big-endian data unit
+mappedPixels(NULL)	// start of the mapped data unit, kept until the image is deleted
 {
 	isLazy = IsLazy;
 	naxes[0] = naxis1;
@@ -131,7 +142,11 @@ isClone(false),		// is this a clone of somebody else's fptr? If so do not close!
 AllExtensions(false), // all extensions in memory
 AllSlices(true),	// all slices in memory
 imageType(FITS),	// Kind of image
-super(NULL)			// the super class that created this instance
+super(NULL),		// the super class that created this instance
+mapping(NULL),		// mmap'ed file, when the data unit is mapped rather than read
+mappingLength(0),	// length of the mapping
+bigEndianPixels(false),	// pixptr points at the mapped big-endian data unit
+mappedPixels(NULL)	// start of the mapped data unit, kept until the image is deleted
 {
 	isLazy = IsLazy;
 	filename = Filename;
@@ -194,7 +209,11 @@ isClone(false),		// is this a clone of somebody else's fptr? If so do not close!
 AllExtensions(true), // all extensions in memory
 AllSlices(true),	// all slices in memory
 imageType(FITS),	// Kind of image
-super(NULL)			// the super class that created this instance
+super(NULL),		// the super class that created this instance
+mapping(NULL),		// mmap'ed file, when the data unit is mapped rather than read
+mappingLength(0),	// length of the mapping
+bigEndianPixels(false),	// pixptr points at the mapped big-endian data unit
+mappedPixels(NULL)	// start of the mapped data unit, kept until the image is deleted
 {
 	naxis1 = Naxis1;
 	naxis2 = Naxis2;
@@ -243,7 +262,11 @@ isClone(false),		// is this a clone of somebody else's fptr? If so do not close!
 AllExtensions(false), // all extensions in memory
 AllSlices(true),	// all slices in memory
 imageType(FITS),	// Kind of image
-super(NULL)			// the super class that created this instance
+super(NULL),		// the super class that created this instance
+mapping(NULL),		// mmap'ed file, when the data unit is mapped rather than read
+mappingLength(0),	// length of the mapping
+bigEndianPixels(false),	// pixptr points at the mapped big-endian data unit
+mappedPixels(NULL)	// start of the mapped data unit, kept until the image is deleted
 {
     isLazy = IsLazy;
 	setHasBeenRead(0, false);
@@ -279,6 +302,59 @@ super(NULL)			// the super class that created this instance
 		throw operaException("operaFITSImage: ", operaErrorCodeFileDoesNotExistError, __FILE__, __FUNCTION__, __LINE__);	
 	}
 }
+/*
+ * \class operaFITSImage(string Filename, eMapAdvice Advice)
+ * \brief Open an existing FITS image read-only, memory-mapping its data unit when the layout allows it.
+ * \param Filename
+ * \param Advice mapSequential or mapRandom, passed on to madvise
+ * \throws operaException cfitsio error code
+ * \return void
+ */
+operaFITSImage::operaFITSImage(string Filename, eMapAdvice Advice) :
+fptr(NULL),			// FITS file pointer
+bitpix(ushort_img),	// BITPIX keyword value (BYTE_IMG, SHORT_IMG, USHORT_IMG, FLOAT_IMG, DOUBLE_IMG)
+bzero(0.0),			// bzero
+bscale(1.0),		// bscale
+hdu(0),				// current active extension
+nhdus(1),			// nummber of hdus
+naxis(2),			// FITS image dimension
+naxis1(0),			// x-dimension to be figured out from NAXIS1 (ncols) 
+naxis2(0),			// y-dimension to be figured out from NAXIS2 (nrows)
+naxis3(1),			// z-dimension to be figured out from NAXIS3 (nslices)
+npixels(0),			// number of pixels	
+npixels_per_slice(0),	// total number of pixels in all slices and extensions
+npixels_per_extension(0),	// number of ccd pixels per extension
+compression(0),		// no compression
+datatype(tushort),	// (TSHORT, TUSHORT, TFLOAT, TDOUBLE)		
+istemp(false),		// set if this instance is a temp created in an expression
+mode(READONLY),		// READWRITE / READONLY
+pixptr(NULL),		// pixel data values
+varptr(NULL),		// variances
+current_extension(1),// current active extension
+current_slice(1),	// current active slice
+extensions(0),		// number of extensions
+isLazy(false),		// Lazy read
+viewOnly(false),	// Is this a view of somebody else's pixels? BEWARE of deletion!
+isClone(false),		// is this a clone of somebody else's fptr? If so do not close!
+AllExtensions(true), // all extensions in memory
+AllSlices(true),	// all slices in memory
+imageType(FITS),	// Kind of image
+super(NULL),		// the super class that created this instance
+mapping(NULL),		// mmap'ed file, when the data unit is mapped rather than read
+mappingLength(0),	// length of the mapping
+bigEndianPixels(false),	// pixptr points at the mapped big-endian data unit
+mappedPixels(NULL)	// start of the mapped data unit, kept until the image is deleted
+{
+	filename = Filename;
+	setHasBeenRead(0, false);
+	setHasBeenWritten(0, false);
+	openFITSfile(Filename, READONLY);
+	readFITSHeaderInfo();
+	if (!mapFITSDataUnit(Advice)) {
+		readFITSArray();
+	}
+}
+
 /* 
  * \class operaFITSImage
  * \brief create a writeable file image of an in memory FITSImage object
@@ -321,7 +397,11 @@ isClone(false),		// is this a clone of somebody else's fptr? If so do not close!
 AllExtensions(true), // all extensions in memory
 AllSlices(true),	// all slices in memory
 imageType(FITS),	// Kind of image
-super(NULL)			// the super class that created this instance
+super(NULL),		// the super class that created this instance
+mapping(NULL),		// mmap'ed file, when the data unit is mapped rather than read
+mappingLength(0),	// length of the mapping
+bigEndianPixels(false),	// pixptr points at the mapped big-endian data unit
+mappedPixels(NULL)	// start of the mapped data unit, kept until the image is deleted
 {
 	isLazy = IsLazy;
 	int status = 0;
@@ -398,8 +478,13 @@ isClone(false),		// is this a clone of somebody else's fptr? If so do not close!
 AllExtensions(true), // all extensions in memory
 AllSlices(true),	// all slices in memory
 imageType(FITS),	// Kind of image
-super(NULL)			// the super class that created this instance
+super(NULL),		// the super class that created this instance
+mapping(NULL),		// mmap'ed file, when the data unit is mapped rather than read
+mappingLength(0),	// length of the mapping
+bigEndianPixels(false),	// pixptr points at the mapped big-endian data unit
+mappedPixels(NULL)	// start of the mapped data unit, kept until the image is deleted
 {
+	imageIn.operaFITSImageToHostOrder();	// clones and views share or copy host-order pixels
 	filename = imageIn.filename;
 	hdu = imageIn.hdu;	// this is wrong?
 	naxis = imageIn.naxis;
@@ -499,7 +584,11 @@ super(NULL)			// the super class that created this instance
  */
 operaFITSImage::~operaFITSImage(){
     if (!super && !viewOnly && !isClone) {
-		if (pixptr) free(pixptr);
+		if (mapping) {
+			munmap(mapping, mappingLength);
+			mapping = NULL;
+		}
+		if (pixptr && !bigEndianPixels) free(pixptr);
 		pixptr = NULL;
 		if (varptr) free(varptr);
 		varptr = NULL;
@@ -537,6 +626,10 @@ void operaFITSImage::operaFITSImageSave() {
 	if (fits_create_file(&newfptr, filename.c_str(), &status)) {
 		throw operaException("operaFITSImage: cfitsio create error: "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
 	}
+	if (writeTileCompressedHDU(newfptr)) {
+		fits_close_file(newfptr, &status);
+		return;
+	}
 	if (fptr == NULL || hdu == 0) {
 		if (fits_create_img(newfptr, bitpix, naxis, naxes, &status)) {
 			throw operaException("operaFITSImage: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
@@ -620,12 +713,17 @@ void operaFITSImage::operaFITSImageSaveAs(string newFilename) {
 	fitsfile *newfptr;		// FITS file pointer for the new image
 	long  fpixel = 1;
 	
+	operaFITSImageToHostOrder();
 	// remove existing file - cfitsio returns an error if it exists...
 	remove(newFilename.c_str());
 	
     if (fits_create_file(&newfptr, newFilename.c_str(), &status)) {
 		throw operaException("operaFITSImage: cfitsio error "+newFilename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
 	}		
+	if (writeTileCompressedHDU(newfptr)) {
+		fits_close_file(newfptr, &status);
+		return;
+	}
 	if (fits_set_compression_type(newfptr, compression, &status)) {
 		throw operaException("operaFITSImage: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
 	}	
@@ -685,6 +783,65 @@ void operaFITSImage::operaFITSImageSaveAs(string newFilename) {
 	newfptr = NULL;
 }
 
+/* 
+ * bool writeTileCompressedHDU(fitsfile *newfptr) 
+ * \brief Writes the image into newfptr as a tile-compressed HDU, the tiles compressed in parallel.
+ * \note PRIVATE
+ * \note Only single-plane integer images are handled; anything else returns false with newfptr untouched
+ * \note and the caller falls back on cfitsio.
+ * \param newfptr - a newly created, empty fitsfile
+ * \throws operaException cfitsio error code
+ * \return bool
+ */
+bool operaFITSImage::writeTileCompressedHDU(fitsfile *newfptr) {
+	int status = 0;
+	const long fpixel = 1;
+	
+	if (compression == cNone || compression == cPLIO || naxis3 > 1 || npixels != naxis1*naxis2) {
+		return false;
+	}
+	if (datatype != tbyte && datatype != tshort && datatype != tushort) {
+		return false;
+	}
+	// a header that is itself compressed carries table keywords we must not copy
+	if (fptr != NULL && hdu != 0 && fits_is_compressed_image(fptr, &status)) {
+		return false;
+	}
+	status = 0;
+	if (fits_set_compression_type(newfptr, compression, &status)) {
+		throw operaException("operaFITSImage: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+	}
+	if (fits_create_img(newfptr, bitpix, 2, naxes, &status)) {
+		throw operaException("operaFITSImage: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+	}
+	//
+	// copy the user keywords, cfitsio has written the structural and compression ones
+	//
+	if (fptr != NULL && hdu != 0) {
+		int nkeys = 0;
+		char card[FLEN_CARD];
+		if (fits_get_hdrspace(fptr, &nkeys, NULL, &status)) {
+			throw operaException("operaFITSImage: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+		}
+		for (int i=1; i<=nkeys; i++) {
+			if (fits_read_record(fptr, i, card, &status)) {
+				throw operaException("operaFITSImage: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+			}
+			if (fits_get_keyclass(card) > TYP_CMPRS_KEY) {
+				if (fits_write_record(newfptr, card, &status)) {
+					throw operaException("operaFITSImage: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+				}
+			}
+		}
+	}
+	if (!operaWriteTileCompressedPixels(newfptr, datatype, pixptr, npixels)) {
+		if (fits_write_img(newfptr, datatype, fpixel, npixels, pixptr, &status)) {
+			throw operaException("operaFITSImage: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+		}
+	}
+	return true;
+}
+
 /* 
  * operaFITSImageCopyHeader(operaFITSImage *from) 
  * \brief Copies all of the header information from image.
@@ -1095,6 +1252,7 @@ void operaFITSImage::operaFITSAddComment(string comment) {
  * \return pixels*
  */
 unsigned short* operaFITSImage::operaFITSImageClonePixelsUSHORT() {
+	operaFITSImageToHostOrder();
 	long npixels = naxis1 * naxis2;
 	long size = sizeof(unsigned short)*npixels;
 	unsigned short *p = (unsigned short *)malloc(size); 
@@ -1118,6 +1276,7 @@ unsigned short* operaFITSImage::operaFITSImageClonePixelsUSHORT() {
  * \return pixels*
  */
 unsigned short* operaFITSImage::operaFITSImageClonePixelsUSHORT(unsigned x, unsigned y, unsigned nx, unsigned ny) {
+	operaFITSImageToHostOrder();
 	long npixels = nx * ny;
 	long size = sizeof(float)*npixels;
 	unsigned short *p = (unsigned short *)malloc(size);
@@ -1143,6 +1302,7 @@ unsigned short* operaFITSImage::operaFITSImageClonePixelsUSHORT(unsigned x, unsi
  * \return pixels*
  */
 float* operaFITSImage::operaFITSImageClonePixels() {
+	operaFITSImageToHostOrder();
 	long npixels = naxis1 * naxis2;
 	long size = sizeof(float)*npixels;
 	float *p = (float *)malloc(size); 
@@ -1166,6 +1326,7 @@ float* operaFITSImage::operaFITSImageClonePixels() {
  * \return pixels*
  */
 float* operaFITSImage::operaFITSImageClonePixels(unsigned x, unsigned y, unsigned nx, unsigned ny) {
+	operaFITSImageToHostOrder();
 	long npixels = nx * ny;
 	long size = sizeof(float)*npixels;
 	float *p = (float *)malloc(size);
@@ -1321,6 +1482,7 @@ void operaFITSImage::operaFITSImageReadVirtual(operaFITSSubImage &subImage, unsi
  * \return void
  */
 void operaFITSImage::operaFITSImageSetData(unsigned short* data) {
+	operaFITSImageToHostOrder();
 	pixptr = (void *)data;
 }
 
@@ -1331,6 +1493,7 @@ void operaFITSImage::operaFITSImageSetData(unsigned short* data) {
  * \return void
  */
 void operaFITSImage::operaFITSImageSetData(float* data) {
+	operaFITSImageToHostOrder();
 	pixptr = (void *)data;
 }
 
@@ -1342,6 +1505,7 @@ void operaFITSImage::operaFITSImageSetData(float* data) {
  * \return void
  */
 void operaFITSImage::operaFITSImageConvertImage(edatatype todatatype) {
+	operaFITSImageToHostOrder();
 	int status = 0;
 	int i = npixels;
 	edatatype olddatatype = datatype;
@@ -1531,6 +1695,7 @@ void operaFITSImage::operaFITSImageConvertImage(edatatype todatatype) {
  * \return void
  */
 void operaFITSImage::operaFITSImageConvertImage(edatatype fromdatatype, edatatype todatatype) {
+	operaFITSImageToHostOrder();
 	int status = 0;
 	int i = npixels;
 	edatatype olddatatype = fromdatatype;
@@ -1712,6 +1877,81 @@ void operaFITSImage::operaFITSImageConvertImage(edatatype fromdatatype, edatatyp
 	if (pixptr) free(pixptr);
 	pixptr = newpixptr;
 }
+/*
+ * Widening conversions (ushort to float etc.) can not be split into chunks in place,
+ * since a chunk's output overwrites the input of the chunks above it. For large images the
+ * input is copied aside once and the chunks are then converted in parallel from the copy.
+ */
+#define CONVERSION_CHUNK_PIXELS 262144
+
+typedef struct conversion_args {
+	const void *from;
+	void *to;
+	unsigned long npixels;
+} conversion_args_t;
+
+template <class InType, class OutType>
+static void convertPixelChunk(unsigned long chunk, void *context) {
+	conversion_args_t *args = (conversion_args_t *)context;
+	unsigned long first = chunk * CONVERSION_CHUNK_PIXELS;
+	unsigned long last = MIN(first + CONVERSION_CHUNK_PIXELS, args->npixels);
+	const InType *from = (const InType *)args->from;
+	OutType *to = (OutType *)args->to;
+	for (unsigned long i=first; i<last; i++) {
+		to[i] = (OutType)from[i];
+	}
+}
+
+template <class InType>
+static operaParallelForFunction widenPixelChunkFunction(edatatype todatatype) {
+	switch (todatatype) {
+		case tfloat: return convertPixelChunk<InType, float>;
+		case tdouble: return convertPixelChunk<InType, double>;
+		default: return NULL;
+	}
+}
+
+/*
+ * bool operaFITSImage::convertImageInPlaceParallel(edatatype fromdatatype, edatatype todatatype)
+ * \brief Convert to a wider type in parallel chunks through a copy of the input.
+ * \return false if the conversion is not a widening one, the image is small or no scratch memory is available
+ */
+bool operaFITSImage::convertImageInPlaceParallel(edatatype fromdatatype, edatatype todatatype) {
+	if (npixels < 2*CONVERSION_CHUNK_PIXELS) {
+		return false;
+	}
+	operaParallelForFunction body = NULL;
+	size_t fromsize = 0;
+	switch (fromdatatype) {
+		case tbyte: body = widenPixelChunkFunction<unsigned char>(todatatype); fromsize = sizeof(unsigned char); break;
+		case tshort: body = widenPixelChunkFunction<short>(todatatype); fromsize = sizeof(short); break;
+		case tushort: body = widenPixelChunkFunction<unsigned short>(todatatype); fromsize = sizeof(unsigned short); break;
+		case tfloat: body = (todatatype == tdouble ? convertPixelChunk<float, double> : NULL); fromsize = sizeof(float); break;
+		default: break;
+	}
+	if (body == NULL) {
+		return false;
+	}
+	void *input = malloc(fromsize * npixels);
+	if (!input) {
+		return false;
+	}
+	memcpy(input, pixptr, fromsize * npixels);
+	conversion_args_t args;
+	args.from = input;
+	args.to = pixptr;
+	args.npixels = npixels;
+	try {
+		operaThreadPool::getSharedPool().parallelFor((npixels + CONVERSION_CHUNK_PIXELS - 1) / CONVERSION_CHUNK_PIXELS, body, &args);
+	}
+	catch (const operaException &) {
+		free(input);
+		throw;
+	}
+	free(input);
+	return true;
+}
+
 /* 
  * void operaFITSImage::operaFITSImageConvertImageInPlace(edatatype fromdatatype, edatatype todatatype)
  * \brief Convert image type and create new image values of that type.
@@ -1721,7 +1961,16 @@ void operaFITSImage::operaFITSImageConvertImage(edatatype fromdatatype, edatatyp
  * \return void
  */
 void operaFITSImage::operaFITSImageConvertImageInPlace(edatatype fromdatatype, edatatype todatatype) {
+	operaFITSImageToHostOrder();
 	int status = 0;
+	if (convertImageInPlaceParallel(fromdatatype, todatatype)) {
+		datatype = todatatype;
+		bitpix = tobitpix(todatatype);
+		if (fits_set_bscale(fptr, 1.0, 0.0, &status)) {
+			throw operaException("operaFITSImage: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+		}
+		return;
+	}
 	int i = npixels;
 	edatatype olddatatype = fromdatatype;
 	datatype = todatatype;
@@ -2019,6 +2268,7 @@ void operaFITSImage::mirrorRows(void) {
  * \brief Assign variances to each pixel in an image in units of ADU.
  */
 void operaFITSImage::assignVariances(float gain) {
+	operaFITSImageToHostOrder();
 	if (varptr == NULL) {
 		varptr = malloc(sizeof(float)*npixels);
 	}
@@ -2109,6 +2359,7 @@ void operaFITSImage::setfitsfileptr(fitsfile *newfptr) {
  * \return void *pixels pointer
  */
 void *operaFITSImage::getpixels() {
+	operaFITSImageToHostOrder();
 	return pixptr;
 }
 /* 
@@ -2402,6 +2653,7 @@ operaImageVector *operaFITSImage::where(unsigned x, unsigned y, unsigned dx, uns
  * \return void
  */
 void operaFITSImage::resize(unsigned x0, unsigned xf, unsigned y0, unsigned yf) {
+	operaFITSImageToHostOrder();
     
     if((x0 == 0 && xf == 0 && y0 == 0 && yf == 0) ||
        x0 >= xf  || y0 >= yf || xf > getnaxis1() || yf > getnaxis2()) {
@@ -2471,6 +2723,7 @@ void operaFITSImage::resize(unsigned x0, unsigned xf, unsigned y0, unsigned yf)
  * \return void
  */
 void operaFITSImage::resize(unsigned cols, unsigned rows) {
+	operaFITSImageToHostOrder();
 	int status = 0;
 	unsigned oldcols = naxis1;
 	unsigned oldrows = naxis2;
@@ -2723,6 +2976,122 @@ void operaFITSImage::readFITSHeaderInfo() {
 	datatype = todatatype(bitpix, bzero, bscale);		
 }
 
+/* 
+ * bool mapFITSDataUnit(eMapAdvice Advice)
+ * \brief maps the data unit of the current HDU read-only in place of reading it.
+ * \note PRIVATE
+ * \return false, with nothing mapped, if the image is compressed (tile or whole file), has several HDUs or slices,
+ * or is not BITPIX -32 or 16 with BSCALE 1 and BZERO 0 or 32768
+ */
+bool operaFITSImage::mapFITSDataUnit(eMapAdvice Advice) {
+	int status = 0;
+	char zbscale[FLEN_VALUE], comment[FLEN_COMMENT];
+	LONGLONG headstart = 0, datastart = 0, dataend = 0;
+	
+	if (compression != cNone || extensions > 0 || naxis != 2) {
+		return false;
+	}
+	if (bitpix == short_img) {
+		if (bzero != 0.0 && bzero != 32768.0) {
+			return false;
+		}
+	} else if (bitpix != float_img) {
+		return false;
+	}
+	if (fits_read_keyword(fptr, "BSCALE", zbscale, comment, &status) == 0 && atof(zbscale) != 1.0) {
+		return false;
+	}
+	status = 0;
+	if (fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status)) {
+		return false;
+	}
+	size_t datasize = toSize(bitpix, npixels);
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	// cfitsio reads .gz files into memory, so check the file on disk really is the FITS file
+	char simple[6];
+	struct stat filestat;
+	if (fstat(fd, &filestat) != 0 || (LONGLONG)filestat.st_size < datastart + (LONGLONG)datasize
+		|| pread(fd, simple, sizeof(simple), 0) != (ssize_t)sizeof(simple) || strncmp(simple, "SIMPLE", sizeof(simple)) != 0) {
+		close(fd);
+		return false;
+	}
+	long pagesize = sysconf(_SC_PAGESIZE);
+	off_t mapstart = (off_t)(datastart / pagesize) * pagesize;
+	size_t length = (size_t)(datastart - mapstart) + datasize;
+	void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, mapstart);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	madvise(map, length, Advice == mapSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+	mapping = map;
+	mappingLength = length;
+	pixptr = (void *)((char *)map + (datastart - mapstart));
+	mappedPixels = pixptr;
+	datatype = todatatype(bitpix, bzero, bscale);
+	bigEndianPixels = true;
+	return true;
+}
+
+/* 
+ * void operaFITSImageToHostOrder()
+ * \brief Replace the pixels of a memory-mapped image by a private copy in host byte order, no-op otherwise.
+ * \details Threads sharing the image may call this at the same time, the first one converts under
+ * hostOrderMutex. The mapping stays until the image is deleted, so a thread still reading the mapped
+ * pixels through getpixelvalue() is not left with unmapped memory, and the pixel pointer is published
+ * before bigEndianPixels is cleared.
+ * \throws operaException operaErrorNoMemory
+ * \return void
+ */
+static pthread_mutex_t hostOrderMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void operaFITSImage::operaFITSImageToHostOrder() {
+	if (!bigEndianPixels) {
+		return;
+	}
+	pthread_mutex_lock(&hostOrderMutex);
+	if (!bigEndianPixels) {
+		pthread_mutex_unlock(&hostOrderMutex);
+		return;
+	}
+	void *hostpixels = malloc(MAX(toSize(bitpix, npixels), toSize(float_img, npixels)));
+	if (!hostpixels) {
+		pthread_mutex_unlock(&hostOrderMutex);
+		throw operaException("operaFITSImage: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);	
+	}
+	switch (datatype) {
+		case tushort: {
+			unsigned short *to = (unsigned short *)hostpixels;
+			for (unsigned long i=0; i<npixels; i++) {
+				to[i] = (unsigned short)mappedPixel(i);
+			}
+		}
+			break;
+		case tshort: {
+			short *to = (short *)hostpixels;
+			for (unsigned long i=0; i<npixels; i++) {
+				to[i] = (short)mappedPixel(i);
+			}
+		}
+			break;
+		default: {
+			float *to = (float *)hostpixels;
+			for (unsigned long i=0; i<npixels; i++) {
+				to[i] = mappedPixel(i);
+			}
+		}
+			break;
+	}
+	pixptr = hostpixels;
+	bitpix = tobitpix(datatype);
+	__sync_synchronize();
+	bigEndianPixels = false;
+	pthread_mutex_unlock(&hostOrderMutex);
+}
+
 /* 
  * void readFITSArray()
  * \brief reads the image array into the class object (allocates memory).
@@ -2757,8 +3126,10 @@ void operaFITSImage::readFITSArray() {
 			if (fits_get_img_equivtype(fptr, &filedatatype, &status)) {
 				throw operaException("operaFITSImage: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
 			}
-			if (fits_read_pix(fptr,todatatype(ebitpix(filedatatype), bzero, bscale), fpixel, npixels_per_extension, NULL, readpointer, NULL, &status)) {
-				throw operaException("operaFITSImage: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+			if (!operaReadTileCompressedPixels(fptr, todatatype(ebitpix(filedatatype), bzero, bscale), readpointer, npixels_per_extension)) {
+				if (fits_read_pix(fptr,todatatype(ebitpix(filedatatype), bzero, bscale), fpixel, npixels_per_extension, NULL, readpointer, NULL, &status)) {
+					throw operaException("operaFITSImage: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
+				}
 			}
 			memcpy(basepointer, readpointer, extensionsize); 
 			switch (datatype) {
@@ -2798,6 +3169,10 @@ void operaFITSImage::readFITSArray() {
 		if (fits_get_img_equivtype(fptr, &filedatatype, &status)) {
 			throw operaException("operaFITSImage: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);	
 		}
+		// tile-compressed integer images are decompressed tile-parallel straight into pixptr
+		if (todatatype(ebitpix(filedatatype), bzero, bscale) == datatype && operaReadTileCompressedPixels(fptr, datatype, pixptr, npixels)) {
+			return;
+		}
 		switch (todatatype(ebitpix(filedatatype), bzero, bscale)) {
 			case tshort: {
 				short *s_pixptr;
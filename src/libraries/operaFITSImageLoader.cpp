@@ -0,0 +1,170 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaFITSImageLoader
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaFITSImageLoader.h"
+
+/*!
+ * operaFITSImageLoader
+ * \brief Background reads of FITS images.
+ * \file operaFITSImageLoader.cpp
+ * \ingroup libraries
+ */
+
+/*
+ * operaFITSImageFuture
+ */
+
+operaFITSImageFuture::operaFITSImageFuture(string Filename, edatatype Datatype, int Mode) :
+filename(Filename),
+datatype(Datatype),
+mode(Mode),
+mapped(false),
+advice(mapSequential),
+done(false),
+failed(false),
+taken(false),
+image(NULL)
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&ready, NULL);
+}
+
+operaFITSImageFuture::operaFITSImageFuture(string Filename, eMapAdvice Advice) :
+filename(Filename),
+datatype(tfloat),
+mode(READONLY),
+mapped(true),
+advice(Advice),
+done(false),
+failed(false),
+taken(false),
+image(NULL)
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&ready, NULL);
+}
+
+operaFITSImageFuture::~operaFITSImageFuture() {
+	wait();		// the I/O thread still refers to us until done
+	if (!taken && image) {
+		delete image;
+	}
+	image = NULL;
+	pthread_cond_destroy(&ready);
+	pthread_mutex_destroy(&mutex);
+}
+
+/*
+ * void loadTask(void *argument)
+ * \brief runs on an I/O thread: read the image and signal the waiters.
+ */
+void operaFITSImageFuture::loadTask(void *argument) {
+	operaFITSImageFuture *future = (operaFITSImageFuture *)argument;
+	operaFITSImage *image = NULL;
+	bool failed = false;
+	operaException exception;
+	try {
+		if (future->mapped) {
+			image = new operaFITSImage(future->filename, future->advice);
+		} else {
+			image = new operaFITSImage(future->filename, future->datatype, future->mode);
+		}
+	}
+	catch (const operaException &e) {
+		failed = true;
+		exception = e;
+	}
+	catch (...) {
+		failed = true;
+		exception = operaException("operaFITSImageLoader: "+future->filename+" ", operaErrorThreadFailure, __FILE__, __FUNCTION__, __LINE__);
+	}
+	pthread_mutex_lock(&future->mutex);
+	future->image = image;
+	future->failed = failed;
+	future->exception = exception;
+	future->done = true;
+	pthread_cond_broadcast(&future->ready);
+	pthread_mutex_unlock(&future->mutex);
+}
+
+bool operaFITSImageFuture::isReady(void) {
+	pthread_mutex_lock(&mutex);
+	bool isdone = done;
+	pthread_mutex_unlock(&mutex);
+	return isdone;
+}
+
+void operaFITSImageFuture::wait(void) {
+	pthread_mutex_lock(&mutex);
+	while (!done) {
+		pthread_cond_wait(&ready, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+operaFITSImage *operaFITSImageFuture::get(void) {
+	wait();
+	if (failed) {
+		throw exception;
+	}
+	taken = true;
+	return image;
+}
+
+/*
+ * operaFITSImageLoader
+ */
+
+/*
+ * operaFITSImageLoader(unsigned IOThreads)
+ * \brief a cfitsio built without --enable-reentrant can only read one file at a time, so it gets a single I/O thread.
+ */
+operaFITSImageLoader::operaFITSImageLoader(unsigned IOThreads) :
+ioThreads(IOThreads > 0 && fits_is_reentrant() ? IOThreads : 1)
+{
+}
+
+operaFITSImageLoader::~operaFITSImageLoader() {
+	ioThreads.waitForAll();
+}
+
+operaFITSImageFuture *operaFITSImageLoader::load(string Filename, edatatype Datatype, int Mode) {
+	operaFITSImageFuture *future = new operaFITSImageFuture(Filename, Datatype, Mode);
+	ioThreads.submit(operaFITSImageFuture::loadTask, (void *)future);
+	return future;
+}
+
+operaFITSImageFuture *operaFITSImageLoader::map(string Filename, eMapAdvice Advice) {
+	operaFITSImageFuture *future = new operaFITSImageFuture(Filename, Advice);
+	ioThreads.submit(operaFITSImageFuture::loadTask, (void *)future);
+	return future;
+}
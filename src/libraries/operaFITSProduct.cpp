@@ -68,8 +68,54 @@ void operaFITSProduct::AddColumnToHeader(string name, string desc) {
 	ostringstream ss;
 	ss << "COL" << ++headercolumns;
 	operaFITSSetHeaderValue(ss.str(), name, desc);
+	columnnames.push_back(name);
+	columndescriptions.push_back(desc);
 }
 
 unsigned operaFITSProduct::HeaderColumnCount() {
 	return headercolumns;
 }
+
+void operaFITSProduct::AppendBinaryTable(string extname) {
+	int status = 0;
+	fitsfile *tablefptr = NULL;
+	const unsigned columns = getnaxis2();
+	const unsigned rows = getnaxis1();
+	
+	vector<string> ttypes(columns);
+	for (unsigned col = 0; col < columns; col++) {
+		if (col >= columnnames.size()) {
+			ttypes[col] = "COL" + itos(col+1);
+			continue;
+		}
+		unsigned occurrence = 1;
+		for (unsigned previous = 0; previous < col; previous++) {
+			if (columnnames[previous] == columnnames[col]) occurrence++;
+		}
+		ttypes[col] = (occurrence > 1 ? columnnames[col] + "_" + itos(occurrence) : columnnames[col]);
+	}
+	vector<char *> ttype(columns), tform(columns);
+	char form[] = "1E";
+	for (unsigned col = 0; col < columns; col++) {
+		ttype[col] = (char *)ttypes[col].c_str();
+		tform[col] = form;
+	}
+	if (fits_open_file(&tablefptr, filename.c_str(), READWRITE, &status)) {
+		throw operaException("operaFITSProduct: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+	}
+	if (fits_create_tbl(tablefptr, BINARY_TBL, rows, columns, &ttype[0], &tform[0], NULL, (char *)extname.c_str(), &status)) {
+		throw operaException("operaFITSProduct: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+	}
+	for (unsigned col = 0; col < columns; col++) {
+		if (fits_write_col(tablefptr, TFLOAT, col+1, 1, 1, rows, (*this)[col], &status)) {
+			throw operaException("operaFITSProduct: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+		}
+		if (col < columndescriptions.size()) {
+			string keyword = "TTYPE" + itos(col+1);
+			fits_modify_comment(tablefptr, (char *)keyword.c_str(), (char *)columndescriptions[col].c_str(), &status);
+		}
+	}
+	if (fits_close_file(tablefptr, &status)) {
+		throw operaException("operaFITSProduct: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+	}
+}
@@ -0,0 +1,555 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaFITSTileCompression
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <zlib.h>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaFITSImage.h"
+#include "libraries/operaFITSTileCompression.h"
+#include "libraries/operaThreadPool.h"
+#include "libraries/operaLibCommon.h"		// for MIN
+
+/*!
+ * operaFITSTileCompression
+ * \brief Parallel tile compression and decompression of FITS images.
+ * \file operaFITSTileCompression.cpp
+ * \ingroup libraries
+ */
+
+/*
+ * The tile coders are exported by libcfitsio but only declared in its private fitsio2.h.
+ */
+extern "C" {
+int fits_rcomp_short(short a[], int nx, unsigned char *c, int clen, int nblock);
+int fits_rcomp_byte(signed char a[], int nx, unsigned char *c, int clen, int nblock);
+int fits_rdecomp_short(unsigned char *c, int clen, unsigned short array[], int nx, int nblock);
+int fits_rdecomp_byte(unsigned char *c, int clen, unsigned char array[], int nx, int nblock);
+int fits_hcompress(int *a, int nx, int ny, int scale, char *output, long *nbytes, int *status);
+int fits_hdecompress(unsigned char *input, int smooth, int *output, int *ny, int *nx, int *scale, int *status);
+}
+
+#define DEFAULT_RICE_BLOCKSIZE 32
+#define GZIP_LEVEL 1				// what cfitsio uses for GZIP_1
+
+/*
+ * The layout of one compressed image HDU, as cfitsio laid it out.
+ */
+typedef struct tileLayout {
+	int compression;				// RICE_1, GZIP_1 or HCOMPRESS_1
+	int zbitpix;					// 8 or 16
+	int bytepix;					// bytes per stored value
+	long naxis1;
+	long naxis2;
+	long tile1;						// ZTILE1
+	long tile2;						// ZTILE2
+	long ntiles1;					// tiles along x
+	long ntiles;					// tiles in all = rows in the table
+	int blocksize;					// RICE BLOCKSIZE
+	int smooth;						// HCOMPRESS SMOOTH
+	int colnum;						// COMPRESSED_DATA column
+} tileLayout_t;
+
+/*
+ * bool getTileLayout(fitsfile *fptr, edatatype Datatype, unsigned long npixels, tileLayout_t &layout)
+ * \brief read the compression keywords of the current HDU, false if we can not code it losslessly here.
+ */
+static bool getTileLayout(fitsfile *fptr, edatatype Datatype, unsigned long npixels, tileLayout_t &layout) {
+	int status = 0;
+	char zcmptype[FLEN_VALUE];
+	long znaxis = 0;
+	double bzero = 0.0, bscale = 1.0;
+
+	if (!fits_is_compressed_image(fptr, &status) || status) {
+		return false;
+	}
+	if (fits_read_key(fptr, TSTRING, "ZCMPTYPE", zcmptype, NULL, &status) ||
+		fits_read_key(fptr, TINT, "ZBITPIX", &layout.zbitpix, NULL, &status) ||
+		fits_read_key(fptr, TLONG, "ZNAXIS", &znaxis, NULL, &status) ||
+		fits_read_key(fptr, TLONG, "ZNAXIS1", &layout.naxis1, NULL, &status) ||
+		fits_read_key(fptr, TLONG, "ZNAXIS2", &layout.naxis2, NULL, &status)) {
+		return false;
+	}
+	layout.tile1 = layout.naxis1;
+	layout.tile2 = 1;
+	fits_read_key(fptr, TLONG, "ZTILE1", &layout.tile1, NULL, &status);
+	status = 0;
+	fits_read_key(fptr, TLONG, "ZTILE2", &layout.tile2, NULL, &status);
+	status = 0;
+	fits_read_key(fptr, TDOUBLE, "BZERO", &bzero, NULL, &status);
+	status = 0;
+	fits_read_key(fptr, TDOUBLE, "BSCALE", &bscale, NULL, &status);
+	status = 0;
+
+	if (strncmp(zcmptype, "RICE_1", 6) == 0 || strncmp(zcmptype, "RICE_ONE", 8) == 0) {
+		layout.compression = RICE_1;
+	} else if (strcmp(zcmptype, "GZIP_1") == 0) {
+		layout.compression = GZIP_1;
+	} else if (strcmp(zcmptype, "HCOMPRESS_1") == 0) {
+		layout.compression = HCOMPRESS_1;
+	} else {
+		return false;
+	}
+	if (znaxis != 2 || layout.tile1 <= 0 || layout.tile2 <= 0 || (unsigned long)(layout.naxis1*layout.naxis2) != npixels) {
+		return false;
+	}
+	/*
+	 * only the stored integer values are coded, so the in-memory type must be the stored type
+	 */
+	if (bscale != 1.0) {
+		return false;
+	}
+	switch (Datatype) {
+		case tbyte:
+			if (layout.zbitpix != BYTE_IMG || bzero != 0.0) return false;
+			break;
+		case tshort:
+			if (layout.zbitpix != SHORT_IMG || bzero != 0.0) return false;
+			break;
+		case tushort:
+			if (layout.zbitpix != SHORT_IMG || bzero != 32768.0) return false;
+			break;
+		default:
+			return false;
+	}
+	layout.bytepix = layout.zbitpix / 8;
+	layout.blocksize = DEFAULT_RICE_BLOCKSIZE;
+	layout.smooth = 0;
+	/*
+	 * the ZNAMEi / ZVALi pairs carry the coder parameters
+	 */
+	for (unsigned i=1; i<10; i++) {
+		char keyname[FLEN_KEYWORD], name[FLEN_VALUE];
+		int value = 0;
+		snprintf(keyname, sizeof(keyname), "ZNAME%u", i);
+		if (fits_read_key(fptr, TSTRING, keyname, name, NULL, &status)) {
+			status = 0;
+			break;
+		}
+		snprintf(keyname, sizeof(keyname), "ZVAL%u", i);
+		if (fits_read_key(fptr, TINT, keyname, &value, NULL, &status)) {
+			status = 0;
+			continue;
+		}
+		if (strcmp(name, "BLOCKSIZE") == 0) {
+			layout.blocksize = value;
+		} else if (strcmp(name, "BYTEPIX") == 0) {
+			if (value != layout.bytepix) return false;
+		} else if (strcmp(name, "SCALE") == 0) {
+			if (value != 0) return false;		// lossy hcompress, leave it to cfitsio
+		} else if (strcmp(name, "SMOOTH") == 0) {
+			layout.smooth = value;
+		}
+	}
+	layout.ntiles1 = (layout.naxis1 + layout.tile1 - 1) / layout.tile1;
+	layout.ntiles = layout.ntiles1 * ((layout.naxis2 + layout.tile2 - 1) / layout.tile2);
+
+	long nrows = 0;
+	if (fits_get_num_rows(fptr, &nrows, &status) || nrows != layout.ntiles) {
+		return false;
+	}
+	if (fits_get_colnum(fptr, CASEINSEN, (char *)"COMPRESSED_DATA", &layout.colnum, &status)) {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * the pixel rectangle covered by tile
+ */
+static void getTileBounds(const tileLayout_t &layout, long tile, long &x0, long &y0, long &nx, long &ny) {
+	x0 = (tile % layout.ntiles1) * layout.tile1;
+	y0 = (tile / layout.ntiles1) * layout.tile2;
+	nx = MIN(layout.tile1, layout.naxis1 - x0);
+	ny = MIN(layout.tile2, layout.naxis2 - y0);
+}
+
+/*
+ * gather the stored values of a tile into idata
+ */
+static void gatherTile(const tileLayout_t &layout, edatatype Datatype, const void *pixels, long tile, int *idata) {
+	long x0, y0, nx, ny;
+	getTileBounds(layout, tile, x0, y0, nx, ny);
+	for (long y=0; y<ny; y++) {
+		unsigned long offset = (unsigned long)(y0+y)*layout.naxis1 + x0;
+		int *out = idata + y*nx;
+		switch (Datatype) {
+			case tbyte: {
+				const unsigned char *in = (const unsigned char *)pixels + offset;
+				for (long x=0; x<nx; x++) out[x] = in[x];
+			}
+				break;
+			case tshort: {
+				const short *in = (const short *)pixels + offset;
+				for (long x=0; x<nx; x++) out[x] = in[x];
+			}
+				break;
+			case tushort: {
+				const unsigned short *in = (const unsigned short *)pixels + offset;
+				for (long x=0; x<nx; x++) out[x] = (int)in[x] - 32768;
+			}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/*
+ * scatter the stored values of a decoded tile back into the image
+ */
+static void scatterTile(const tileLayout_t &layout, edatatype Datatype, void *pixels, long tile, const int *idata) {
+	long x0, y0, nx, ny;
+	getTileBounds(layout, tile, x0, y0, nx, ny);
+	for (long y=0; y<ny; y++) {
+		unsigned long offset = (unsigned long)(y0+y)*layout.naxis1 + x0;
+		const int *in = idata + y*nx;
+		switch (Datatype) {
+			case tbyte: {
+				unsigned char *out = (unsigned char *)pixels + offset;
+				for (long x=0; x<nx; x++) out[x] = (unsigned char)in[x];
+			}
+				break;
+			case tshort: {
+				short *out = (short *)pixels + offset;
+				for (long x=0; x<nx; x++) out[x] = (short)in[x];
+			}
+				break;
+			case tushort: {
+				unsigned short *out = (unsigned short *)pixels + offset;
+				for (long x=0; x<nx; x++) out[x] = (unsigned short)(in[x] + 32768);
+			}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/*
+ * GZIP_1 codes the big-endian byte stream of the stored values
+ */
+static void packBigEndian(const int *idata, long n, int bytepix, unsigned char *bytes) {
+	if (bytepix == 1) {
+		for (long i=0; i<n; i++) bytes[i] = (unsigned char)idata[i];
+	} else {
+		for (long i=0; i<n; i++) {
+			unsigned short v = (unsigned short)(short)idata[i];
+			bytes[2*i] = (unsigned char)(v >> 8);
+			bytes[2*i+1] = (unsigned char)(v & 0xff);
+		}
+	}
+}
+
+static void unpackBigEndian(const unsigned char *bytes, long n, int bytepix, int *idata) {
+	if (bytepix == 1) {
+		for (long i=0; i<n; i++) idata[i] = bytes[i];
+	} else {
+		for (long i=0; i<n; i++) {
+			idata[i] = (short)(unsigned short)((bytes[2*i] << 8) | bytes[2*i+1]);
+		}
+	}
+}
+
+/*
+ * Thread Support to code all tiles in parallel
+ */
+typedef struct tileCodingContext {
+	const tileLayout_t *layout;
+	edatatype datatype;
+	void *pixels;
+	unsigned char **buffers;		// one compressed stream per tile
+	long *lengths;					// bytes in each stream
+} tileCodingContext_t;
+
+static void compressTile(unsigned long tile, void *context) {
+	tileCodingContext_t *c = (tileCodingContext_t *)context;
+	const tileLayout_t &layout = *c->layout;
+	long x0, y0, nx, ny;
+	getTileBounds(layout, tile, x0, y0, nx, ny);
+	long n = nx*ny;
+
+	int *idata = (int *)malloc(n*sizeof(int));
+	if (!idata) {
+		throw operaException("operaFITSTileCompression: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);
+	}
+	gatherTile(layout, c->datatype, c->pixels, tile, idata);
+
+	long clen = 0;
+	unsigned char *cbuf = NULL;
+	switch (layout.compression) {
+		case RICE_1: {
+			int maxlen = (int)(n*layout.bytepix + n/layout.blocksize + 64);
+			void *narrow = malloc(n*layout.bytepix);
+			cbuf = (unsigned char *)malloc(maxlen);
+			clen = -1;
+			if (narrow && cbuf) {
+				if (layout.bytepix == 2) {
+					short *sdata = (short *)narrow;
+					for (long i=0; i<n; i++) sdata[i] = (short)idata[i];
+					clen = fits_rcomp_short(sdata, (int)n, cbuf, maxlen, layout.blocksize);
+				} else {
+					signed char *bdata = (signed char *)narrow;
+					for (long i=0; i<n; i++) bdata[i] = (signed char)idata[i];
+					clen = fits_rcomp_byte(bdata, (int)n, cbuf, maxlen, layout.blocksize);
+				}
+			}
+			if (narrow) free(narrow);
+		}
+			break;
+		case GZIP_1: {
+			unsigned char *bytes = (unsigned char *)malloc(n*layout.bytepix);
+			z_stream stream;
+			memset(&stream, 0, sizeof(stream));
+			clen = -1;
+			if (bytes && deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, MAX_WBITS+16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+				packBigEndian(idata, n, layout.bytepix, bytes);
+				uLong maxlen = deflateBound(&stream, n*layout.bytepix) + 32;
+				cbuf = (unsigned char *)malloc(maxlen);
+				if (cbuf) {
+					stream.next_in = bytes;
+					stream.avail_in = (uInt)(n*layout.bytepix);
+					stream.next_out = cbuf;
+					stream.avail_out = (uInt)maxlen;
+					if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+						clen = (long)stream.total_out;
+					}
+				}
+				deflateEnd(&stream);
+			}
+			if (bytes) free(bytes);
+		}
+			break;
+		case HCOMPRESS_1: {
+			int status = 0;
+			clen = (long)(n*sizeof(int) + n/2 + 1024);
+			cbuf = (unsigned char *)malloc(clen);
+			// hcompress indexes a[nx][ny] with ny varying fastest, i.e. nx is our row count
+			if (!cbuf || fits_hcompress(idata, (int)ny, (int)nx, 0, (char *)cbuf, &clen, &status)) {
+				clen = -1;
+			}
+		}
+			break;
+		default:
+			break;
+	}
+	free(idata);
+	if (clen <= 0) {
+		if (cbuf) free(cbuf);
+		throw operaException("operaFITSTileCompression: ", operaErrorCodeTileError, __FILE__, __FUNCTION__, __LINE__);
+	}
+	c->buffers[tile] = cbuf;
+	c->lengths[tile] = clen;
+}
+
+static void decompressTile(unsigned long tile, void *context) {
+	tileCodingContext_t *c = (tileCodingContext_t *)context;
+	const tileLayout_t &layout = *c->layout;
+	long x0, y0, nx, ny;
+	getTileBounds(layout, tile, x0, y0, nx, ny);
+	long n = nx*ny;
+	unsigned char *cbuf = c->buffers[tile];
+	long clen = c->lengths[tile];
+
+	int *idata = (int *)malloc(n*sizeof(int));
+	if (!idata) {
+		throw operaException("operaFITSTileCompression: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);
+	}
+	bool ok = false;
+	switch (layout.compression) {
+		case RICE_1: {
+			void *narrow = malloc(n*layout.bytepix);
+			if (narrow) {
+				if (layout.bytepix == 2) {
+					unsigned short *sdata = (unsigned short *)narrow;
+					ok = fits_rdecomp_short(cbuf, (int)clen, sdata, (int)n, layout.blocksize) == 0;
+					for (long i=0; ok && i<n; i++) idata[i] = (short)sdata[i];
+				} else {
+					unsigned char *bdata = (unsigned char *)narrow;
+					ok = fits_rdecomp_byte(cbuf, (int)clen, bdata, (int)n, layout.blocksize) == 0;
+					for (long i=0; ok && i<n; i++) idata[i] = bdata[i];
+				}
+				free(narrow);
+			}
+		}
+			break;
+		case GZIP_1: {
+			unsigned char *bytes = (unsigned char *)malloc(n*layout.bytepix);
+			z_stream stream;
+			memset(&stream, 0, sizeof(stream));
+			if (bytes && inflateInit2(&stream, MAX_WBITS+32) == Z_OK) {
+				stream.next_in = cbuf;
+				stream.avail_in = (uInt)clen;
+				stream.next_out = bytes;
+				stream.avail_out = (uInt)(n*layout.bytepix);
+				ok = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == (uLong)(n*layout.bytepix);
+				inflateEnd(&stream);
+				if (ok) unpackBigEndian(bytes, n, layout.bytepix, idata);
+			}
+			if (bytes) free(bytes);
+		}
+			break;
+		case HCOMPRESS_1: {
+			int status = 0, hnx = 0, hny = 0, scale = 0;
+			ok = fits_hdecompress(cbuf, layout.smooth, idata, &hny, &hnx, &scale, &status) == 0 && (long)hnx*hny == n;
+		}
+			break;
+		default:
+			break;
+	}
+	if (ok) {
+		scatterTile(layout, c->datatype, c->pixels, tile, idata);
+	}
+	free(idata);
+	if (!ok) {
+		throw operaException("operaFITSTileCompression: ", operaErrorCodeTileError, __FILE__, __FUNCTION__, __LINE__);
+	}
+}
+
+/*
+ * bool operaWriteTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels)
+ * \brief Compress pixels tile by tile in parallel into the empty compressed image HDU at fptr.
+ * \return false if this HDU can not be handled here and nothing was written
+ */
+bool operaWriteTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels) {
+	tileLayout_t layout;
+	if (!getTileLayout(fptr, Datatype, npixels, layout)) {
+		return false;
+	}
+	tileCodingContext_t context;
+	context.layout = &layout;
+	context.datatype = Datatype;
+	context.pixels = pixels;
+	context.buffers = (unsigned char **)calloc(layout.ntiles, sizeof(unsigned char *));
+	context.lengths = (long *)calloc(layout.ntiles, sizeof(long));
+	if (!context.buffers || !context.lengths) {
+		throw operaException("operaFITSTileCompression: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);
+	}
+	int status = 0;
+	try {
+		operaThreadPool::getSharedPool().parallelFor(layout.ntiles, compressTile, (void *)&context);
+		/*
+		 * the rows go out in tile order, so the heap is laid out exactly as cfitsio would have
+		 */
+		for (long tile=0; tile<layout.ntiles && !status; tile++) {
+			fits_write_col(fptr, TBYTE, layout.colnum, tile+1, 1, context.lengths[tile], context.buffers[tile], &status);
+		}
+	}
+	catch (const operaException &) {
+		for (long tile=0; tile<layout.ntiles; tile++) if (context.buffers[tile]) free(context.buffers[tile]);
+		free(context.buffers);
+		free(context.lengths);
+		throw;
+	}
+	for (long tile=0; tile<layout.ntiles; tile++) if (context.buffers[tile]) free(context.buffers[tile]);
+	free(context.buffers);
+	free(context.lengths);
+	if (status) {
+		throw operaException("operaFITSTileCompression: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+	}
+	return true;
+}
+
+/*
+ * bool operaReadTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels)
+ * \brief Decompress the tile-compressed image HDU at fptr into pixels, tiles decoded in parallel.
+ * \return false if this HDU can not be handled here and nothing was read
+ */
+bool operaReadTileCompressedPixels(fitsfile *fptr, edatatype Datatype, void *pixels, unsigned long npixels) {
+	tileLayout_t layout;
+	if (!getTileLayout(fptr, Datatype, npixels, layout)) {
+		return false;
+	}
+	int status = 0;
+	long *lengths = (long *)calloc(layout.ntiles, sizeof(long));
+	unsigned char **buffers = (unsigned char **)calloc(layout.ntiles, sizeof(unsigned char *));
+	if (!lengths || !buffers) {
+		throw operaException("operaFITSTileCompression: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);
+	}
+	/*
+	 * A tile cfitsio could not compress is kept in another column; leave those files to cfitsio.
+	 */
+	long total = 0;
+	for (long tile=0; tile<layout.ntiles; tile++) {
+		long offset = 0;
+		if (fits_read_descript(fptr, layout.colnum, tile+1, &lengths[tile], &offset, &status)) {
+			free(lengths);
+			free(buffers);
+			throw operaException("operaFITSTileCompression: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+		}
+		if (lengths[tile] == 0) {
+			free(lengths);
+			free(buffers);
+			return false;
+		}
+		total += lengths[tile];
+	}
+	/*
+	 * read the compressed streams in order, then decode them in parallel
+	 */
+	unsigned char *heap = (unsigned char *)malloc(total);
+	if (!heap) {
+		free(lengths);
+		free(buffers);
+		throw operaException("operaFITSTileCompression: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);
+	}
+	unsigned char *next = heap;
+	for (long tile=0; tile<layout.ntiles && !status; tile++) {
+		int anynul = 0;
+		buffers[tile] = next;
+		fits_read_col(fptr, TBYTE, layout.colnum, tile+1, 1, lengths[tile], NULL, next, &anynul, &status);
+		next += lengths[tile];
+	}
+	if (status) {
+		free(heap);
+		free(lengths);
+		free(buffers);
+		throw operaException("operaFITSTileCompression: cfitsio error ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+	}
+	tileCodingContext_t context;
+	context.layout = &layout;
+	context.datatype = Datatype;
+	context.pixels = pixels;
+	context.buffers = buffers;
+	context.lengths = lengths;
+	try {
+		operaThreadPool::getSharedPool().parallelFor(layout.ntiles, decompressTile, (void *)&context);
+	}
+	catch (const operaException &) {
+		free(heap);
+		free(lengths);
+		free(buffers);
+		throw;
+	}
+	free(heap);
+	free(lengths);
+	free(buffers);
+	return true;
+}
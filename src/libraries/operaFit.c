@@ -946,34 +946,28 @@ void operaLMFit2DGaussian(unsigned m_dat, double *x, double *y, double *fxy, dou
 
 void operaFitSpline(unsigned nin, const float *xin, const float *yin, unsigned nout, const float *xout, float *yout)
 {
+	if (nin < 2) {
+		return;
+	}
 	float yp1 = (yin[1] - yin[0])/(xin[1] - xin[0]);
 	float ypn = (yin[nin-1] - yin[nin-2])/(xin[nin-1] - xin[nin-2]);
-	float *y2 = (float *)malloc(nin*sizeof(float));
-	
-	// Call cubicspline to get second derivatives
-	cubicspline(xin, yin, nin, yp1, ypn, y2);
 	
-	// Call splineinterpolate for interpolations
-	for (unsigned i=0; i<nout; i++) {
-		splineinterpolate(xin, yin, y2, nin, xout[i] , &yout[i]);
-	}
-	free(y2);
+	operaSpline_t *spline = operaSplineCreateFloat(nin, xin, yin, yp1, ypn);
+	operaSplineEvaluateFloat(spline, nout, xout, yout);
+	operaSplineDelete(spline);
 }
 
 void operaFitSplineDouble(unsigned nin, const double *xin, const double *yin, unsigned nout, const double *xout, double *yout)
 {
+	if (nin < 2) {
+		return;
+	}
 	double yp1 = (yin[1] - yin[0])/(xin[1] - xin[0]);
 	double ypn = (yin[nin-1] - yin[nin-2])/(xin[nin-1] - xin[nin-2]);
-	double *y2 = (double *)malloc(nin*sizeof(double));
-	
-	// Call cubicspline to get second derivatives
-	cubicsplineDouble(xin, yin, nin, yp1, ypn, y2);
 	
-	// Call splineinterpolate for interpolations
-	for (unsigned i=0; i<nout; i++) {
-		splineinterpolateDouble(xin, yin, y2, nin, xout[i] , &yout[i]);
-	}
-	free(y2);
+	operaSpline_t *spline = operaSplineCreate(nin, xin, yin, yp1, ypn);
+	operaSplineEvaluate(spline, nout, xout, yout);
+	operaSplineDelete(spline);
 }
 
 /* 
@@ -983,47 +977,252 @@ void operaFitSplineDouble(unsigned nin, const double *xin, const double *yin, un
  * \param xin is a float array for the input x data points 
  * \param nyin is an unsigned for the number of y input data points 
  * \param yin is a float array for the input y data points  
- * \param fxyin is a float array for the input fxy data points  
+ * \param fxyin is a float array for the input fxy data points, fxyin[j*nxin+i] = f(xin[i], yin[j])
  * \param nxout is an unsigned for the number of x output data points.
  * \param xout is a float array for the output x data points, which should be provided.
  * \param nyout is an unsigned for the number of y output data points.
  * \param yout is a float array for the output y data points, which should be provided. 
- * \param fxyout is a float array for the output interpolated fxy data points, which is calculated
+ * \param fxyout is a float array for the output interpolated fxy data points, fxyout[j*nxout+i] = f(xout[i], yout[j])
+ * \details Natural splines along x through each input row are evaluated at every xout, then for each xout
+ * a natural spline along y through those values is evaluated at every yout. Both passes reuse one spline
+ * object per axis, only its values change.
  * \return void
  */
 
 void operaFit2DSpline(unsigned nxin, float *xin, unsigned nyin, float *yin, float *fxyin, unsigned nxout, float *xout, unsigned nyout, float *yout, float *fxyout)
 {
-	unsigned ii, ipix;
-	float x, y; 
-	
-	
-	CMatrix z  = newCMatrix(nxin, nyin); // CMatrix of data
-	CMatrix z2 = newCMatrix(nxin, nyin); // CMatrix containing 2nd derivatives
+	if (nxin < 2 || nyin < 2) {
+		return;
+	}
+	double *xind = (double *)malloc(nxin*sizeof(double));
+	double *yind = (double *)malloc(nyin*sizeof(double));
+	double *xoutd = (double *)malloc(nxout*sizeof(double));
+	double *youtd = (double *)malloc(nyout*sizeof(double));
+	double *values = (double *)malloc((nxin > nyin ? nxin : nyin)*sizeof(double));
+	double *rows = (double *)malloc(nyin*nxout*sizeof(double));		// row splines at xout
+	double *column = (double *)malloc(nyout*sizeof(double));
+	
+	for (unsigned i=0; i<nxin; i++) xind[i] = xin[i];
+	for (unsigned j=0; j<nyin; j++) yind[j] = yin[j];
+	for (unsigned i=0; i<nxout; i++) xoutd[i] = xout[i];
+	for (unsigned j=0; j<nyout; j++) youtd[j] = yout[j];
+	
+	for (unsigned i=0; i<nxin; i++) values[i] = fxyin[i];
+	operaSpline_t *spline = operaSplineCreate(nxin, xind, values, 1.0e30, 1.0e30);
+	for (unsigned j=0; j<nyin; j++) {
+		if (j > 0) {
+			for (unsigned i=0; i<nxin; i++) values[i] = fxyin[j*nxin+i];
+			operaSplineSetValues(spline, values, 1.0e30, 1.0e30);
+		}
+		operaSplineEvaluate(spline, nxout, xoutd, rows + j*nxout);
+	}
+	operaSplineDelete(spline);
+	
+	for (unsigned j=0; j<nyin; j++) values[j] = rows[j*nxout];
+	spline = operaSplineCreate(nyin, yind, values, 1.0e30, 1.0e30);
+	for (unsigned i=0; i<nxout; i++) {
+		if (i > 0) {
+			for (unsigned j=0; j<nyin; j++) values[j] = rows[j*nxout+i];
+			operaSplineSetValues(spline, values, 1.0e30, 1.0e30);
+		}
+		operaSplineEvaluate(spline, nyout, youtd, column);
+		for (unsigned j=0; j<nyout; j++) {
+			fxyout[j*nxout+i] = (float)column[j];
+		}
+	}
+	operaSplineDelete(spline);
+	
+	free(column);
+	free(rows);
+	free(values);
+	free(youtd);
+	free(xoutd);
+	free(yind);
+	free(xind);
+}
+
+/*
+ * Spline objects
+ */
 
-	// get a pointer to the base of the data and copy in the vector
-	float *zbase = z[0];
-	for (unsigned j=0; j<nxin*nyin; j++) {
-		*zbase++ = *fxyin++;
-	}  
-	
-	// Call cubicspline2D to get second derivatives 
-	cubicspline2D(xin, yin, z, nxin, nyin, z2);  
-	
-	// Call splineinterpolate2D for interpolations 
-	// ??? fixme
-	for (unsigned j=1; j<=nyout; j++) {
-		ii = (j-1)*nxout;  
-		y = yout[j-1];
-		for (unsigned i=1; i<=nxout;i ++) {
-			x = xout[i-1];     
-			ipix = ii + i - 1;    
-			splineinterpolate2D(xin, yin, z, z2, nxin, nyin, x, y, &fxyout[ipix]);
+#define OPERA_SPLINE_BLOCK 256		// queries located before they are evaluated
+#define OPERA_SPLINE_WALK 8			// knots walked before falling back to the buckets
+
+static inline unsigned operaSplineBucket(const operaSpline_t *spline, double x)
+{
+	unsigned k = (unsigned)((x - spline->x[0])*spline->bucketscale);
+	return k < spline->nbuckets ? k : spline->nbuckets-1;
+}
+
+/*
+ * unsigned operaSplineLocate(const operaSpline_t *spline, double x, unsigned i)
+ * \brief the interval of x, walking forward from interval i of the previous query when x is at or above it.
+ * \details buckets[k] is the last interval whose knot falls in a bucket before k, so it starts at or below any
+ * x in bucket k and the walk from there only crosses the knots of bucket k.
+ */
+static inline unsigned operaSplineLocate(const operaSpline_t *spline, double x, unsigned i)
+{
+	const double *xa = spline->x;
+	unsigned last = spline->n - 2;
+	if (x >= xa[i]) {
+		for (unsigned step=0; step<OPERA_SPLINE_WALK; step++) {
+			if (i == last || x < xa[i+1]) {
+				return i;
+			}
+			i++;
+		}
+	}
+	if (!(x >= xa[1])) {
+		return 0;
+	}
+	if (x >= xa[last]) {
+		return last;
+	}
+	i = spline->buckets[operaSplineBucket(spline, x)];
+	while (x >= xa[i+1]) {
+		i++;
+	}
+	return i;
+}
+
+/* 
+ * operaSpline_t *operaSplineCreate(unsigned n, const double *x, const double *y, double yp1, double ypn)
+ * \brief A cubic spline through n points (x, y), x strictly increasing, for repeated evaluation.
+ * \param yp1, ypn are the first derivatives at the ends, above 0.99e30 for a natural spline end, as in cubicspline
+ * \return the spline, to be freed with operaSplineDelete, or NULL for less than 2 points
+ */
+operaSpline_t *operaSplineCreate(unsigned n, const double *x, const double *y, double yp1, double ypn)
+{
+	if (n < 2) {
+		return NULL;
+	}
+	operaSpline_t *spline = (operaSpline_t *)malloc(sizeof(operaSpline_t));
+	spline->n = n;
+	spline->x = (double *)malloc(n*sizeof(double));
+	memcpy(spline->x, x, n*sizeof(double));
+	spline->coeffs = (double *)malloc(4*(n-1)*sizeof(double));
+	spline->y2 = (double *)malloc(n*sizeof(double));
+	
+	unsigned last = n - 2;
+	double range = x[n-1] - x[0];
+	spline->nbuckets = n - 1;
+	spline->bucketscale = range > 0.0 ? (double)spline->nbuckets/range : 0.0;
+	spline->buckets = (unsigned *)malloc(spline->nbuckets*sizeof(unsigned));
+	unsigned i = 0;
+	for (unsigned k=0; k<spline->nbuckets; k++) {
+		while (i < last && operaSplineBucket(spline, x[i+1]) < k) {
+			i++;
 		}
-	}  
+		spline->buckets[k] = i;
+	}
 	
-	deleteCMatrix(z);
-	deleteCMatrix(z2);
+	operaSplineSetValues(spline, y, yp1, ypn);
+	return spline;
+}
+
+operaSpline_t *operaSplineCreateFloat(unsigned n, const float *x, const float *y, float yp1, float ypn)
+{
+	if (n < 2) {
+		return NULL;
+	}
+	double *xd = (double *)malloc(n*sizeof(double));
+	double *yd = (double *)malloc(n*sizeof(double));
+	for (unsigned i=0; i<n; i++) {
+		xd[i] = x[i];
+		yd[i] = y[i];
+	}
+	operaSpline_t *spline = operaSplineCreate(n, xd, yd, yp1, ypn);
+	free(yd);
+	free(xd);
+	return spline;
+}
+
+/* 
+ * void operaSplineSetValues(operaSpline_t *spline, const double *y, double yp1, double ypn)
+ * \brief Refit the spline to new values y at the same knots.
+ */
+void operaSplineSetValues(operaSpline_t *spline, const double *y, double yp1, double ypn)
+{
+	const double *x = spline->x;
+	double *y2 = spline->y2;
+	cubicsplineDouble(x, y, spline->n, yp1, ypn, y2);
+	for (unsigned i=0; i<spline->n-1; i++) {
+		double h = x[i+1] - x[i];
+		double *c = spline->coeffs + 4*i;
+		c[0] = y[i];
+		c[1] = (y[i+1] - y[i])/h - h*(2.0*y2[i] + y2[i+1])/6.0;
+		c[2] = 0.5*y2[i];
+		c[3] = (y2[i+1] - y2[i])/(6.0*h);
+	}
+}
+
+/* 
+ * void operaSplineEvaluate(const operaSpline_t *spline, unsigned nout, const double *xout, double *yout)
+ * \brief The spline at each of xout. Any order works, ascending xout is the fastest.
+ * \details Each block of queries is located first, then evaluated in a loop free of branches.
+ */
+void operaSplineEvaluate(const operaSpline_t *spline, unsigned nout, const double *xout, double *yout)
+{
+	unsigned interval[OPERA_SPLINE_BLOCK];
+	unsigned i = 0;
+	for (unsigned first=0; first<nout; first+=OPERA_SPLINE_BLOCK) {
+		unsigned count = nout - first < OPERA_SPLINE_BLOCK ? nout - first : OPERA_SPLINE_BLOCK;
+		const double *xq = xout + first;
+		double *yq = yout + first;
+		for (unsigned k=0; k<count; k++) {
+			i = operaSplineLocate(spline, xq[k], i);
+			interval[k] = i;
+		}
+		for (unsigned k=0; k<count; k++) {
+			const double *c = spline->coeffs + 4*interval[k];
+			double t = xq[k] - spline->x[interval[k]];
+			yq[k] = c[0] + t*(c[1] + t*(c[2] + t*c[3]));
+		}
+	}
+}
+
+void operaSplineEvaluateFloat(const operaSpline_t *spline, unsigned nout, const float *xout, float *yout)
+{
+	unsigned interval[OPERA_SPLINE_BLOCK];
+	unsigned i = 0;
+	for (unsigned first=0; first<nout; first+=OPERA_SPLINE_BLOCK) {
+		unsigned count = nout - first < OPERA_SPLINE_BLOCK ? nout - first : OPERA_SPLINE_BLOCK;
+		const float *xq = xout + first;
+		float *yq = yout + first;
+		for (unsigned k=0; k<count; k++) {
+			i = operaSplineLocate(spline, xq[k], i);
+			interval[k] = i;
+		}
+		for (unsigned k=0; k<count; k++) {
+			const double *c = spline->coeffs + 4*interval[k];
+			double t = xq[k] - spline->x[interval[k]];
+			yq[k] = (float)(c[0] + t*(c[1] + t*(c[2] + t*c[3])));
+		}
+	}
+}
+
+/* 
+ * double operaSplineValue(const operaSpline_t *spline, double x)
+ * \brief The spline at a single x.
+ */
+double operaSplineValue(const operaSpline_t *spline, double x)
+{
+	unsigned i = operaSplineLocate(spline, x, 0);
+	const double *c = spline->coeffs + 4*i;
+	double t = x - spline->x[i];
+	return c[0] + t*(c[1] + t*(c[2] + t*c[3]));
+}
+
+void operaSplineDelete(operaSpline_t *spline)
+{
+	if (spline == NULL) {
+		return;
+	}
+	free(spline->buckets);
+	free(spline->y2);
+	free(spline->coeffs);
+	free(spline->x);
+	free(spline);
 }
 
 /*
@@ -0,0 +1,391 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaGaussianFit
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <math.h>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaGaussianFit.h"
+#include "libraries/operaThreadPool.h"
+#include "libraries/operaLibCommon.h"		// for MIN, MAX
+#include "libraries/mpfit.h"				// for the status codes
+
+/*!
+ * operaGaussianFit
+ * \brief Levenberg-Marquardt fitting of a few Gaussians with closed-form derivatives.
+ * \file operaGaussianFit.cpp
+ * \ingroup libraries
+ */
+
+#define GAUSSFIT_FTOL 1e-10			// relative chi-square convergence, as the mpfit default
+#define GAUSSFIT_XTOL 1e-10			// relative parameter convergence, as the mpfit default
+#define GAUSSFIT_LAMBDA0 1e-3
+#define GAUSSFIT_MAXLAMBDA 1e10
+#define GAUSSFIT_BATCH_CHUNK 16		// problems handed to a thread at a time
+
+typedef double gaussFitMatrix[MAXGAUSSFITPARAMETERS][MAXGAUSSFITPARAMETERS];
+
+/*
+ * Constructors / Destructors
+ */
+
+operaGaussianFitProblem::operaGaussianFitProblem() :
+nDataPoints(0), x(NULL), y(NULL), yerrors(NULL),
+nPeaks(0), useBaseline(false),
+maxIterations(200), chisqr(0), status(0)
+{
+	for (unsigned j=0; j<MAXGAUSSFITPARAMETERS; j++) {
+		par[j] = epar[j] = 0;
+		fixed[j] = lowerLimited[j] = upperLimited[j] = false;
+		lowerLimit[j] = upperLimit[j] = 0;
+	}
+}
+
+void operaGaussianFitProblem::setData(unsigned NDataPoints, const double *X, const double *Y, const double *YErrors) {
+	nDataPoints = NDataPoints;
+	x = X;
+	y = Y;
+	yerrors = YErrors;
+}
+
+void operaGaussianFitProblem::setPeak(unsigned k, double Amplitude, double Center, double Sigma) {
+	if (k >= MAXGAUSSFITPEAKS) {
+		throw operaException("operaGaussianFit: ", operaErrorInvalidParameter, __FILE__, __FUNCTION__, __LINE__);
+	}
+	if (useBaseline && k >= nPeaks) {	// keep the baseline at the end
+		double intercept = par[3*nPeaks], slope = par[3*nPeaks+1];
+		nPeaks = k+1;
+		setBaseline(intercept, slope);
+	} else if (k >= nPeaks) {
+		nPeaks = k+1;
+	}
+	par[3*k] = Amplitude;
+	par[3*k+1] = Center;
+	par[3*k+2] = Sigma;
+	for (unsigned j=3*k; j<3*k+3; j++) {
+		epar[j] = 0;
+		fixed[j] = lowerLimited[j] = upperLimited[j] = false;
+	}
+}
+
+void operaGaussianFitProblem::setBaseline(double Intercept, double Slope) {
+	useBaseline = true;
+	par[3*nPeaks] = Intercept;
+	par[3*nPeaks+1] = Slope;
+	for (unsigned j=3*nPeaks; j<3*nPeaks+2; j++) {
+		epar[j] = 0;
+		fixed[j] = lowerLimited[j] = upperLimited[j] = false;
+	}
+}
+
+/*
+ * double gaussianFitModel(const operaGaussianFitProblem &problem, const double *par, double x, double *deriv)
+ * \brief the model at x, and if deriv is not NULL its derivative with respect to every parameter.
+ */
+static inline double gaussianFitModel(const operaGaussianFitProblem &problem, const double *par, double x, double *deriv) {
+	double f = 0;
+	for (unsigned k=0; k<problem.nPeaks; k++) {
+		double a = par[3*k];
+		double dx = x - par[3*k+1];
+		double sig = par[3*k+2];
+		double sig2 = sig*sig;
+		double e = exp(-dx*dx/(2.0*sig2));
+		f += a*e;
+		if (deriv) {
+			deriv[3*k] = e;
+			deriv[3*k+1] = a*e*dx/sig2;
+			deriv[3*k+2] = a*e*dx*dx/(sig2*sig);
+		}
+	}
+	if (problem.useBaseline) {
+		unsigned b = 3*problem.nPeaks;
+		f += par[b] + par[b+1]*x;
+		if (deriv) {
+			deriv[b] = 1.0;
+			deriv[b+1] = x;
+		}
+	}
+	return f;
+}
+
+static double gaussianFitChisqr(const operaGaussianFitProblem &problem, const double *par) {
+	double chi2 = 0;
+	for (unsigned i=0; i<problem.nDataPoints; i++) {
+		double r = (problem.y[i] - gaussianFitModel(problem, par, problem.x[i], NULL))/problem.yerrors[i];
+		chi2 += r*r;
+	}
+	return chi2;
+}
+
+/*
+ * double gaussianFitNormalEquations(...)
+ * \brief accumulate alpha = J^T J and beta = J^T r over the free parameters, returns chi-square.
+ */
+static double gaussianFitNormalEquations(const operaGaussianFitProblem &problem, const double *par, unsigned nfree, const unsigned *freeIndex, gaussFitMatrix alpha, double *beta) {
+	double deriv[MAXGAUSSFITPARAMETERS];
+	double chi2 = 0;
+	for (unsigned j=0; j<nfree; j++) {
+		beta[j] = 0;
+		for (unsigned l=0; l<=j; l++) {
+			alpha[j][l] = 0;
+		}
+	}
+	for (unsigned i=0; i<problem.nDataPoints; i++) {
+		double w = 1.0/problem.yerrors[i];
+		double r = (problem.y[i] - gaussianFitModel(problem, par, problem.x[i], deriv))*w;
+		chi2 += r*r;
+		for (unsigned j=0; j<nfree; j++) {
+			double dj = deriv[freeIndex[j]]*w;
+			beta[j] += dj*r;
+			for (unsigned l=0; l<=j; l++) {
+				alpha[j][l] += dj*deriv[freeIndex[l]]*w;
+			}
+		}
+	}
+	for (unsigned j=0; j<nfree; j++) {
+		for (unsigned l=0; l<j; l++) {
+			alpha[l][j] = alpha[j][l];
+		}
+	}
+	return chi2;
+}
+
+/*
+ * bool choleskyDecompose(unsigned n, gaussFitMatrix m)
+ * \brief in place, the lower triangle of m becomes L with L L^T = m. Returns false if m is not positive definite.
+ */
+static bool choleskyDecompose(unsigned n, gaussFitMatrix m) {
+	for (unsigned j=0; j<n; j++) {
+		double d = m[j][j];
+		for (unsigned k=0; k<j; k++) {
+			d -= m[j][k]*m[j][k];
+		}
+		if (!(d > 0)) {
+			return false;
+		}
+		m[j][j] = sqrt(d);
+		for (unsigned i=j+1; i<n; i++) {
+			double s = m[i][j];
+			for (unsigned k=0; k<j; k++) {
+				s -= m[i][k]*m[j][k];
+			}
+			m[i][j] = s/m[j][j];
+		}
+	}
+	return true;
+}
+
+static void choleskySolve(unsigned n, const gaussFitMatrix l, double *b) {
+	for (unsigned i=0; i<n; i++) {
+		for (unsigned k=0; k<i; k++) {
+			b[i] -= l[i][k]*b[k];
+		}
+		b[i] /= l[i][i];
+	}
+	for (unsigned i=n; i-- > 0; ) {
+		for (unsigned k=i+1; k<n; k++) {
+			b[i] -= l[k][i]*b[k];
+		}
+		b[i] /= l[i][i];
+	}
+}
+
+int operaGaussianFitLM(operaGaussianFitProblem &problem) {
+	unsigned npar = problem.getNumberOfParameters();
+	if (problem.nPeaks > MAXGAUSSFITPEAKS) {
+		return problem.status = MP_ERR_PARAM;
+	}
+	if (problem.nDataPoints == 0) {
+		return problem.status = MP_ERR_NPOINTS;
+	}
+	unsigned freeIndex[MAXGAUSSFITPARAMETERS];
+	unsigned nfree = 0;
+	for (unsigned j=0; j<npar; j++) {
+		if (!problem.fixed[j]) {
+			freeIndex[nfree++] = j;
+		}
+		if ((problem.lowerLimited[j] && problem.par[j] < problem.lowerLimit[j]) || (problem.upperLimited[j] && problem.par[j] > problem.upperLimit[j])) {
+			return problem.status = MP_ERR_INITBOUNDS;
+		}
+	}
+	if (nfree == 0) {
+		return problem.status = MP_ERR_NFREE;
+	}
+	if (problem.nDataPoints < nfree) {
+		return problem.status = MP_ERR_DOF;
+	}
+
+	gaussFitMatrix alpha, m;
+	double beta[MAXGAUSSFITPARAMETERS], step[MAXGAUSSFITPARAMETERS];
+	double par[MAXGAUSSFITPARAMETERS], trial[MAXGAUSSFITPARAMETERS];
+	bool active[MAXGAUSSFITPARAMETERS];
+	for (unsigned j=0; j<npar; j++) {
+		par[j] = trial[j] = problem.par[j];
+	}
+
+	double chi2 = gaussianFitNormalEquations(problem, par, nfree, freeIndex, alpha, beta);
+	if (isnan(chi2) || isinf(chi2)) {
+		return problem.status = MP_ERR_NAN;
+	}
+	double lambda = GAUSSFIT_LAMBDA0;
+	int status = MP_MAXITER;
+
+	for (unsigned iter=0; iter<problem.maxIterations; iter++) {
+		// a parameter sitting on a limit with the gradient pointing out of the box is held this iteration
+		for (unsigned j=0; j<nfree; j++) {
+			unsigned p = freeIndex[j];
+			active[j] = !((problem.lowerLimited[p] && par[p] <= problem.lowerLimit[p] && beta[j] < 0) ||
+						  (problem.upperLimited[p] && par[p] >= problem.upperLimit[p] && beta[j] > 0));
+		}
+		bool anyActive = false;
+		for (unsigned j=0; j<nfree; j++) {
+			anyActive = anyActive || active[j];
+		}
+		if (!anyActive) {
+			status = MP_OK_PAR;
+			break;
+		}
+		bool improved = false;
+		double newchi2 = chi2;
+		while (lambda < GAUSSFIT_MAXLAMBDA) {
+			for (unsigned j=0; j<nfree; j++) {
+				for (unsigned l=0; l<nfree; l++) {
+					m[j][l] = (active[j] && active[l]) ? alpha[j][l] : 0.0;
+				}
+				m[j][j] = active[j] ? alpha[j][j]*(1.0 + lambda) : 1.0;
+				if (m[j][j] == 0) {
+					m[j][j] = lambda;
+				}
+				step[j] = active[j] ? beta[j] : 0.0;
+			}
+			if (!choleskyDecompose(nfree, m)) {
+				lambda *= 10.0;
+				continue;
+			}
+			choleskySolve(nfree, m, step);
+			for (unsigned j=0; j<nfree; j++) {
+				unsigned p = freeIndex[j];
+				double value = par[p] + step[j];
+				if (problem.lowerLimited[p] && value < problem.lowerLimit[p]) {
+					value = problem.lowerLimit[p];
+				}
+				if (problem.upperLimited[p] && value > problem.upperLimit[p]) {
+					value = problem.upperLimit[p];
+				}
+				trial[p] = value;
+			}
+			newchi2 = gaussianFitChisqr(problem, trial);
+			if (newchi2 < chi2) {
+				improved = true;
+				break;
+			}
+			lambda *= 10.0;
+		}
+		if (!improved) {
+			status = (chi2 == 0 ? MP_OK_CHI : MP_FTOL);	// no step lowers chi-square any more
+			break;
+		}
+
+		// as in MINPACK, chi-square has converged when both the actual and the predicted (linear model) reductions are small
+		double predicted = 0;
+		for (unsigned j=0; j<nfree; j++) {
+			double dj = trial[freeIndex[j]] - par[freeIndex[j]];
+			double adj = 0;
+			for (unsigned l=0; l<nfree; l++) {
+				adj += alpha[j][l]*(trial[freeIndex[l]] - par[freeIndex[l]]);
+			}
+			predicted += dj*(2.0*beta[j] - adj);
+		}
+		bool smallChange = (chi2 - newchi2) <= GAUSSFIT_FTOL*chi2 && fabs(predicted) <= GAUSSFIT_FTOL*chi2;
+		bool smallStep = true;
+		for (unsigned j=0; j<nfree; j++) {
+			unsigned p = freeIndex[j];
+			if (fabs(trial[p] - par[p]) > GAUSSFIT_XTOL*(fabs(par[p]) + GAUSSFIT_XTOL)) {
+				smallStep = false;
+			}
+			par[p] = trial[p];
+		}
+		chi2 = gaussianFitNormalEquations(problem, par, nfree, freeIndex, alpha, beta);
+		lambda = MAX(lambda/10.0, 1e-12);
+		if (smallChange || smallStep) {
+			status = (smallChange && smallStep) ? MP_OK_BOTH : (smallChange ? MP_OK_CHI : MP_OK_PAR);
+			break;
+		}
+	}
+
+	// errors from the diagonal of the covariance matrix, the inverse of J^T J at the solution
+	for (unsigned j=0; j<nfree; j++) {
+		for (unsigned l=0; l<nfree; l++) {
+			m[j][l] = alpha[j][l];
+		}
+	}
+	bool invertible = choleskyDecompose(nfree, m);
+	for (unsigned j=0; j<npar; j++) {
+		problem.par[j] = par[j];
+		problem.epar[j] = 0;
+	}
+	if (invertible) {
+		for (unsigned j=0; j<nfree; j++) {
+			for (unsigned l=0; l<nfree; l++) {
+				step[l] = (l == j ? 1.0 : 0.0);
+			}
+			choleskySolve(nfree, m, step);
+			problem.epar[freeIndex[j]] = sqrt(step[j]);
+		}
+	}
+	problem.chisqr = chi2/(double)(problem.nDataPoints - npar);
+	return problem.status = status;
+}
+
+/*
+ * shared by the threads of one operaGaussianFitLMBatch
+ */
+class gaussianFitBatch {
+public:
+	unsigned nProblems;
+	operaGaussianFitProblem *problems;
+};
+
+static void fitGaussianChunk(unsigned long chunk, void *context) {
+	gaussianFitBatch *batch = (gaussianFitBatch *)context;
+	unsigned first = (unsigned)chunk*GAUSSFIT_BATCH_CHUNK;
+	unsigned last = MIN(first + GAUSSFIT_BATCH_CHUNK, batch->nProblems);
+	for (unsigned i=first; i<last; i++) {
+		operaGaussianFitLM(batch->problems[i]);
+	}
+}
+
+void operaGaussianFitLMBatch(unsigned nProblems, operaGaussianFitProblem *problems) {
+	gaussianFitBatch batch;
+	batch.nProblems = nProblems;
+	batch.problems = problems;
+	unsigned long nchunks = (nProblems + GAUSSFIT_BATCH_CHUNK - 1) / GAUSSFIT_BATCH_CHUNK;
+	operaThreadPool::getSharedPool().parallelFor(nchunks, fitGaussianChunk, &batch);
+}
@@ -466,18 +466,7 @@ void operaIOFormats::readFormatWithOrders(operaSpectralOrderVector& orders, istr
 }
 
 void operaIOFormats::writeLibreEsprit(const operaSpectralOrderVector& orders, ostream &fout, operaSpectralOrder_t format) {
-	unsigned rows = 0;
-	for (unsigned order=orders.getMaxorder(); order>=orders.getMinorder(); order--) {
-		const operaSpectralOrder *spectralOrder = orders.GetSpectralOrder(order);
-		if (validFormatOrder(spectralOrder, format)) {
-			unsigned length = sizeOfFormatOrder(spectralOrder, format);
-			for (unsigned index = 0; index < length; index++) {
-				if (validLibreEspritElement(spectralOrder, format, index)) {
-					rows++;
-				}
-			}
-		}
-	}
+	unsigned rows = LibreEspritRows(orders, format);
 	unsigned cols = 0;
 	if (format == LibreEspritsp2Spectrum || format == LibreEspritpolSpectrum) cols = 2;
 	else if (format == LibreEspritsp1Spectrum) cols = 6;
@@ -502,6 +491,129 @@ void operaIOFormats::writeLibreEsprit(const operaSpectralOrderVector& orders, os
 	}
 }
 
+unsigned operaIOFormats::LibreEspritColumns(operaSpectralOrder_t format) {
+	switch (format) {
+		case LibreEspritsp2Spectrum:
+		case LibreEspritpolSpectrum: return 3;
+		case LibreEspritsp1Spectrum: return 7;
+		case LibreEspritpolarimetry: return 6;
+		default: return 0;
+	}
+}
+
+unsigned operaIOFormats::LibreEspritRows(const operaSpectralOrderVector& orders, operaSpectralOrder_t format) {
+	unsigned rows = 0;
+	for (unsigned order=orders.getMaxorder(); order>=orders.getMinorder(); order--) {
+		const operaSpectralOrder *spectralOrder = orders.GetSpectralOrder(order);
+		if (validFormatOrder(spectralOrder, format)) {
+			unsigned length = sizeOfFormatOrder(spectralOrder, format);
+			for (unsigned index = 0; index < length; index++) {
+				if (validLibreEspritElement(spectralOrder, format, index)) {
+					rows++;
+				}
+			}
+		}
+	}
+	return rows;
+}
+
+unsigned operaIOFormats::WriteLibreEspritColumns(const operaSpectralOrderVector& orders, operaSpectralOrder_t format, float *const *columns) {
+	if (LibreEspritColumns(format) == 0) {
+		throw operaException("operaIOFormats: ", operaErrorCodeBadInstrumentModeError, __FILE__, __FUNCTION__, __LINE__);
+	}
+	vector<unsigned> valid;
+	unsigned row = 0;
+	for (unsigned order=orders.getMaxorder(); order>=orders.getMinorder(); order--) {
+		const operaSpectralOrder *spectralOrder = orders.GetSpectralOrder(order);
+		if (!validFormatOrder(spectralOrder, format)) continue;
+		valid.clear();
+		unsigned length = sizeOfFormatOrder(spectralOrder, format);
+		for (unsigned index = 0; index < length; index++) {
+			if (validLibreEspritElement(spectralOrder, format, index)) valid.push_back(index);
+		}
+		const unsigned n = valid.size();
+		const operaSpectralElements *spectralElements = spectralOrder->getSpectralElements();
+		float *wl = columns[0] + row;
+		for (unsigned k = 0; k < n; k++) wl[k] = (float)spectralElements->getwavelength(valid[k]);
+		switch (format) {
+			case LibreEspritsp2Spectrum:
+			case LibreEspritpolSpectrum: {
+				float *flux = columns[1] + row, *err = columns[2] + row;
+				for (unsigned k = 0; k < n; k++) flux[k] = (float)spectralElements->getFlux(valid[k]);
+				for (unsigned k = 0; k < n; k++) err[k] = (float)sqrt(spectralElements->getFluxVariance(valid[k]));
+				break;
+			}
+			case LibreEspritsp1Spectrum: {
+				const operaSpectralElements *beams[3] = {spectralElements, spectralOrder->getBeamElements(0), spectralOrder->getBeamElements(1)};
+				for (unsigned b = 0; b < 3; b++) {
+					float *flux = columns[1+b] + row, *err = columns[4+b] + row;
+					for (unsigned k = 0; k < n; k++) flux[k] = (float)beams[b]->getFlux(valid[k]);
+					for (unsigned k = 0; k < n; k++) err[k] = (float)sqrt(beams[b]->getFluxVariance(valid[k]));
+				}
+				break;
+			}
+			case LibreEspritpolarimetry: {
+				const operaPolarimetry *Polarimetry = spectralOrder->getPolarimetry();
+				stokes_parameter_t stokesParameter = getStokesParameter(spectralOrder);
+				float *flux = columns[1] + row, *pol = columns[2] + row, *null1 = columns[3] + row, *null2 = columns[4] + row, *err = columns[5] + row;
+				for (unsigned k = 0; k < n; k++) flux[k] = (float)spectralElements->getFlux(valid[k]);
+				for (unsigned k = 0; k < n; k++) pol[k] = (float)Polarimetry->getDegreeOfPolarizationFlux(stokesParameter, valid[k]);
+				for (unsigned k = 0; k < n; k++) null1[k] = (float)Polarimetry->getFirstNullPolarizationFlux(stokesParameter, valid[k]);
+				for (unsigned k = 0; k < n; k++) null2[k] = (float)Polarimetry->getSecondNullPolarizationFlux(stokesParameter, valid[k]);
+				for (unsigned k = 0; k < n; k++) err[k] = (float)sqrt(Polarimetry->getDegreeOfPolarizationVariance(stokesParameter, valid[k]));
+				break;
+			}
+			default:
+				break;
+		}
+		row += n;
+	}
+	return row;
+}
+
+void operaIOFormats::SelectLibreEspritFluxAndWavelength(operaSpectralOrder *spectralOrder, operaFluxType_t fluxType, operaWavelengthType_t wavelengthType, bool removePolarContinuum) {
+	if (spectralOrder->gethasSpectralElements()) {
+		operaSpectralElements *spectralElements = spectralOrder->getSpectralElements();
+		if (spectralElements->getHasExtendedBeamFlux()) {
+			switch (fluxType) {
+				case RawFluxInElectronsPerElement:
+					spectralOrder->CopyRawFluxIntoFluxVector();
+					break;
+				case NormalizedFluxToContinuum:
+					spectralOrder->CopyNormalizedFluxIntoFluxVector();
+					break;
+				case CalibratedFluxNormalizedToRefWavelength:
+					spectralOrder->CopyFcalFluxIntoFluxVector();
+					break;
+				default:
+					break;
+			}
+			switch (wavelengthType) {
+				case ThArCalibratedInNM:
+					break;
+				case TelluricCorrectedWavelengthInNM:
+					spectralElements->copyFROMtell();
+					break;
+				case RVCorrectedWavelengthInNM:
+					spectralOrder->applyWavelengthCorrectionFromExtendedRvel();
+					break;
+				case RVAndTelluricCorrectedWavelengthInNM:
+					spectralElements->copyFROMtell();
+					spectralOrder->applyWavelengthCorrectionFromExtendedRvel();
+					break;
+				default:
+					break;
+			}
+		}
+	}
+	if (spectralOrder->gethasPolarimetry() && removePolarContinuum) {
+		operaPolarimetry *polarimetry = spectralOrder->getPolarimetry();
+		if (polarimetry->getHasContinuumRemoved()) {
+			polarimetry->copyFROMcontinuumremoved();
+		}
+	}
+}
+
 void operaIOFormats::writeLibreEspritCenterSNR(const operaSpectralOrderVector& orders, ostream &fout) {
 	fout << "***SNR of '" << orders.getObject() << "'" << endl;
 	fout << orders.getMaxorder() - orders.getMinorder() + 1 << " 1" << endl;
@@ -76,8 +76,9 @@ geometricCenterX(0.5),
 geometricCenterY(0.5),
 nDataPoints(0),
 maxnDataPoints(0),
-dataCube(0, 0, 0),
-ipPolyModel(NYPoints, NXPoints),
+dataCube(),
+ipPolyNCoefficients(0),
+ipPolyOrders(NTotalPoints),
 chisqrMatrix(NYPoints, NXPoints)
 {
 	
@@ -95,9 +96,10 @@ geometricCenterX(0.5),
 geometricCenterY(0.5),
 nDataPoints(1),
 maxnDataPoints(1),
-dataCube(1, NYPoints, NXPoints),
+dataCube(NTotalPoints),
 distd(1),
-ipPolyModel(NYPoints, NXPoints),
+ipPolyNCoefficients(0),
+ipPolyOrders(NTotalPoints),
 chisqrMatrix(NYPoints, NXPoints)
 {
 	if (NXPoints == 0 || NYPoints == 0) {
@@ -118,9 +120,10 @@ geometricCenterX(0.5),
 geometricCenterY(0.5),
 nDataPoints(NDataPoints),
 maxnDataPoints(NDataPoints),
-dataCube(NDataPoints, NYPoints, NXPoints),
+dataCube(NDataPoints*NTotalPoints),
 distd(NDataPoints),
-ipPolyModel(NYPoints, NXPoints),
+ipPolyNCoefficients(0),
+ipPolyOrders(NTotalPoints),
 chisqrMatrix(NYPoints, NXPoints)
 {
 	if (NXPoints == 0 || NYPoints == 0 || NDataPoints == 0) {
@@ -252,7 +255,14 @@ DMatrix operaInstrumentProfile::getdataCubeValues(unsigned index) const {
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-    return dataCube[index];
+	DMatrix DataMatrix(NYPoints, NXPoints);
+	const double *slice = dataCube.datapointer() + index*NTotalPoints;
+	for (unsigned j=0; j<NYPoints; j++) {
+		for (unsigned i=0; i<NXPoints; i++) {
+			DataMatrix[j][i] = slice[j*NXPoints+i];
+		}
+	}
+    return DataMatrix;
 }
 
 double operaInstrumentProfile::getdataCubeValues(unsigned i, unsigned j, unsigned index) const {
@@ -261,7 +271,7 @@ double operaInstrumentProfile::getdataCubeValues(unsigned i, unsigned j, unsigne
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-	return dataCube[index][j][i];
+	return dataCube[(index*NYPoints+j)*NXPoints+i];
 }
 
 void operaInstrumentProfile::setdataCubeValues(DMatrix DataMatrix, unsigned index) {
@@ -270,7 +280,12 @@ void operaInstrumentProfile::setdataCubeValues(DMatrix DataMatrix, unsigned inde
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-	dataCube[index] = DataMatrix;
+	double *slice = dataCube.datapointer() + index*NTotalPoints;
+	for (unsigned j=0; j<NYPoints; j++) {
+		for (unsigned i=0; i<NXPoints; i++) {
+			slice[j*NXPoints+i] = DataMatrix[j][i];
+		}
+	}
 }
 
 void operaInstrumentProfile::setdataCubeValues(double DataValue, unsigned i, unsigned j, unsigned index) {
@@ -279,10 +294,7 @@ void operaInstrumentProfile::setdataCubeValues(double DataValue, unsigned i, uns
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-	if(index > dataCube.slices()) cout << "slice=" << index << " vs " << dataCube.slices() << endl; 
-	else if(j > dataCube.rows()) cout << "j=" << j << " vs " << dataCube.rows() << endl; 
-	else if(i > dataCube.cols()) cout << "i=" << i << " vs " << dataCube.cols() << endl;
-	dataCube[index][j][i] = DataValue;
+	dataCube[(index*NYPoints+j)*NXPoints+i] = DataValue;
 }
 
 double operaInstrumentProfile::getdataGivenCoords(double xcoord, double ycoord, unsigned index) const {
@@ -291,7 +303,7 @@ double operaInstrumentProfile::getdataGivenCoords(double xcoord, double ycoord,
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-	return dataCube[index][getIPixjIndex(ycoord)][getIPixiIndex(xcoord)];
+	return dataCube[(index*NYPoints+getIPixjIndex(ycoord))*NXPoints+getIPixiIndex(xcoord)];
 }
 
 void operaInstrumentProfile::setdataCubeValues(operaFITSImage &image, operaFITSImage &badpix, double xcenter, double ycenter, unsigned index) {
@@ -306,9 +318,9 @@ void operaInstrumentProfile::setdataCubeValues(operaFITSImage &image, operaFITSI
             unsigned xx = (unsigned)floor(xcenter + getIPixXCoordinate(i));
             if (xx > 0 && xx < image.getnaxis1() && yy > 0 && yy < image.getnaxis2()){
                 if (image[yy][xx] < SATURATIONLIMIT && badpix[yy][xx] == 1 && image[yy][xx] > 0) {
-                    dataCube[index][j][i] = image[yy][xx];
+                    dataCube[(index*NYPoints+j)*NXPoints+i] = image[yy][xx];
                 } else {
-                    dataCube[index][j][i] = NAN;
+                    dataCube[(index*NYPoints+j)*NXPoints+i] = NAN;
                 }
             }
         }
@@ -442,15 +454,36 @@ void operaInstrumentProfile::printModel(double DistanceInPixels, unsigned ordern
 	}
 }
 
+/*
+ * void setipPolyNCoefficients(unsigned NCoefficients)
+ * \brief make room for NCoefficients coefficients per point, the new planes are zero.
+ */
+void operaInstrumentProfile::setipPolyNCoefficients(unsigned NCoefficients) {
+	ipPolyNCoefficients = NCoefficients;
+	ipPolyCoefficients.resize(NCoefficients*NTotalPoints);
+}
+
 void operaInstrumentProfile::setipPolyModel(const PolynomialMatrix& IPPolyModel) {
-	ipPolyModel = IPPolyModel;
+	ipPolyNCoefficients = 0;
+	ipPolyCoefficients.clear();
+	for (unsigned j=0; j<NYPoints; j++) {
+		for (unsigned i=0; i<NXPoints; i++) {
+			setipPolyModelCoefficients(IPPolyModel[j][i], i, j);
+		}
+	}
 }
 
-const PolynomialMatrix& operaInstrumentProfile::getipPolyModel(void) {
-	return ipPolyModel;
+PolynomialMatrix operaInstrumentProfile::getipPolyModel(void) const {
+	PolynomialMatrix IPPolyModel(NYPoints, NXPoints);
+	for (unsigned j=0; j<NYPoints; j++) {
+		for (unsigned i=0; i<NXPoints; i++) {
+			IPPolyModel[j][i] = getipPolyModelCoefficients(i, j);
+		}
+	}
+	return IPPolyModel;
 }
 
-const Polynomial& operaInstrumentProfile::getipPolyModelCoefficients(unsigned i,unsigned j) const {
+Polynomial operaInstrumentProfile::getipPolyModelCoefficients(unsigned i,unsigned j) const {
 #ifdef RANGE_CHECK
 	if (j >= NYPoints) {
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
@@ -459,7 +492,12 @@ const Polynomial& operaInstrumentProfile::getipPolyModelCoefficients(unsigned i,
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-	return ipPolyModel[j][i];
+	unsigned point = j*NXPoints+i;
+	Polynomial PolyModelCoeffs(ipPolyOrders[point]);
+	for (unsigned k=0; k<ipPolyOrders[point]; k++) {
+		PolyModelCoeffs.setCoefficient(k, ipPolyCoefficients[k*NTotalPoints+point]);
+	}
+	return PolyModelCoeffs;
 }
 
 void operaInstrumentProfile::setipPolyModelCoefficients(const Polynomial& PolyModelCoeffs,unsigned i,unsigned j) {
@@ -471,27 +509,60 @@ void operaInstrumentProfile::setipPolyModelCoefficients(const Polynomial& PolyMo
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 #endif
-	ipPolyModel[j][i] = PolyModelCoeffs;
+	unsigned point = j*NXPoints+i;
+	unsigned order = PolyModelCoeffs.getOrderOfPolynomial();
+	if (order > ipPolyNCoefficients) {
+		setipPolyNCoefficients(order);
+	}
+	for (unsigned k=0; k<ipPolyNCoefficients; k++) {
+		ipPolyCoefficients[k*NTotalPoints+point] = k < order ? PolyModelCoeffs.getCoefficient(k) : 0.0;
+	}
+	ipPolyOrders[point] = order;
 }
 
 DMatrix operaInstrumentProfile::getipDataFromPolyModel(double d) const {
 	DMatrix ipmatrix(NYPoints, NXPoints);
+	operaVector ipdata(NTotalPoints);
+	getipDataFromPolyModel(d, ipdata.datapointer());
 	for (unsigned j=0; j<NYPoints; j++) {
 		for (unsigned i=0; i<NXPoints; i++) {
-			ipmatrix[j][i] = getipDataFromPolyModel(d,i,j);
+			ipmatrix[j][i] = ipdata[j*NXPoints+i];
 		}
 	}
 	return ipmatrix;
 }
 
 double operaInstrumentProfile::getipDataFromPolyModel(double d, unsigned i, unsigned j) const {
-	return ipPolyModel[j][i].Evaluate(d);
-	//Below might be slightly faster?
-	/*unsigned order = ipPolyModel[j][i].getOrderOfPolynomial(); 
-	const double* coeffs = ipPolyModel[j][i].getVector();
-	double total = 0;
-	for(unsigned i = order; i > 0; i--) total = d*total + coeffs[i-1];
-	return total;*/
+	if (ipPolyNCoefficients == 0) {
+		return 0.0;
+	}
+	const double *coeffs = ipPolyCoefficients.datapointer() + j*NXPoints + i;
+	double total = coeffs[(ipPolyNCoefficients-1)*NTotalPoints];
+	for (unsigned k = ipPolyNCoefficients-1; k > 0; k--) total = total*d + coeffs[(k-1)*NTotalPoints];
+	return total;
+}
+
+void operaInstrumentProfile::getipDataFromPolyModel(double d, double *ipdata) const {
+	getipDataFromPolyModel(&d, 1, ipdata);
+}
+
+void operaInstrumentProfile::getipDataFromPolyModel(const double *d, unsigned nd, double *ipdata) const {
+	const unsigned np = NTotalPoints;
+	if (ipPolyNCoefficients == 0) {
+		for (unsigned p=0; p<nd*np; p++) ipdata[p] = 0.0;
+		return;
+	}
+	const double *coeffs = ipPolyCoefficients.datapointer();
+	for (unsigned n=0; n<nd; n++) {
+		double *ip = ipdata + n*np;
+		const double dn = d[n];
+		const double *plane = coeffs + (ipPolyNCoefficients-1)*np;
+		for (unsigned p=0; p<np; p++) ip[p] = plane[p];
+		for (unsigned k = ipPolyNCoefficients-1; k > 0; k--) {
+			plane = coeffs + (k-1)*np;
+			for (unsigned p=0; p<np; p++) ip[p] = ip[p]*dn + plane[p];
+		}
+	}
 }
 
 void operaInstrumentProfile::setdataCubeFromPolyModel(void) {
@@ -506,17 +577,18 @@ void operaInstrumentProfile::setdataCubeFromPolyModel(unsigned index) {
 		throw operaException("operaInstrumentProfile: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
 	}
 #endif
-    for (unsigned j=0; j<NYPoints; j++) {
-        for (unsigned i=0; i<NXPoints; i++) {
-            if(!isnan(getdataCubeValues(i,j,index))) {
-				setdataCubeValues(getipDataFromPolyModel(distd[index],i,j),i,j,index);
-			}
-        }
-    }			
+	operaVector ipdata(NTotalPoints);
+	getipDataFromPolyModel(distd[index], ipdata.datapointer());
+	double *slice = dataCube.datapointer() + index*NTotalPoints;
+	for (unsigned p=0; p<NTotalPoints; p++) {
+		if(!isnan(slice[p])) {
+			slice[p] = ipdata[p];
+		}
+	}
 }
 
 void operaInstrumentProfile::FitPolyMatrixtoIPDataVector(unsigned coeffs, bool witherrors) {
-    ipPolyModel = PolynomialMatrix(NYPoints, NXPoints);
+    setipPolyModel(PolynomialMatrix(NYPoints, NXPoints));
 	chisqrMatrix = DMatrix(NYPoints, NXPoints);
 	
 	operaVector par(coeffs);
@@ -600,7 +672,7 @@ void operaInstrumentProfile::FitPolyMatrixtoIPDataVector(unsigned coeffs, bool w
 }
 
 void operaInstrumentProfile::FitMediantoIPDataVector(void) {
-    ipPolyModel = PolynomialMatrix(NYPoints, NXPoints);
+    setipPolyModel(PolynomialMatrix(NYPoints, NXPoints));
 	chisqrMatrix = DMatrix(NYPoints, NXPoints);
 	
 	operaVector ytmp(nDataPoints);
@@ -0,0 +1,205 @@
+/*******************************************************************
+ ****                LIBRARY FOR OPERA v1.0                     ****
+ *******************************************************************
+ Library name: operaKeyValueStore
+ Version: 1.0
+ Description: hashed name := value store of a harness file
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope 
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+ 
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+ 
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+
+/*!
+ * \brief hashed name := value store of a harness file.
+ * \file operaKeyValueStore.c
+ * \ingroup libraries
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+// do not link in perror and strerror...
+#define OPERAERRRORCODESONLY
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaKeyValueStore.h"
+
+/*
+ * FNV-1a hash of a name
+ */
+static unsigned operaKeyValueStoreHash(const char *name) {
+	unsigned hash = 2166136261u;
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * the table slot of name, either holding it or the free slot it would go in
+ */
+static unsigned operaKeyValueStoreSlot(const operaKeyValueStore *store, const char *name) {
+	unsigned mask = store->tablesize - 1;
+	unsigned slot = operaKeyValueStoreHash(name) & mask;
+	while (store->table[slot] && strcmp(store->names[store->table[slot]-1], name)) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/*
+ * split a line "name := value # comment" into its trimmed name and value in place, returns 0 if it is not an entry
+ */
+static int operaKeyValueStoreParseLine(char *line, char **name, char **value) {
+	char *equal = strchr(line, '=');
+	if (equal == NULL || equal == line || (equal[-1] != ':' && equal[-1] != '?'))
+		return 0;
+	char *end = equal - 1;												// the ":" or "?"
+	while (end > line && isspace((unsigned char)end[-1])) {
+		end--;
+	}
+	if (end == line)
+		return 0;
+	*end = '\0';
+	char *start = equal + 1;
+	while (*start == ' ' || *start == '\t') {							// get rid of the leading ws
+		start++;
+	}
+	end = start;
+	while (*end != '\0' && *end != '\n' && *end != '#') {				// stop at the "\n" or a comment
+		end++;
+	}
+	while (end > start && (end[-1] == '\t' || end[-1] == ' ')) {		// get rid of trailing ws
+		end--;
+	}
+	*end = '\0';
+	*name = line;
+	*value = start;
+	return 1;
+}
+
+/*
+ * a malloced copy of a string
+ */
+static char *operaKeyValueStoreCopy(const char *string) {
+	size_t length = strlen(string) + 1;
+	char *copy = (char *)malloc(length);
+	if (copy)
+		memcpy(copy, string, length);
+	return copy;
+}
+
+/*
+ * insert an entry unless the name is already there, the first entry of a name wins
+ */
+static operaErrorCode operaKeyValueStoreInsert(operaKeyValueStore *store, const char *name, const char *value) {
+	if (2*(store->count+1) > store->tablesize) {
+		unsigned newsize = store->tablesize ? 2*store->tablesize : 64;
+		unsigned *table = (unsigned *)calloc(newsize, sizeof(unsigned));
+		char **names = (char **)realloc(store->names, newsize/2*sizeof(char *));
+		char **values = names ? (char **)realloc(store->values, newsize/2*sizeof(char *)) : NULL;
+		if (names) store->names = names;
+		if (values) store->values = values;
+		if (table == NULL || names == NULL || values == NULL) {
+			free(table);
+			return operaErrorCodeNoMemory;
+		}
+		free(store->table);
+		store->table = table;
+		store->tablesize = newsize;
+		for (unsigned i=0; i<store->count; i++) {
+			store->table[operaKeyValueStoreSlot(store, store->names[i])] = i+1;
+		}
+	}
+	unsigned slot = operaKeyValueStoreSlot(store, name);
+	if (store->table[slot])
+		return operaErrorCodeOK;
+	char *namecopy = operaKeyValueStoreCopy(name);
+	char *valuecopy = operaKeyValueStoreCopy(value);
+	if (namecopy == NULL || valuecopy == NULL) {
+		free(namecopy);
+		free(valuecopy);
+		return operaErrorCodeNoMemory;
+	}
+	store->names[store->count] = namecopy;
+	store->values[store->count] = valuecopy;
+	store->table[slot] = ++store->count;
+	return operaErrorCodeOK;
+}
+
+void operaKeyValueStoreFree(operaKeyValueStore *store) {
+	for (unsigned i=0; i<store->count; i++) {
+		free(store->names[i]);
+		free(store->values[i]);
+	}
+	free(store->names);
+	free(store->values);
+	free(store->table);
+	memset(store, 0, sizeof(operaKeyValueStore));
+}
+
+operaErrorCode operaKeyValueStoreLoad(operaKeyValueStore *store, const char *filename, unsigned maxlinelength) {
+	struct stat status;
+	if (stat(filename, &status))
+		return errno;
+	if (store->filename[0] != '\0' && strcmp(store->filename, filename) == 0 && store->mtime == status.st_mtime && store->size == status.st_size)
+		return operaErrorCodeOK;
+	
+	FILE *stream = fopen(filename, "r");
+	if (stream == NULL)
+		return errno;
+	operaKeyValueStoreFree(store);
+	char *scanbuff = (char *)malloc(maxlinelength);
+	if (scanbuff == NULL) {
+		fclose(stream);
+		return operaErrorCodeNoMemory;
+	}
+	operaErrorCode errorcode = operaErrorCodeOK;
+	while (errorcode == operaErrorCodeOK && fgets(scanbuff, maxlinelength, stream) != NULL) {
+		char *name, *value;
+		if (operaKeyValueStoreParseLine(scanbuff, &name, &value))
+			errorcode = operaKeyValueStoreInsert(store, name, value);
+	}
+	free(scanbuff);
+	fclose(stream);
+	if (errorcode != operaErrorCodeOK) {
+		operaKeyValueStoreFree(store);
+		return errorcode;
+	}
+	strncpy(store->filename, filename, sizeof(store->filename)-1);
+	store->mtime = status.st_mtime;
+	store->size = status.st_size;
+	return operaErrorCodeOK;
+}
+
+const char *operaKeyValueStoreFind(const operaKeyValueStore *store, const char *name) {
+	if (store->count == 0)
+		return NULL;
+	unsigned slot = operaKeyValueStoreSlot(store, name);
+	return store->table[slot] ? store->values[store->table[slot]-1] : NULL;
+}
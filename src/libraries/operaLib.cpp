@@ -44,6 +44,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include <sstream>
 #include <fstream>
@@ -226,4 +228,131 @@ int mkpath(const char *path, mode_t mode)
     return (status);
 }
 
+/*
+ * Exact decimal formatting of floats
+ *
+ * A float has a 24 bit mantissa, so value * 10^k is exact in a double for 0 <= k <= 12, 5^12 fitting
+ * in 28 bits. For k < 0 the quotient by 10^-k is estimated, then corrected with the remainder, which is
+ * exact for -k <= 12 as long as the quotient has no more than 24 bits. Either way the decimal digits are
+ * those of the exact binary value rounded half to even, as printf rounds them.
+ */
+static const double formatPowersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12};
+#define FORMAT_MAXEXACTPOWER 12
+#define FORMAT_MAXSCIENTIFICPRECISION 6
+#define FORMAT_MAXDIGITS 4503599627370496.0		// 2^52
+
+/*
+ * bool formatRoundScaled(double absvalue, int k, unsigned long &digits)
+ * digits = absvalue * 10^k rounded half to even, false if that cannot be done exactly.
+ */
+static bool formatRoundScaled(double absvalue, int k, unsigned long &digits) {
+	if (k >= 0) {
+		if (k > FORMAT_MAXEXACTPOWER) return false;
+		double scaled = absvalue * formatPowersOfTen[k];
+		if (scaled >= FORMAT_MAXDIGITS) return false;
+		double rounded = floor(scaled);
+		double fraction = scaled - rounded;
+		if (fraction > 0.5 || (fraction == 0.5 && fmod(rounded, 2.0) != 0.0)) rounded += 1.0;
+		digits = (unsigned long)rounded;
+		return true;
+	}
+	if (-k > FORMAT_MAXEXACTPOWER) return false;
+	double power = formatPowersOfTen[-k];
+	double rounded = floor(absvalue / power + 0.5);
+	double remainder2 = 2.0*(absvalue - rounded * power);
+	if (remainder2 > power) rounded += 1.0;
+	else if (remainder2 < -power) rounded -= 1.0;
+	else if ((remainder2 == power || remainder2 == -power) && fmod(rounded, 2.0) != 0.0) rounded += remainder2 > 0 ? 1.0 : -1.0;
+	if (rounded >= 16777216.0) return false;	// 2^24, beyond which the remainder may not be exact
+	digits = (unsigned long)rounded;
+	return true;
+}
+
+/*
+ * unsigned formatDigits(char *out, unsigned long digits, unsigned mindigits)
+ * write digits in decimal with at least mindigits digits, returns the count.
+ */
+static unsigned formatDigits(char *out, unsigned long digits, unsigned mindigits) {
+	char reversed[24];
+	unsigned count = 0;
+	do {
+		reversed[count++] = (char)('0' + digits % 10);
+		digits /= 10;
+	} while (digits || count < mindigits);
+	for (unsigned i=0; i<count; i++) out[i] = reversed[count-1-i];
+	return count;
+}
+
+/*
+ * unsigned formatPad(char *buffer, unsigned size, const char *text, unsigned length, unsigned width)
+ * right justify text in width into buffer.
+ */
+static unsigned formatPad(char *buffer, unsigned size, const char *text, unsigned length, unsigned width) {
+	unsigned pad = width > length ? width - length : 0;
+	if (pad + length + 1 > size) return 0;
+	memset(buffer, ' ', pad);
+	memcpy(buffer + pad, text, length);
+	buffer[pad + length] = '\0';
+	return pad + length;
+}
+
+static unsigned formatFallback(char *buffer, unsigned size, const char *format, double value, unsigned width, unsigned precision) {
+	int length = snprintf(buffer, size, format, (int)width, (int)precision, value);
+	if (length < 0) return 0;
+	return (unsigned)length < size ? (unsigned)length : size - 1;
+}
+
+unsigned formatFixed(char *buffer, unsigned size, double value, unsigned width, unsigned precision) {
+	unsigned long digits;
+	double absvalue = fabs(value);
+	if (!isfinite(value) || (double)(float)absvalue != absvalue || !formatRoundScaled(absvalue, (int)precision, digits)) {
+		return formatFallback(buffer, size, "%*.*f", value, width, precision);
+	}
+	char text[48];
+	unsigned length = 0;
+	if (signbit(value)) text[length++] = '-';
+	unsigned long unit = (unsigned long)formatPowersOfTen[precision];
+	length += formatDigits(text + length, digits / unit, 1);
+	if (precision) {
+		text[length++] = '.';
+		length += formatDigits(text + length, digits % unit, precision);
+	}
+	unsigned written = formatPad(buffer, size, text, length, width);
+	return written ? written : formatFallback(buffer, size, "%*.*f", value, width, precision);
+}
 
+unsigned formatScientific(char *buffer, unsigned size, double value, unsigned width, unsigned precision) {
+	unsigned long digits = 0;
+	int exponent = 0;
+	double absvalue = fabs(value);
+	bool exact = isfinite(value) && (double)(float)absvalue == absvalue && precision <= FORMAT_MAXSCIENTIFICPRECISION;
+	if (exact && absvalue != 0.0) {
+		unsigned long lowest = (unsigned long)formatPowersOfTen[precision];
+		exponent = (int)floor(log10(absvalue));
+		for (unsigned attempt=0; exact && attempt<3; attempt++) {
+			exact = formatRoundScaled(absvalue, (int)precision - exponent, digits);
+			if (!exact) break;
+			if (digits >= 10*lowest) exponent++;
+			else if (digits < lowest) exponent--;
+			else break;
+		}
+		exact = exact && digits >= lowest && digits < 10*lowest;
+	}
+	if (!exact) {
+		return formatFallback(buffer, size, "%*.*e", value, width, precision);
+	}
+	char text[48];
+	unsigned length = 0;
+	if (signbit(value)) text[length++] = '-';
+	unsigned long unit = (unsigned long)formatPowersOfTen[precision];
+	length += formatDigits(text + length, digits / unit, 1);
+	if (precision) {
+		text[length++] = '.';
+		length += formatDigits(text + length, digits % unit, precision);
+	}
+	text[length++] = 'e';
+	text[length++] = exponent < 0 ? '-' : '+';
+	length += formatDigits(text + length, (unsigned long)(exponent < 0 ? -exponent : exponent), 2);
+	unsigned written = formatPad(buffer, size, text, length, width);
+	return written ? written : formatFallback(buffer, size, "%*.*e", value, width, precision);
+}
@@ -0,0 +1,367 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaLineDatabase
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaLineDatabase.h"
+#include "libraries/gzstream.h"					// for igzstream
+
+/*!
+ * operaLineDatabase
+ * \brief Sorted, memory-mapped reference line tables.
+ * \file operaLineDatabase.cpp
+ * \ingroup libraries
+ */
+
+#define LINEDATABASE_MAGIC "OPERALDB"
+#define LINEDATABASE_VERSION 1
+#define LINEDATABASE_BYTEORDER 0x01020304
+
+typedef struct operaLineDatabaseHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;					// reads differently on a host of the other endianness
+	uint32_t columns;					// 2: wavelength, intensity; 3: plus variance
+	uint32_t reserved;
+	uint64_t count;
+} operaLineDatabaseHeader_t;			// 32 bytes, keeps the columns 8 byte aligned
+
+/*
+ * Rows are ordered by wavelength, ties keep their file order.
+ */
+class wavelengthOrder {
+	const operaVector &wavelength;
+public:
+	wavelengthOrder(const operaVector &Wavelength) : wavelength(Wavelength) {}
+	bool operator()(unsigned a, unsigned b) const { return wavelength[a] < wavelength[b]; }
+};
+
+static void sortByWavelength(operaSpectrum &table) {
+	const operaVector &wavelength = table.wavelengthvector();
+	bool sorted = true;
+	for (unsigned i=1; i<wavelength.size() && sorted; i++) {
+		sorted = !(wavelength[i] < wavelength[i-1]);
+	}
+	if (sorted) {
+		return;
+	}
+	vector<unsigned> order(wavelength.size());
+	for (unsigned i=0; i<order.size(); i++) {
+		order[i] = i;
+	}
+	stable_sort(order.begin(), order.end(), wavelengthOrder(wavelength));
+	operaSpectrum sortedTable;
+	for (unsigned i=0; i<order.size(); i++) {
+		sortedTable.insert(table.getwavelength(order[i]), table.getflux(order[i]), table.getvariance(order[i]));
+	}
+	table = sortedTable;
+}
+
+/*
+ * Constructors / Destructors
+ */
+
+operaLineDatabase::operaLineDatabase() :
+mapping(NULL),
+mappingLength(0),
+wavelengths(NULL),
+intensities(NULL),
+variances(NULL),
+count(0)
+{
+}
+
+operaLineDatabase::operaLineDatabase(string Filename, operaLineFormat_t Format) :
+mapping(NULL),
+mappingLength(0),
+wavelengths(NULL),
+intensities(NULL),
+variances(NULL),
+count(0)
+{
+	open(Filename, Format);
+}
+
+operaLineDatabase::~operaLineDatabase() {
+	close();
+}
+
+/*
+ * void open(string Filename, operaLineFormat_t Format)
+ * \brief map Filename if it is a binary table, or its binary table if that is not older than it, otherwise parse it.
+ */
+void operaLineDatabase::open(string Filename, operaLineFormat_t Format) {
+	close();
+	if (isBinary(Filename)) {
+		openBinary(Filename);
+		return;
+	}
+	string binaryFilename = getBinaryFilename(Filename);
+	struct stat textstat, binarystat;
+	if (stat(Filename.c_str(), &textstat) == 0 && stat(binaryFilename.c_str(), &binarystat) == 0
+		&& binarystat.st_mtime >= textstat.st_mtime && isBinary(binaryFilename)) {
+		openBinary(binaryFilename);
+		if ((variances != NULL) == hasVarianceColumn(Format)) {
+			return;
+		}
+		close();	// built from another format, fall back to the text
+	}
+	parsed = readText(Filename, Format);
+	count = parsed.size();
+	if (count > 0) {
+		wavelengths = parsed.wavelength_ptr();
+		intensities = parsed.flux_ptr();
+		variances = hasVarianceColumn(Format) ? parsed.variance_ptr() : NULL;
+	}
+}
+
+/*
+ * void openBinary(string Filename)
+ * \brief map a binary table and point the columns into it.
+ */
+void operaLineDatabase::openBinary(string Filename) {
+	int fd = ::open(Filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw operaException("operaLineDatabase: "+Filename+" ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+	}
+	operaLineDatabaseHeader_t header;
+	struct stat filestat;
+	if (fstat(fd, &filestat) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+		|| strncmp(header.magic, LINEDATABASE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != LINEDATABASE_VERSION || header.byteorder != LINEDATABASE_BYTEORDER
+		|| (header.columns != 2 && header.columns != 3)
+		|| (uint64_t)filestat.st_size != sizeof(header) + header.columns * header.count * sizeof(double)) {
+		::close(fd);
+		throw operaException("operaLineDatabase: "+Filename+" ", operaErrorLineDatabaseFormat, __FILE__, __FUNCTION__, __LINE__);
+	}
+	size_t length = (size_t)filestat.st_size;
+	void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		throw operaException("operaLineDatabase: "+Filename+" ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+	}
+	madvise(map, length, MADV_RANDOM);		// bisection, then short runs
+	mapping = map;
+	mappingLength = length;
+	count = (unsigned)header.count;
+	wavelengths = (const double *)((const char *)map + sizeof(header));
+	intensities = wavelengths + count;
+	variances = header.columns == 3 ? intensities + count : NULL;
+}
+
+/*
+ * void close(void)
+ * \brief unmap or free the table.
+ */
+void operaLineDatabase::close(void) {
+	if (mapping) {
+		munmap(mapping, mappingLength);
+		mapping = NULL;
+		mappingLength = 0;
+	}
+	parsed = operaSpectrum();
+	wavelengths = intensities = variances = NULL;
+	count = 0;
+}
+
+/*
+ * void getRange(double wl0, double wlf, unsigned &first, unsigned &last)
+ * \brief the rows with wl0 <= wavelength <= wlf are [first, last).
+ */
+void operaLineDatabase::getRange(double wl0, double wlf, unsigned &first, unsigned &last) const {
+	if (count == 0 || wlf < wl0) {
+		first = last = 0;
+		return;
+	}
+	first = (unsigned)(lower_bound(wavelengths, wavelengths + count, wl0) - wavelengths);
+	last = (unsigned)(upper_bound(wavelengths + first, wavelengths + count, wlf) - wavelengths);
+}
+
+operaSpectrum operaLineDatabase::getSpectrum(void) const {
+	return getSpectrum(operaWavelengthRange(-HUGE_VAL, HUGE_VAL));
+}
+
+operaSpectrum operaLineDatabase::getSpectrum(operaWavelengthRange range) const {
+	unsigned first, last;
+	getRange(range.getwl0(), range.getwlf(), first, last);
+	operaSpectrum spectrum(last - first);
+	if (last > first) {
+		memcpy(spectrum.wavelength_ptr(), wavelengths + first, (last - first)*sizeof(double));
+		memcpy(spectrum.flux_ptr(), intensities + first, (last - first)*sizeof(double));
+		if (variances) {
+			memcpy(spectrum.variance_ptr(), variances + first, (last - first)*sizeof(double));
+		} else {
+			memset(spectrum.variance_ptr(), 0, (last - first)*sizeof(double));
+		}
+	}
+	return spectrum;
+}
+
+operaSpectralLineList operaLineDatabase::getLineList(void) const {
+	return getLineList(operaWavelengthRange(-HUGE_VAL, HUGE_VAL));
+}
+
+operaSpectralLineList operaLineDatabase::getLineList(operaWavelengthRange range) const {
+	unsigned first, last;
+	getRange(range.getwl0(), range.getwlf(), first, last);
+	operaSpectralLineList lines;
+	if (last > first) {
+		lines.center = operaVector(wavelengths + first, last - first);
+		lines.amplitude = operaVector(intensities + first, last - first);
+	}
+	return lines;
+}
+
+/*
+ * operaSpectrum readText(string Filename, operaLineFormat_t Format)
+ * \brief parse a reference file, the conversions are those the modules used to do on their own.
+ */
+operaSpectrum operaLineDatabase::readText(string Filename, operaLineFormat_t Format) {
+	const double N_OVER_V = TYPICAL_PRESSURE_AT_MAUNAKEA/(TYPICAL_TEMPERATURE_AT_MAUNAKEA*k_BOLTZMANN_CONSTANT);
+
+	operaSpectrum table;
+	igzstream astream(Filename.c_str());
+	if (!astream.is_open()) {
+		throw operaException("operaLineDatabase: "+Filename+" ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+	}
+	string dataline;
+	while (getline(astream, dataline)) {
+		if (dataline.empty() || dataline[0] == '#') { // skip blank lines and comments
+			continue;
+		}
+		switch (Format) {
+			case LineFormatHITRAN: {
+				double wave_number;
+				float intensity;
+				if(!sscanf(dataline.c_str(), "%*d %lf %G %*[^\n]", &wave_number, &intensity)) continue; //skip over bad line
+				double wavelength_in_nm = 1e7/wave_number;
+				table.insert(convertVacuumToAirWavelength(wavelength_in_nm*10)/10, ((double)intensity/(N_OVER_V*1e-6))/TYPICAL_ATMOSPHERE_PATH_LENGTH);
+			}
+				break;
+			case LineFormatRaw: {
+				double wavelength, intensity;
+				istringstream ss(dataline);
+				ss >> wavelength >> intensity;
+				table.insert(wavelength, intensity);
+			}
+				break;
+			case LineFormatThAr: {
+				istringstream ss(dataline);
+				double wn, wl, intensity;
+				string marker;
+				ss >> wn >> wl >> intensity >> marker;
+				if (marker == "Th" || marker == "Ar") {
+					table.insert(wl * 0.1, pow(10, intensity));
+				}
+			}
+				break;
+			case LineFormatAtlasSpectrum: {
+				double tmpwl, tmpi, tmpvar, tmp1, tmp2;
+				sscanf(dataline.c_str(), "%lf %lf %lf %lf %lf", &tmpwl, &tmpi, &tmp1, &tmp2, &tmpvar);
+				table.insert(0.1*tmpwl, tmpi, tmpvar);
+			}
+				break;
+		}
+	}
+	astream.close();
+	if (Format == LineFormatHITRAN) {
+		table.reverse();	// the file is in increasing wavenumber
+	}
+	sortByWavelength(table);
+	return table;
+}
+
+/*
+ * void write(string Filename, const operaSpectrum &Table, bool WithVariances)
+ * \brief write the header and the columns, the table must be sorted by wavelength.
+ */
+void operaLineDatabase::write(string Filename, const operaSpectrum &Table, bool WithVariances) {
+	operaLineDatabaseHeader_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LINEDATABASE_MAGIC, sizeof(header.magic));
+	header.version = LINEDATABASE_VERSION;
+	header.byteorder = LINEDATABASE_BYTEORDER;
+	header.columns = WithVariances ? 3 : 2;
+	header.count = Table.size();
+
+	ofstream fout(Filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!fout.is_open()) {
+		throw operaException("operaLineDatabase: "+Filename+" ", operaErrorNoOutput, __FILE__, __FUNCTION__, __LINE__);
+	}
+	fout.write((const char *)&header, sizeof(header));
+	if (Table.size() > 0) {
+		fout.write((const char *)Table.wavelength_ptr(), Table.size()*sizeof(double));
+		fout.write((const char *)Table.flux_ptr(), Table.size()*sizeof(double));
+		if (WithVariances) {
+			fout.write((const char *)Table.variance_ptr(), Table.size()*sizeof(double));
+		}
+	}
+	fout.close();
+	if (fout.fail()) {
+		throw operaException("operaLineDatabase: "+Filename+" ", operaErrorNoOutput, __FILE__, __FUNCTION__, __LINE__);
+	}
+}
+
+/*
+ * string getBinaryFilename(string TextFilename)
+ * \brief the text file name without .gz, plus .ldb
+ */
+string operaLineDatabase::getBinaryFilename(string TextFilename) {
+	if (TextFilename.size() > 3 && TextFilename.compare(TextFilename.size()-3, 3, ".gz") == 0) {
+		TextFilename.erase(TextFilename.size()-3);
+	}
+	return TextFilename + LINEDATABASE_EXTENSION;
+}
+
+/*
+ * bool isBinary(string Filename)
+ * \brief does Filename start with the line database magic?
+ */
+bool operaLineDatabase::isBinary(string Filename) {
+	char magic[8];
+	int fd = ::open(Filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	bool binary = read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic) && strncmp(magic, LINEDATABASE_MAGIC, sizeof(magic)) == 0;
+	::close(fd);
+	return binary;
+}
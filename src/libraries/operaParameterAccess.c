@@ -59,20 +59,19 @@
  */
 
 #include <stdlib.h>
-#include <regex.h>
 
 // do not link in perror and strerror...
 #define OPERAERRRORCODESONLY
 #include "globaldefines.h"
 #include "operaError.h"
 #include "libraries/operaParameterAccess.h"
-#include "libraries/operaLibCommon.h"	// for startsWith
+#include "libraries/operaKeyValueStore.h"
 
 #ifndef PATH_MAX
 #define PATH_MAX 1024
 #endif
 static char parameterfilename[PATH_MAX];	// known to be all NULLs
-static FILE *stream = NULL;					// the stream pointer to the file
+static operaKeyValueStore store;			// the entries of the file, read once
 // the default location of the parameter file. Now how did we find this?
 static const char *parameterfilebasename = "/harness/espadons/Makefile.parameters";
 
@@ -110,52 +109,53 @@ operaErrorCode operaParameterAccessSetParamaterFilepath(const char *filepath) {
  * \return value = value of name or NULL if not known
  */
 operaErrorCode operaParameterAccessGet(const char *name, char **value) {
-	regex_t regex;
-	char scanbuff[MAXPARAMETERVALUELENGTH];
-	char namebuff[MAXPARAMETERVALUELENGTH];
-
 	if (name == NULL || value == NULL)
 		return operaErrorCodeNULL;
 	if (*name == '\0')
 		return operaErrorCodeNULLString;
 	
+	return operaParameterAccessGetValues(&name, value, 1);
+}
+
+/* 
+ * operaErrorCode operaParameterAccessGetValues(const char **names, char **values, unsigned count)
+ * \brief This function gets the value [list] of each of count names, reading the parameter file at most once.
+ * \note Note that this function allocates storage for each value found, which must be freed by the caller.
+ * On operaErrorCodeNoMemory no storage is left allocated and all values are NULL.
+ * \param names is an array of count char pointers to the names
+ * \param values is an array of count char pointers set to the value [list] of each name or NULL if not known
+ * \return operaErrorCode or errno
+ */
+operaErrorCode operaParameterAccessGetValues(const char **names, char **values, unsigned count) {
+	if (names == NULL || values == NULL)
+		return operaErrorCodeNULL;
+	
 	// check to see that we have a filepath set
 	if (parameterfilename[0] == '\0') 
 		operaParameterAccessSetParamaterFilepath(NULL);	// set in the default
 	
-	if (stream == NULL) {
-		if ((stream = fopen(parameterfilename, "r")) == NULL) 
-			return errno;
-	}
-	*value = NULL;
-	snprintf(namebuff, sizeof(namebuff), "%s[[:space:]]*[?:]=[[:space:]]*[[:print:]]*", name);
-	regcomp(&regex, namebuff, 0);
-	while (fgets(scanbuff, MAXPARAMETERVALUELENGTH, stream) != NULL) {
-		if (!regexec(&regex, scanbuff, 0, NULL, 0)) 
-			if (startsWith(scanbuff, name) > 0) {						// we got the name
-				*value = (char *)malloc(MAXPARAMETERVALUELENGTH);
-				char *start = strstr(scanbuff, "=")+1;							// after the "="
-				while (*start == ' ' || *start == '\t') {						// get rid of the ":="
-					start++;
+	operaErrorCode errorcode = operaKeyValueStoreLoad(&store, parameterfilename, MAXPARAMETERVALUELENGTH);
+	if (errorcode != operaErrorCodeOK)
+		return errorcode;
+	for (unsigned i=0; i<count; i++) {
+		values[i] = NULL;
+		if (names[i] == NULL)
+			continue;
+		const char *found = operaKeyValueStoreFind(&store, names[i]);
+		if (found) {
+			values[i] = (char *)malloc(MAXPARAMETERVALUELENGTH);
+			if (values[i] == NULL) {
+				// leave no value half answered: free the ones already found
+				for (unsigned j=0; j<i; j++) {
+					free(values[j]);
+					values[j] = NULL;
 				}
-				char *end = start;
-				while (*end != '\n' && *end != '#') {							// get rid of the "\n"
-					end++;
-				}
-				*end-- = '\0';
-				while (*end == '\t' || *end == ' ') {							// get rid of trailing ws
-					*end-- = '\0';
-				}
-				strncpy(*value, start, sizeof(scanbuff)-1); 
-				break;
+				return operaErrorCodeNoMemory;
 			}
-		if (feof(stream))
-			break;
+			strncpy(values[i], found, MAXPARAMETERVALUELENGTH-1);
+			values[i][MAXPARAMETERVALUELENGTH-1] = '\0';
+		}
 	}
-	if (stream)
-		fclose(stream);
-	stream = NULL;
-	regfree(&regex);
 	return operaErrorCodeOK;
 }
 /* 
@@ -0,0 +1,447 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaRadialVelocityLineFit
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <math.h>
+#include <algorithm>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaRadialVelocityLineFit.h"
+#include "libraries/operaLibCommon.h"		// for MAX, SPEED_OF_LIGHT_M
+#include "libraries/mpfit.h"				// for the status codes
+
+/*!
+ * operaRadialVelocityLineFit
+ * \brief Joint fit of a radial velocity shared by many Gaussian lines, through the Schur complement of the rv row.
+ * \file operaRadialVelocityLineFit.cpp
+ * \ingroup libraries
+ */
+
+using namespace std;
+
+#define RVLINEFIT_FTOL 1e-10				// relative chi-square convergence, as the mpfit default
+#define RVLINEFIT_XTOL 1e-10				// relative parameter convergence, as the mpfit default
+#define RVLINEFIT_LAMBDA0 1e-3
+#define RVLINEFIT_MAXLAMBDA 1e10
+#define RVLINEFIT_HUBER_K 1.345				// 95% efficiency on Gaussian noise
+#define RVLINEFIT_TUKEY_C 4.685				// 95% efficiency on Gaussian noise
+#define RVLINEFIT_MAD_TO_SIGMA 1.4826
+#define RVLINEFIT_ROBUST_ITERATIONS 10
+#define RVLINEFIT_ROBUST_TOLERANCE 1e-3		// rv change, in units of its error, that ends the reweighting
+
+/*
+ * Constructors / Destructors
+ */
+
+operaRadialVelocityLineFit::operaRadialVelocityLineFit() :
+radialVelocity(0), radialVelocityError(0), velocityOffset(0), chisqr(0), status(0), maxIterations(200)
+{
+}
+
+unsigned operaRadialVelocityLineFit::addLine(double Wavelength, double Level, double Amplitude, double Sigma) {
+	if (Sigma == 0) {
+		throw operaException("operaRadialVelocityLineFit: ", operaErrorInvalidParameter, __FILE__, __FUNCTION__, __LINE__);
+	}
+	wl0.push_back(Wavelength);
+	lineParameters.push_back(Level);
+	lineParameters.push_back(Amplitude);
+	lineParameters.push_back(Sigma);
+	return (unsigned)wl0.size() - 1;
+}
+
+void operaRadialVelocityLineFit::addDataPoint(unsigned Line, double Wavelength, double Flux, double Variance) {
+	if (Line >= wl0.size()) {
+		throw operaException("operaRadialVelocityLineFit: ", operaErrorInvalidParameter, __FILE__, __FUNCTION__, __LINE__);
+	}
+	if (!(Variance > 0) || isinf(Variance) || isnan(Flux) || isinf(Flux)) {
+		return;
+	}
+	pointLine.push_back(Line);
+	wavelength.push_back(Wavelength);
+	flux.push_back(Flux);
+	inverseVariance.push_back(1.0/Variance);
+}
+
+/*
+ * double lineFitModel(unsigned point, double rv, const double *par, double *deriv) const
+ * \brief the model at a data point, par the parameters of its line, and if deriv is not NULL
+ * its derivatives with respect to level, amplitude, sigma and rv.
+ */
+inline double operaRadialVelocityLineFit::lineFitModel(unsigned point, double rv, const double *par, double *deriv) const {
+	double wl = wavelength[point];
+	double d = wl - wl0[pointLine[point]] - (rv + velocityOffset)*wl/SPEED_OF_LIGHT_M;
+	double a = par[1];
+	double sig = par[2];
+	double sig2 = sig*sig;
+	double e = exp(-d*d/(2.0*sig2));
+	if (deriv) {
+		deriv[0] = 1.0;
+		deriv[1] = -e;
+		deriv[2] = -a*e*d*d/(sig2*sig);
+		deriv[3] = -a*e*d*wl/(SPEED_OF_LIGHT_M*sig2);
+	}
+	return 1.0 + par[0] - a*e;
+}
+
+double operaRadialVelocityLineFit::getModel(unsigned Point) const {
+	return lineFitModel(Point, radialVelocity, &lineParameters[3*pointLine[Point]], NULL);
+}
+
+double operaRadialVelocityLineFit::lineFitChisqr(double rv, const vector<double> &par, const vector<bool> &active) const {
+	double chi2 = 0;
+	for (unsigned i=0; i<wavelength.size(); i++) {
+		unsigned l = pointLine[i];
+		if (active[l] && weight[i] > 0) {
+			double r = flux[i] - lineFitModel(i, rv, &par[3*l], NULL);
+			chi2 += r*r*weight[i];
+		}
+	}
+	return chi2;
+}
+
+/*
+ * double lineFitNormalEquations(...)
+ * \brief accumulate the blocks of every active line and the rv row of J^T W J and J^T W r, returns chi-square.
+ */
+double operaRadialVelocityLineFit::lineFitNormalEquations(double rv, const vector<double> &par, const vector<bool> &active, vector<lineBlock> &blocks, double &alphaRV, double &betaRV) const {
+	double deriv[4];
+	double chi2 = 0;
+	alphaRV = betaRV = 0;
+	for (unsigned l=0; l<blocks.size(); l++) {
+		lineBlock &block = blocks[l];
+		for (unsigned j=0; j<3; j++) {
+			block.coupling[j] = block.beta[j] = 0;
+			for (unsigned k=0; k<3; k++) {
+				block.alpha[j][k] = 0;
+			}
+		}
+	}
+	for (unsigned i=0; i<wavelength.size(); i++) {
+		unsigned l = pointLine[i];
+		if (!active[l] || !(weight[i] > 0)) {
+			continue;
+		}
+		double w = weight[i];
+		double r = flux[i] - lineFitModel(i, rv, &par[3*l], deriv);
+		chi2 += r*r*w;
+		lineBlock &block = blocks[l];
+		for (unsigned j=0; j<3; j++) {
+			double dj = deriv[j]*w;
+			block.beta[j] += dj*r;
+			block.coupling[j] += dj*deriv[3];
+			for (unsigned k=0; k<=j; k++) {
+				block.alpha[j][k] += dj*deriv[k];
+			}
+		}
+		alphaRV += deriv[3]*deriv[3]*w;
+		betaRV += deriv[3]*w*r;
+	}
+	for (unsigned l=0; l<blocks.size(); l++) {
+		lineBlock &block = blocks[l];
+		block.alpha[0][1] = block.alpha[1][0];
+		block.alpha[0][2] = block.alpha[2][0];
+		block.alpha[1][2] = block.alpha[2][1];
+	}
+	return chi2;
+}
+
+/*
+ * bool choleskyDecompose3(double m[3][3])
+ * \brief in place, the lower triangle of m becomes L with L L^T = m. Returns false if m is not positive definite.
+ */
+static bool choleskyDecompose3(double m[3][3]) {
+	for (unsigned j=0; j<3; j++) {
+		double d = m[j][j];
+		for (unsigned k=0; k<j; k++) {
+			d -= m[j][k]*m[j][k];
+		}
+		if (!(d > 0)) {
+			return false;
+		}
+		m[j][j] = sqrt(d);
+		for (unsigned i=j+1; i<3; i++) {
+			double s = m[i][j];
+			for (unsigned k=0; k<j; k++) {
+				s -= m[i][k]*m[j][k];
+			}
+			m[i][j] = s/m[j][j];
+		}
+	}
+	return true;
+}
+
+static void choleskySolve3(const double l[3][3], double *b) {
+	for (unsigned i=0; i<3; i++) {
+		for (unsigned k=0; k<i; k++) {
+			b[i] -= l[i][k]*b[k];
+		}
+		b[i] /= l[i][i];
+	}
+	for (unsigned i=3; i-- > 0; ) {
+		for (unsigned k=i+1; k<3; k++) {
+			b[i] -= l[k][i]*b[k];
+		}
+		b[i] /= l[i][i];
+	}
+}
+
+/*
+ * int fitWeighted(const vector<bool> &active, unsigned nActive, unsigned nPoints)
+ * \brief Levenberg-Marquardt with the current weights, from the current parameters.
+ * \details Each damped step solves the arrow system by eliminating the line blocks:
+ * S = alphaRV - sum c^T A^-1 c, drv = (betaRV - sum c^T A^-1 beta)/S, then dpar = A^-1 (beta - c drv) for each line.
+ */
+int operaRadialVelocityLineFit::fitWeighted(const vector<bool> &active, unsigned nActive, unsigned nPoints) {
+	unsigned nlines = (unsigned)wl0.size();
+	vector<lineBlock> blocks(nlines);
+	vector<double> par(lineParameters), trial(lineParameters);
+	vector<double> ainvc(3*nlines), ainvb(3*nlines);
+	double rv = radialVelocity, trialrv = radialVelocity;
+	double alphaRV, betaRV;
+
+	double chi2 = lineFitNormalEquations(rv, par, active, blocks, alphaRV, betaRV);
+	if (isnan(chi2) || isinf(chi2)) {
+		return MP_ERR_NAN;
+	}
+	double lambda = RVLINEFIT_LAMBDA0;
+	int fitstatus = MP_MAXITER;
+	double drv = 0;
+
+	for (unsigned iter=0; iter<maxIterations; iter++) {
+		bool improved = false;
+		double newchi2 = chi2;
+		while (lambda < RVLINEFIT_MAXLAMBDA) {
+			double s = alphaRV*(1.0 + lambda);
+			if (s == 0) {
+				s = lambda;
+			}
+			double g = betaRV;
+			bool decomposed = true;
+			for (unsigned l=0; l<nlines && decomposed; l++) {
+				if (!active[l]) {
+					continue;
+				}
+				const lineBlock &block = blocks[l];
+				double m[3][3];
+				for (unsigned j=0; j<3; j++) {
+					for (unsigned k=0; k<3; k++) {
+						m[j][k] = block.alpha[j][k];
+					}
+					m[j][j] = block.alpha[j][j]*(1.0 + lambda);
+					if (m[j][j] == 0) {
+						m[j][j] = lambda;
+					}
+					ainvc[3*l+j] = block.coupling[j];
+					ainvb[3*l+j] = block.beta[j];
+				}
+				if (!choleskyDecompose3(m)) {
+					decomposed = false;
+					break;
+				}
+				choleskySolve3(m, &ainvc[3*l]);
+				choleskySolve3(m, &ainvb[3*l]);
+				for (unsigned j=0; j<3; j++) {
+					s -= block.coupling[j]*ainvc[3*l+j];
+					g -= block.coupling[j]*ainvb[3*l+j];
+				}
+			}
+			if (!decomposed || !(s > 0)) {
+				lambda *= 10.0;
+				continue;
+			}
+			drv = g/s;
+			trialrv = rv + drv;
+			for (unsigned l=0; l<nlines; l++) {
+				if (active[l]) {
+					for (unsigned j=0; j<3; j++) {
+						trial[3*l+j] = par[3*l+j] + ainvb[3*l+j] - ainvc[3*l+j]*drv;
+					}
+				}
+			}
+			newchi2 = lineFitChisqr(trialrv, trial, active);
+			if (newchi2 < chi2) {
+				improved = true;
+				break;
+			}
+			lambda *= 10.0;
+		}
+		if (!improved) {
+			fitstatus = (chi2 == 0 ? MP_OK_CHI : MP_FTOL);	// no step lowers chi-square any more
+			break;
+		}
+
+		// as in MINPACK, chi-square has converged when both the actual and the predicted (linear model) reductions are small
+		double predicted = drv*(2.0*betaRV - alphaRV*drv);
+		for (unsigned l=0; l<nlines; l++) {
+			if (!active[l]) {
+				continue;
+			}
+			const lineBlock &block = blocks[l];
+			for (unsigned j=0; j<3; j++) {
+				double dj = trial[3*l+j] - par[3*l+j];
+				double adj = block.coupling[j]*drv;
+				for (unsigned k=0; k<3; k++) {
+					adj += block.alpha[j][k]*(trial[3*l+k] - par[3*l+k]);
+				}
+				predicted += dj*(2.0*block.beta[j] - adj) - block.coupling[j]*dj*drv;
+			}
+		}
+		bool smallChange = (chi2 - newchi2) <= RVLINEFIT_FTOL*chi2 && fabs(predicted) <= RVLINEFIT_FTOL*chi2;
+		bool smallStep = fabs(drv) <= RVLINEFIT_XTOL*(fabs(rv) + RVLINEFIT_XTOL);
+		for (unsigned p=0; p<3*nlines; p++) {
+			if (fabs(trial[p] - par[p]) > RVLINEFIT_XTOL*(fabs(par[p]) + RVLINEFIT_XTOL)) {
+				smallStep = false;
+			}
+			par[p] = trial[p];
+		}
+		rv = trialrv;
+		chi2 = lineFitNormalEquations(rv, par, active, blocks, alphaRV, betaRV);
+		lambda = MAX(lambda/10.0, 1e-12);
+		if (smallChange || smallStep) {
+			fitstatus = (smallChange && smallStep) ? MP_OK_BOTH : (smallChange ? MP_OK_CHI : MP_OK_PAR);
+			break;
+		}
+	}
+
+	// the rv variance is the inverse of the undamped Schur complement; a line without curvature (a = 0) does not constrain rv
+	double s = alphaRV;
+	for (unsigned l=0; l<nlines; l++) {
+		if (!active[l]) {
+			continue;
+		}
+		const lineBlock &block = blocks[l];
+		double m[3][3];
+		double c[3];
+		for (unsigned j=0; j<3; j++) {
+			for (unsigned k=0; k<3; k++) {
+				m[j][k] = block.alpha[j][k];
+			}
+			c[j] = block.coupling[j];
+		}
+		if (choleskyDecompose3(m)) {
+			choleskySolve3(m, c);
+			for (unsigned j=0; j<3; j++) {
+				s -= block.coupling[j]*c[j];
+			}
+		}
+	}
+	radialVelocity = rv;
+	radialVelocityError = (s > 0 ? sqrt(1.0/s) : 0);
+	for (unsigned l=0; l<nlines; l++) {
+		par[3*l+2] = fabs(par[3*l+2]);		// the model only depends on sigma squared
+	}
+	lineParameters = par;
+	chisqr = chi2/(double)(nPoints - (1 + 3*nActive));
+	return fitstatus;
+}
+
+/*
+ * double robustWeight(operaRobustWeighting_t robustWeighting, double t)
+ * \brief psi(t)/t for a residual t in units of the robust scale.
+ */
+static inline double robustWeight(operaRobustWeighting_t robustWeighting, double t) {
+	double at = fabs(t);
+	switch (robustWeighting) {
+		case RobustWeightingHuber:
+			return at <= RVLINEFIT_HUBER_K ? 1.0 : RVLINEFIT_HUBER_K/at;
+		case RobustWeightingTukey: {
+			if (at >= RVLINEFIT_TUKEY_C) {
+				return 0.0;
+			}
+			double u = t/RVLINEFIT_TUKEY_C;
+			return (1.0 - u*u)*(1.0 - u*u);
+		}
+		default:
+			return 1.0;
+	}
+}
+
+int operaRadialVelocityLineFit::fit(operaRobustWeighting_t robustWeighting) {
+	unsigned nlines = (unsigned)wl0.size();
+	vector<unsigned> pointsPerLine(nlines, 0);
+	for (unsigned i=0; i<pointLine.size(); i++) {
+		pointsPerLine[pointLine[i]]++;
+	}
+	vector<bool> active(nlines, false);
+	unsigned nActive = 0, nPoints = 0;
+	for (unsigned l=0; l<nlines; l++) {
+		if (pointsPerLine[l] >= RVLINEFIT_MINPOINTS) {
+			active[l] = true;
+			nActive++;
+			nPoints += pointsPerLine[l];
+		}
+	}
+	if (nActive == 0) {
+		return status = MP_ERR_NPOINTS;
+	}
+	if (nPoints <= 1 + 3*nActive) {
+		return status = MP_ERR_DOF;
+	}
+
+	weight = inverseVariance;
+	status = fitWeighted(active, nActive, nPoints);
+	if (status <= 0 || robustWeighting == RobustWeightingNone) {
+		return status;
+	}
+
+	vector<double> normalized(wavelength.size());
+	vector<double> absolute;
+	absolute.reserve(nPoints);
+	for (unsigned iter=0; iter<RVLINEFIT_ROBUST_ITERATIONS; iter++) {
+		absolute.clear();
+		for (unsigned i=0; i<wavelength.size(); i++) {
+			if (active[pointLine[i]]) {
+				normalized[i] = (flux[i] - getModel(i))*sqrt(inverseVariance[i]);
+				absolute.push_back(fabs(normalized[i]));
+			}
+		}
+		vector<double>::iterator median = absolute.begin() + absolute.size()/2;
+		nth_element(absolute.begin(), median, absolute.end());
+		double scale = RVLINEFIT_MAD_TO_SIGMA*(*median);
+		if (!(scale > 0)) {
+			break;
+		}
+		for (unsigned i=0; i<wavelength.size(); i++) {
+			if (active[pointLine[i]]) {
+				weight[i] = inverseVariance[i]*robustWeight(robustWeighting, normalized[i]/scale);
+			}
+		}
+		double previous = radialVelocity;
+		int robuststatus = fitWeighted(active, nActive, nPoints);
+		if (robuststatus <= 0) {
+			break;							// keep the previous pass
+		}
+		status = robuststatus;
+		if (fabs(radialVelocity - previous) <= RVLINEFIT_ROBUST_TOLERANCE*radialVelocityError) {
+			break;
+		}
+	}
+	return status;
+}
@@ -0,0 +1,578 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaSourceDetection
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaThreadPool.h"
+#include "libraries/operaSourceDetection.h"
+
+/*!
+ * operaSourceDetection
+ * \brief Point source detection and centroiding in image planes, and matching to a 2MASS extract.
+ * \file operaSourceDetection.cpp
+ * \ingroup libraries
+ */
+
+using namespace std;
+
+/*
+ * float medianInPlace(float *values, unsigned n)
+ * \brief the upper median of values, which are reordered.
+ */
+static float medianInPlace(float *values, unsigned n) {
+	nth_element(values, values + n/2, values + n);
+	return values[n/2];
+}
+
+/*
+ * void medianFilterMeshes(std::vector<float> &meshes, unsigned nmeshx, unsigned nmeshy)
+ * \brief replace each mesh by the median of the meshes in its 3x3 neighbourhood.
+ */
+static void medianFilterMeshes(std::vector<float> &meshes, unsigned nmeshx, unsigned nmeshy) {
+	std::vector<float> filtered(meshes.size());
+	float neighbours[9];
+	for (unsigned my=0; my<nmeshy; my++) {
+		for (unsigned mx=0; mx<nmeshx; mx++) {
+			unsigned n = 0;
+			for (unsigned ny=(my ? my-1 : 0); ny<=my+1 && ny<nmeshy; ny++) {
+				for (unsigned nx=(mx ? mx-1 : 0); nx<=mx+1 && nx<nmeshx; nx++) {
+					neighbours[n++] = meshes[ny*nmeshx+nx];
+				}
+			}
+			filtered[my*nmeshx+mx] = medianInPlace(neighbours, n);
+		}
+	}
+	meshes.swap(filtered);
+}
+
+/*
+ * void meshInterpolation(unsigned pixel, unsigned meshSize, unsigned nmeshes, unsigned &mesh, float &weight)
+ * \brief the mesh whose center is at or before the center of pixel, and the weight of the next mesh, clamped at the edges.
+ */
+static void meshInterpolation(unsigned pixel, unsigned meshSize, unsigned nmeshes, unsigned &mesh, float &weight) {
+	double position = (pixel + 0.5)/meshSize - 0.5;
+	if (position <= 0.0 || nmeshes == 1) {
+		mesh = 0;
+		weight = 0.0;
+	} else if (position >= nmeshes - 1) {
+		mesh = nmeshes - 2;
+		weight = 1.0;
+	} else {
+		mesh = (unsigned)position;
+		weight = (float)(position - mesh);
+	}
+}
+
+/*
+ * Constructors / Destructors
+ */
+
+operaSourceDetector::operaSourceDetector(double Threshold, unsigned MinArea, double Saturation, double ApertureRadius, unsigned BackgroundMeshSize) :
+threshold(Threshold),
+minArea(MinArea),
+saturation(Saturation),
+apertureRadius(ApertureRadius),
+backgroundMeshSize(BackgroundMeshSize)
+{
+}
+
+/*
+ * void measureBackground(const float *pixels, unsigned naxis1, unsigned naxis2, float *residual, std::vector<float> &sigma, unsigned &nmeshx) const
+ * \brief write pixels minus the background into residual, and the background sigma of each mesh into sigma.
+ * \details Saturated and non-finite pixels are left out of the statistics. Meshes with too few pixels left take the
+ * median of the others, before the 3x3 median filter. Without any usable mesh the sigma is infinite, so nothing is detected.
+ */
+void operaSourceDetector::measureBackground(const float *pixels, unsigned naxis1, unsigned naxis2, float *residual, std::vector<float> &sigma, unsigned &nmeshx) const {
+	const unsigned meshSize = backgroundMeshSize ? backgroundMeshSize : 1;
+	nmeshx = (naxis1 + meshSize - 1)/meshSize;
+	const unsigned nmeshy = (naxis2 + meshSize - 1)/meshSize;
+	const unsigned nmeshes = nmeshx*nmeshy;
+	const float saturationLevel = (float)saturation;
+
+	std::vector<float> background(nmeshes);
+	sigma.resize(nmeshes);
+	std::vector<bool> usable(nmeshes, false);
+	std::vector<float> values(meshSize*meshSize);
+	std::vector<float> usableBackground, usableSigma;
+
+	for (unsigned my=0; my<nmeshy; my++) {
+		unsigned ylast = min((my+1)*meshSize, naxis2);
+		for (unsigned mx=0; mx<nmeshx; mx++) {
+			unsigned xlast = min((mx+1)*meshSize, naxis1);
+			unsigned n = 0;
+			for (unsigned y=my*meshSize; y<ylast; y++) {
+				const float *row = pixels + (unsigned long)y*naxis1;
+				for (unsigned x=mx*meshSize; x<xlast; x++) {
+					if (isfinite(row[x]) && row[x] < saturationLevel) {
+						values[n++] = row[x];
+					}
+				}
+			}
+			if (n < SOURCEDETECTION_MIN_MESH_PIXELS) {
+				continue;
+			}
+			unsigned mesh = my*nmeshx+mx;
+			float median = medianInPlace(&values[0], n);
+			for (unsigned i=0; i<n; i++) {
+				values[i] = fabs(values[i] - median);
+			}
+			background[mesh] = median;
+			sigma[mesh] = (float)(SOURCEDETECTION_MAD_TO_SIGMA*medianInPlace(&values[0], n));
+			usable[mesh] = true;
+			usableBackground.push_back(background[mesh]);
+			usableSigma.push_back(sigma[mesh]);
+		}
+	}
+	if (usableBackground.empty()) {
+		std::fill(sigma.begin(), sigma.end(), (float)HUGE_VAL);
+		std::fill(residual, residual + (unsigned long)naxis1*naxis2, 0.0f);
+		return;
+	}
+	if (usableBackground.size() < nmeshes) {
+		float fillBackground = medianInPlace(&usableBackground[0], usableBackground.size());
+		float fillSigma = medianInPlace(&usableSigma[0], usableSigma.size());
+		for (unsigned mesh=0; mesh<nmeshes; mesh++) {
+			if (!usable[mesh]) {
+				background[mesh] = fillBackground;
+				sigma[mesh] = fillSigma;
+			}
+		}
+	}
+	medianFilterMeshes(background, nmeshx, nmeshy);
+	medianFilterMeshes(sigma, nmeshx, nmeshy);
+
+	// bilinear interpolation between the mesh centers, the column weights computed once
+	std::vector<unsigned> columnMesh(naxis1);
+	std::vector<float> columnWeight(naxis1);
+	for (unsigned x=0; x<naxis1; x++) {
+		meshInterpolation(x, meshSize, nmeshx, columnMesh[x], columnWeight[x]);
+	}
+	std::vector<float> rowBackground(nmeshx);
+	for (unsigned y=0; y<naxis2; y++) {
+		unsigned my;
+		float wy;
+		meshInterpolation(y, meshSize, nmeshy, my, wy);
+		const float *lower = &background[my*nmeshx];
+		const float *upper = nmeshy > 1 ? lower + nmeshx : lower;
+		for (unsigned mx=0; mx<nmeshx; mx++) {
+			rowBackground[mx] = lower[mx] + wy*(upper[mx] - lower[mx]);
+		}
+		const float *row = pixels + (unsigned long)y*naxis1;
+		float *out = residual + (unsigned long)y*naxis1;
+		for (unsigned x=0; x<naxis1; x++) {
+			unsigned mx = columnMesh[x];
+			float b = nmeshx > 1 ? rowBackground[mx] + columnWeight[x]*(rowBackground[mx+1] - rowBackground[mx]) : rowBackground[0];
+			out[x] = row[x] - b;
+		}
+	}
+}
+
+/*
+ * void detect(const float *pixels, unsigned naxis1, unsigned naxis2, std::vector<operaSource> &sources) const
+ * \brief detect the sources of one plane.
+ */
+void operaSourceDetector::detect(const float *pixels, unsigned naxis1, unsigned naxis2, std::vector<operaSource> &sources) const {
+	sources.clear();
+	if (naxis1 == 0 || naxis2 == 0) {
+		return;
+	}
+	const unsigned long npixels = (unsigned long)naxis1*naxis2;
+	const unsigned meshSize = backgroundMeshSize ? backgroundMeshSize : 1;
+	const float saturationLevel = (float)saturation;
+
+	std::vector<float> residualBuffer(npixels);
+	float *residual = &residualBuffer[0];
+	std::vector<float> sigma;
+	unsigned nmeshx;
+	measureBackground(pixels, naxis1, naxis2, residual, sigma, nmeshx);
+	for (unsigned mesh=0; mesh<sigma.size(); mesh++) {
+		sigma[mesh] *= (float)threshold;		// now the detection level of the mesh
+	}
+
+	std::vector<unsigned char> visited(npixels, 0);
+	std::vector<unsigned long> stack;
+
+	for (unsigned y0=0; y0<naxis2; y0++) {
+		const float *rowLevel = &sigma[(y0/meshSize)*nmeshx];
+		for (unsigned x0=0; x0<naxis1; x0++) {
+			unsigned long start = (unsigned long)y0*naxis1 + x0;
+			if (visited[start] || !(residual[start] > rowLevel[x0/meshSize])) {
+				continue;
+			}
+			double sum = 0.0, sumx = 0.0, sumy = 0.0;
+			float peak = residual[start];
+			unsigned long peakIndex = start;
+			unsigned area = 0;
+			bool saturated = false;
+
+			visited[start] = 1;
+			stack.push_back(start);
+			while (!stack.empty()) {
+				unsigned long index = stack.back();
+				stack.pop_back();
+				unsigned x = (unsigned)(index % naxis1);
+				unsigned y = (unsigned)(index / naxis1);
+				double r = residual[index];
+				sum += r;
+				sumx += r*x;
+				sumy += r*y;
+				area++;
+				if (pixels[index] >= saturationLevel) {
+					saturated = true;
+				}
+				if (residual[index] > peak) {
+					peak = residual[index];
+					peakIndex = index;
+				}
+				unsigned ylast = min(y+1, naxis2-1);
+				unsigned xlast = min(x+1, naxis1-1);
+				for (unsigned ny=(y ? y-1 : 0); ny<=ylast; ny++) {
+					const float *level = &sigma[(ny/meshSize)*nmeshx];
+					for (unsigned nx=(x ? x-1 : 0); nx<=xlast; nx++) {
+						unsigned long neighbour = (unsigned long)ny*naxis1 + nx;
+						if (!visited[neighbour] && residual[neighbour] > level[nx/meshSize]) {
+							visited[neighbour] = 1;
+							stack.push_back(neighbour);
+						}
+					}
+				}
+			}
+			if (area < minArea || saturated || !(sum > 0.0)) {
+				continue;
+			}
+
+			operaSource source;
+			double xc = sumx/sum;
+			double yc = sumy/sum;
+			source.x = xc + 1.0;
+			source.y = yc + 1.0;
+			source.flux = sum;
+			source.peak = peak;
+			source.background = pixels[peakIndex] - residual[peakIndex];
+			source.area = area;
+
+			double apertureFlux = 0.0;
+			double r2 = apertureRadius*apertureRadius;
+			int ystart = max(0, (int)ceil(yc - apertureRadius));
+			int yend = min((int)naxis2-1, (int)floor(yc + apertureRadius));
+			int xstart = max(0, (int)ceil(xc - apertureRadius));
+			int xend = min((int)naxis1-1, (int)floor(xc + apertureRadius));
+			for (int y=ystart; y<=yend; y++) {
+				const float *row = residual + (unsigned long)y*naxis1;
+				double dy2 = (y - yc)*(y - yc);
+				for (int x=xstart; x<=xend; x++) {
+					if ((x - xc)*(x - xc) + dy2 <= r2 && isfinite(row[x])) {
+						apertureFlux += row[x];
+					}
+				}
+			}
+			source.apertureFlux = apertureFlux;
+			sources.push_back(source);
+		}
+	}
+}
+
+/*
+ * The context of the parallel detection, one plane per index.
+ */
+class sourceDetectionPlanes {
+public:
+	const operaSourceDetector *detector;
+	const float *pixels;
+	unsigned naxis1, naxis2;
+	std::vector< std::vector<operaSource> > *sources;
+};
+
+static void detectPlane(unsigned long plane, void *context) {
+	sourceDetectionPlanes *planes = (sourceDetectionPlanes *)context;
+	const float *pixels = planes->pixels + plane*planes->naxis1*(unsigned long)planes->naxis2;
+	planes->detector->detect(pixels, planes->naxis1, planes->naxis2, (*planes->sources)[plane]);
+}
+
+/*
+ * void detect(const float *pixels, unsigned naxis1, unsigned naxis2, unsigned nplanes, std::vector< std::vector<operaSource> > &sources) const
+ * \brief detect the sources of nplanes consecutive planes in parallel.
+ */
+void operaSourceDetector::detect(const float *pixels, unsigned naxis1, unsigned naxis2, unsigned nplanes, std::vector< std::vector<operaSource> > &sources) const {
+	sources.clear();
+	sources.resize(nplanes);
+	sourceDetectionPlanes planes;
+	planes.detector = this;
+	planes.pixels = pixels;
+	planes.naxis1 = naxis1;
+	planes.naxis2 = naxis2;
+	planes.sources = &sources;
+	operaThreadPool::getSharedPool().parallelFor(nplanes, detectPlane, &planes);
+}
+
+/*
+ * void readTwoMassExtract(string filename, std::vector<operaCatalogStar> &stars)
+ * \brief read a local 2MASS extract, one "ra dec J H K" star per line.
+ */
+void readTwoMassExtract(string filename, std::vector<operaCatalogStar> &stars) {
+	stars.clear();
+	ifstream extract(filename.c_str());
+	if (!extract.is_open()) {
+		throw operaException("readTwoMassExtract: "+filename+" ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+	}
+	string dataline;
+	while (getline(extract, dataline)) {
+		istringstream ss(dataline);
+		operaCatalogStar star;
+		if (ss >> star.ra >> star.dec >> star.J >> star.H >> star.K) {
+			stars.push_back(star);
+		}
+	}
+	extract.close();
+}
+
+/*
+ * bool skyToTangentPlane(double ra, double dec, double ra0, double dec0, double &xi, double &eta)
+ * \brief gnomonic projection about (ra0, dec0), in degrees.
+ */
+bool skyToTangentPlane(double ra, double dec, double ra0, double dec0, double &xi, double &eta) {
+	const double deg = M_PI/180.0;
+	double sind = sin(dec*deg), cosd = cos(dec*deg);
+	double sind0 = sin(dec0*deg), cosd0 = cos(dec0*deg);
+	double dra = (ra - ra0)*deg;
+	double cosdra = cos(dra);
+	double cosc = sind0*sind + cosd0*cosd*cosdra;
+	if (cosc <= 0.0) {
+		return false;
+	}
+	xi = cosd*sin(dra)/cosc/deg;
+	eta = (cosd0*sind - sind0*cosd*cosdra)/cosc/deg;
+	return true;
+}
+
+/*
+ * void tangentPlaneToSky(double xi, double eta, double ra0, double dec0, double &ra, double &dec)
+ * \brief inverse gnomonic projection about (ra0, dec0), in degrees, ra in [0, 360).
+ */
+void tangentPlaneToSky(double xi, double eta, double ra0, double dec0, double &ra, double &dec) {
+	const double deg = M_PI/180.0;
+	xi *= deg;
+	eta *= deg;
+	double sind0 = sin(dec0*deg), cosd0 = cos(dec0*deg);
+	double denominator = cosd0 - eta*sind0;
+	ra = ra0 + atan2(xi, denominator)/deg;
+	dec = atan2(sind0 + eta*cosd0, sqrt(xi*xi + denominator*denominator))/deg;
+	ra = fmod(ra, 360.0);
+	if (ra < 0.0) {
+		ra += 360.0;
+	}
+}
+
+/*
+ * void pixelToSky(double x, double y, double &ra, double &dec) const
+ * \brief sky position of a FITS pixel through the CD matrix and the gnomonic projection.
+ */
+void operaTangentPlaneWCS::pixelToSky(double x, double y, double &ra, double &dec) const {
+	double dx = x - crpix1;
+	double dy = y - crpix2;
+	tangentPlaneToSky(cd11*dx + cd12*dy, cd21*dx + cd22*dy, crval1, crval2, ra, dec);
+}
+
+/*
+ * operaSourceMatcher(const std::vector<double> &x, const std::vector<double> &y, double CellSize)
+ * \brief counting sort of the points by cell.
+ * \details The cells grow beyond CellSize when the points are spread over more than
+ * SOURCEMATCHER_CELLS_PER_POINT cells per point, which bounds the grid and keeps the cell indices in range.
+ */
+operaSourceMatcher::operaSourceMatcher(const std::vector<double> &x, const std::vector<double> &y, double CellSize) :
+cellSize(CellSize),
+xmin(0.0),
+ymin(0.0),
+ncellsx(0),
+ncellsy(0),
+px(x),
+py(y)
+{
+	if (!(CellSize > 0.0) || x.size() != y.size()) {
+		throw operaException("operaSourceMatcher: ", operaErrorInvalidInput, __FILE__, __FUNCTION__, __LINE__);
+	}
+	if (px.empty()) {
+		return;
+	}
+	xmin = *min_element(px.begin(), px.end());
+	ymin = *min_element(py.begin(), py.end());
+	double spanx = *max_element(px.begin(), px.end()) - xmin;
+	double spany = *max_element(py.begin(), py.end()) - ymin;
+	double maxcells = (double)SOURCEMATCHER_CELLS_PER_POINT*px.size();
+	if ((spanx/cellSize + 1.0)*(spany/cellSize + 1.0) > maxcells) {
+		// at most 3 maxcells + 1 cells with this size
+		cellSize = max(max(cellSize, sqrt(spanx*spany/maxcells)), max(spanx, spany)/maxcells);
+	}
+	ncellsx = (unsigned)(spanx/cellSize) + 1;
+	ncellsy = (unsigned)(spany/cellSize) + 1;
+
+	std::vector<unsigned long> pointCell(px.size());
+	cellStart.assign((unsigned long)ncellsx*ncellsy + 1, 0);
+	for (unsigned i=0; i<px.size(); i++) {
+		unsigned cx = min((unsigned)((px[i] - xmin)/cellSize), ncellsx-1);
+		unsigned cy = min((unsigned)((py[i] - ymin)/cellSize), ncellsy-1);
+		pointCell[i] = (unsigned long)cy*ncellsx + cx;
+		cellStart[pointCell[i]+1]++;
+	}
+	for (unsigned long c=0; c+1<cellStart.size(); c++) {
+		cellStart[c+1] += cellStart[c];
+	}
+	cellPoints.resize(px.size());
+	std::vector<unsigned> next(cellStart.begin(), cellStart.end()-1);
+	for (unsigned i=0; i<px.size(); i++) {
+		cellPoints[next[pointCell[i]]++] = i;
+	}
+}
+
+/*
+ * bool cellRange(double x, double y, double radius, unsigned &cxfirst, unsigned &cxlast, unsigned &cyfirst, unsigned &cylast) const
+ * \brief the cells overlapped by the square about the circle, false if it misses the grid.
+ */
+bool operaSourceMatcher::cellRange(double x, double y, double radius, unsigned &cxfirst, unsigned &cxlast, unsigned &cyfirst, unsigned &cylast) const {
+	if (px.empty()) {
+		return false;
+	}
+	double cxlow = floor((x - radius - xmin)/cellSize);
+	double cxhigh = floor((x + radius - xmin)/cellSize);
+	double cylow = floor((y - radius - ymin)/cellSize);
+	double cyhigh = floor((y + radius - ymin)/cellSize);
+	if (cxhigh < 0.0 || cyhigh < 0.0 || cxlow >= ncellsx || cylow >= ncellsy) {
+		return false;
+	}
+	cxfirst = cxlow > 0.0 ? (unsigned)cxlow : 0;
+	cyfirst = cylow > 0.0 ? (unsigned)cylow : 0;
+	cxlast = cxhigh < ncellsx-1 ? (unsigned)cxhigh : ncellsx-1;
+	cylast = cyhigh < ncellsy-1 ? (unsigned)cyhigh : ncellsy-1;
+	return true;
+}
+
+/*
+ * int nearest(double x, double y, double radius) const
+ * \brief the nearest point within radius, looking only at the cells the circle overlaps.
+ */
+int operaSourceMatcher::nearest(double x, double y, double radius) const {
+	unsigned cxfirst, cxlast, cyfirst, cylast;
+	if (!cellRange(x, y, radius, cxfirst, cxlast, cyfirst, cylast)) {
+		return -1;
+	}
+	int best = -1;
+	double bestDistance2 = radius*radius;
+	for (unsigned cy=cyfirst; cy<=cylast; cy++) {
+		for (unsigned cx=cxfirst; cx<=cxlast; cx++) {
+			unsigned long cell = (unsigned long)cy*ncellsx + cx;
+			for (unsigned k=cellStart[cell]; k<cellStart[cell+1]; k++) {
+				unsigned i = cellPoints[k];
+				double dx = px[i] - x;
+				double dy = py[i] - y;
+				double distance2 = dx*dx + dy*dy;
+				if (distance2 <= bestDistance2) {
+					bestDistance2 = distance2;
+					best = (int)i;
+				}
+			}
+		}
+	}
+	return best;
+}
+
+/*
+ * unsigned match(const std::vector<double> &x, const std::vector<double> &y, double searchRadius, double matchRadius, std::vector<int> &matches, double &dx, double &dy) const
+ * \brief a vote of the offsets to all points within searchRadius, then a fine match of the shifted positions.
+ * \details Every point within searchRadius of a position votes for its offset in a histogram of bins of
+ * matchRadius, or coarser so that there are at most SOURCEMATCHER_MAX_VOTE_BINS bins a side. The true offset
+ * collects a vote from most positions while the chance pairs spread over the histogram, so unlike the
+ * offset to the nearest point it holds in crowded fields and with offsets near searchRadius. The offset is
+ * the mean of the votes in the 3x3 bins about the fullest one.
+ */
+unsigned operaSourceMatcher::match(const std::vector<double> &x, const std::vector<double> &y, double searchRadius, double matchRadius, std::vector<int> &matches, double &dx, double &dy) const {
+	double binSize = max(matchRadius, 2.0*searchRadius/SOURCEMATCHER_MAX_VOTE_BINS);
+	unsigned nbins = (unsigned)(2.0*searchRadius/binSize) + 1;
+	std::vector<unsigned> votes((unsigned long)nbins*nbins, 0);
+	std::vector<double> offsetx, offsety;
+	std::vector<unsigned long> offsetBin;
+	double searchRadius2 = searchRadius*searchRadius;
+	for (unsigned i=0; i<x.size(); i++) {
+		unsigned cxfirst, cxlast, cyfirst, cylast;
+		if (!cellRange(x[i], y[i], searchRadius, cxfirst, cxlast, cyfirst, cylast)) {
+			continue;
+		}
+		for (unsigned cy=cyfirst; cy<=cylast; cy++) {
+			for (unsigned cx=cxfirst; cx<=cxlast; cx++) {
+				unsigned long cell = (unsigned long)cy*ncellsx + cx;
+				for (unsigned k=cellStart[cell]; k<cellStart[cell+1]; k++) {
+					unsigned j = cellPoints[k];
+					double ox = px[j] - x[i];
+					double oy = py[j] - y[i];
+					if (ox*ox + oy*oy > searchRadius2) {
+						continue;
+					}
+					unsigned bx = min((unsigned)((ox + searchRadius)/binSize), nbins-1);
+					unsigned by = min((unsigned)((oy + searchRadius)/binSize), nbins-1);
+					unsigned long bin = (unsigned long)by*nbins + bx;
+					votes[bin]++;
+					offsetx.push_back(ox);
+					offsety.push_back(oy);
+					offsetBin.push_back(bin);
+				}
+			}
+		}
+	}
+	dx = dy = 0.0;
+	if (!offsetx.empty()) {
+		unsigned long best = (unsigned long)(max_element(votes.begin(), votes.end()) - votes.begin());
+		long bestx = (long)(best % nbins);
+		long besty = (long)(best / nbins);
+		double sumx = 0.0, sumy = 0.0;
+		unsigned n = 0;
+		for (unsigned k=0; k<offsetx.size(); k++) {
+			if (labs((long)(offsetBin[k] % nbins) - bestx) <= 1 && labs((long)(offsetBin[k] / nbins) - besty) <= 1) {
+				sumx += offsetx[k];
+				sumy += offsety[k];
+				n++;
+			}
+		}
+		dx = sumx/n;
+		dy = sumy/n;
+	}
+	unsigned matched = 0;
+	matches.resize(x.size());
+	for (unsigned i=0; i<x.size(); i++) {
+		matches[i] = nearest(x[i] + dx, y[i] + dy, matchRadius);
+		if (matches[i] >= 0) {
+			matched++;
+		}
+	}
+	return matched;
+}
@@ -40,6 +40,7 @@
 #include "libraries/operaFit.h"
 #include "libraries/operaMath.h"
 #include "libraries/operaStats.h"
+#include "libraries/operaThreadPool.h"
 
 /*!
  * operaSpectralLines
@@ -51,6 +52,14 @@
 
 using namespace std;
 
+/*
+ * the Gaussian fits of the detected features are independent of each other, so they are spread over the shared pool
+ */
+static void fitFeatureGaussianModel(unsigned long index, void *context) {
+    operaSpectralFeature **features = (operaSpectralFeature **)context;
+    features[index]->fitGaussianModel();
+}
+
 /* 
  * \class operaSpectralLines
  * \brief This class is a container to manipulate a set of spectral lines
@@ -428,19 +437,20 @@ void operaSpectralLines::detectSpectralFeatures(double DetectionThreshold, doubl
             /*
              * At this point the data, the number of peaks, and the inital guess for the
              * gaussian parameters are already loaded into the feature class. Next step is
-             * to perform a least square fit to a multiple gaussian plus background model.
+             * to perform a least square fit to a multiple gaussian plus background model,
+             * done for all features at once below.
              */
             
             spectralFeatures[NFeatures]->fitBackground();
             
-            spectralFeatures[NFeatures]->fitGaussianModel();
-            
             NLines += multiplicity;
             
             NFeatures++;
         }
     }
 
+    operaThreadPool::getSharedPool().parallelFor(NFeatures, fitFeatureGaussianModel, (void *)spectralFeatures);
+    
     nFeatures = NFeatures;
     
     setnLines(NLines);
@@ -640,19 +650,20 @@ void operaSpectralLines::detectAbsorptionSpectralFeatures(double DetectionThresh
             /*
              * At this point the data, the number of peaks, and the inital guess for the
              * gaussian parameters are already loaded into the feature class. Next step is
-             * to perform a least square fit to a multiple gaussian plus background model.
+             * to perform a least square fit to a multiple gaussian plus background model,
+             * done for all features at once below.
              */
             
             spectralFeatures[NFeatures]->fitBackground();
             
-            spectralFeatures[NFeatures]->fitGaussianModel();
-            
             NLines += multiplicity;
             
             NFeatures++;
         }
     }
     
+    operaThreadPool::getSharedPool().parallelFor(NFeatures, fitFeatureGaussianModel, (void *)spectralFeatures);
+    
     nFeatures = NFeatures;
     
     setnLines(NLines);
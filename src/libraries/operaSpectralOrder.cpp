@@ -851,6 +851,10 @@ void operaSpectralOrder::NormalizeFlat(operaFITSImage &flatMatrix, operaFITSImag
 		throw operaException("operaSpectralOrder: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
 	unsigned NXPoints = InstrumentProfile->getxsize()*InstrumentProfile->getXsampling();	
+	// the end slopes and the spline need at least two subpixels
+	if (NXPoints < 2) {
+		throw operaException("operaSpectralOrder: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
+	}
 	
 	unsigned NumberofElementsToBin = binsize;
 	
@@ -867,10 +871,12 @@ void operaSpectralOrder::NormalizeFlat(operaFITSImage &flatMatrix, operaFITSImag
 	if (!SubPixXcoords) {
 		throw operaException("operaSpectralOrder: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);	
 	}
-	float *y2 = (float *)malloc(NXPoints*sizeof(float));
-	if (!y2) {
+	double *SplineValues = (double *)malloc(NXPoints*sizeof(double));
+	if (!SplineValues) {
 		throw operaException("operaSpectralOrder: ", operaErrorNoMemory, __FILE__, __FUNCTION__, __LINE__);	
 	}
+	// the knots are the IP subpixel coordinates for every element, only the values are refit
+	operaSpline_t *spline = NULL;
 	// Below it loops over all spectral elements
 	for (unsigned indexElem=0; indexElem < SpectralElements->getnSpectralElements(); indexElem++) {		
 		
@@ -912,8 +918,14 @@ void operaSpectralOrder::NormalizeFlat(operaFITSImage &flatMatrix, operaFITSImag
 		float yp1 = (SubPixElemSampleMedianCounts[1] - SubPixElemSampleMedianCounts[0])/(SubPixXcoords[1] - SubPixXcoords[0]);
 		float ypn = (SubPixElemSampleMedianCounts[NXPoints-1] - SubPixElemSampleMedianCounts[NXPoints-2])/(SubPixXcoords[NXPoints-1] - SubPixXcoords[NXPoints-2]);
 		
-		// Call cubicspline to get second derivatives 
-		cubicspline(SubPixXcoords, SubPixElemSampleMedianCounts, NXPoints, yp1, ypn, y2);
+		if (spline == NULL) {
+			spline = operaSplineCreateFloat(NXPoints, SubPixXcoords, SubPixElemSampleMedianCounts, yp1, ypn);
+		} else {
+			for (unsigned i=0; i<NXPoints; i++) {
+				SplineValues[i] = SubPixElemSampleMedianCounts[i];
+			}
+			operaSplineSetValues(spline, SplineValues, yp1, ypn);
+		}
 		/**** End of prep for interpolation ***/
 		
 		unsigned xlocalmin = (unsigned)floor(SpectralElements->getphotoCenterX(indexElem) - Geometry->getapertureWidth()/2);
@@ -925,15 +937,14 @@ void operaSpectralOrder::NormalizeFlat(operaFITSImage &flatMatrix, operaFITSImag
 		unsigned yy = (unsigned)round(SpectralElements->getphotoCenterY(indexElem));
 		
 		for(unsigned xx=xlocalmin; xx<xlocalmax; xx++) {
-			float ExpectedFlux;
 			float xcoordInIPPixunits = (float)xx + 0.5 - SpectralElements->getphotoCenterX(indexElem);
-			// Call splineinterpolate for interpolations 
-			splineinterpolate(SubPixXcoords, SubPixElemSampleMedianCounts, y2, NXPoints, xcoordInIPPixunits, &ExpectedFlux);			
+			float ExpectedFlux = (float)operaSplineValue(spline, xcoordInIPPixunits);
 			outputMatrix[yy][xx] = flatMatrix[yy][xx]/ExpectedFlux;
 		}
 	}
 	// DT Jan 2013 moved outside of loop
-	free(y2);
+	operaSplineDelete(spline);
+	free(SplineValues);
 	free(SubPixXcoords);
 	free(SubPixElemSampleMedianCounts);
 	free(SubPixElementCounts);
@@ -1632,12 +1643,14 @@ void operaSpectralOrder::setSpectralLines(operaFITSImage &masterCompImage, opera
         unsigned NXPoints = InstrumentProfile->getNXPoints();		
         unsigned NYPoints = InstrumentProfile->getNYPoints();
         unsigned nMaxDataPoints = SpectralElements->getnSpectralElements();
+        operaVector ipdata(InstrumentProfile->getNTotalPoints());
         
         for(unsigned indexElem=0;indexElem < nMaxDataPoints; indexElem++) {    
             
             float xcenter =  SpectralElements->getphotoCenterX(indexElem);
             float ycenter =  SpectralElements->getphotoCenterY(indexElem);
             float distdElem = SpectralElements->getdistd(indexElem);
+            InstrumentProfile->getipDataFromPolyModel(distdElem, ipdata.datapointer());
             
             float my = 0;
             float myvar = 0; 
@@ -1655,12 +1668,12 @@ void operaSpectralOrder::setSpectralLines(operaFITSImage &masterCompImage, opera
                         masterCompImage[yy][xx] < SATURATIONLIMIT && 
                         badpix[yy][xx] == 1 && 
                         (float)masterCompImage[yy][xx] > 0 ) {                    
-                        my +=  (float)(masterCompImage[yy][xx]  - bias[yy][xx]) * InstrumentProfile->getipDataFromPolyModel(distdElem,i,j);
-                        myvar += (noise/gain)*(noise/gain)/float(NXPoints*NYPoints) + fabs((float)masterCompImage[yy][xx] * InstrumentProfile->getipDataFromPolyModel(distdElem,i,j));
+                        my +=  (float)(masterCompImage[yy][xx]  - bias[yy][xx]) * ipdata[j*NXPoints+i];
+                        myvar += (noise/gain)*(noise/gain)/float(NXPoints*NYPoints) + fabs((float)masterCompImage[yy][xx] * ipdata[j*NXPoints+i]);
                     } else {
-                        fluxFractionLost += InstrumentProfile->getipDataFromPolyModel(distdElem,i,j);
+                        fluxFractionLost += ipdata[j*NXPoints+i];
                     }
-                    IPNormalizationFactor += InstrumentProfile->getipDataFromPolyModel(distdElem,i,j); //In case IP is not properly normalized. This could occurs after the polynomial fit
+                    IPNormalizationFactor += ipdata[j*NXPoints+i]; //In case IP is not properly normalized. This could occurs after the polynomial fit
                 }
             }      
             
@@ -1713,11 +1726,13 @@ void operaSpectralOrder::calculateXCorrBetweenIPandImage(operaFITSImage &Image,
     const unsigned NXPoints = InstrumentProfile->getNXPoints();		
     const unsigned NYPoints = InstrumentProfile->getNYPoints();
     const unsigned nMaxDataPoints = SpectralElements->getnSpectralElements();
+    operaVector ipdata(InstrumentProfile->getNTotalPoints());
     
     for(unsigned indexElem=0;indexElem < nMaxDataPoints; indexElem++) {    
         float xcenter =  SpectralElements->getphotoCenterX(indexElem);
         float ycenter =  SpectralElements->getphotoCenterY(indexElem);
         float distdElem = SpectralElements->getdistd(indexElem);
+        InstrumentProfile->getipDataFromPolyModel(distdElem, ipdata.datapointer());
 		
 		VLArray<int> xCoords(NXPoints);
         VLArray<int> yCoords(NYPoints);
@@ -1733,7 +1748,8 @@ void operaSpectralOrder::calculateXCorrBetweenIPandImage(operaFITSImage &Image,
 		VLArray<bool> validCoords(NYPoints, NXPoints);
 		for (unsigned j=jMin; j<jMax; j++) {
             for (unsigned i=iMin; i<iMax; i++) {
-				validCoords(j, i) = Image[yCoords(j)][xCoords(i)] > 0 && Image[yCoords(j)][xCoords(i)] < SATURATIONLIMIT && badpix[yCoords(j)][xCoords(i)];
+				const float pixel = Image.getpixelvalue(yCoords(j), xCoords(i));
+				validCoords(j, i) = pixel > 0 && pixel < SATURATIONLIMIT && badpix.getpixelvalue(yCoords(j), xCoords(i));
 			}
 		}
         
@@ -1743,8 +1759,8 @@ void operaSpectralOrder::calculateXCorrBetweenIPandImage(operaFITSImage &Image,
 		for (unsigned j=jMin; j<jMax; j++) {	
             for (unsigned i=iMin; i<iMax; i++) {
                 if (validCoords(j, i)) {                    
-                    avgImg += (float)Image[yCoords(j)][xCoords(i)];
-                    ipvals(j, i) = InstrumentProfile->getipDataFromPolyModel(distdElem,i,j);
+                    avgImg += Image.getpixelvalue(yCoords(j), xCoords(i));
+                    ipvals(j, i) = ipdata[j*NXPoints+i];
                     meanIP += ipvals(j, i);
                     npImg++;
                 }
@@ -1758,7 +1774,7 @@ void operaSpectralOrder::calculateXCorrBetweenIPandImage(operaFITSImage &Image,
             for (unsigned i=iMin; i<iMax; i++) {
                 if (validCoords(j, i)) {
 					const float ip = ipvals(j, i) - meanIP;
-					const float imgval = (float)Image[yCoords(j)][xCoords(i)] - avgImg;
+					const float imgval = Image.getpixelvalue(yCoords(j), xCoords(i)) - avgImg;
                     Xcorr +=  imgval * ip;
                     imgsqr += imgval * imgval;
                     ipsqr += ip * ip;
@@ -2303,19 +2319,41 @@ operaFluxVector operaSpectralOrder::extractSubpixelFlux(operaFITSImage &objectIm
 	double elemXcenter = SpectralElements->getphotoCenterX(indexElem);
 	double elemYcenter = SpectralElements->getphotoCenterY(indexElem);
 	
-	for(unsigned pix=0; pix<aperturePixels->getNPixels(); pix++) {
-		// Select image col and row of subpixel
-		unsigned col = (unsigned)floor(elemXcenter + aperturePixels->getXcenter(pix));
-		unsigned row = (unsigned)floor(elemYcenter + aperturePixels->getYcenter(pix));
+	// Select image col and row of each subpixel through the aperture template
+	unsigned nPixels = aperturePixels->getNPixels();
+	if (nPixels == 0) return fluxVector;
+	// the buffers of the order only grow, an order is extracted by one thread at a time
+	if (subpixelCols.size() < nPixels) {
+		subpixelCols.resize(nPixels);
+		subpixelRows.resize(nPixels);
+	}
+	const unsigned *cols = &subpixelCols[0];
+	const unsigned *rows = &subpixelRows[0];
+	aperturePixels->placeSubpixels(elemXcenter, elemYcenter, &subpixelCols[0], &subpixelRows[0], subpixelPlaced);
+	
+	// Consecutive subpixels mostly fall in the same image pixel, which is then read once
+	unsigned lastcol = 0, lastrow = 0;
+	bool lastValid = false, haveLast = false;
+	double pixelFlux = 0, pixelFluxVar = 0;
+	for(unsigned pix=0; pix<nPixels; pix++) {
+		unsigned col = cols[pix];
+		unsigned row = rows[pix];
         if(pixcol) pixcol->insert(col);
 		if(pixrow) pixrow->insert(row);
-        if(col < objectImage.getnaxis1() && row < objectImage.getnaxis2() && objectImage[row][col] < SATURATIONLIMIT && badpix[row][col] > badpixValue && nflatImage[row][col]) {
-			double gain = gainBiasNoise.getGain(col,row);
-			double noise = gainBiasNoise.getNoise(col,row);
-			
-			double pixelFlux = gain*(objectImage[row][col] - biasImage[row][col])/nflatImage[row][col]; // Measured flux in e-/pixel
-			double pixelFluxVar = 2.0*noise*noise; // Just count detector noise for now, we can add the rest depending on the extraction method (factor of 2 in detector noise due to bias subtraction)
-			
+		if(!haveLast || col != lastcol || row != lastrow) {
+			lastValid = col < objectImage.getnaxis1() && row < objectImage.getnaxis2() && objectImage.getpixelvalue(row,col) < SATURATIONLIMIT && badpix.getpixelvalue(row,col) > badpixValue && nflatImage.getpixelvalue(row,col);
+			if(lastValid) {
+				double gain = gainBiasNoise.getGain(col,row);
+				double noise = gainBiasNoise.getNoise(col,row);
+				
+				pixelFlux = gain*(objectImage.getpixelvalue(row,col) - biasImage.getpixelvalue(row,col))/nflatImage.getpixelvalue(row,col); // Measured flux in e-/pixel
+				pixelFluxVar = 2.0*noise*noise; // Just count detector noise for now, we can add the rest depending on the extraction method (factor of 2 in detector noise due to bias subtraction)
+			}
+			lastcol = col;
+			lastrow = row;
+			haveLast = true;
+		}
+        if(lastValid) {
 			fluxVector.insert(pixelFlux * subpixelArea, pixelFluxVar * subpixelArea); // Convert from e-/pixel to e-/subpixel, since we have flux values per subpixel
 		} else {
 			fluxVector.insert(NAN, NAN);
@@ -2574,14 +2612,12 @@ void operaSpectralOrder::extractOptimalSpectrum(operaFITSImage &objectImage, ope
      * 1. Revise variance estimates. STEP #6 K. Horne, 1986
      * 2. Mask cosmic ray hits.      STEP #7 K. Horne, 1986
      * 3. Extract optimal spectrum.  STEP #8 K. Horne, 1986     
+     * iterated up to iterations times per element.
      */       
-    ostream *current_pout = NULL;
-    
-    for(unsigned iter = 0; iter < iterations; iter++){
-        if(iter == iterations-1) current_pout = pout;
-        if(verbose) cerr << "operaSpectralOrder::extractOptimalSpectrum: iter="<<iter<<" measuring optimal spectrum..." << endl;
-        measureOptimalSpectrum(objectImage,nflatImage,biasImage,badpix,gainBiasNoise, minSigmaClip, sigmaClipRange);
-		printBeamSpectrum(current_pout);
+    if(iterations) {
+        if(verbose) cerr << "operaSpectralOrder::extractOptimalSpectrum: iterations="<<iterations<<" measuring optimal spectrum..." << endl;
+        measureOptimalSpectrum(objectImage,nflatImage,biasImage,badpix,gainBiasNoise, minSigmaClip, sigmaClipRange, iterations);
+        printBeamSpectrum(pout);
     }
     
     // get rid of stuff we don't need anymore
@@ -2758,97 +2794,153 @@ void operaSpectralOrder::measureRawSpectrumRejectingBadpixels(operaFITSImage &in
 }
 
 void operaSpectralOrder::measureOptimalSpectrum(operaFITSImage &inputImage, operaFITSImage &nflatImage, operaFITSImage &biasImage, operaFITSImage &badpix, GainBiasNoise &gainBiasNoise, double minSigmaClip ,double sigmaClipRange) {
+    measureOptimalSpectrum(inputImage, nflatImage, biasImage, badpix, gainBiasNoise, minSigmaClip, sigmaClipRange, 1);
+}
+
+/*
+ * Elements are independent, so each one goes through its rejection iterations on its own: the subpixel
+ * fluxes are extracted once into buffers reused for every element, and an element stops iterating
+ * when a pass rejects no pixel and moves no flux by more than OPTIMAL_EXTRACTION_CONVERGENCE errors,
+ * since further passes would only repeat it.
+ */
+void operaSpectralOrder::measureOptimalSpectrum(operaFITSImage &inputImage, operaFITSImage &nflatImage, operaFITSImage &biasImage, operaFITSImage &badpix, GainBiasNoise &gainBiasNoise, double minSigmaClip ,double sigmaClipRange, unsigned iterations) {
     
     unsigned NumberofElements = SpectralElements->getnSpectralElements();
     
+    unsigned NXPoints = 0;
+    for(unsigned beam = 0; beam < numberOfBeams; beam++) {
+        NXPoints += ExtractionApertures[beam]->getSubpixels()->getNPixels();
+    }
+    operaVector pixelFlux(NXPoints);
+    operaVector pixelVariance(NXPoints);
+    operaVector previousFlux(numberOfBeams+1);
+    
     for(unsigned indexElem=0;indexElem < NumberofElements; indexElem++) {
         double BackgroundFlux=0;
         for(unsigned background=0;background<LEFTANDRIGHT;background++) {
             BackgroundFlux += BackgroundElements[background]->getFlux(indexElem)/(double)LEFTANDRIGHT;
         }
         
-        double OldFlux = SpectralElements->getFlux(indexElem);
-        double optimalFluxDenominatorAllBeams = 0;
-        double optimalFluxNumeratorAllBeams = 0;
-        double SumOfUsefulFluxWithinApertureAllBeams = 0;
-        double maxSigSq = 0;
-        
         unsigned beamstart = 0;
         for(unsigned beam = 0; beam < numberOfBeams; beam++) {
-            double OldBeamFlux = BeamElements[beam]->getFlux(indexElem);
-            double optimalBeamFluxDenominator = 0;
-            double optimalBeamFluxNumerator = 0;
-            double SumOfUsefulBeamFluxWithinAperture = 0;
-            double maxBeamSigSq = 0;
-            
-            operaFluxVector pixelFlux = extractSubpixelFlux(inputImage, nflatImage, biasImage, badpix, 0, gainBiasNoise, indexElem, ExtractionApertures[beam]->getSubpixels()) - BackgroundFlux;
-            for(unsigned pix=0; pix<pixelFlux.getlength(); pix++) {
-                const double beamip = BeamProfiles[beam]->getdataCubeValues(pix, 0, indexElem);
-                const double fullip = InstrumentProfile->getdataCubeValues(beamstart+pix, 0, indexElem);
-                if(!isnan(pixelFlux.getflux(pix))) {
-                    if(!isnan(beamip)) {
-                        double BeamResidual = pixelFlux.getflux(pix) - OldBeamFlux*beamip;
-                        double RevisedBeamVariance = pixelFlux.getvariance(pix) + fabs(BackgroundFlux) + fabs(OldBeamFlux*beamip);
-                        double BeamSigmaSq = BeamResidual*BeamResidual / RevisedBeamVariance;
-                        if(BeamSigmaSq > maxBeamSigSq) {
-                            maxBeamSigSq = BeamSigmaSq;
-                        }
+            operaFluxVector beamFlux = extractSubpixelFlux(inputImage, nflatImage, biasImage, badpix, 0, gainBiasNoise, indexElem, ExtractionApertures[beam]->getSubpixels());
+            for(unsigned pix=0; pix<beamFlux.getlength(); pix++) {
+                pixelFlux[beamstart+pix] = beamFlux.getflux(pix) - BackgroundFlux;
+                pixelVariance[beamstart+pix] = beamFlux.getvariance(pix);
+            }
+            beamstart += beamFlux.getlength();
+        }
+        
+        for(unsigned iter = 0; iter < iterations; iter++) {
+            for(unsigned index = 0; index < numberOfBeams+1; index++) {
+                previousFlux[index] = MainAndBeamElements(index).getFlux(indexElem);
+            }
+            if(measureOptimalElement(indexElem, pixelFlux, pixelVariance, BackgroundFlux, minSigmaClip, sigmaClipRange)) {
+                continue;
+            }
+            bool converged = true;
+            for(unsigned index = 0; index < numberOfBeams+1 && converged; index++) {
+                double change = MainAndBeamElements(index).getFlux(indexElem) - previousFlux[index];
+                double variance = MainAndBeamElements(index).getFluxVariance(indexElem);
+                converged = change*change <= OPTIMAL_EXTRACTION_CONVERGENCE*OPTIMAL_EXTRACTION_CONVERGENCE*variance;
+            }
+            if(converged) {
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * One rejection pass over an element, from its background subtracted subpixel fluxes and variances,
+ * all beams end to end. Returns the number of profile pixels newly rejected.
+ */
+unsigned operaSpectralOrder::measureOptimalElement(unsigned indexElem, const operaVector &pixelFlux, const operaVector &pixelVariance, double BackgroundFlux, double minSigmaClip, double sigmaClipRange) {
+    unsigned rejected = 0;
+    double OldFlux = SpectralElements->getFlux(indexElem);
+    double optimalFluxDenominatorAllBeams = 0;
+    double optimalFluxNumeratorAllBeams = 0;
+    double SumOfUsefulFluxWithinApertureAllBeams = 0;
+    double maxSigSq = 0;
+    
+    unsigned beamstart = 0;
+    for(unsigned beam = 0; beam < numberOfBeams; beam++) {
+        double OldBeamFlux = BeamElements[beam]->getFlux(indexElem);
+        double optimalBeamFluxDenominator = 0;
+        double optimalBeamFluxNumerator = 0;
+        double SumOfUsefulBeamFluxWithinAperture = 0;
+        double maxBeamSigSq = 0;
+        
+        const unsigned nbeampixels = ExtractionApertures[beam]->getSubpixels()->getNPixels();
+        for(unsigned pix=0; pix<nbeampixels; pix++) {
+            const double beamip = BeamProfiles[beam]->getdataCubeValues(pix, 0, indexElem);
+            const double fullip = InstrumentProfile->getdataCubeValues(beamstart+pix, 0, indexElem);
+            if(!isnan(pixelFlux[beamstart+pix])) {
+                if(!isnan(beamip)) {
+                    double BeamResidual = pixelFlux[beamstart+pix] - OldBeamFlux*beamip;
+                    double RevisedBeamVariance = pixelVariance[beamstart+pix] + fabs(BackgroundFlux) + fabs(OldBeamFlux*beamip);
+                    double BeamSigmaSq = BeamResidual*BeamResidual / RevisedBeamVariance;
+                    if(BeamSigmaSq > maxBeamSigSq) {
+                        maxBeamSigSq = BeamSigmaSq;
                     }
-                    if(!isnan(fullip)) {
-                        double Residual = pixelFlux.getflux(pix) - OldFlux*fullip;
-                        double RevisedVariance = pixelFlux.getvariance(pix) + fabs(BackgroundFlux) + fabs(OldFlux*fullip);
-                        double SigmaSq = Residual*Residual/RevisedVariance;
-                        if(SigmaSq > maxSigSq) {
-                            maxSigSq = SigmaSq;
-                        }
+                }
+                if(!isnan(fullip)) {
+                    double Residual = pixelFlux[beamstart+pix] - OldFlux*fullip;
+                    double RevisedVariance = pixelVariance[beamstart+pix] + fabs(BackgroundFlux) + fabs(OldFlux*fullip);
+                    double SigmaSq = Residual*Residual/RevisedVariance;
+                    if(SigmaSq > maxSigSq) {
+                        maxSigSq = SigmaSq;
                     }
                 }
             }
-            for(unsigned pix=0; pix<pixelFlux.getlength(); pix++) {
-                const double beamip = BeamProfiles[beam]->getdataCubeValues(pix, 0, indexElem);
-                const double fullip = InstrumentProfile->getdataCubeValues(beamstart+pix, 0, indexElem);
-                if(!isnan(pixelFlux.getflux(pix))) {
-                    if(!isnan(beamip)) {
-                        double BeamResidual = pixelFlux.getflux(pix) - OldBeamFlux*beamip;
-                        if(BeamResidual < 0) BeamResidual = 0;
-                        double RevisedBeamVariance = pixelFlux.getvariance(pix) + fabs(BackgroundFlux) + fabs(OldBeamFlux*beamip);
-                        double BeamSigmaSq = BeamResidual*BeamResidual / RevisedBeamVariance;
-                        if(BeamSigmaSq < minSigmaClip || BeamSigmaSq < maxBeamSigSq/sigmaClipRange) {
-                            optimalBeamFluxNumerator += beamip*pixelFlux.getflux(pix)/RevisedBeamVariance;
-                            optimalBeamFluxDenominator += beamip*beamip/RevisedBeamVariance;
-                            SumOfUsefulBeamFluxWithinAperture += beamip;
-                        } else {
-                            BeamProfiles[beam]->setdataCubeValues(NAN, pix, 0, indexElem);
-                        }
+        }
+        for(unsigned pix=0; pix<nbeampixels; pix++) {
+            const double beamip = BeamProfiles[beam]->getdataCubeValues(pix, 0, indexElem);
+            const double fullip = InstrumentProfile->getdataCubeValues(beamstart+pix, 0, indexElem);
+            if(!isnan(pixelFlux[beamstart+pix])) {
+                if(!isnan(beamip)) {
+                    double BeamResidual = pixelFlux[beamstart+pix] - OldBeamFlux*beamip;
+                    if(BeamResidual < 0) BeamResidual = 0;
+                    double RevisedBeamVariance = pixelVariance[beamstart+pix] + fabs(BackgroundFlux) + fabs(OldBeamFlux*beamip);
+                    double BeamSigmaSq = BeamResidual*BeamResidual / RevisedBeamVariance;
+                    if(BeamSigmaSq < minSigmaClip || BeamSigmaSq < maxBeamSigSq/sigmaClipRange) {
+                        optimalBeamFluxNumerator += beamip*pixelFlux[beamstart+pix]/RevisedBeamVariance;
+                        optimalBeamFluxDenominator += beamip*beamip/RevisedBeamVariance;
+                        SumOfUsefulBeamFluxWithinAperture += beamip;
+                    } else {
+                        BeamProfiles[beam]->setdataCubeValues(NAN, pix, 0, indexElem);
+                        rejected++;
                     }
-                    if(!isnan(fullip)) {
-                        double Residual = pixelFlux.getflux(pix) - OldFlux*fullip;
-                        if(Residual < 0) Residual = 0;
-                        double RevisedVariance = pixelFlux.getvariance(pix) + fabs(BackgroundFlux) + fabs(OldFlux*fullip);
-                        double SigmaSq = Residual*Residual/RevisedVariance;
-                        if(SigmaSq < minSigmaClip || SigmaSq < maxSigSq/sigmaClipRange) {
-                            optimalFluxNumeratorAllBeams += fullip*pixelFlux.getflux(pix)/RevisedVariance;
-                            optimalFluxDenominatorAllBeams += fullip*fullip/RevisedVariance;
-                            SumOfUsefulFluxWithinApertureAllBeams += fullip;
-                        } else {
-                            InstrumentProfile->setdataCubeValues(NAN, beamstart+pix, 0, indexElem);
-                        }
+                }
+                if(!isnan(fullip)) {
+                    double Residual = pixelFlux[beamstart+pix] - OldFlux*fullip;
+                    if(Residual < 0) Residual = 0;
+                    double RevisedVariance = pixelVariance[beamstart+pix] + fabs(BackgroundFlux) + fabs(OldFlux*fullip);
+                    double SigmaSq = Residual*Residual/RevisedVariance;
+                    if(SigmaSq < minSigmaClip || SigmaSq < maxSigSq/sigmaClipRange) {
+                        optimalFluxNumeratorAllBeams += fullip*pixelFlux[beamstart+pix]/RevisedVariance;
+                        optimalFluxDenominatorAllBeams += fullip*fullip/RevisedVariance;
+                        SumOfUsefulFluxWithinApertureAllBeams += fullip;
+                    } else {
+                        InstrumentProfile->setdataCubeValues(NAN, beamstart+pix, 0, indexElem);
+                        rejected++;
                     }
                 }
             }
-            beamstart += pixelFlux.getlength();
-            
-            if(optimalBeamFluxDenominator) {
-                BeamElements[beam]->setFlux(optimalBeamFluxNumerator/optimalBeamFluxDenominator,indexElem);
-                BeamElements[beam]->setFluxVariance(SumOfUsefulBeamFluxWithinAperture/optimalBeamFluxDenominator,indexElem);
-            }
         }
+        beamstart += nbeampixels;
         
-        if(optimalFluxDenominatorAllBeams) {
-            SpectralElements->setFlux(optimalFluxNumeratorAllBeams/optimalFluxDenominatorAllBeams,indexElem);
-            SpectralElements->setFluxVariance(SumOfUsefulFluxWithinApertureAllBeams/optimalFluxDenominatorAllBeams,indexElem);
+        if(optimalBeamFluxDenominator) {
+            BeamElements[beam]->setFlux(optimalBeamFluxNumerator/optimalBeamFluxDenominator,indexElem);
+            BeamElements[beam]->setFluxVariance(SumOfUsefulBeamFluxWithinAperture/optimalBeamFluxDenominator,indexElem);
         }
     }
+    
+    if(optimalFluxDenominatorAllBeams) {
+        SpectralElements->setFlux(optimalFluxNumeratorAllBeams/optimalFluxDenominatorAllBeams,indexElem);
+        SpectralElements->setFluxVariance(SumOfUsefulFluxWithinApertureAllBeams/optimalFluxDenominatorAllBeams,indexElem);
+    }
+    return rejected;
 }
 
 void operaSpectralOrder::setWavelengthsFromCalibration() {
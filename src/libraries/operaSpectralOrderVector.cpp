@@ -57,6 +57,7 @@
 #include "libraries/operaStats.h"
 #include "libraries/gzstream.h"
 #include "libraries/operaFFT.h"    
+#include "libraries/operaThreadPool.h"
 #include "libraries/ladfit.h" // for ladfit_d
 
 #include "libraries/operaSpectralTools.h"			// void calculateUniformSample, getFluxAtWavelength
@@ -77,42 +78,43 @@ using namespace std;
  * \brief Base constructor.
  */
 operaSpectralOrderVector::operaSpectralOrderVector() :
-vector(MAXORDERS+1),
+vector(MAXORDERS+1, (operaSpectralOrder *)NULL),
 orderSpacingPolynomial(NULL),
-length(0),
+numberOfDispersionPolynomials(0),
+length(MAXORDERS),
 minorder(0),
 maxorder(0),
 sequence(0),
 instrumentmode(MODE_UNKNOWN),
 count(0),
-gainBiasNoise(NULL)
+gainBiasNoise(NULL),
+orderMaxdatapoints(0),
+orderMaxValues(0),
+orderNElements(0)
 {
-	unsigned order = 0;
-	for (order=minorder; order<MAXORDERS; order++) {
-		vector[order] = new operaSpectralOrder(order);
+	for (unsigned dispIndex=0; dispIndex<MAXORDEROFWAVELENGTHPOLYNOMIAL; dispIndex++) {
+		dispersionPolynomial[dispIndex] = NULL;
 	}
-	vector[order] = NULL;
-	length = MAXORDERS;
-	orderSpacingPolynomial = new Polynomial();
-    for (unsigned dispIndex=0; dispIndex<MAXORDEROFWAVELENGTHPOLYNOMIAL; dispIndex++) {
-        dispersionPolynomial[dispIndex] = new LaurentPolynomial();
-    }
-	gainBiasNoise = new GainBiasNoise();
+	pthread_mutex_init(&lazyMutex, NULL);
 }
 /* 
  * \class operaSpectralOrderVector(unsigned length, unsigned maxdatapoints, unsigned maxValues, unsigned nElements);
  * \brief Create a NULL-terminated SpectralOrderVector of spectralorders of type "None".
  */
 operaSpectralOrderVector::operaSpectralOrderVector(unsigned Length, unsigned maxdatapoints, unsigned maxValues, unsigned nElements) :
-vector(MAXORDERS+1),
+vector(MAXORDERS+1, (operaSpectralOrder *)NULL),
 orderSpacingPolynomial(NULL),
+numberOfDispersionPolynomials(0),
 length(0),
 minorder(0),
 maxorder(0),
 sequence(0),
 instrumentmode(MODE_UNKNOWN),
 count(0),
-gainBiasNoise(NULL)
+gainBiasNoise(NULL),
+orderMaxdatapoints(maxdatapoints),
+orderMaxValues(maxValues),
+orderNElements(nElements)
 {
 	if (Length == 0) {
 		throw operaException("operaSpectralOrderVector: ", operaErrorZeroLength, __FILE__, __FUNCTION__, __LINE__);	
@@ -120,17 +122,11 @@ gainBiasNoise(NULL)
 	if (Length > MAXORDERS) {
 		throw operaException("operaSpectralOrderVector: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);	
 	}
-	unsigned order = 0;
 	length = Length;
-	for (order=minorder; order<MAXORDERS; order++) {
-		vector[order] = new operaSpectralOrder(order, maxdatapoints, maxValues, nElements, None);
+	for (unsigned dispIndex=0; dispIndex<MAXORDEROFWAVELENGTHPOLYNOMIAL; dispIndex++) {
+		dispersionPolynomial[dispIndex] = NULL;
 	}
-	vector[order] = NULL;
-	orderSpacingPolynomial = new Polynomial();
-    for (unsigned dispIndex=0; dispIndex<MAXORDEROFWAVELENGTHPOLYNOMIAL; dispIndex++) {
-        dispersionPolynomial[dispIndex] = new LaurentPolynomial();
-    }
-	gainBiasNoise = new GainBiasNoise();
+	pthread_mutex_init(&lazyMutex, NULL);
 }
 /*
  * Destructor
@@ -146,6 +142,7 @@ operaSpectralOrderVector::~operaSpectralOrderVector() {
 	
 	delete gainBiasNoise;
 	gainBiasNoise = NULL;
+	pthread_mutex_destroy(&lazyMutex);
 }
 
 /*
@@ -176,17 +173,51 @@ void operaSpectralOrderVector::setnumberOfDispersionPolynomials(unsigned NumberO
 void operaSpectralOrderVector::freeSpectralOrderVector() {
 	for (unsigned order = 0; order < MAXORDERS; order++) {
 		delete vector[order];
+		vector[order] = NULL;
+	}
+}
+
+/*
+ * operaSpectralOrder *allocateSpectralOrder(unsigned order) const;
+ * \brief returns the order, creating it on its first access as the constructor used to create every order.
+ * \note threads of an order-parallel loop may get orders concurrently, so the slot is read and filled under lazyMutex.
+ */
+operaSpectralOrder *operaSpectralOrderVector::allocateSpectralOrder(unsigned order) const {
+	pthread_mutex_lock(&lazyMutex);
+	try {
+		if (vector[order] == NULL) {
+			if (orderMaxdatapoints == 0) {
+				vector[order] = new operaSpectralOrder(order);
+			} else {
+				vector[order] = new operaSpectralOrder(order, orderMaxdatapoints, orderMaxValues, orderNElements, None);
+			}
+		}
 	}
+	catch (...) {
+		pthread_mutex_unlock(&lazyMutex);
+		throw;
+	}
+	operaSpectralOrder *spectralOrder = vector[order];
+	pthread_mutex_unlock(&lazyMutex);
+	return spectralOrder;
 }
 /* 
  * unsigned getGainBiasNoise();
- * \brief returns a pointer to the GainBiasNoise class instance.
+ * \brief returns a pointer to the GainBiasNoise class instance, created under lazyMutex on first access.
  */
 GainBiasNoise *operaSpectralOrderVector::getGainBiasNoise() {
-	return gainBiasNoise;
+	pthread_mutex_lock(&lazyMutex);
+	if (gainBiasNoise == NULL) gainBiasNoise = new GainBiasNoise();
+	GainBiasNoise *gbn = gainBiasNoise;
+	pthread_mutex_unlock(&lazyMutex);
+	return gbn;
 }
 const GainBiasNoise *operaSpectralOrderVector::getGainBiasNoise() const {
-	return gainBiasNoise;
+	pthread_mutex_lock(&lazyMutex);
+	if (gainBiasNoise == NULL) gainBiasNoise = new GainBiasNoise();
+	const GainBiasNoise *gbn = gainBiasNoise;
+	pthread_mutex_unlock(&lazyMutex);
+	return gbn;
 }
 
 void operaSpectralOrderVector::setWavelengthsFromCalibration(int Minorder, int Maxorder) {
@@ -260,28 +291,22 @@ void operaSpectralOrderVector::setMaxorder(unsigned Maxorder) {
 
 
 void operaSpectralOrderVector::shiftOrdersDown(unsigned shift) {
-	std::vector<operaSpectralOrder*> temp(MAXORDERS);
+	std::vector<operaSpectralOrder*> temp(MAXORDERS+1, (operaSpectralOrder *)NULL);
 	for(unsigned order = 0; order < MAXORDERS-shift; order++) {
 		temp[order] = vector[order+shift];
-		temp[order]->setorder(order);
+		if (temp[order]) temp[order]->setorder(order);
 	}
 	for(unsigned order = 0; order < shift; order++) {
 		delete vector[order];
 	}
-	for(unsigned order = MAXORDERS-shift; order < MAXORDERS; order++) {
-		temp[order] = new operaSpectralOrder(order);
-	}
 	vector = temp;
 }
 
 void operaSpectralOrderVector::shiftOrdersUp(unsigned shift) {
-	std::vector<operaSpectralOrder*> temp(MAXORDERS);
+	std::vector<operaSpectralOrder*> temp(MAXORDERS+1, (operaSpectralOrder *)NULL);
 	for(unsigned order = shift; order < MAXORDERS; order++) {
 		temp[order] = vector[order-shift];
-		temp[order]->setorder(order);
-	}
-	for(unsigned order = 0; order < shift; order++) {
-		temp[order] = new operaSpectralOrder(order);
+		if (temp[order]) temp[order]->setorder(order);
 	}
 	for(unsigned order = MAXORDERS-shift; order < MAXORDERS; order++) {
 		delete vector[order];
@@ -336,10 +361,18 @@ unsigned operaSpectralOrderVector::getSequence(void) const {
  * \brief gets the order spacing polynomial
  */
 Polynomial *operaSpectralOrderVector::getOrderSpacingPolynomial(void) {
-	return orderSpacingPolynomial;
+	pthread_mutex_lock(&lazyMutex);
+	if (orderSpacingPolynomial == NULL) orderSpacingPolynomial = new Polynomial();
+	Polynomial *polynomial = orderSpacingPolynomial;
+	pthread_mutex_unlock(&lazyMutex);
+	return polynomial;
 }
 const Polynomial *operaSpectralOrderVector::getOrderSpacingPolynomial(void) const {
-	return orderSpacingPolynomial;
+	pthread_mutex_lock(&lazyMutex);
+	if (orderSpacingPolynomial == NULL) orderSpacingPolynomial = new Polynomial();
+	const Polynomial *polynomial = orderSpacingPolynomial;
+	pthread_mutex_unlock(&lazyMutex);
+	return polynomial;
 }
 
 /* 
@@ -360,13 +393,21 @@ LaurentPolynomial *operaSpectralOrderVector::getDispersionPolynomial(unsigned in
     if (index >= numberOfDispersionPolynomials) {
 		throw operaException("operaSpectralOrderVector: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
 	}
-	return dispersionPolynomial[index];
+	pthread_mutex_lock(&lazyMutex);
+	if (dispersionPolynomial[index] == NULL) dispersionPolynomial[index] = new LaurentPolynomial();
+	LaurentPolynomial *polynomial = dispersionPolynomial[index];
+	pthread_mutex_unlock(&lazyMutex);
+	return polynomial;
 }
 const LaurentPolynomial *operaSpectralOrderVector::getDispersionPolynomial(unsigned index) const {
     if (index >= numberOfDispersionPolynomials) {
 		throw operaException("operaSpectralOrderVector: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
 	}
-	return dispersionPolynomial[index];
+	pthread_mutex_lock(&lazyMutex);
+	if (dispersionPolynomial[index] == NULL) dispersionPolynomial[index] = new LaurentPolynomial();
+	const LaurentPolynomial *polynomial = dispersionPolynomial[index];
+	pthread_mutex_unlock(&lazyMutex);
+	return polynomial;
 }
 
 /*
@@ -384,13 +425,16 @@ void operaSpectralOrderVector::setDispersionPolynomial(unsigned index, const int
 /* 
  * operaSpectralOrder* operaSpectralOrderVector::GetSpectralOrder(unsigned order);
  * \brief Gets an operaSpectralOrder* to a given order, else NULL
+ * \details The order is created on its first access, so a vector only holds the orders that were used.
  */
 const operaSpectralOrder* operaSpectralOrderVector::GetSpectralOrder(unsigned order) const {
-	return vector[order]; //Why don't we just do this instead? Should always work?
+	if (order >= MAXORDERS) return NULL;
+	return allocateSpectralOrder(order);
 }
 
 operaSpectralOrder* operaSpectralOrderVector::GetSpectralOrder(unsigned order) {
-	return vector[order];
+	if (order >= MAXORDERS) return NULL;
+	return allocateSpectralOrder(order);
 }
 
 
@@ -895,531 +939,307 @@ void operaSpectralOrderVector::getOrdersByWavelengthRange(operaWavelengthRange w
     Maxorder = tempmax;
 }
 
-void operaSpectralOrderVector::measureContinuumAcrossOrders(unsigned binsize, int orderBin, unsigned nsigcut) {
-    
-    unsigned maxNDataPoints = 0;
-    unsigned numberOfBeams = getNumberOfBeams(minorder, maxorder);
-    
-    int usefulMinorder = (int)minorder;
-    int usefulMaxorder = (int)maxorder;
-    
-    bool hasUsefulMinorder = false;
-    
-    for(int order=(int)minorder; order<=(int)maxorder; order++) {
-        
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        
-        if (spectralOrder->gethasSpectralElements() && spectralOrder->gethasWavelength()) {
-            
-            if(!hasUsefulMinorder) {
-                usefulMinorder = order;
-                hasUsefulMinorder = true;
-            }
-            usefulMaxorder = order;
-            
-			spectralOrder->setWavelengthsFromCalibration();
-			
-            spectralOrder->calculateContinuum(binsize,nsigcut);
-            
-            if(spectralOrder->gethasSpectralEnergyDistribution()) {
-                operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-                
-                if(maxNDataPoints < spectralEnergyDistribution->getnDataPoints()) {
-                    maxNDataPoints = spectralEnergyDistribution->getnDataPoints();
-                }
-            }
-        }
-    }
-    
-    operaFluxVector *FluxCalibrationFitVector[MAXORDERS];
-    operaFluxVector *BeamFluxCalibrationFitVector[MAXNUMBEROFBEAMS][MAXORDERS];
-    
-    float *fluxData = new float[MAXORDERS];
-    float *orderData = new float[MAXORDERS];
-        
-    float *fluxBeamData[MAXNUMBEROFBEAMS];
-    float *orderBeamData[MAXNUMBEROFBEAMS];
-    float orderBeamFlux[MAXNUMBEROFBEAMS];
-    unsigned npBeam[MAXNUMBEROFBEAMS];
-    
-    for(unsigned beam=0; beam < numberOfBeams; beam++) {
-        npBeam[beam] = 0;
-        fluxBeamData[beam] = new float[MAXORDERS];
-        orderBeamData[beam] = new float[MAXORDERS];
-    }
-    
-    float fluxvariance = 0;
-    float beamfluxvariance = 0;
+/*
+ * Across-order fits
+ *
+ * Each order is fitted against its neighbours within orderBin with a robust line in the order number.
+ * The fits only read the neighbours and the results are written back once every order is fitted, so
+ * the orders are fitted in parallel on the shared thread pool.
+ */
+class acrossOrderFitJob {
+public:
+	std::vector<operaSpectralOrder *> orders;	// orders[o - firstorder], NULL outside [0, MAXORDERS)
+	int firstorder;
+	int minorder, maxorder;				// the orders fitted, also the bounds of the windows
+	int orderBin;
+	unsigned numberOfBeams;
+	unsigned binsize, nsigcut;			// continuum of each order
+	unsigned maxNDataPoints;
+	bool requireWavelength;				// continuum: usable orders must also have a wavelength
+	int lowOrderToClip, highOrderToClip;	// flux calibration
+	bool throughput;
+	std::vector<operaFluxVector *> fits;	// numberOfBeams+1 per fitted order, main then beams
+	
+	acrossOrderFitJob(operaSpectralOrderVector &spectralOrders, int Minorder, int Maxorder, int OrderBin, unsigned NumberOfBeams) :
+	orders(Maxorder-Minorder+3, (operaSpectralOrder *)NULL), firstorder(Minorder-1), minorder(Minorder), maxorder(Maxorder),
+	orderBin(OrderBin), numberOfBeams(NumberOfBeams), binsize(0), nsigcut(0), maxNDataPoints(0), requireWavelength(false),
+	lowOrderToClip(0), highOrderToClip(0), throughput(false), fits((Maxorder-Minorder+1)*(NumberOfBeams+1), (operaFluxVector *)NULL)
+	{
+		// the orders are allocated here, the tasks only look them up
+		for (int o=firstorder; o<=Maxorder+1; o++) {
+			if (o >= 0) orders[o-firstorder] = spectralOrders.GetSpectralOrder((unsigned)o);
+		}
+	}
+	~acrossOrderFitJob() {
+		for (unsigned i=0; i<fits.size(); i++) {
+			delete fits[i];
+		}
+	}
+	operaSpectralOrder *getOrder(int o) const {
+		if (o < firstorder || o > maxorder+1) return NULL;
+		return orders[o-firstorder];
+	}
+	/*
+	 * the window of an order, an odd number of orders clipped to [minorder, maxorder]
+	 */
+	void getWindow(int order, int &loword, int &hiord) const {
+		loword = order - orderBin;
+		hiord = order + orderBin;
+		if (loword < minorder) loword = minorder;
+		if (hiord > maxorder) hiord = maxorder;
+		if (!((hiord - loword + 1)%2)) {
+			if (hiord == maxorder) loword--;
+			else hiord++;
+		}
+	}
+};
 
-    unsigned order_count = 0;
-    
-    for(int order=usefulMinorder; order<=usefulMaxorder; order++) {
-        int loword = order - orderBin;
-        int hiord = order + orderBin;
-        if(loword < usefulMinorder) {
-            loword = usefulMinorder;
-        }
-        if(hiord > usefulMaxorder) {
-            hiord = usefulMaxorder;
-        }
-        
-        int nord = (hiord - loword + 1);
-        
-        if(!(nord%2)) {
-            if(hiord == usefulMaxorder) {
-                loword--;
-            } else {
-                hiord++;
-            }
-        }
-        
-        nord = (hiord - loword + 1);
-        
-        if(GetSpectralOrder(order)->gethasSpectralElements() && GetSpectralOrder(order)->gethasSpectralEnergyDistribution() && GetSpectralOrder(order)->gethasWavelength()) {
-            
-            unsigned nDataPointsOfCurrentOrder = GetSpectralOrder(order)->getSpectralEnergyDistribution()->getnDataPoints();
-            
-            FluxCalibrationFitVector[order_count]  = new operaFluxVector(nDataPointsOfCurrentOrder);
-            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                BeamFluxCalibrationFitVector[beam][order_count] = new operaFluxVector(nDataPointsOfCurrentOrder);
-            }
-            
-            for(unsigned dataIndex=0;dataIndex < maxNDataPoints; dataIndex++) {
-                if(dataIndex>=nDataPointsOfCurrentOrder) {
-                    break;
-                }
-                
-                unsigned np = 0;
-                float orderFlux = NAN;
-                
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    npBeam[beam] = 0;
-                    orderBeamFlux[beam] = NAN;
-                }
-                
-                for(int o=loword; o<=hiord; o++) {
-                    operaSpectralOrder *spectralOrder = GetSpectralOrder(o);
-                    
-                    if(spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution() && spectralOrder->gethasWavelength()) {
-                        
-                        operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-                        
-                        if(dataIndex < spectralEnergyDistribution->getnDataPoints() && dataIndex < nDataPointsOfCurrentOrder) {
-                            float flux = (float)spectralEnergyDistribution->getfluxData(dataIndex);
-                            fluxvariance = flux;
-                            
-                            if(!isnan(flux)) {
-                                orderData[np] = (float)o;
-                                fluxData[np] = flux;
-                                if(o==order) {
-                                    orderFlux = flux;
-                                }
-                                np++;
-                            }
-                            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                                operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                                float beamflux = beamSED->getfluxData(dataIndex);
-                                beamfluxvariance = beamflux;
-                                
-                                if(!isnan(beamflux)) {
-                                    orderBeamData[beam][npBeam[beam]] = (float)o;
-                                    fluxBeamData[beam][npBeam[beam]] = beamflux;
-                                    if(o==order) {
-                                        orderBeamFlux[beam] = beamflux;
-                                    }
-                                    npBeam[beam]++;
-                                }
-                            }
-                        }
-                        
-                    }
-                }
-                
-                if(np && !(np%2)) {
-                    np--;
-                }
-                if(np>=3) {
-                    float am,bm,abdevm;
+static bool hasContinuum(const operaSpectralOrder *spectralOrder, bool requireWavelength) {
+	return spectralOrder && spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution() && (!requireWavelength || spectralOrder->gethasWavelength());
+}
 
-                    ladfit(orderData,fluxData,np,&am,&bm,&abdevm); /* robust linear fit: f(x) =  a + b*x */
-                    
-                    float dytop = 0;
-                    
-                    for(unsigned i=0;i<np;i++){
-                        float fitMedianSlope = (bm*orderData[i] + am);
-                        
-                        if(fabs(fluxData[i] - fitMedianSlope) < abdevm &&
-                           fabs(fluxData[i] - fitMedianSlope) > dytop) {
-                            dytop = fabs(fluxData[i] - fitMedianSlope);
-                        }
-                    }
-                    if(dytop == 0) {
-                        dytop = abdevm;
-                    }
-                    
-                    FluxCalibrationFitVector[order_count]->setflux(double(bm*(float)order + am + dytop),dataIndex);
-                    FluxCalibrationFitVector[order_count]->setvariance(double(0.674433*abdevm)*double(0.674433*abdevm),dataIndex);
-                } else {
-                    FluxCalibrationFitVector[order_count]->setflux((double)orderFlux,dataIndex);
-                    FluxCalibrationFitVector[order_count]->setvariance((double)fluxvariance,dataIndex);
-                }
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    if(npBeam[beam] && !(npBeam[beam]%2)) {
-                        npBeam[beam]--;
-                    }
-                }
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    if(npBeam[beam]>=3) {
-                        float amBeam,bmBeam,abdevmBeam;
-                        ladfit(orderBeamData[beam],fluxBeamData[beam],npBeam[beam],&amBeam,&bmBeam,&abdevmBeam); /* robust linear fit: f(x) =  a + b*x */
-                        float dytop = 0;
-                        
-                        for(unsigned i=0;i<npBeam[beam];i++){
-                            float fitMedianSlope = (bmBeam*orderBeamData[beam][i] + amBeam);
-                            
-                            if(fabs(fluxBeamData[beam][i] - fitMedianSlope) < abdevmBeam &&
-                               (fluxBeamData[beam][i] - fitMedianSlope) > dytop) {
-                                dytop = fluxBeamData[beam][i] - fitMedianSlope;
-                            }
-                        }
-                        
-                        if(dytop == 0) {
-                            dytop = abdevmBeam;
-                        }
-                        BeamFluxCalibrationFitVector[beam][order_count]->setflux(double(bmBeam*(float)order + amBeam + dytop),dataIndex);
-                        BeamFluxCalibrationFitVector[beam][order_count]->setvariance(double(0.674433*abdevmBeam)*double(0.674433*abdevmBeam),dataIndex);
-                    } else {
-                        BeamFluxCalibrationFitVector[beam][order_count]->setflux(double(orderBeamFlux[beam]),dataIndex);
-                        BeamFluxCalibrationFitVector[beam][order_count]->setvariance(double(beamfluxvariance),dataIndex);
-                    }
-                } // for(unsigned beam=0; beam < numberOfBeams; beam++) {
-            } // for(unsigned dataIndex=0;dataIndex < maxNDataPoints; dataIndex++) {
-            order_count++;
-        } // if(GetSpectralOrder(order)->gethasSpectralElements() && GetSpectralOrder(order)->gethasSpectralEnergyDistribution()) {
-    } // for(int order=(int)minorder; order<=(int)maxorder; order++) {
-
-    order_count = 0;
-    for(int order=usefulMinorder; order<=usefulMaxorder; order++) {
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        
-        if(spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution() && spectralOrder->gethasWavelength()) {
-            
-            operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-            unsigned nDataPointsOfCurrentOrder = spectralEnergyDistribution->getnDataPoints();
-            
-            for(unsigned dataIndex = 0; dataIndex < nDataPointsOfCurrentOrder; dataIndex++) {
-                spectralEnergyDistribution->setfluxData(FluxCalibrationFitVector[order_count]->getflux(dataIndex),dataIndex);
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                    beamSED->setfluxData(BeamFluxCalibrationFitVector[beam][order_count]->getflux(dataIndex),dataIndex);
-                }
-#ifdef PRINT_DEBUG
-                cout << order << ' ' << dataIndex << ' '
-                << spectralEnergyDistribution->getdistanceData(dataIndex) << ' '
-                << spectralEnergyDistribution->getfluxData(dataIndex) << ' '
-                << FluxCalibrationFitVector[order_count]->getflux(dataIndex) << ' ';
-                
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                    cout << beam << ' ' << beamSED->getfluxData(dataIndex) << ' ' << BeamFluxCalibrationFitVector[beam][order_count]->getflux(dataIndex) << ' ';
-                }
-                cout << endl;
-#endif
-            }
-#ifdef PRINT_DEBUG
-            cout << endl;
-#endif
-            order_count++;
-        }
-    }
+/*
+ * robust line through the np (order, flux) pairs evaluated at order, optionally raised by the largest
+ * deviation within the absolute deviation, signed or not; false if there are fewer than 3 points.
+ */
+static bool fitAcrossOrders(float *orderData, float *fluxData, unsigned np, int order, bool raiseToTop, bool signedTop, double &flux, double &variance) {
+	if (np < 3) return false;
+	float am,bm,abdevm;
+	ladfit(orderData,fluxData,np,&am,&bm,&abdevm); /* robust linear fit: f(x) =  a + b*x */
+	if (raiseToTop) {
+		float dytop = 0;
+		for(unsigned i=0;i<np;i++){
+			float deviation = fluxData[i] - (bm*orderData[i] + am);
+			if(fabs(deviation) < abdevm && (signedTop ? deviation : fabs(deviation)) > dytop) {
+				dytop = signedTop ? deviation : fabs(deviation);
+			}
+		}
+		if(dytop == 0) {
+			dytop = abdevm;
+		}
+		flux = double(bm*(float)order + am + dytop);
+	} else {
+		flux = double(bm*(double)order + am);
+	}
+	variance = double(0.674433*abdevm)*double(0.674433*abdevm);
+	return true;
+}
 
-    for(int order=usefulMinorder; order<=usefulMaxorder; order++) {
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        
-        if (spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution() && spectralOrder->gethasWavelength()) {
-            operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-            spectralEnergyDistribution->populateUncalibratedFluxFromContinuumData();
-            
-            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                beamSED->populateUncalibratedFluxFromContinuumData();
-            }
-        }
-    } //for(int order=(int)minorder; order<=(int)maxorder; order++) {
+static void calculateOrderContinuum(unsigned long index, void *context) {
+	acrossOrderFitJob *job = (acrossOrderFitJob *)context;
+	operaSpectralOrder *spectralOrder = job->getOrder(job->minorder + (int)index);
+	if (spectralOrder->gethasSpectralElements() && spectralOrder->gethasWavelength()) {
+		spectralOrder->setWavelengthsFromCalibration();
+		spectralOrder->calculateContinuum(job->binsize, job->nsigcut);
+	}
 }
 
+/*
+ * fit the continuum samples of one order across its neighbours, the main SED and each beam SED on its own.
+ */
+static void fitContinuumAcrossOrders(unsigned long index, void *context) {
+	acrossOrderFitJob *job = (acrossOrderFitJob *)context;
+	int order = job->minorder + (int)index;
+	operaSpectralOrder *spectralOrder = job->getOrder(order);
+	if (!hasContinuum(spectralOrder, job->requireWavelength)) return;
+	
+	int loword, hiord;
+	job->getWindow(order, loword, hiord);
+	unsigned nord = (unsigned)(hiord - loword + 1);
+	unsigned nseries = job->numberOfBeams + 1;
+	unsigned nDataPoints = spectralOrder->getSpectralEnergyDistribution()->getnDataPoints();
+	if (nDataPoints > job->maxNDataPoints) nDataPoints = job->maxNDataPoints;
+	
+	operaFluxVector **fit = &job->fits[index*nseries];
+	for (unsigned b=0; b<nseries; b++) {
+		fit[b] = new operaFluxVector(spectralOrder->getSpectralEnergyDistribution()->getnDataPoints());
+	}
+	// scratch for one window per series
+	std::vector<float> orderData(nseries*nord), fluxData(nseries*nord), orderFlux(nseries), fluxvariance(nseries, 0.0);
+	std::vector<unsigned> np(nseries);
+	
+	for(unsigned dataIndex=0; dataIndex < nDataPoints; dataIndex++) {
+		for (unsigned b=0; b<nseries; b++) {
+			np[b] = 0;
+			orderFlux[b] = NAN;
+		}
+		for(int o=loword; o<=hiord; o++) {
+			operaSpectralOrder *neighbour = job->getOrder(o);
+			if (!hasContinuum(neighbour, job->requireWavelength) || dataIndex >= neighbour->getSpectralEnergyDistribution()->getnDataPoints()) continue;
+			for (unsigned b=0; b<nseries; b++) {
+				float flux = (float)neighbour->MainAndBeamSED(b).getfluxData(dataIndex);
+				fluxvariance[b] = flux;
+				if(!isnan(flux)) {
+					orderData[b*nord + np[b]] = (float)o;
+					fluxData[b*nord + np[b]] = flux;
+					if(o==order) {
+						orderFlux[b] = flux;
+					}
+					np[b]++;
+				}
+			}
+		}
+		for (unsigned b=0; b<nseries; b++) {
+			if(np[b] && !(np[b]%2)) {
+				np[b]--;
+			}
+			double flux, variance;
+			if (!fitAcrossOrders(&orderData[b*nord], &fluxData[b*nord], np[b], order, true, b > 0, flux, variance)) {
+				flux = (double)orderFlux[b];
+				variance = (double)fluxvariance[b];
+			}
+			fit[b]->setflux(flux, dataIndex);
+			fit[b]->setvariance(variance, dataIndex);
+		}
+	}
+}
 
-void operaSpectralOrderVector::measureContinuumAcrossOrders(unsigned binsize, int orderBin, unsigned nsigcut, unsigned nOrdersPicked, int *orderForWavelength) {
-    
-    int usefulMinorder = (int)minorder;
-    int usefulMaxorder = (int)maxorder;
-    
-    bool hasUsefulMinorder = false;
+/*
+ * feed the fitted continuum back into the SEDs of one order.
+ */
+static void storeContinuumAcrossOrders(unsigned long index, void *context) {
+	acrossOrderFitJob *job = (acrossOrderFitJob *)context;
+	int order = job->minorder + (int)index;
+	operaSpectralOrder *spectralOrder = job->getOrder(order);
+	if (!hasContinuum(spectralOrder, job->requireWavelength)) return;
+	
+	operaFluxVector **fit = &job->fits[index*(job->numberOfBeams+1)];
+	unsigned nDataPoints = spectralOrder->getSpectralEnergyDistribution()->getnDataPoints();
+	for (unsigned b=0; b<=job->numberOfBeams; b++) {
+		operaSpectralEnergyDistribution &spectralEnergyDistribution = spectralOrder->MainAndBeamSED(b);
+		for(unsigned dataIndex = 0; dataIndex < nDataPoints; dataIndex++) {
+			spectralEnergyDistribution.setfluxData(fit[b]->getflux(dataIndex),dataIndex);
+		}
+	}
+	for (unsigned b=0; b<=job->numberOfBeams; b++) {
+		spectralOrder->MainAndBeamSED(b).populateUncalibratedFluxFromContinuumData();
+	}
+}
+
+void operaSpectralOrderVector::measureContinuumAcrossOrders(unsigned binsize, int orderBin, unsigned nsigcut) {
+	measureContinuumAcrossOrders(binsize, orderBin, nsigcut, 0, NULL);
+}
 
-    unsigned maxNDataPoints = 0;
+void operaSpectralOrderVector::measureContinuumAcrossOrders(unsigned binsize, int orderBin, unsigned nsigcut, unsigned nOrdersPicked, int *orderForWavelength) {
 	unsigned numberOfBeams = getNumberOfBeams(minorder, maxorder);
-    
-    for(int order=(int)minorder; order<=(int)maxorder; order++) {
-        
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        
-        if (spectralOrder->gethasSpectralElements() && spectralOrder->gethasWavelength()) {
-            
-            if(!hasUsefulMinorder) {
-                usefulMinorder = order;
-                hasUsefulMinorder = true;
-            }
-            usefulMaxorder = order;
-            
-            spectralOrder->setWavelengthsFromCalibration();
-            
-            spectralOrder->calculateContinuum(binsize,nsigcut);
-            
-            if(spectralOrder->gethasSpectralEnergyDistribution()) {
-                operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-                
-                if(maxNDataPoints < spectralEnergyDistribution->getnDataPoints()) {
-                    maxNDataPoints = spectralEnergyDistribution->getnDataPoints();
-                }
-            }
-        }
-    }
-    
-    int actualMinorder = usefulMinorder;
-    int actualMaxorder = usefulMaxorder;
-    
-    if(orderForWavelength[0] < usefulMinorder) {
-        actualMinorder = orderForWavelength[0];
-    }
-    
-    if(orderForWavelength[nOrdersPicked-1] > usefulMaxorder) {
-        actualMaxorder = orderForWavelength[nOrdersPicked-1];
-    }
-    
-    operaFluxVector *FluxCalibrationFitVector[MAXORDERS];
-    operaFluxVector *BeamFluxCalibrationFitVector[MAXNUMBEROFBEAMS][MAXORDERS];
-    
-    float *fluxData = new float[MAXORDERS];
-    float *orderData = new float[MAXORDERS];
-    
-    float *fluxBeamData[MAXNUMBEROFBEAMS];
-    float *orderBeamData[MAXNUMBEROFBEAMS];
-    float orderBeamFlux[MAXNUMBEROFBEAMS];
-    unsigned npBeam[MAXNUMBEROFBEAMS];
-    
-    for(unsigned beam=0; beam < numberOfBeams; beam++) {
-        npBeam[beam] = 0;
-        fluxBeamData[beam] = new float[MAXORDERS];
-        orderBeamData[beam] = new float[MAXORDERS];
-    }
-    
-    float fluxvariance = 0;
-    float beamfluxvariance = 0;
-    
-    unsigned order_count = 0;
-    
-    for(int order=actualMinorder; order<=actualMaxorder; order++) {
-        
-        int loword = order - orderBin;
-        int hiord = order + orderBin;
-        if(loword < actualMinorder) {
-            loword = actualMinorder;
-        }
-        if(hiord > actualMaxorder) {
-            hiord = actualMaxorder;
-        }
-        
-        int nord = (hiord - loword + 1);
-        
-        if(!(nord%2)) {
-            if(hiord == actualMaxorder) {
-                loword--;
-            } else {
-                hiord++;
-            }
-        }
-        
-        nord = (hiord - loword + 1);
-                
-        if(GetSpectralOrder(order)->gethasSpectralElements() && GetSpectralOrder(order)->gethasSpectralEnergyDistribution()) {
-            
-            unsigned nDataPointsOfCurrentOrder = GetSpectralOrder(order)->getSpectralEnergyDistribution()->getnDataPoints();
-            
-            FluxCalibrationFitVector[order_count]  = new operaFluxVector(nDataPointsOfCurrentOrder);
-            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                BeamFluxCalibrationFitVector[beam][order_count] = new operaFluxVector(nDataPointsOfCurrentOrder);
-            }
-            
-            for(unsigned dataIndex=0;dataIndex < maxNDataPoints; dataIndex++) {
-                if(dataIndex>=nDataPointsOfCurrentOrder) {
-                    break;
-                }
-                
-                unsigned np = 0;
-                float orderFlux = NAN;
-                
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    npBeam[beam] = 0;
-                    orderBeamFlux[beam] = NAN;
-                }
-                
-                for(int o=loword; o<=hiord; o++) {
-                    operaSpectralOrder *spectralOrder = GetSpectralOrder(o);
-                    
-                    if(spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution()) {
-                        
-                        operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-                        
-                        if(dataIndex < spectralEnergyDistribution->getnDataPoints() && dataIndex < nDataPointsOfCurrentOrder) {
-                            float flux = spectralEnergyDistribution->getfluxData(dataIndex);
-                            fluxvariance = flux;
-                            
-                            if(!isnan(flux)) {
-                                orderData[np] = (float)o;
-                                fluxData[np] = flux;
-                                if(o==order) {
-                                    orderFlux = flux;
-                                }
-                                np++;
-                            }
-                            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                                operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                                float beamflux = beamSED->getfluxData(dataIndex);
-                                beamfluxvariance = beamflux;
-                                
-                                if(!isnan(beamflux)) {
-                                    orderBeamData[beam][npBeam[beam]] = (float)o;
-                                    fluxBeamData[beam][npBeam[beam]] = beamflux;
-                                    if(o==order) {
-                                        orderBeamFlux[beam] = beamflux;
-                                    }
-                                    npBeam[beam]++;
-                                }
-                            }
-                        }
-                        
-                    }
-                }
-                
-                if(np && !(np%2)) {
-                    np--;
-                }
-                
-                if(np>=3) {
-                    float am,bm,abdevm;
-                    ladfit(orderData,fluxData,np,&am,&bm,&abdevm); /* robust linear fit: f(x) =  a + b*x */
-                    
-                    float dytop = 0;
-                    
-                    for(unsigned i=0;i<np;i++){
-                        float fitMedianSlope = (bm*orderData[i] + am);
-                        
-                        if(fabs(fluxData[i] - fitMedianSlope) < abdevm &&
-                           fabs(fluxData[i] - fitMedianSlope) > dytop) {
-                            dytop = fabs(fluxData[i] - fitMedianSlope);
-                        }
-                    }
-                    
-                    if(dytop == 0) {
-                        dytop = abdevm;
-                    }
-                    
-                    FluxCalibrationFitVector[order_count]->setflux(double(bm*(float)order + am + dytop),dataIndex);
-                    FluxCalibrationFitVector[order_count]->setvariance(double(0.674433*abdevm)*double(0.674433*abdevm),dataIndex);
-                } else {
-                    FluxCalibrationFitVector[order_count]->setflux((double)orderFlux,dataIndex);
-                    FluxCalibrationFitVector[order_count]->setvariance((double)fluxvariance,dataIndex);
-                }
-                
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    if(npBeam[beam] && !(npBeam[beam]%2)) {
-                        npBeam[beam]--;
-                    }
-                }
-                
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    if(npBeam[beam]>=3) {
-                        float amBeam,bmBeam,abdevmBeam;
-                        ladfit(orderBeamData[beam],fluxBeamData[beam],npBeam[beam],&amBeam,&bmBeam,&abdevmBeam); /* robust linear fit: f(x) =  a + b*x */
-                        
-                        float dytop = 0;
-                        
-                        for(unsigned i=0;i<npBeam[beam];i++){
-                            double fitMedianSlope = (bmBeam*orderBeamData[beam][i] + amBeam);
-                            
-                            if(fabs(fluxBeamData[beam][i] - fitMedianSlope) < abdevmBeam &&
-                               (fluxBeamData[beam][i] - fitMedianSlope) > dytop) {
-                                dytop = fluxBeamData[beam][i] - fitMedianSlope;
-                            }
-                        }
-                        
-                        if(dytop == 0) {
-                            dytop = abdevmBeam;
-                        }
-                        BeamFluxCalibrationFitVector[beam][order_count]->setflux(double(bmBeam*(float)order + amBeam + dytop),dataIndex);
-                        BeamFluxCalibrationFitVector[beam][order_count]->setvariance(double(0.674433*abdevmBeam)*double(0.674433*abdevmBeam),dataIndex);
-                    } else {
-                        BeamFluxCalibrationFitVector[beam][order_count]->setflux((double)orderBeamFlux[beam],dataIndex);
-                        BeamFluxCalibrationFitVector[beam][order_count]->setvariance((double)beamfluxvariance,dataIndex);
-                    }
-                }
-            } // for(unsigned dataIndex=0;dataIndex < maxNDataPoints; dataIndex++) {
-			order_count++;
-        } // if(GetSpectralOrder(order)->gethasSpectralElements() && GetSpectralOrder(order)->gethasSpectralEnergyDistribution()) {
-    } // for(int order=(int)minorder; order<=(int)maxorder; order++) {
-    
-    order_count = 0;
-                       
-    for(int order=(int)actualMinorder; order<=(int)actualMaxorder; order++) {
-        
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        
-        if(spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution()) {
-            
-            operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-            unsigned nDataPointsOfCurrentOrder = spectralEnergyDistribution->getnDataPoints();
-            
-            for(unsigned dataIndex = 0; dataIndex < nDataPointsOfCurrentOrder; dataIndex++) {
-                spectralEnergyDistribution->setfluxData(FluxCalibrationFitVector[order_count]->getflux(dataIndex),dataIndex);
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                    beamSED->setfluxData(BeamFluxCalibrationFitVector[beam][order_count]->getflux(dataIndex),dataIndex);
-                }
-#ifdef PRINT_DEBUG
-                cout << order << ' ' << dataIndex << ' '
-                << spectralEnergyDistribution->getdistanceData(dataIndex) << ' '
-                << spectralEnergyDistribution->getfluxData(dataIndex) << ' '
-                << FluxCalibrationFitVector[order_count]->getflux(dataIndex) << ' ';
-                
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                    cout << beam << ' ' << beamSED->getfluxData(dataIndex) << ' ' << BeamFluxCalibrationFitVector[beam][order_count]->getflux(dataIndex) << ' ';
-                }
-                cout << endl;
-#endif
-            }
-#ifdef PRINT_DEBUG
-            cout << endl;
-#endif
-            order_count++;
-        }
-    }
-    
-    for(int order=(int)actualMinorder; order<=(int)actualMaxorder; order++) {
-        
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        
-        if (spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution()) {
-            operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-            spectralEnergyDistribution->populateUncalibratedFluxFromContinuumData();
-            
-            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                beamSED->populateUncalibratedFluxFromContinuumData();
-            }
-        }
-    } //for(int order=(int)minorder; order<=(int)maxorder; order++) {
+	
+	// Step 1. the continuum of each order
+	acrossOrderFitJob orderJob(*this, (int)minorder, (int)maxorder, 0, 0);
+	orderJob.binsize = binsize;
+	orderJob.nsigcut = nsigcut;
+	operaThreadPool::getSharedPool().parallelFor(maxorder - minorder + 1, calculateOrderContinuum, &orderJob);
+	
+	int usefulMinorder = (int)minorder;
+	int usefulMaxorder = (int)maxorder;
+	bool hasUsefulMinorder = false;
+	unsigned maxNDataPoints = 0;
+	for(int order=(int)minorder; order<=(int)maxorder; order++) {
+		operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
+		if (spectralOrder->gethasSpectralElements() && spectralOrder->gethasWavelength()) {
+			if(!hasUsefulMinorder) {
+				usefulMinorder = order;
+				hasUsefulMinorder = true;
+			}
+			usefulMaxorder = order;
+			if(spectralOrder->gethasSpectralEnergyDistribution() && maxNDataPoints < spectralOrder->getSpectralEnergyDistribution()->getnDataPoints()) {
+				maxNDataPoints = spectralOrder->getSpectralEnergyDistribution()->getnDataPoints();
+			}
+		}
+	}
+	
+	// without picked orders the fit is over the useful orders, and these must have a wavelength
+	int actualMinorder = usefulMinorder;
+	int actualMaxorder = usefulMaxorder;
+	if (nOrdersPicked) {
+		if(orderForWavelength[0] < usefulMinorder) {
+			actualMinorder = orderForWavelength[0];
+		}
+		if(orderForWavelength[nOrdersPicked-1] > usefulMaxorder) {
+			actualMaxorder = orderForWavelength[nOrdersPicked-1];
+		}
+	}
+	
+	// Step 2. robust fit between neighbour orders, Step 3. feed back into the SEDs
+	acrossOrderFitJob job(*this, actualMinorder, actualMaxorder, orderBin, numberOfBeams);
+	job.maxNDataPoints = maxNDataPoints;
+	job.requireWavelength = (orderForWavelength == NULL);
+	unsigned long nfitted = (unsigned long)(actualMaxorder - actualMinorder + 1);
+	operaThreadPool::getSharedPool().parallelFor(nfitted, fitContinuumAcrossOrders, &job);
+	operaThreadPool::getSharedPool().parallelFor(nfitted, storeContinuumAcrossOrders, &job);
+}
+
+/*
+ * fit the flux calibration of one order across its neighbours, leaving out the clipped orders.
+ * Orders outside the clipping range keep their own calibration.
+ */
+static void fitFluxCalibrationAcrossOrders(unsigned long index, void *context) {
+	acrossOrderFitJob *job = (acrossOrderFitJob *)context;
+	int order = job->minorder + (int)index;
+	operaSpectralOrder *spectralOrder = job->getOrder(order);
+	if (!hasContinuum(spectralOrder, true)) return;
+	
+	bool clipped = !(order > job->lowOrderToClip && order < job->highOrderToClip);
+	int loword = order, hiord = order;
+	if (!clipped) job->getWindow(order, loword, hiord);
+	unsigned nord = (unsigned)(hiord - loword + 1);
+	unsigned nseries = job->numberOfBeams + 1;
+	unsigned nElements = spectralOrder->getSpectralElements()->getnSpectralElements();
+	unsigned nFitted = nElements < job->maxNDataPoints ? nElements : job->maxNDataPoints;
+	
+	operaFluxVector **fit = &job->fits[index*nseries];
+	for (unsigned b=0; b<nseries; b++) {
+		fit[b] = new operaFluxVector(nElements);
+	}
+	std::vector<float> orderData(nseries*nord), fluxData(nseries*nord), orderFlux(nseries), fluxvariance(nseries, 0.0);
+	std::vector<unsigned> np(nseries);
+	
+	for(unsigned elemIndex=0; elemIndex < nFitted; elemIndex++) {
+		for (unsigned b=0; b<nseries; b++) {
+			np[b] = 0;
+			orderFlux[b] = NAN;
+		}
+		for(int o=loword; o<=hiord; o++) {
+			operaSpectralOrder *neighbour = job->getOrder(o);
+			if (!hasContinuum(neighbour, true) || elemIndex >= neighbour->getSpectralEnergyDistribution()->getCalibration(job->throughput).getlength()) continue;
+			bool used = (o > job->lowOrderToClip && o < job->highOrderToClip) || o == order;
+			for (unsigned b=0; b<nseries; b++) {
+				if (b && !used) break;
+				const operaFluxVector& fluxCalibration = neighbour->MainAndBeamSED(b).getCalibration(job->throughput);
+				float flux = (float)fluxCalibration.getflux(elemIndex);
+				fluxvariance[b] = (float)fluxCalibration.getvariance(elemIndex);
+				if(used && !isnan(flux)) {
+					orderData[b*nord + np[b]] = (float)o;
+					fluxData[b*nord + np[b]] = flux;
+					if(o==order) {
+						orderFlux[b] = flux;
+					}
+					np[b]++;
+				}
+			}
+		}
+		for (unsigned b=0; b<nseries; b++) {
+			if(!clipped && np[b] && !(np[b]%2)) {
+				np[b]--;
+			}
+			double flux, variance;
+			if (!fitAcrossOrders(&orderData[b*nord], &fluxData[b*nord], np[b], order, false, false, flux, variance)) {
+				flux = (double)orderFlux[b];
+				variance = (double)fluxvariance[b];
+			}
+			fit[b]->setflux(flux, elemIndex);
+			fit[b]->setvariance(variance, elemIndex);
+		}
+	}
+}
 
+static void storeFluxCalibrationAcrossOrders(unsigned long index, void *context) {
+	acrossOrderFitJob *job = (acrossOrderFitJob *)context;
+	operaSpectralOrder *spectralOrder = job->getOrder(job->minorder + (int)index);
+	if (!hasContinuum(spectralOrder, true)) return;
+	operaFluxVector **fit = &job->fits[index*(job->numberOfBeams+1)];
+	for(unsigned b=0; b < spectralOrder->MainAndBeamCount() && b <= job->numberOfBeams; b++) {
+		spectralOrder->MainAndBeamSED(b).setFluxCalibration(*fit[b]);
+	}
 }
 
 void operaSpectralOrderVector::FitFluxCalibrationAcrossOrders(int lowOrderToClip, int highOrderToClip, int orderBin, bool throughput) {
@@ -1455,226 +1275,16 @@ void operaSpectralOrderVector::FitFluxCalibrationAcrossOrders(int lowOrderToClip
             }
         }
     }
-
-    operaFluxVector *FluxCalibrationFitVector[MAXORDERS];
-    float *fluxData = new float[MAXORDERS];
-    float *orderData = new float[MAXORDERS];
-    float *fluxBeamData[MAXNUMBEROFBEAMS];
-    
-    operaFluxVector *BeamFluxCalibrationFitVector[MAXNUMBEROFBEAMS][MAXORDERS];
-    float *orderBeamData[MAXNUMBEROFBEAMS];
-    float orderBeamFlux[MAXNUMBEROFBEAMS];
-    unsigned npBeam[MAXNUMBEROFBEAMS];
-    
-    for(unsigned beam=0; beam < numberOfBeams; beam++) {
-        npBeam[beam] = 0;
-        fluxBeamData[beam] = new float[MAXORDERS];
-        orderBeamData[beam] = new float[MAXORDERS];
-    }
-    
-    float fluxvariance = 0;
-    float beamfluxvariance = 0;
     
-    unsigned order_count = 0;
-    
-    // Step 2. Calculate robust fit between neighbor orders
-    for(int order=usefulMinorder; order<=usefulMaxorder; order++) {
-        
-        int loword = order - orderBin;
-        int hiord = order + orderBin;
-        if(loword < usefulMinorder) {
-            loword = usefulMinorder;
-        }
-        if(hiord > usefulMaxorder) {
-            hiord = usefulMaxorder;
-        }
-        
-        int nord = (hiord - loword + 1);
-        
-        if(!(nord%2)) {
-            if(hiord == usefulMaxorder) {
-                loword--;
-            } else {
-                hiord++;
-            }
-        }
-        
-        nord = (hiord - loword + 1);
-        
-        unsigned nElementsOfCurrentOrder = GetSpectralOrder(order)->getSpectralElements()->getnSpectralElements();
-        
-        FluxCalibrationFitVector[order_count]  = new operaFluxVector(nElementsOfCurrentOrder);
-        
-        for(unsigned beam=0; beam < numberOfBeams; beam++) {
-            BeamFluxCalibrationFitVector[beam][order_count] = new operaFluxVector(nElementsOfCurrentOrder);
-        }
-
-        for(unsigned elemIndex=0;elemIndex < maxNElements; elemIndex++) {
-            
-            if(elemIndex>=nElementsOfCurrentOrder){break;}
-            
-            unsigned np = 0;
-            float orderFlux = NAN;
-            
-            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                npBeam[beam] = 0;
-                orderBeamFlux[beam] = NAN;
-            }
-            
-            if (order > lowOrderToClip && order < highOrderToClip) {
-                for(int o=loword; o<=hiord; o++) {
-                    operaSpectralOrder *spectralOrder = GetSpectralOrder(o);
-                    
-                    if(spectralOrder->gethasSpectralElements() &&
-                       spectralOrder->gethasSpectralEnergyDistribution() &&
-                       spectralOrder->gethasWavelength()) {
-                        
-                        operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-                        
-                        const operaFluxVector& fluxCalibration = spectralEnergyDistribution->getCalibration(throughput);
-                        
-                        if(elemIndex < fluxCalibration.getlength() && elemIndex < nElementsOfCurrentOrder) {
-                            float flux = (float)fluxCalibration.getflux(elemIndex);
-                            fluxvariance = (float)fluxCalibration.getvariance(elemIndex);
-                            
-                            if ((o > lowOrderToClip && o < highOrderToClip) || o==order) {
-                                
-                                if(!isnan(flux)) {
-                                    orderData[np] = (float)o;
-                                    fluxData[np] = flux;
-                                    if(o==order) {
-                                        orderFlux = flux;
-                                    }
-                                    np++;
-                                }
-                                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                                    operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                                    
-                                    const operaFluxVector& BeamFluxCalibration = beamSED->getCalibration(throughput);
-                                    
-                                    float beamflux = (float)BeamFluxCalibration.getflux(elemIndex);
-                                    beamfluxvariance = (float)BeamFluxCalibration.getvariance(elemIndex);
-                                    
-                                    if(!isnan(beamflux)) {
-                                        orderBeamData[beam][npBeam[beam]] = (float)o;
-                                        fluxBeamData[beam][npBeam[beam]] = beamflux;
-                                        if(o==order) {
-                                            orderBeamFlux[beam] = beamflux;
-                                        }
-                                        npBeam[beam]++;
-                                    }
-                                }
-                            }
-                        }
-                        
-                    }
-                }
-                if(np && !(np%2)) {
-                    np--;
-                }
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    if(npBeam[beam] && !(npBeam[beam]%2)) {
-                        npBeam[beam]--;
-                    }
-                }
-            } else {
-                int o = order;
-                operaSpectralOrder *spectralOrder = GetSpectralOrder(o);
-                
-                if(spectralOrder->gethasSpectralElements() &&
-                   spectralOrder->gethasSpectralEnergyDistribution() &&
-                   spectralOrder->gethasWavelength()) {
-                    
-                    operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-                    
-                    const operaFluxVector& fluxCalibration = spectralEnergyDistribution->getCalibration(throughput);
-                    
-                    if(elemIndex < fluxCalibration.getlength() && elemIndex < nElementsOfCurrentOrder) {
-                        float flux = (float)fluxCalibration.getflux(elemIndex);
-                        fluxvariance = (float)fluxCalibration.getvariance(elemIndex);
-                        
-                        if(!isnan(flux)) {
-                            orderData[np] = (float)o;
-                            fluxData[np] = flux;
-                            orderFlux = flux;
-                            np++;
-                        }
-                        for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                            operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                            const operaFluxVector& BeamFluxCalibration = beamSED->getCalibration(throughput);
-                            float beamflux = (float)BeamFluxCalibration.getflux(elemIndex);
-                            beamfluxvariance = (float)BeamFluxCalibration.getvariance(elemIndex);
-                            if(!isnan(beamflux)) {
-                                orderBeamData[beam][npBeam[beam]] = (float)o;
-                                fluxBeamData[beam][npBeam[beam]] = beamflux;
-                                orderBeamFlux[beam] = beamflux;
-                                npBeam[beam]++;
-                            }
-                        }
-                    }
-                }
-            }
-            
-            if(np>=3) {
-                float am,bm,abdevm;
-                ladfit(orderData,fluxData,np,&am,&bm,&abdevm); // robust linear fit: f(x) =  a + b*x 
-                
-                FluxCalibrationFitVector[order_count]->setflux(double(bm*(double)order + am),elemIndex);
-                FluxCalibrationFitVector[order_count]->setvariance(double(0.674433*abdevm)*double(0.674433*abdevm),elemIndex);
-            } else {
-                FluxCalibrationFitVector[order_count]->setflux((double)orderFlux,elemIndex);
-                FluxCalibrationFitVector[order_count]->setvariance((double)fluxvariance,elemIndex);
-            }
-            
-            for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                if(npBeam[beam]>=3) {
-                    float amBeam,bmBeam,abdevmBeam;
-                    ladfit(orderBeamData[beam],fluxBeamData[beam],npBeam[beam],&amBeam,&bmBeam,&abdevmBeam); // robust linear fit: f(x) =  a + b*x 
-                    BeamFluxCalibrationFitVector[beam][order_count]->setflux(double(bmBeam*(double)order + amBeam),elemIndex);
-                    BeamFluxCalibrationFitVector[beam][order_count]->setvariance(double(0.674433*abdevmBeam)*double(0.674433*abdevmBeam),elemIndex);
-                } else {
-                    BeamFluxCalibrationFitVector[beam][order_count]->setflux((double)orderBeamFlux[beam],elemIndex);
-                    BeamFluxCalibrationFitVector[beam][order_count]->setvariance((double)beamfluxvariance,elemIndex);
-                }
-            }
-        } //  for(unsigned elemIndex=0;elemIndex < maxNElements; elemIndex++) {
-        order_count++;
-    } // for(int order=(int)minorder; order<=(int)maxorder; order++) {
-    
-    order_count = 0;
-    // Step 3. Feed back fit quantities to order SED
-    for(int order=usefulMinorder; order<=usefulMaxorder; order++) {
-        
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        
-        if(spectralOrder->gethasSpectralElements() &&
-           spectralOrder->gethasSpectralEnergyDistribution() && 
-           spectralOrder->gethasWavelength()) {
-            
-            for(unsigned b=0; b < spectralOrder->MainAndBeamCount(); b++) {
-				if(b == 0) spectralOrder->MainAndBeamSED(b).setFluxCalibration(*FluxCalibrationFitVector[order_count]);
-				else spectralOrder->MainAndBeamSED(b).setFluxCalibration(*BeamFluxCalibrationFitVector[b-1][order_count]);
-            }
-            
-            /*operaSpectralEnergyDistribution *spectralEnergyDistribution = spectralOrder->getSpectralEnergyDistribution();
-            
-            operaSpectralElements& fluxCalibrationElements = spectralEnergyDistribution->getCalibrationElements(throughput);
-            
-            for(unsigned elemIndex=0;elemIndex < fluxCalibrationElements.getnSpectralElements(); elemIndex++) {
-                
-                fluxCalibrationElements.setFlux(FluxCalibrationFitVector[order_count]->getflux(elemIndex),elemIndex);
-                fluxCalibrationElements.setFluxVariance(FluxCalibrationFitVector[order_count]->getvariance(elemIndex),elemIndex);
-                
-                for(unsigned beam=0; beam < numberOfBeams; beam++) {
-                    operaSpectralEnergyDistribution *beamSED = spectralOrder->getBeamSED(beam);
-                    operaSpectralElements& BeamFluxCalibrationElements = beamSED->getCalibrationElements(throughput);
-                    BeamFluxCalibrationElements.setFlux(BeamFluxCalibrationFitVector[beam][order_count]->getflux(elemIndex),elemIndex);
-                    BeamFluxCalibrationElements.setFluxVariance(BeamFluxCalibrationFitVector[beam][order_count]->getvariance(elemIndex),elemIndex);
-                }
-            }*/
-            order_count++;
-        }
-    }
+    // Step 2. Calculate robust fit between neighbor orders, Step 3. Feed back fit quantities to order SED
+	acrossOrderFitJob job(*this, usefulMinorder, usefulMaxorder, orderBin, numberOfBeams);
+	job.maxNDataPoints = maxNElements;
+	job.lowOrderToClip = lowOrderToClip;
+	job.highOrderToClip = highOrderToClip;
+	job.throughput = throughput;
+	unsigned long nfitted = (unsigned long)(usefulMaxorder - usefulMinorder + 1);
+	operaThreadPool::getSharedPool().parallelFor(nfitted, fitFluxCalibrationAcrossOrders, &job);
+	operaThreadPool::getSharedPool().parallelFor(nfitted, storeFluxCalibrationAcrossOrders, &job);
 }
 
 void operaSpectralOrderVector::getContinuumFluxesForNormalization(double *uncalibratedContinuumFluxForNormalization, double uncalibratedContinuumBeamFluxForNormalization[MAXNUMBEROFBEAMS],unsigned binsize, int orderBin, unsigned nsigcut) {
@@ -1953,6 +1563,50 @@ void operaSpectralOrderVector::normalizeFluxOrderbyOrderINTOExtendendSpectra(uns
     }
 }
 
+/*
+ * Per-order phases of the normalization and flux calibration, run on the shared thread pool once the
+ * continuum sample across orders is known.
+ */
+class orderCalibrationJob {
+public:
+	std::vector<operaSpectralOrder *> orders;	// Minorder to Maxorder
+	bool requireSED;
+	bool normalizeBeams;
+	const operaSpectrum *continuumSample;
+	bool useThroughput;
+	const operaVector *spectralBinConstants;
+	
+	orderCalibrationJob(operaSpectralOrderVector &spectralOrders, int Minorder, int Maxorder) :
+	requireSED(false), normalizeBeams(false), continuumSample(NULL), useThroughput(false), spectralBinConstants(NULL)
+	{
+		for (int order=Minorder; order<=Maxorder; order++) {
+			orders.push_back(spectralOrders.GetSpectralOrder(order));
+		}
+	}
+	bool calibrates(const operaSpectralOrder *spectralOrder) const {
+		return spectralOrder->gethasWavelength() && spectralOrder->gethasSpectralElements() && (!requireSED || spectralOrder->gethasSpectralEnergyDistribution());
+	}
+};
+
+static void normalizeOrderToContinuumSample(unsigned long index, void *context) {
+	orderCalibrationJob *job = (orderCalibrationJob *)context;
+	operaSpectralOrder *spectralOrder = job->orders[index];
+	if (job->calibrates(spectralOrder)) {
+		spectralOrder->fitSEDUncalibratedFluxToSample(*job->continuumSample); //Fit the SED uncalibrated flux to our uniform continuum sample
+		spectralOrder->applyNormalizationFromExistingContinuum(job->normalizeBeams); //Divide flux vector by the SED uncalibrated flux
+		spectralOrder->CopyFluxVectorIntoNormalizedFlux(); //Don't forget to copy back to normalized flux once we're done
+	}
+}
+
+static void calibrateOrderFlux(unsigned long index, void *context) {
+	orderCalibrationJob *job = (orderCalibrationJob *)context;
+	operaSpectralOrder *spectralOrder = job->orders[index];
+	if (job->calibrates(spectralOrder)) {
+		spectralOrder->multiplySpectralElementsBySEDElements(job->useThroughput, *job->spectralBinConstants);
+		spectralOrder->CopyFluxVectorIntoFcalFlux();
+	}
+}
+
 // Normalizes the flux to the continuum by sampling the continuum across all orders, and saves the result into the normalized flux of the extended spectra
 void operaSpectralOrderVector::normalizeFluxINTOExtendendSpectra(string inputWavelengthMaskForUncalContinuum, unsigned numberOfPointsInUniformSample, unsigned normalizationBinsize, double delta_wl, int Minorder, int Maxorder, bool normalizeBeams) {
     
@@ -1964,14 +1618,10 @@ void operaSpectralOrderVector::normalizeFluxINTOExtendendSpectra(string inputWav
     
     operaSpectrum continuumSample = calculateCleanUniformSampleOfContinuum(Minorder, Maxorder, normalizationBinsize, delta_wl, inputWavelengthMaskForUncalContinuum, numberOfPointsInUniformSample, normalizeBeams);
     
-	for (int order=Minorder; order<=Maxorder; order++) {
-		operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-		if (spectralOrder->gethasWavelength() && spectralOrder->gethasSpectralElements()) {
-			spectralOrder->fitSEDUncalibratedFluxToSample(continuumSample); //Fit the SED uncalibrated flux to our uniform continuum sample
-			spectralOrder->applyNormalizationFromExistingContinuum(normalizeBeams); //Divide flux vector by the SED uncalibrated flux
-			spectralOrder->CopyFluxVectorIntoNormalizedFlux(); //Don't forget to copy back to normalized flux once we're done
-		}
-    }
+	orderCalibrationJob job(*this, Minorder, Maxorder);
+	job.normalizeBeams = normalizeBeams;
+	job.continuumSample = &continuumSample;
+	operaThreadPool::getSharedPool().parallelFor(job.orders.size(), normalizeOrderToContinuumSample, &job);
 }
 
 void operaSpectralOrderVector::normalizeAndCalibrateFluxINTOExtendendSpectra(string inputWavelengthMaskForUncalContinuum, double exposureTime, bool AbsoluteCalibration, unsigned numberOfPointsInUniformSample, unsigned normalizationBinsize, double delta_wl, int Minorder, int Maxorder, bool normalizeBeams, double SkyOverStarFiberAreaRatio, bool StarPlusSky) {
@@ -2011,14 +1661,11 @@ void operaSpectralOrderVector::normalizeAndCalibrateFluxINTOExtendendSpectra(str
     
     operaSpectrum continuumSample = calculateCleanUniformSampleOfContinuum(Minorder, Maxorder, normalizationBinsize, delta_wl, inputWavelengthMaskForUncalContinuum, numberOfPointsInUniformSample, normalizeBeams);
     
-    for (int order=Minorder; order<=Maxorder; order++) {
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        if (spectralOrder->gethasWavelength() && spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution()) {
-			spectralOrder->fitSEDUncalibratedFluxToSample(continuumSample); //Fit the SED uncalibrated flux to our uniform continuum sample
-			spectralOrder->applyNormalizationFromExistingContinuum(normalizeBeams); //Divide flux vector by the SED uncalibrated flux
-			spectralOrder->CopyFluxVectorIntoNormalizedFlux(); //Don't forget to copy back to normalized flux once we're done
-		}
-    }
+    orderCalibrationJob job(*this, Minorder, Maxorder);
+    job.requireSED = true;
+    job.normalizeBeams = normalizeBeams;
+    job.continuumSample = &continuumSample;
+    operaThreadPool::getSharedPool().parallelFor(job.orders.size(), normalizeOrderToContinuumSample, &job);
     
     //Below we apply flux calibrations
     for (int order=Minorder; order<=Maxorder; order++) GetSpectralOrder(order)->CopyFcalFluxIntoFluxVector(); //Start off by copying in fcal flux
@@ -2042,17 +1689,9 @@ void operaSpectralOrderVector::normalizeAndCalibrateFluxINTOExtendendSpectra(str
 		if(StarPlusSky && beam*2 >= NumberofBeams) spectralBinConstants[beam+1] /= SkyOverStarFiberAreaRatio; // Sky Fiber
 	}
 
-    for (int order=Minorder; order<=Maxorder; order++) {
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        if (spectralOrder->gethasWavelength() && spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution()) {
-            if(AbsoluteCalibration) { // use fluxcalibation
-                spectralOrder->multiplySpectralElementsBySEDElements(false, spectralBinConstants);
-            } else { // use throughput
-                spectralOrder->multiplySpectralElementsBySEDElements(true, spectralBinConstants);
-            }
-            spectralOrder->CopyFluxVectorIntoFcalFlux();
-        }
-    }
+    job.useThroughput = !AbsoluteCalibration; // fluxcalibration for absolute calibration, otherwise throughput
+    job.spectralBinConstants = &spectralBinConstants;
+    operaThreadPool::getSharedPool().parallelFor(job.orders.size(), calibrateOrderFlux, &job);
 }
 
 // Applies a flat response calibration to the flux and saves the result into the fcal flux of the extended spectra
@@ -2072,19 +1711,11 @@ void operaSpectralOrderVector::applyFlatResponseINTOExtendendSpectra(string flat
     readFlatResponseIntoSED(flatResponse,Minorder,Maxorder,FITSformat); // Read flat response data into Spectral Energy Distribution class
 
     // The flux calibration is effectively calculated below, but it expects that SED elements are in there.
-    bool AbsoluteCalibration = false;
-    
-    for (int order=Minorder; order<=Maxorder; order++) {
-        operaSpectralOrder *spectralOrder = GetSpectralOrder(order);
-        if (spectralOrder->gethasWavelength() && spectralOrder->gethasSpectralElements() && spectralOrder->gethasSpectralEnergyDistribution()) {
-            if(AbsoluteCalibration) { // use fluxcalibation
-                spectralOrder->multiplySpectralElementsBySEDElements(false, spectralBinConstants);
-            } else { // use throughput
-                spectralOrder->multiplySpectralElementsBySEDElements(true, spectralBinConstants);
-            }
-            spectralOrder->CopyFluxVectorIntoFcalFlux();
-        }
-    }
+    orderCalibrationJob job(*this, Minorder, Maxorder);
+    job.requireSED = true;
+    job.useThroughput = true; // use throughput
+    job.spectralBinConstants = &spectralBinConstants;
+    operaThreadPool::getSharedPool().parallelFor(job.orders.size(), calibrateOrderFlux, &job);
 }
 
 // Applies the removal of the continuum polarization and saves the result into the continuum removed polarization
@@ -47,6 +47,7 @@ Date: Aug/2011
 #include <sstream>
 #include <fstream>
 #include <math.h>
+#include <algorithm>
 
 #include "globaldefines.h"
 #include "operaError.h"
@@ -110,6 +111,40 @@ operaSpectralLineList getSpectralLinesMatchingCondition(const operaSpectralLines
 	return linelist;
 }
 
+// Finds the first and last index between wl0 and wlf. Assumes wavelength vector is in increasing order.
+void getWavelengthSubrange(const operaVector& wavelength, double wl0, double wlf, unsigned& startindex, unsigned& endindex)
+{
+	endindex = startindex = 0;
+	if (wavelength.empty() || wlf < wl0) return;
+	const double *wl = wavelength.datapointer();
+	startindex = (unsigned)(lower_bound(wl, wl + wavelength.size(), wl0) - wl);
+	endindex = (unsigned)(upper_bound(wl + startindex, wl + wavelength.size(), wlf) - wl);
+}
+
+static operaVector getSubvector(const operaVector& input, unsigned startindex, unsigned endindex) {
+	if (endindex <= startindex || input.size() < endindex) return operaVector();
+	return operaVector(input.datapointer() + startindex, endindex - startindex);
+}
+
+operaSpectrum getSortedSpectrumWithinRange(operaWavelengthRange wlrange, const operaSpectrum& inputSpectrum) {
+	unsigned startindex, endindex;
+	getWavelengthSubrange(inputSpectrum.wavelengthvector(), wlrange.getwl0(), wlrange.getwlf(), startindex, endindex);
+	operaSpectrum outputSpectrum;
+	for (unsigned i = startindex; i < endindex; i++) outputSpectrum.insertfrom(inputSpectrum, i);
+	return outputSpectrum;
+}
+
+operaSpectralLineList getSortedSpectrumWithinRange(operaWavelengthRange wlrange, const operaSpectralLineList& inputLines) {
+	unsigned startindex, endindex;
+	getWavelengthSubrange(inputLines.center, wlrange.getwl0(), wlrange.getwlf(), startindex, endindex);
+	operaSpectralLineList outputLines;
+	outputLines.center = getSubvector(inputLines.center, startindex, endindex);
+	outputLines.centerError = getSubvector(inputLines.centerError, startindex, endindex);
+	outputLines.sigma = getSubvector(inputLines.sigma, startindex, endindex);
+	outputLines.amplitude = getSubvector(inputLines.amplitude, startindex, endindex);
+	return outputLines;
+}
+
 operaSpectralLineList getAllSpectralLines(const operaSpectralLines& spectralLines) {
 	return getSpectralLinesMatchingCondition(spectralLines, Always());
 }
@@ -145,120 +180,213 @@ operaSpectralLines DetectSpectralLines(operaSpectralElements* spectralElements,
 }
 
 
-class GaussianFunc {
-	double a, b, c;
-public:
-	GaussianFunc(double height, double center, double sigma) : a(height), b(center), c(sigma) { }
-	double operator()(double x) { return a*exp(-(x-b)*(x-b)/(2*c*c)); }
-};
-
-class NormalizedGaussianFunc : public GaussianFunc {
-public:
-	NormalizedGaussianFunc(double center, double sigma) : GaussianFunc(1.0/(sigma * sqrt(2.0*M_PI)), center, sigma) { }
-};
-
 double operaCrossCorrelation(operaVector a, operaVector b) {
 	a -= Mean(a);
 	b -= Mean(b);
     return InnerProduct(a, b) / sqrt(InnerProduct(a, a) * InnerProduct(b, b));
 }
 
+/*
+ * The normalized cross-correlation of the flux with a Gaussian of sigma window/2 points over a window of window points
+ * each side, window = ceil(2 sigma/step) for the local sampling step. The Gaussian template only depends on the window,
+ * so it is built, with its mean and centered norm, when the window changes rather than for every point. Each window is
+ * then read in place in two passes, the means and then the centered products, as operaCrossCorrelation computes them.
+ */
 operaVector calculateXCorrWithGaussian(const operaVector& wavelength, const operaVector& flux, double sigma) {
     unsigned np = wavelength.size();
-    operaVector outputXcorr;
+    if (flux.size() != np) throw operaException("calculateXCorrWithGaussian: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
+    operaVector outputXcorr(np);
+    const double *wl = wavelength.datapointer();
+    const double *f = flux.datapointer();
+    
+    std::vector<double> gaussianTemplate;
+    unsigned templateWindow = 0;
+    double templateMean = 0, templateNorm = 0;
+    bool haveTemplate = false;
+    
     for(unsigned i=0; i<np; i++) {
-		double wlstep;
-        if(i==0) {
-            wlstep = fabs(wavelength[i+1] - wavelength[i]);
-        } else if (i==np-1) {
-            wlstep = fabs(wavelength[i] - wavelength[i-1]);
-        } else {
-            wlstep = fabs(wavelength[i+1] - wavelength[i-1])/2.0;
+        unsigned window = np/2;
+        if (np > 1) {
+            double wlstep;
+            if(i==0) {
+                wlstep = fabs(wl[i+1] - wl[i]);
+            } else if (i==np-1) {
+                wlstep = fabs(wl[i] - wl[i-1]);
+            } else {
+                wlstep = fabs(wl[i+1] - wl[i-1])/2.0;
+            }
+            double halfwidth = ceil(2*sigma/wlstep);
+            if (halfwidth < (double)window) window = (unsigned)halfwidth;
+        }
+        if (!haveTemplate || window != templateWindow) {
+            haveTemplate = true;
+            templateWindow = window;
+            gaussianTemplate.resize(2*window);
+            double templateSigma = window/2.0;
+            double sum = 0;
+            for (unsigned k=0; k<2*window; k++) {
+                double x = (double)k - (double)window;
+                gaussianTemplate[k] = exp(-x*x/(2*templateSigma*templateSigma));
+                sum += gaussianTemplate[k];
+            }
+            templateMean = sum/(2*window);
+            templateNorm = 0;
+            for (unsigned k=0; k<2*window; k++) {
+                templateNorm += (gaussianTemplate[k] - templateMean)*(gaussianTemplate[k] - templateMean);
+            }
         }
         
-        unsigned window = (unsigned)ceil(2*sigma/wlstep);
-        if (window > np/2) window = np/2;
-        
-        operaVector windowFunc;
-        operaVector mainFunc;
-        
-        NormalizedGaussianFunc g(i, window/2.0);
         unsigned minj = i > window ? i-window : 0;
         unsigned maxj = i+window < np ? i+window : np;
-        for(unsigned j=minj; j<maxj; j++) {
-			windowFunc.insert(g(j));
-            mainFunc.insert(flux[j]);
+        unsigned n = maxj - minj;
+        if (n == 0) {
+            outputXcorr[i] = NAN;
+            continue;
+        }
+        const double *g = &gaussianTemplate[minj + window - i];	// g[j-minj] is the template at j
+        const double *y = f + minj;
+        
+        double tmean = templateMean;
+        double fmean = 0;
+        bool truncated = (n != 2*window);
+        if (truncated) tmean = 0;
+        for (unsigned j=0; j<n; j++) {
+            fmean += y[j];
+            if (truncated) tmean += g[j];
         }
-        outputXcorr.insert(operaCrossCorrelation(windowFunc, mainFunc));
+        fmean /= n;
+        if (truncated) tmean /= n;
+        
+        double sgf = 0, sff = 0, sgg = 0;
+        for (unsigned j=0; j<n; j++) {
+            double dg = g[j] - tmean;
+            double df = y[j] - fmean;
+            sgf += dg*df;
+            sff += df*df;
+            if (truncated) sgg += dg*dg;
+        }
+        if (!truncated) sgg = templateNorm;
+        outputXcorr[i] = sgf / sqrt(sgg * sff);
     }
     return outputXcorr;
 }
 
+/*
+ * Gaussian kernel table: exp(-t) = exp(-k h) * exp(-r), k the nearest multiple of h = 1/GAUSSIANKERNEL_STEPS to t
+ * and |r| <= h/2, the first factor tabulated and the second a cubic Taylor polynomial. The relative error of a
+ * weight is below r^4/24 <= 1.6e-10, so a convolved value, a ratio of sums of positive weights, is within
+ * 3.2e-10 * max|flux - convolved| of the exact one. Beyond the table (t > GAUSSIANKERNEL_MAXT) exp is called.
+ */
+#define GAUSSIANKERNEL_STEPS 64
+#define GAUSSIANKERNEL_MAXT 32
+
+class gaussianKernelTable {
+public:
+	double table[GAUSSIANKERNEL_STEPS*GAUSSIANKERNEL_MAXT+1];
+	gaussianKernelTable() {
+		for (unsigned k=0; k<=GAUSSIANKERNEL_STEPS*GAUSSIANKERNEL_MAXT; k++) {
+			table[k] = exp(-(double)k/GAUSSIANKERNEL_STEPS);
+		}
+	}
+	inline double expMinus(double t) const {
+		if (!(t <= GAUSSIANKERNEL_MAXT)) return exp(-t);	// also a NaN t, which must not index the table
+		unsigned k = (unsigned)(t*GAUSSIANKERNEL_STEPS + 0.5);
+		double r = t - (double)k/GAUSSIANKERNEL_STEPS;
+		return table[k] * (1.0 - r*(1.0 - r*(0.5 - r/6.0)));
+	}
+};
+
+static const gaussianKernelTable gaussianKernel;
+
+/*
+ * void convolveSpectraWithGaussianKernel(const operaVector& wavelength, const operaVector& sigma, unsigned nspectra, const operaVector *const *fluxes, operaVector *const *convolvedSpectra)
+ * \brief convolve nspectra fluxes sampled on the same wavelengths with a normalized Gaussian of width sigma[i] at point i.
+ * \details Each point is the weighted mean of the fluxes within a window of ceil(2 sigma/step) points each side, step the local
+ * sampling. The weights depend only on the wavelengths and sigma, so they are computed once per point for all the spectra.
+ */
+static void convolveSpectraWithGaussianKernel(const operaVector& wavelength, const operaVector& sigma, unsigned nspectra, const operaVector *const *fluxes, operaVector *const *convolvedSpectra) {
+	unsigned np = wavelength.size();
+	for (unsigned s=0; s<nspectra; s++) {
+		if (fluxes[s]->size() != np) throw operaException("convolveSpectrumWithGaussian: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
+		convolvedSpectra[s]->resize(np);
+		convolvedSpectra[s]->fill(0.0);
+	}
+	if (sigma.size() != np) throw operaException("convolveSpectrumWithGaussian: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
+	const double *wl = wavelength.datapointer();
+	std::vector<double> weights(np + 1);			// one window
+	for (unsigned i=0; i<np; i++) {
+		unsigned window = np/2;
+		if (np > 1) {
+			double wlstep;
+			if(i==0) {
+				wlstep = fabs(wl[i+1] - wl[i]);
+			} else if (i==np-1) {
+				wlstep = fabs(wl[i] - wl[i-1]);
+			} else {
+				wlstep = fabs(wl[i+1] - wl[i-1])/2.0;
+			}
+			double halfwidth = ceil(2*sigma[i]/wlstep);
+			if (halfwidth < (double)window) window = (unsigned)halfwidth;
+		}
+		unsigned minj = i > window ? i-window : 0;
+		unsigned maxj = i+window < np ? i+window : np;
+		
+		double a = 1.0/(2.0*sigma[i]*sigma[i]);
+		double weighSum = 0;
+		double *w = &weights[0];
+		for(unsigned j=minj; j<maxj; j++) {
+			double d = wl[j] - wl[i];
+			w[j-minj] = gaussianKernel.expMinus(d*d*a);
+			weighSum += w[j-minj];
+		}
+		if (weighSum) {
+			for (unsigned s=0; s<nspectra; s++) {
+				const double *flux = fluxes[s]->datapointer();
+				double sum = 0;
+				for(unsigned j=minj; j<maxj; j++) {
+					sum += flux[j] * w[j-minj];
+				}
+				convolvedSpectra[s]->datapointer()[i] = sum / weighSum;
+			}
+		}
+	}
+}
+
 operaVector convolveSpectrumWithGaussian(const operaVector& wavelength, const operaVector& flux, double sigma) {
-    unsigned np = wavelength.size();
-	operaVector convolvedSpectrum(np);
-    for(unsigned i=0;i<np;i++) {
-		double wlstep;
-        if(i==0) {
-            wlstep = fabs(wavelength[i+1] - wavelength[i]);
-        } else if (i==np-1) {
-            wlstep = fabs(wavelength[i] - wavelength[i-1]);
-        } else {
-            wlstep = fabs(wavelength[i+1] - wavelength[i-1])/2.0;
-        }
-        
-        unsigned window = (unsigned)ceil(2*sigma/wlstep);
-        if (window > np/2) window = np/2;
-        
-        double weighSum = 0;
-        NormalizedGaussianFunc g(wavelength[i], sigma);
-        unsigned minj = i > window ? i-window : 0;
-        unsigned maxj = i+window < np ? i+window : np;
-        for(unsigned j=minj; j<maxj; j++) {
-            double temp = g(wavelength[j]);
-            convolvedSpectrum[i] += flux[j] * temp;
-            weighSum += temp;
-        }
-        if (weighSum) {
-            convolvedSpectrum[i] /= weighSum;
-        }
-    }
-    return convolvedSpectrum;
+	operaVector convolvedSpectrum;
+	operaVector sigmas(wavelength.size());
+	sigmas.fill(sigma);
+	const operaVector *fluxes = &flux;
+	operaVector *outputs = &convolvedSpectrum;
+	convolveSpectraWithGaussianKernel(wavelength, sigmas, 1, &fluxes, &outputs);
+	return convolvedSpectrum;
 }
 
 operaVector convolveSpectrumWithGaussianByResolution(const operaVector& wavelength, const operaVector& flux, double spectralResolution) {
-	unsigned np = wavelength.size();
-	operaVector convolvedSpectrum(np);
-    for(unsigned i=0;i<np;i++) {
-		double wlstep;
-        if(i==0) {
-            wlstep = fabs(wavelength[i+1] - wavelength[i]);
-        } else if (i==np-1) {
-            wlstep = fabs(wavelength[i] - wavelength[i-1]);
-        } else {
-            wlstep = fabs(wavelength[i+1] - wavelength[i-1])/2.0;
-        }
-        
-        double sigma = wavelength[i] / spectralResolution;
-        unsigned window = (unsigned)ceil(2*sigma/wlstep);
-        if (window > np/2) window = np/2;
-        
-        double weighSum = 0;
-        NormalizedGaussianFunc g(wavelength[i], sigma);
-        unsigned minj = i > window ? i-window : 0;
-        unsigned maxj = i+window < np ? i+window : np;
-        for(unsigned j=minj; j<maxj; j++) {
-            if(j >= 0 && j < np) {
-                double temp = g(wavelength[j]);
-                convolvedSpectrum[i] += flux[j] * temp;
-                weighSum += temp;
-            }
-        }
-        if (weighSum) {
-            convolvedSpectrum[i] /= weighSum;
-        }
-    }
-    return convolvedSpectrum;
+	operaVector resolutions(wavelength.size());
+	resolutions.fill(spectralResolution);
+	return convolveSpectrumWithGaussianByResolution(wavelength, flux, resolutions);
+}
+
+operaVector convolveSpectrumWithGaussianByResolution(const operaVector& wavelength, const operaVector& flux, const operaVector& spectralResolution) {
+	operaVector convolvedSpectrum;
+	const operaVector *fluxes = &flux;
+	operaVector *outputs = &convolvedSpectrum;
+	convolveSpectraWithGaussianKernel(wavelength, wavelength / spectralResolution, 1, &fluxes, &outputs);
+	return convolvedSpectrum;
+}
+
+std::vector<operaVector> convolveSpectraWithGaussianByResolution(const operaVector& wavelength, const std::vector<operaVector>& fluxes, const operaVector& spectralResolution) {
+	unsigned nspectra = fluxes.size();
+	std::vector<operaVector> convolvedSpectra(nspectra);
+	std::vector<const operaVector *> inputs(nspectra);
+	std::vector<operaVector *> outputs(nspectra);
+	for (unsigned s=0; s<nspectra; s++) {
+		inputs[s] = &fluxes[s];
+		outputs[s] = &convolvedSpectra[s];
+	}
+	if (nspectra) convolveSpectraWithGaussianKernel(wavelength, wavelength / spectralResolution, nspectra, &inputs[0], &outputs[0]);
+	return convolvedSpectra;
 }
 
 /*
@@ -781,12 +909,34 @@ operaVector fitSpectrum(const operaVector& inputWavelength, const operaVector& i
 	return outputFlux;
 }
 
+/*
+ * Fit spline to the values y at the knots x, with the end slopes of operaFitSplineDouble,
+ * creating it on first use and refitting it afterwards.
+ */
+static void refitSpline(operaSpline_t *&spline, unsigned n, const double *x, const double *y) {
+	double yp1 = (y[1] - y[0])/(x[1] - x[0]);
+	double ypn = (y[n-1] - y[n-2])/(x[n-1] - x[n-2]);
+	if (spline == NULL) {
+		spline = operaSplineCreate(n, x, y, yp1, ypn);
+	} else {
+		operaSplineSetValues(spline, y, yp1, ypn);
+	}
+}
+
 operaSpectrum fitSpectrum(const operaSpectrum& inputSpectrum, const operaVector& outputWavelength) {
     operaSpectrum outputSpectrum(inputSpectrum.fluxcount(), outputWavelength);
+    if (inputSpectrum.size() < 2) {
+        return outputSpectrum;
+    }
+    // all the flux and variance vectors share the input wavelengths as knots
+    operaSpline_t *spline = NULL;
     for(unsigned v=0; v<inputSpectrum.fluxcount(); v++) {
-		operaFitSplineDouble(inputSpectrum.size(), inputSpectrum.wavelength_ptr(), inputSpectrum.flux_ptr(v), outputSpectrum.size(), outputSpectrum.wavelength_ptr(), outputSpectrum.flux_ptr(v));
-		operaFitSplineDouble(inputSpectrum.size(), inputSpectrum.wavelength_ptr(), inputSpectrum.variance_ptr(v), outputSpectrum.size(), outputSpectrum.wavelength_ptr(), outputSpectrum.variance_ptr(v));
+		refitSpline(spline, inputSpectrum.size(), inputSpectrum.wavelength_ptr(), inputSpectrum.flux_ptr(v));
+		operaSplineEvaluate(spline, outputSpectrum.size(), outputSpectrum.wavelength_ptr(), outputSpectrum.flux_ptr(v));
+		refitSpline(spline, inputSpectrum.size(), inputSpectrum.wavelength_ptr(), inputSpectrum.variance_ptr(v));
+		operaSplineEvaluate(spline, outputSpectrum.size(), outputSpectrum.wavelength_ptr(), outputSpectrum.variance_ptr(v));
 	}
+    operaSplineDelete(spline);
     return outputSpectrum;
 }
 
@@ -849,53 +999,80 @@ operaVector fitSpectrumToPolynomial(const operaVector& inputWavelength, const op
     return Operation(Polynomial(coeffs), outputWavelength);
 }
 
-// Helper function for LinearFit
-double LinearMedianDelta(const operaVector& x, const operaVector& y, double b, double& a, double& absdev, double eps) {
-	operaVector d = y - (b * x);
-	a = Median(d);
-	d -= a; // d = y - (b * x + a)
-	absdev = Sum(Abs(d));
+/*
+ * double medianInPlace(unsigned n, double *values)
+ * \brief the median as MedianQuick computes it, partially reordering values.
+ */
+static inline double medianInPlace(unsigned n, double *values) {
+	double *middle = values + n/2;
+	std::nth_element(values, middle, values + n);
+	if (n % 2 == 1) return *middle;
+	return (*std::max_element(values, middle) + *middle) / 2.0;
+}
+
+// Helper function for LinearFit, d and work are scratch arrays of n values
+static double LinearMedianDelta(unsigned n, const double *x, const double *y, double b, double& a, double& absdev, double eps, double *d, double *work) {
+	for (unsigned i=0; i<n; i++) {
+		d[i] = y[i] - b * x[i];
+		work[i] = d[i];
+	}
+	a = medianInPlace(n, work);
+	absdev = 0.0;
 	double sum = 0.0;
-	for (unsigned i=0; i<d.size(); i++) {
+	for (unsigned i=0; i<n; i++) {
+		d[i] -= a; // d = y - (b * x + a)
+		absdev += fabs(d[i]);
 		if (y[i] != 0.0) d[i] /= fabs(y[i]);
 		if (fabs(d[i]) > eps) sum += (d[i] >= 0.0 ? x[i] : -x[i]);
 	}
 	return sum;
 }
 
-void LinearFit(const operaVector& x, const operaVector& y, double& a, double& b, double& absdev) {
+/*
+ * void LinearFitLAD(unsigned n, const double *x, const double *y, double sx, double sxx, double& a, double& b, double& absdev, double *d, double *work)
+ * \brief the least absolute deviation fit of LinearFit on arrays, with the sums of x and x^2 given by the caller
+ * and d, work scratch arrays of n values, so repeated fits allocate nothing.
+ */
+static void LinearFitLAD(unsigned n, const double *x, const double *y, double sx, double sxx, double& a, double& b, double& absdev, double *d, double *work) {
 	float eps = EPS;
 	
-	double sx = Sum(x);
-	double sy = Sum(y);
-	double sxy = InnerProduct(x, y);
-	double sxx = InnerProduct(x, x);
-	double del = x.size() * sxx - sx * sx;
+	double sy = 0.0;
+	double sxy = 0.0;
+	for (unsigned i=0; i<n; i++) {
+		sy += y[i];
+		sxy += x[i] * y[i];
+	}
+	double del = n * sxx - sx * sx;
 	
 	if (del == 0.0) { // All X's are the same
-		b = Median(y);
+		std::copy(y, y + n, work);
+		b = medianInPlace(n, work);
 		a = 0.0; // Bisect the range w/ a flat line
 		return;
 	}
 	double aa = (sxx * sy - sx * sxy) / del; // Least squares solution y = aa + bb * x
-	double bb = (x.size() * sxy - sx * sy) / del;
+	double bb = (n * sxy - sx * sy) / del;
 	
-	const operaVector& t = y - (aa + bb * x);
-	double sigb = Magnitude(t)/sqrt(del); // Standard deviation sig = sqrt(chisqr/del)
+	double chisqr = 0.0;
+	for (unsigned i=0; i<n; i++) {
+		double t = y[i] - (aa + bb * x[i]);
+		chisqr += t * t;
+	}
+	double sigb = sqrt(chisqr)/sqrt(del); // Standard deviation sig = sqrt(chisqr/del)
 	
 	double b1 = bb;
-	double f1 = LinearMedianDelta(x, y, b1, aa, absdev, eps);
+	double f1 = LinearMedianDelta(n, x, y, b1, aa, absdev, eps, d, work);
 	
 	//  Quick return. The initial least squares gradient is the LAD solution.
 	if (f1 != 0.0) {
 		double delb = (f1 >= 0 ? 3.0 : -3.0) * sigb;
 		double b2 = b1 + delb;
-		double f2 = LinearMedianDelta(x, y, b2, aa, absdev, eps);
+		double f2 = LinearMedianDelta(n, x, y, b2, aa, absdev, eps, d, work);
 		while (f1*f2 > 0.0) {     // Bracket the zero of the function
 			b1 = b2;
 			f1 = f2;
 			b2 = b1 + delb;
-			f2 = LinearMedianDelta(x, y, b2, aa, absdev, eps);
+			f2 = LinearMedianDelta(n, x, y, b2, aa, absdev, eps, d, work);
 		}
 		//  In case we finish early.
 		bb = b2;
@@ -907,7 +1084,7 @@ void LinearFit(const operaVector& x, const operaVector& y, double& a, double& b,
 			bb = 0.5 * (b1 + b2);
 			if (bb == b1 || bb == b2)
 				break;
-			f = LinearMedianDelta(x, y, bb, aa, absdev, eps);
+			f = LinearMedianDelta(n, x, y, bb, aa, absdev, eps, d, work);
 			if (f*f1 >= 0.0) {
 				f1 = f;
 				b1 = bb;
@@ -917,11 +1094,17 @@ void LinearFit(const operaVector& x, const operaVector& y, double& a, double& b,
 			}
 		}
 	}
-	absdev /= x.size();
+	absdev /= n;
 	b = bb;
 	a = aa;
 }
 
+void LinearFit(const operaVector& x, const operaVector& y, double& a, double& b, double& absdev) {
+	if (x.size() != y.size()) throw operaException("LinearFit: ", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
+	std::vector<double> scratch(2*x.size() + 1);
+	LinearFitLAD(x.size(), x.datapointer(), y.datapointer(), Sum(x), InnerProduct(x, x), a, b, absdev, &scratch[0], &scratch[x.size()]);
+}
+
 void LinearFit(const operaVector& x, const operaVector& y, double& a, double& aError, double& b, double& bError, double& absdev) {
 	LinearFit(x, y, a, b, absdev);
 	double sigy = MedianStdDev(y - a - b*x, 0);
@@ -959,10 +1142,32 @@ unsigned findClosestInSortedRange(const operaVector& vector, double target, unsi
 	return iter - vector.begin();
 }
 
+/*
+ * The sum of the integers and of their squares in [first, last), exact in double as long as the sums are below 2^53,
+ * so they equal the sums accumulated over the window indices.
+ */
+static inline double sumOfIndices(unsigned first, unsigned last) {
+	unsigned long long n = last - first;
+	return (double)(n*(first + last - 1ULL)/2ULL);
+}
+
+static inline double sumOfSquaredIndices(unsigned first, unsigned last) {
+	unsigned long long f = first, l = last;
+	return (double)(l*(l - 1ULL)*(2ULL*l - 1ULL)/6ULL - (f ? f*(f - 1ULL)*(2ULL*f - 1ULL)/6ULL : 0ULL));
+}
+
 void measureFluxContinuum(const operaFluxVector& uncalibratedFlux, unsigned binsize, unsigned nsigcut, operaVector& continuumElemSamples, operaVector& continuumFluxSamples) {
 	const unsigned NumberofPoints = uncalibratedFlux.getlength();
 	if(NumberofPoints < 2*binsize) throw operaException("NumberofPoints < 2*binsize", operaErrorLengthMismatch, __FILE__, __FUNCTION__, __LINE__);
     
+    // Scratch shared by all bins: a window of up to 3 bins, the work arrays of the fits, and the residuals of one bin
+    std::vector<double> elemindex_tmp(3*binsize);
+    std::vector<double> uncalflux_tmp(3*binsize);
+    std::vector<double> fitscratch(6*binsize);
+    std::vector<double> residuals_tmp(binsize);
+    double *elemindex = &elemindex_tmp[0];
+    double *uncalflux = &uncalflux_tmp[0];
+    
     for(unsigned start=0; start<NumberofPoints; start+=binsize){
         // If our bin runs past the end, shift it back
         unsigned end = start+binsize;
@@ -984,42 +1189,49 @@ void measureFluxContinuum(const operaFluxVector& uncalibratedFlux, unsigned bins
             if (lastPoint > NumberofPoints) lastPoint = NumberofPoints; // Othewise we can run past the end on the 2nd to last bin
         }
 		
-		operaVector uncalflux_tmp;
-        operaVector elemindex_tmp;
+        unsigned npoints = 0;
         for(unsigned i=firstPoint;i<lastPoint;i++) {
-            uncalflux_tmp.insert(uncalibratedFlux.getflux(i));
-            elemindex_tmp.insert((double)i);
+            uncalflux[npoints] = uncalibratedFlux.getflux(i);
+            elemindex[npoints] = (double)i;
+            npoints++;
         }
         
         double am, bm, abdevm;
 		// 1st pass: calculate continuum slope
-		LinearFit(elemindex_tmp, uncalflux_tmp, am, bm, abdevm); // robust linear fit: f(x) =  a + b*x
+		LinearFitLAD(npoints, elemindex, uncalflux, sumOfIndices(firstPoint, lastPoint), sumOfSquaredIndices(firstPoint, lastPoint), am, bm, abdevm, &fitscratch[0], &fitscratch[3*binsize]); // robust linear fit: f(x) =  a + b*x
         // Filter out points that deviate more than abdev from the robust linear fit
-        uncalflux_tmp.clear();
-        elemindex_tmp.clear();
+        npoints = 0;
+        double sx = 0.0, sxx = 0.0;
         for(unsigned i=firstPoint;i<lastPoint;i++) {
             if(fabs(uncalibratedFlux.getflux(i) - (bm*i + am)) < abdevm) {
-                uncalflux_tmp.insert(uncalibratedFlux.getflux(i));
-                elemindex_tmp.insert((double)i);
+                uncalflux[npoints] = uncalibratedFlux.getflux(i);
+                elemindex[npoints] = (double)i;
+                sx += elemindex[npoints];
+                sxx += elemindex[npoints] * elemindex[npoints];
+                npoints++;
             }
         }
         // 2nd pass: calculate continuum slope    
-        if(elemindex_tmp.size() > 0) {
-            LinearFit(elemindex_tmp, uncalflux_tmp, am, bm, abdevm); // robust linear fit: f(x) =  a + b*x
+        if(npoints > 0) {
+            LinearFitLAD(npoints, elemindex, uncalflux, sx, sxx, am, bm, abdevm, &fitscratch[0], &fitscratch[3*binsize]); // robust linear fit: f(x) =  a + b*x
         }
         
-        // Calculate residuals in our original binsize and sort
-        operaVector residuals_tmp;
-        for(unsigned i=start; i<end; i++) residuals_tmp.insert(uncalibratedFlux.getflux(i) - (bm*i + am));
-        residuals_tmp.sort();
+        // Calculate residuals in our original binsize
+        double *residuals = &residuals_tmp[0];
+        for(unsigned i=start; i<end; i++) residuals[i-start] = uncalibratedFlux.getflux(i) - (bm*i + am);
         
-        // Select largest residual which does not exceed nsigcut*(absolute deviation)
+        // Select largest residual which does not exceed nsigcut*(absolute deviation), among the upper continuumBinFraction of the bin
         double dytop = nsigcut*abdevm; // if none are found then use nsigcut*abdev
         double continuumBinFraction = 0.5;
-        for(unsigned i=binsize-1; i>(unsigned)(binsize*(1.0 - continuumBinFraction)); i--) {
-            if(residuals_tmp[i] < nsigcut*abdevm) {
-                dytop = residuals_tmp[i];
-                break;
+        unsigned firstrank = (unsigned)(binsize*(1.0 - continuumBinFraction)) + 1;
+        if (firstrank < binsize) {
+            std::nth_element(residuals, residuals + firstrank, residuals + binsize);
+            bool found = false;
+            for(unsigned i=firstrank; i<binsize; i++) {
+                if(residuals[i] < nsigcut*abdevm && (!found || residuals[i] > dytop)) {
+                    dytop = residuals[i];
+                    found = true;
+                }
             }
         }
         
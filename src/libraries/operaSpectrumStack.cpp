@@ -0,0 +1,311 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaSpectrumStack
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <algorithm>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaSpectrumStack.h"
+#include "libraries/operaThreadPool.h"
+#include "libraries/operaLibCommon.h"		// for MIN, SPEED_OF_LIGHT_KMS
+#include "libraries/operaStats.h"			// for operaArrayMedian
+
+/*!
+ * operaSpectrumStack
+ * \brief Stacking of many spectra onto radial velocity bins.
+ * \file operaSpectrumStack.cpp
+ * \ingroup libraries
+ */
+
+using namespace std;
+
+#define STACK_CHUNK_BINS 4096
+
+/*
+ * where one input stands in the merge of one chunk
+ */
+typedef struct stackCursor {
+	double wavelength;
+	unsigned input;
+	unsigned long index;
+	unsigned long end;
+} stackCursor_t;
+
+static bool laterCursor(const stackCursor_t &a, const stackCursor_t &b) {
+	return a.wavelength > b.wavelength;		// std heaps are max-heaps, this makes the smallest wavelength the top
+}
+
+static bool earlierInput(const pair<unsigned, float> &a, const pair<unsigned, float> &b) {
+	return a.first < b.first;
+}
+
+/*
+ * statistics of the points of one bin, for every method at once
+ */
+class stackBin {
+public:
+	double sumFlux, sumVariance;				// StackSum: all non-NaN points
+	double sumNonZeroFlux, sumNonZeroVariance;	// StackMean: non-zero, non-NaN points
+	unsigned nNonZero;
+	double weightedFlux, weightedVariance, weightSum;	// StackWeightedMean
+	vector< pair<unsigned, float> > values;		// StackMedian: (input, flux), the median of an even count depends on the order
+	bool keepValues;
+
+	stackBin(bool KeepValues) : keepValues(KeepValues) { clear(); }
+
+	void clear(void) {
+		sumFlux = sumVariance = 0;
+		sumNonZeroFlux = sumNonZeroVariance = 0;
+		nNonZero = 0;
+		weightedFlux = weightedVariance = weightSum = 0;
+		values.clear();
+	}
+
+	void add(unsigned input, double flux, double variance) {
+		if (isnan(flux)) {
+			return;
+		}
+		sumFlux += flux;
+		sumVariance += variance;
+		if (flux) {
+			sumNonZeroFlux += flux;
+			sumNonZeroVariance += variance;
+			nNonZero++;
+			double weight = 1.0;
+			if (variance) {
+				weight = 1.0/(variance)*(variance);
+				weightedVariance += variance*weight;
+			}
+			weightedFlux += flux*weight;
+			weightSum += weight;
+			if (keepValues) {
+				values.push_back(pair<unsigned, float>(input, (float)flux));
+			}
+		}
+	}
+
+	/*
+	 * returns false if the bin yields no output point for Method
+	 */
+	bool result(operaStackMethod_t Method, double &flux, double &variance) {
+		switch (Method) {
+			case StackSum:
+				flux = sumFlux;
+				variance = sumVariance;
+				return flux != 0;
+			case StackMean:
+				if (!nNonZero) {
+					return false;
+				}
+				flux = sumNonZeroFlux/(double)nNonZero;
+				variance = sumNonZeroVariance/(double)nNonZero;
+				return true;
+			case StackMedian: {
+				unsigned nin = (unsigned)values.size();
+				if (!nin) {
+					return false;
+				}
+				// back to input order, points of one input already come in wavelength order
+				stable_sort(values.begin(), values.end(), earlierInput);
+				vector<float> fluxdata(nin);
+				for (unsigned i=0; i<nin; i++) {
+					fluxdata[i] = values[i].second;
+				}
+				float flux_err;
+				if (nin > 2) {
+					flux = (double)operaArrayMedian(nin, &fluxdata[0]);
+					flux_err = operaArrayMedianSigma(nin, &fluxdata[0], flux);
+				} else {
+					flux = (double)operaArrayMean(nin, &fluxdata[0]);
+					flux_err = operaArraySigma(nin, &fluxdata[0]);
+				}
+				variance = (double)(flux_err*flux_err);
+				return true;
+			}
+			default:
+				if (!weightSum) {
+					return false;
+				}
+				flux = weightedFlux/weightSum;
+				variance = weightedVariance/weightSum;
+				return true;
+		}
+	}
+};
+
+/*
+ * shared by the chunks of one stack()
+ */
+class stackJob {
+public:
+	const operaSpectrumStack *stack;
+	vector<double> edges;						// bin k is [edges[k], edges[k+1]]
+	double radialVelocityBin;
+	operaStackMethod_t method;
+	vector< vector<double> > wavelength;		// output of each chunk
+	vector< vector<double> > flux;
+	vector< vector<double> > variance;
+};
+
+/*
+ * Constructors / Destructors
+ */
+
+operaSpectrumStack::operaSpectrumStack() {
+}
+
+void operaSpectrumStack::addSpectrum(const operaSpectrum &spectrum) {
+	vector< pair<double, unsigned> > order;
+	order.reserve(spectrum.size());
+	for (unsigned i=0; i<spectrum.size(); i++) {
+		if (!isnan(spectrum.getwavelength(i))) {
+			order.push_back(pair<double, unsigned>(spectrum.getwavelength(i), i));
+		}
+	}
+	stable_sort(order.begin(), order.end());
+	
+	inputs.push_back(stackInput());
+	stackInput &input = inputs.back();
+	input.wavelength.resize(order.size());
+	input.flux.resize(order.size());
+	input.variance.resize(order.size());
+	for (unsigned i=0; i<order.size(); i++) {
+		input.wavelength[i] = order[i].first;
+		input.flux[i] = (float)spectrum.getflux(order[i].second);
+		input.variance[i] = (float)spectrum.getvariance(order[i].second);
+	}
+}
+
+/*
+ * void stackChunk(unsigned long chunk, void *context)
+ * \brief k-way merge of all inputs over the bins of one chunk.
+ */
+void operaSpectrumStack::stackChunk(unsigned long chunk, void *context) {
+	stackJob *job = (stackJob *)context;
+	const vector<stackInput> &inputs = job->stack->inputs;
+	const vector<double> &edges = job->edges;
+	unsigned long nbins = edges.size() - 1;
+	unsigned long firstBin = chunk * STACK_CHUNK_BINS;
+	unsigned long lastBin = MIN(firstBin + STACK_CHUNK_BINS, nbins);
+	double chunkStart = edges[firstBin];
+	double chunkEnd = edges[lastBin];
+	
+	// a point on the boundary between two chunks belongs to the earlier one
+	vector<stackCursor_t> heap;
+	for (unsigned n=0; n<inputs.size(); n++) {
+		const vector<double> &wl = inputs[n].wavelength;
+		vector<double>::const_iterator begin = (firstBin == 0 ? lower_bound(wl.begin(), wl.end(), chunkStart) : upper_bound(wl.begin(), wl.end(), chunkStart));
+		vector<double>::const_iterator end = upper_bound(begin, wl.end(), chunkEnd);
+		if (begin < end) {
+			stackCursor_t cursor;
+			cursor.index = begin - wl.begin();
+			cursor.end = end - wl.begin();
+			cursor.wavelength = wl[cursor.index];
+			cursor.input = n;
+			heap.push_back(cursor);
+		}
+	}
+	make_heap(heap.begin(), heap.end(), laterCursor);
+	
+	vector<double> &outWavelength = job->wavelength[chunk];
+	vector<double> &outFlux = job->flux[chunk];
+	vector<double> &outVariance = job->variance[chunk];
+	stackBin current(job->method == StackMedian);
+	unsigned long bin = firstBin;
+	bool binHasPoints = false;
+	double flux, variance;
+	
+	while (!heap.empty()) {
+		pop_heap(heap.begin(), heap.end(), laterCursor);
+		stackCursor_t &cursor = heap.back();
+		while (cursor.wavelength > edges[bin+1]) {
+			if (binHasPoints && current.result(job->method, flux, variance)) {
+				double dwl = (job->radialVelocityBin * edges[bin])/SPEED_OF_LIGHT_KMS;
+				outWavelength.push_back(edges[bin] + dwl/2.0);
+				outFlux.push_back(flux);
+				outVariance.push_back(variance);
+			}
+			current.clear();
+			binHasPoints = false;
+			bin++;
+		}
+		const stackInput &input = inputs[cursor.input];
+		current.add(cursor.input, input.flux[cursor.index], input.variance[cursor.index]);
+		binHasPoints = true;
+		if (++cursor.index < cursor.end) {
+			cursor.wavelength = input.wavelength[cursor.index];
+			push_heap(heap.begin(), heap.end(), laterCursor);
+		} else {
+			heap.pop_back();
+		}
+	}
+	if (binHasPoints && current.result(job->method, flux, variance)) {
+		double dwl = (job->radialVelocityBin * edges[bin])/SPEED_OF_LIGHT_KMS;
+		outWavelength.push_back(edges[bin] + dwl/2.0);
+		outFlux.push_back(flux);
+		outVariance.push_back(variance);
+	}
+}
+
+operaSpectrum operaSpectrumStack::stack(double FirstWavelength, double LastWavelength, double RadialVelocityBin, operaStackMethod_t Method) const {
+	if (RadialVelocityBin <= 0 || FirstWavelength <= 0) {
+		throw operaException("operaSpectrumStack: ", operaErrorInvalidParameter, __FILE__, __FUNCTION__, __LINE__);
+	}
+	stackJob job;
+	job.stack = this;
+	job.radialVelocityBin = RadialVelocityBin;
+	job.method = Method;
+	
+	// the bin edges are accumulated exactly as wl += dwl, so the grid does not depend on the chunking
+	double wl = FirstWavelength;
+	while (wl < LastWavelength) {
+		job.edges.push_back(wl);
+		wl += (RadialVelocityBin * wl)/SPEED_OF_LIGHT_KMS;
+	}
+	job.edges.push_back(wl);
+	
+	operaSpectrum outspectrum;
+	unsigned long nbins = job.edges.size() - 1;
+	if (nbins == 0 || inputs.empty()) {
+		return outspectrum;
+	}
+	unsigned long nchunks = (nbins + STACK_CHUNK_BINS - 1) / STACK_CHUNK_BINS;
+	job.wavelength.resize(nchunks);
+	job.flux.resize(nchunks);
+	job.variance.resize(nchunks);
+	operaThreadPool::getSharedPool().parallelFor(nchunks, stackChunk, &job);
+	
+	for (unsigned long chunk=0; chunk<nchunks; chunk++) {
+		for (unsigned i=0; i<job.wavelength[chunk].size(); i++) {
+			outspectrum.insert(job.wavelength[chunk][i], job.flux[chunk][i], job.variance[chunk][i]);
+		}
+	}
+	return outspectrum;
+}
@@ -0,0 +1,195 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaTelluricTransmission
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <math.h>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaTelluricTransmission.h"
+
+/*!
+ * operaTelluricTransmission
+ * \brief Synthetic telluric transmission on a cached ln(wavelength) raster.
+ * \file operaTelluricTransmission.cpp
+ * \ingroup libraries
+ */
+
+using namespace std;
+
+/*
+ * Constructors / Destructors
+ */
+
+operaTelluricTransmission::operaTelluricTransmission(const operaSpectrum &TelluricLines) :
+lines(TelluricLines)
+{
+	pthread_mutex_init(&mutex, NULL);
+}
+
+operaTelluricTransmission::~operaTelluricTransmission() {
+	clearCache();
+	pthread_mutex_destroy(&mutex);
+}
+
+/*
+ * void clearCache(void)
+ * \brief drop every raster.
+ */
+void operaTelluricTransmission::clearCache(void) {
+	pthread_mutex_lock(&mutex);
+	for (unsigned r=0; r<rasters.size(); r++) {
+		delete rasters[r];
+	}
+	rasters.clear();
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * const telluricRaster *getRaster(double resolution, double wlmin, double wlmax)
+ * \brief a cached raster at this resolution covering [wlmin, wlmax], built if there is none.
+ * Rasters are only deleted by clearCache, so the pointer stays valid for the caller.
+ */
+const operaTelluricTransmission::telluricRaster *operaTelluricTransmission::getRaster(double resolution, double wlmin, double wlmax) {
+	pthread_mutex_lock(&mutex);
+	for (unsigned r=0; r<rasters.size(); r++) {
+		if (rasters[r]->resolution == resolution && rasters[r]->wlmin <= wlmin && wlmax <= rasters[r]->wlmax) {
+			const telluricRaster *raster = rasters[r];
+			pthread_mutex_unlock(&mutex);
+			return raster;
+		}
+	}
+	telluricRaster *raster = NULL;
+	try {
+		raster = buildRaster(resolution, wlmin, wlmax);
+	}
+	catch (...) {
+		pthread_mutex_unlock(&mutex);
+		throw;
+	}
+	rasters.push_back(raster);
+	pthread_mutex_unlock(&mutex);
+	return raster;
+}
+
+/*
+ * telluricRaster *buildRaster(double resolution, double wlmin, double wlmax)
+ * \brief rasterize the optical depth per unit airmass of every line that reaches [wlmin, wlmax], padded by TELLURIC_GRID_PADDING.
+ * \details Each line adds depth * exp(-d^2/2k^2) at the nodes within the truncation, d the distance in nodes and k the
+ * nodes per sigma. The Gaussian is stepped by the recurrence g(d+1) = g(d) * exp(-(2d+1)/2k^2), so a line costs three
+ * exp whatever its extent. The nodes are then scaled by the normalization resolution/(sqrt(2 pi) wl) of a Gaussian of
+ * sigma wl/resolution.
+ */
+operaTelluricTransmission::telluricRaster *operaTelluricTransmission::buildRaster(double resolution, double wlmin, double wlmax) const {
+	const double samplesPerSigma = TELLURIC_SAMPLES_PER_SIGMA;
+	const double halfwidth = TELLURIC_TRUNCATION_IN_SIGMAS*samplesPerSigma;		// in nodes
+	const double a = 1.0/(2.0*samplesPerSigma*samplesPerSigma);
+	const double c = exp(-2.0*a);
+
+	telluricRaster *raster = new telluricRaster();
+	raster->resolution = resolution;
+	raster->wlmin = wlmin*(1.0 - TELLURIC_GRID_PADDING);
+	raster->wlmax = wlmax*(1.0 + TELLURIC_GRID_PADDING);
+	raster->step = 1.0/(resolution*samplesPerSigma);
+	// two extra nodes each side for the cubic interpolation
+	raster->lnwl0 = log(raster->wlmin) - 2.0*raster->step;
+	unsigned nnodes = (unsigned)ceil((log(raster->wlmax) - raster->lnwl0)/raster->step) + 3;
+	raster->opticalDepth.resize(nnodes);
+	raster->opticalDepth.fill(0.0);
+	double *depth = raster->opticalDepth.datapointer();
+
+	// lines up to the truncation beyond the first and last node contribute
+	double reach = halfwidth*raster->step;
+	unsigned startindex, endindex;
+	getWavelengthSubrange(lines.wavelengthvector(), exp(raster->lnwl0 - reach), exp(raster->lnwl0 + (nnodes-1)*raster->step + reach), startindex, endindex);
+
+	for (unsigned j=startindex; j<endindex; j++) {
+		double linedepth = lines.getflux(j);
+		if (linedepth == 0.0) continue;
+		double position = (log(lines.getwavelength(j)) - raster->lnwl0)/raster->step;
+		int first = (int)ceil(position - halfwidth);
+		int last = (int)floor(position + halfwidth);
+		if (first < 0) first = 0;
+		if (last > (int)nnodes-1) last = (int)nnodes-1;
+		if (first > last) continue;
+		double d = (double)first - position;
+		double g = exp(-d*d*a);
+		double r = exp(-(2.0*d + 1.0)*a);
+		for (int n=first; n<=last; n++) {
+			depth[n] += linedepth*g;
+			g *= r;
+			r *= c;
+		}
+	}
+
+	double normalization = resolution/(sqrt(2.0*M_PI)*exp(raster->lnwl0));
+	double ratio = exp(-raster->step);
+	for (unsigned n=0; n<nnodes; n++) {
+		depth[n] *= normalization;
+		normalization *= ratio;
+	}
+	return raster;
+}
+
+/*
+ * operaVector getTransmission(const operaVector &Wavelength, double Resolution, double Airmass)
+ * \brief exp(-Airmass * optical depth), the optical depth interpolated in the raster with a 4 point Lagrange polynomial.
+ */
+operaVector operaTelluricTransmission::getTransmission(const operaVector &Wavelength, double Resolution, double Airmass) {
+	operaVector transmission(Wavelength.size());
+	transmission.fill(1.0);
+	if (Wavelength.empty() || lines.empty() || Resolution <= 0.0) {
+		return transmission;
+	}
+	double wlmin = Wavelength[0], wlmax = Wavelength[0];
+	for (unsigned i=1; i<Wavelength.size(); i++) {
+		if (Wavelength[i] < wlmin) wlmin = Wavelength[i];
+		if (Wavelength[i] > wlmax) wlmax = Wavelength[i];
+	}
+	if (wlmin <= 0.0) {
+		throw operaException("operaTelluricTransmission: ", operaErrorInvalidInput, __FILE__, __FUNCTION__, __LINE__);
+	}
+	const telluricRaster *raster = getRaster(Resolution, wlmin, wlmax);
+	const double *depth = raster->opticalDepth.datapointer();
+	int lastnode = (int)raster->opticalDepth.size() - 3;
+
+	for (unsigned i=0; i<Wavelength.size(); i++) {
+		double position = (log(Wavelength[i]) - raster->lnwl0)/raster->step;
+		int n = (int)floor(position);
+		if (n < 1) n = 1;
+		if (n > lastnode) n = lastnode;
+		double f = position - n;
+		double opticalDepth = -f*(f-1.0)*(f-2.0)/6.0*depth[n-1]
+							+ (f+1.0)*(f-1.0)*(f-2.0)/2.0*depth[n]
+							- (f+1.0)*f*(f-2.0)/2.0*depth[n+1]
+							+ (f+1.0)*f*(f-1.0)/6.0*depth[n+2];
+		transmission[i] = exp(-Airmass*opticalDepth);
+	}
+	return transmission;
+}
@@ -0,0 +1,310 @@
+/*******************************************************************
+ ****               		OPERA PIPELINE v1.0                     ****
+ ********************************************************************
+ Library name: operaThreadPool
+ Version: 1.0
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include <unistd.h>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaThreadPool.h"
+#include "libraries/operaLibCommon.h"		// for MIN
+
+/*!
+ * operaThreadPool
+ * \brief A reusable pool of pthread workers.
+ * \file operaThreadPool.cpp
+ * \ingroup libraries
+ */
+
+/*
+ * Workers of every pool carry their pool under this key, so that
+ * parallelFor can tell it is being called from inside one of its own tasks.
+ */
+static pthread_key_t workerKey;
+static pthread_once_t workerKeyOnce = PTHREAD_ONCE_INIT;
+
+static void createWorkerKey(void) {
+	pthread_key_create(&workerKey, NULL);
+}
+
+/*
+ * State shared by the caller and the helpers of one parallelFor.
+ * It is reference counted because helpers may still be queued when
+ * the caller has already seen every index completed.
+ */
+class parallelForJob {
+public:
+	pthread_mutex_t mutex;
+	pthread_cond_t finished;
+	unsigned long count;
+	unsigned long next;
+	unsigned long completed;
+	unsigned references;
+	operaParallelForFunction body;
+	void *context;
+	bool failed;
+	operaException exception;
+
+	parallelForJob(unsigned long Count, operaParallelForFunction Body, void *Context, unsigned References) :
+	count(Count), next(0), completed(0), references(References), body(Body), context(Context), failed(false)
+	{
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&finished, NULL);
+	}
+	~parallelForJob() {
+		pthread_cond_destroy(&finished);
+		pthread_mutex_destroy(&mutex);
+	}
+};
+
+static void releaseParallelForJob(parallelForJob *job) {
+	pthread_mutex_lock(&job->mutex);
+	bool last = (--job->references == 0);
+	pthread_mutex_unlock(&job->mutex);
+	if (last) {
+		delete job;
+	}
+}
+
+static void runParallelForJob(parallelForJob *job) {
+	while (true) {
+		pthread_mutex_lock(&job->mutex);
+		if (job->next >= job->count) {
+			pthread_mutex_unlock(&job->mutex);
+			break;
+		}
+		unsigned long index = job->next++;
+		bool failed = job->failed;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (!failed) {
+			try {
+				job->body(index, job->context);
+			}
+			catch (const operaException &e) {
+				pthread_mutex_lock(&job->mutex);
+				if (!job->failed) {
+					job->failed = true;
+					job->exception = e;
+				}
+				pthread_mutex_unlock(&job->mutex);
+			}
+			catch (...) {
+				pthread_mutex_lock(&job->mutex);
+				if (!job->failed) {
+					job->failed = true;
+					job->exception = operaException("operaThreadPool: ", operaErrorThreadFailure, __FILE__, __FUNCTION__, __LINE__);
+				}
+				pthread_mutex_unlock(&job->mutex);
+			}
+		}
+		pthread_mutex_lock(&job->mutex);
+		if (++job->completed == job->count) {
+			pthread_cond_broadcast(&job->finished);
+		}
+		pthread_mutex_unlock(&job->mutex);
+	}
+}
+
+static void parallelForHelper(void *argument) {
+	parallelForJob *job = (parallelForJob *)argument;
+	runParallelForJob(job);
+	releaseParallelForJob(job);
+}
+
+/*
+ * Constructors / Destructors
+ */
+
+operaThreadPool::operaThreadPool(unsigned NThreads) :
+pending(0),
+shuttingDown(false)
+{
+	pthread_once(&workerKeyOnce, createWorkerKey);
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&workAvailable, NULL);
+	pthread_cond_init(&workDone, NULL);
+
+	if (NThreads == 0) {
+		NThreads = getNumberOfProcessors();
+	}
+	workers.reserve(NThreads);
+	for (unsigned i=0; i<NThreads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, workerThread, (void *)this) != 0) {
+			if (workers.empty()) {
+				throw operaException("operaThreadPool: ", operaErrorThreadFailure, __FILE__, __FUNCTION__, __LINE__);
+			}
+			break;	// run with what we have
+		}
+		workers.push_back(thread);
+	}
+}
+
+operaThreadPool::~operaThreadPool() {
+	pthread_mutex_lock(&mutex);
+	shuttingDown = true;
+	pthread_cond_broadcast(&workAvailable);
+	pthread_mutex_unlock(&mutex);
+	for (unsigned i=0; i<workers.size(); i++) {
+		pthread_join(workers[i], NULL);
+	}
+	pthread_cond_destroy(&workDone);
+	pthread_cond_destroy(&workAvailable);
+	pthread_mutex_destroy(&mutex);
+}
+
+/*
+ * void *workerThread(void *argument)
+ * \brief worker main loop: pop a task, run it, repeat until the pool shuts down and the queue is empty.
+ */
+void *operaThreadPool::workerThread(void *argument) {
+	operaThreadPool *pool = (operaThreadPool *)argument;
+	pthread_setspecific(workerKey, argument);
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (pool->queue.empty() && !pool->shuttingDown) {
+			pthread_cond_wait(&pool->workAvailable, &pool->mutex);
+		}
+		if (pool->queue.empty()) {	// shutting down
+			break;
+		}
+		operaTask_t task = pool->queue.front();
+		pool->queue.pop_front();
+		pthread_mutex_unlock(&pool->mutex);
+
+		task.function(task.argument);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (--pool->pending == 0) {
+			pthread_cond_broadcast(&pool->workDone);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+/*
+ * void submit(operaTaskFunction Function, void *Argument)
+ * \brief queue a task, returns immediately
+ */
+void operaThreadPool::submit(operaTaskFunction Function, void *Argument) {
+	operaTask_t task;
+	task.function = Function;
+	task.argument = Argument;
+	pthread_mutex_lock(&mutex);
+	queue.push_back(task);
+	pending++;
+	pthread_cond_signal(&workAvailable);
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * void waitForAll(void)
+ * \brief block until every submitted task has completed
+ */
+void operaThreadPool::waitForAll(void) {
+	pthread_mutex_lock(&mutex);
+	while (pending > 0) {
+		pthread_cond_wait(&workDone, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * void parallelFor(unsigned long Count, operaParallelForFunction Body, void *Context)
+ * \brief call Body(i, Context) for i in [0, Count), indices are handed out one at a time
+ * so uneven work (e.g. tiles that compress poorly) balances itself.
+ */
+void operaThreadPool::parallelFor(unsigned long Count, operaParallelForFunction Body, void *Context) {
+	if (Count == 0) {
+		return;
+	}
+	// a worker of this pool waiting on its own pool could deadlock it, workers of another pool may fan out here
+	if (Count == 1 || workers.empty() || pthread_getspecific(workerKey) == (void *)this) {
+		for (unsigned long i=0; i<Count; i++) {
+			Body(i, Context);
+		}
+		return;
+	}
+	unsigned helpers = (unsigned)MIN((unsigned long)workers.size(), Count-1);
+	parallelForJob *job = new parallelForJob(Count, Body, Context, helpers+1);
+	for (unsigned i=0; i<helpers; i++) {
+		submit(parallelForHelper, (void *)job);
+	}
+	runParallelForJob(job);
+
+	pthread_mutex_lock(&job->mutex);
+	while (job->completed < job->count) {
+		pthread_cond_wait(&job->finished, &job->mutex);
+	}
+	bool failed = job->failed;
+	operaException exception = job->exception;
+	pthread_mutex_unlock(&job->mutex);
+	releaseParallelForJob(job);
+
+	if (failed) {
+		throw exception;
+	}
+}
+
+/*
+ * bool isWorkerThread(void)
+ * \brief is the calling thread one of the workers of any pool?
+ */
+bool operaThreadPool::isWorkerThread(void) {
+	pthread_once(&workerKeyOnce, createWorkerKey);
+	return pthread_getspecific(workerKey) != NULL;
+}
+
+/*
+ * unsigned getNumberOfProcessors(void)
+ * \brief returns the number of online processors
+ */
+unsigned operaThreadPool::getNumberOfProcessors(void) {
+	long nprocessors = sysconf(_SC_NPROCESSORS_ONLN);
+	return nprocessors > 0 ? (unsigned)nprocessors : 1;
+}
+
+/*
+ * operaThreadPool &getSharedPool(void)
+ * \brief returns the process-wide pool, created on first use
+ */
+static operaThreadPool *sharedPool = NULL;
+static pthread_once_t sharedPoolOnce = PTHREAD_ONCE_INIT;
+
+static void createSharedPool(void) {
+	sharedPool = new operaThreadPool();
+}
+
+operaThreadPool &operaThreadPool::getSharedPool(void) {
+	pthread_once(&sharedPoolOnce, createSharedPool);
+	return *sharedPool;
+}
@@ -0,0 +1,683 @@
+/*******************************************************************
+ ****                  MODULE FOR OPERA v1.0                    ****
+ *******************************************************************
+ Module name: espqld
+ Version: 1.0
+ Description: A resident quicklook daemon.
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>			// for max
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaFITSImage.h"
+#include "libraries/operaLib.h"
+#include "libraries/operaSpectralOrder.h"
+#include "libraries/operaSpectralOrderVector.h"
+#include "libraries/operaIOFormats.h"
+#include "libraries/operaThreadPool.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/*! \file espqld.cpp */
+
+using namespace std;
+
+/*!
+ * espqld
+ * \brief A resident quicklook daemon for use at CFHT while observing.
+ * \details espqlh runs the opera harness (operaExtractRawSum, then operaSNR) for every
+ * \details new frame, so each SNR estimate pays for several process start-ups and for
+ * \details re-reading the geometry, gain, wavelength and master bias. espqld keeps those
+ * \details resident, one set per instrument configuration (the harness QUALIFIERS),
+ * \details and does the raw sum extraction and SNR of all orders in process, in parallel
+ * \details over orders. New frames are picked up through inotify as soon as they are closed.
+ * \details Results go to stdout (director), are appended to a results file, and are sent
+ * \details to every client connected to an optional local (AF_UNIX) socket.
+ * \arg argc
+ * \arg argv
+ * \ingroup tools
+ * \return EXIT_STATUS
+ */
+
+/*
+ * The calibrations of one instrument configuration, kept for the whole night.
+ * The spectral elements of every order are laid out once, each frame only
+ * overwrites their flux and variance.
+ */
+class quicklookCalibration {
+public:
+	string qualifiers;
+	operaSpectralOrderVector spectralOrders;
+	operaFITSImage *bias;
+	double gain;
+	double noise;
+	time_t geometryTime;
+	vector<unsigned> orders;
+
+	quicklookCalibration() : bias(NULL), gain(1.0), noise(0.0), geometryTime(0) {};
+	~quicklookCalibration() { if (bias) { bias->operaFITSImageClose(); delete bias; } };
+};
+
+/*
+ * One frame being reduced, shared by the order tasks.
+ */
+class quicklookFrame {
+public:
+	quicklookCalibration *calibration;
+	operaFITSImage *image;
+	int upperlowerbounds;
+	vector<float> snr;
+};
+
+static const float defaultBias = 400.0;
+
+/* Print out the proper program usage syntax */
+static void printUsageSyntax() {
+	cout << " Usage: espqld --night=<basename of images directory> [--director] [--cd|--directory=<directory>] [--upenadir=<directory>] [--calibrationdir=<directory>] [--wave=<wcal file>] [--aperture=f] [--socket=<path>] [--results=<file>] --zip=.gz [--ordernumber=n] --saturation=f(65535.0) --maxsaturated=n(25) --updatelogbook --ccdbin -[vh]\n";
+}
+
+static time_t modificationTime(string filename) {
+	struct stat attrib;
+	if (stat(filename.c_str(), &attrib) != 0) {
+		return 0;
+	}
+	return attrib.st_mtime;
+}
+
+static double now(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec*1e-6;
+}
+
+static string firstWord(string value) {
+	istringstream ss(value);
+	string word;
+	ss >> word;
+	return word;
+}
+
+/*
+ * Same as the operagetmode script: Polarimetry -> pol, star+sky -> sp1, star only -> sp2.
+ */
+static string getMode(string instmode) {
+	istringstream ss(instmode);
+	string first, second;
+	ss >> first >> second;
+	if (first == "Polarimetry,") return "pol";
+	if (second == "star+sky,") return "sp1";
+	if (second == "star") return "sp2";
+	if (first == "TWOSLICE") return "sp1";
+	if (first == "FOURSLICE") return "sp2";
+	return "unknown";
+}
+
+/*
+ * The harness QUALIFIERS, $(DETECTOR)$(AMPLIFIER)_$(MODE)_$(SPEED),
+ * built from the same header keywords as operagetdetector, operagetamplifier and operagetspeed.
+ */
+static string getQualifiers(operaFITSImage &image, string &mode) {
+	string detector = firstWord(image.operaFITSGetHeaderValue("DETECTOR"));
+	string amplifier = image.operaFITSGetHeaderValue("AMPLIST");
+	if (amplifier.find(",") != string::npos) {
+		amplifier.erase(amplifier.find(","), 1);
+	}
+	amplifier = firstWord(amplifier);
+	string speed = firstWord(image.operaFITSGetHeaderValue("EREADSPD"));
+	if (speed.find(":") != string::npos) {
+		speed.erase(speed.find(":"), 1);
+	}
+	mode = getMode(image.operaFITSGetHeaderValue("INSTMODE"));
+	return detector + amplifier + "_" + mode + "_" + speed;
+}
+
+/*
+ * Read the calibrations of one configuration and lay out the spectral elements,
+ * as operaExtractRawSum does before extracting.
+ */
+static quicklookCalibration *loadCalibration(string calibrationdir, string qualifiers, string zipped, string wavefile, float aperture, unsigned ordernumber) {
+	string geometryfile = calibrationdir + qualifiers + ".geom" + zipped;
+	string gainfile = calibrationdir + qualifiers + ".gain" + zipped;
+	string biasfile = calibrationdir + "masterbias_" + qualifiers + ".fits" + zipped;
+
+	if (!fileexists(geometryfile) || !fileexists(gainfile)) {
+		return NULL;
+	}
+	quicklookCalibration *calibration = new quicklookCalibration();
+	try {
+		calibration->qualifiers = qualifiers;
+		calibration->geometryTime = modificationTime(geometryfile);
+		operaIOFormats::ReadIntoSpectralOrders(calibration->spectralOrders, geometryfile);
+		if (!wavefile.empty()) {
+			operaIOFormats::ReadIntoSpectralOrders(calibration->spectralOrders, wavefile);
+		}
+		operaIOFormats::ReadIntoSpectralOrders(calibration->spectralOrders, gainfile);
+		unsigned amp = 0;
+		calibration->gain = calibration->spectralOrders.getGainBiasNoise()->getGain(amp);
+		calibration->noise = calibration->spectralOrders.getGainBiasNoise()->getNoise(amp);
+		if (fileexists(biasfile)) {
+			calibration->bias = new operaFITSImage(biasfile, tfloat, READONLY);
+		}
+
+		unsigned minorder = calibration->spectralOrders.getMinorder();
+		unsigned maxorder = calibration->spectralOrders.getMaxorder();
+		if (ordernumber != 0) {
+			minorder = ordernumber;
+			maxorder = ordernumber;
+		}
+		const float spectralElementHeight = 1.0;
+		const unsigned xsampling = 5;
+		const unsigned extraAperturePixels = 2;
+		for (unsigned order=minorder; order<=maxorder; order++) {
+			operaSpectralOrder *spectralOrder = calibration->spectralOrders.GetSpectralOrder(order);
+			if (spectralOrder->gethasGeometry() && (wavefile.empty() || spectralOrder->gethasWavelength())) {
+				operaGeometry *geometry = spectralOrder->getGeometry();
+				spectralOrder->setInstrumentProfileVector((unsigned)aperture + 2*extraAperturePixels + 1, xsampling, 1, 1, 1);
+				geometry->setapertureWidth(aperture);
+				geometry->CalculateAndSetOrderLength();
+				spectralOrder->setSpectralElementsByHeight(spectralElementHeight);
+				if (!wavefile.empty()) {
+					spectralOrder->CalculateWavelengthSolution();
+				}
+				calibration->orders.push_back(order);
+			}
+		}
+	}
+	catch (...) {
+		delete calibration;
+		throw;
+	}
+	return calibration;
+}
+
+/*
+ * Extract and measure one order, called from the thread pool.
+ */
+static void reduceOrder(unsigned long index, void *context) {
+	quicklookFrame *frame = (quicklookFrame *)context;
+	operaSpectralOrder *spectralOrder = frame->calibration->spectralOrders.GetSpectralOrder(frame->calibration->orders[index]);
+	spectralOrder->extractRawSum(*frame->image, frame->calibration->noise, frame->calibration->gain);
+	spectralOrder->calculateSNR();
+	frame->snr[index] = spectralOrder->getCentralSmoothedSNR(frame->upperlowerbounds);
+}
+
+/*
+ * Send a result line to the results file and to all socket clients, dropping clients that went away.
+ */
+static void publish(string line, string resultsfile, vector<int> &clients) {
+	if (!resultsfile.empty()) {
+		ofstream results(resultsfile.c_str(), ios::app);
+		if (results.is_open()) {
+			results << line << endl;
+			results.close();
+		}
+	}
+	string message = line + "\n";
+	for (vector<int>::iterator client = clients.begin(); client != clients.end(); ) {
+		if (send(*client, message.c_str(), message.size(), MSG_NOSIGNAL) < 0) {
+			close(*client);
+			client = clients.erase(client);
+		} else {
+			client++;
+		}
+	}
+}
+
+static int openListeningSocket(string path) {
+	struct sockaddr_un address;
+	if (path.size() >= sizeof(address.sun_path)) {
+		throw operaException("espqld: socket path too long: "+path, operaErrorInvalidParameter, __FILE__, __FUNCTION__, __LINE__);
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		throw operaException("espqld: "+path+" ", errno, __FILE__, __FUNCTION__, __LINE__);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+	unlink(path.c_str());	// left over from a previous night
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 8) != 0) {
+		int error = errno;
+		close(fd);
+		throw operaException("espqld: "+path+" ", error, __FILE__, __FUNCTION__, __LINE__);
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+static bool isQuicklookFrame(string basefilename) {
+	const char *suffixes[] = {"o.fits", "f.fits", "a.fits"};
+	for (unsigned i=0; i<3; i++) {
+		string suffix = suffixes[i];
+		if (basefilename.size() > suffix.size() && basefilename.compare(basefilename.size()-suffix.size(), suffix.size(), suffix) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	string upenadir = "/data/niele/espadons/opera/";
+	string directory = "/data/niele/espadons/";
+	string operainstalldir = "~/opera-1.0/";
+	string calibrationdir;
+	string wavefile;
+	string socketpath;
+	string resultsfile;
+	string night;
+	string zipped = ".gz";
+	bool director = false;
+	bool updatelogbook = false;
+	float saturation = 65535.0;
+	unsigned maxSaturatedCount = 25;
+	unsigned ordernumber = 0;
+	float aperture = 0.0;			// 0: the harness default for the instrument mode
+	const string info4 = "info4: ";
+	const string logonly = "logonly: ";
+	int upperlowerbounds = 1000;
+	unsigned waittime = 1;
+	bool isPolar = false;
+	float polarAccumulatedSNR = 0.0;
+	float ccdbin = 1.0;
+
+	int verbose=false;
+
+	struct option longopts[] = {
+		{"cd",				1, NULL, 'c'},	// where to look for inputs
+		{"directory",		1, NULL, 'y'},	// where to look for inputs
+		{"night",			1, NULL, 'n'},	// night directory
+		{"upenadir",		1, NULL, 'u'},	// upena output directory
+		{"calibrationdir",	1, NULL, 'C'},	// default: upenadir/calibrations/night/
+		{"wave",			1, NULL, 'W'},	// default: $opera/config/wcal_ref.dat.gz
+		{"aperture",		1, NULL, 'A'},	// extraction aperture width in pixels
+		{"socket",			1, NULL, 'S'},	// local socket results are sent to
+		{"results",			1, NULL, 'R'},	// default: upenadir/spectra/night/quicklook.snr
+		{"director",		0, NULL, 'r'},	// are we running in director?
+		{"zip",				1, NULL, 'z'},	// calibrations are zipped, i.e. ".gz"
+		{"ordernumber",		1, NULL, 'o'},	// show only specific order
+		{"saturation",		1, NULL, 's'},	// set saturation limit	value in ADU
+		{"maxsaturated",	1, NULL, 'm'},	// set saturation count
+		{"wait",			1, NULL, 'w'},	// polling period without inotify
+		{"updatelogbook",	0, NULL, 'l'},	// update the CFHT logbook with peak SNR
+		{"upperlowerbounds",1, NULL, 'b'},	// upper lower bounds for smoothing
+		{"ccdbin",			0, NULL, 'i'},	// ccd bin stats
+
+		{"verbose",			0, NULL, 'v'},
+		{"help",			0, NULL, 'h'},
+		{0,0,0,0}};
+
+	while ((opt = getopt_long(argc, argv, "c:y:n:u:C:W:A:S:R:rz:o:s:m:w:lb:ivh", longopts, NULL))  != -1) {
+		switch (opt) {
+			case 'c':
+			case 'y':
+				directory = optarg;
+				break;
+			case 'n':
+				night = optarg;
+				break;
+			case 'u':
+				upenadir = optarg;
+				break;
+			case 'C':
+				calibrationdir = optarg;
+				break;
+			case 'W':
+				wavefile = optarg;
+				break;
+			case 'A':
+				aperture = atof(optarg);
+				break;
+			case 'S':
+				socketpath = optarg;
+				break;
+			case 'R':
+				resultsfile = optarg;
+				break;
+			case 'r':
+				director = true;
+				break;
+			case 'z':
+				zipped = optarg;
+				break;
+			case 'o':
+				ordernumber = atoi(optarg);
+				break;
+			case 's':
+				saturation = atof(optarg);
+				break;
+			case 'm':
+				maxSaturatedCount = atoi(optarg);
+				break;
+			case 'w':
+				waittime = atoi(optarg);
+				break;
+			case 'l':
+				updatelogbook = true;
+				break;
+			case 'b':
+				upperlowerbounds = atoi(optarg);
+				break;
+			case 'i':
+				ccdbin = sqrt(2.6/1.8);
+				break;
+
+			case 'v':
+				verbose = true;
+				break;
+			case 'h':
+				printUsageSyntax();
+				exit(EXIT_SUCCESS);
+				break;
+			default:
+				printUsageSyntax();
+				exit(EXIT_SUCCESS);
+				break;
+		}	// switch
+	}	// while
+
+	std::map<string, quicklookCalibration *> calibrations;
+	vector<int> clients;
+	int listener = -1;
+	int watcher = -1;
+
+	try {
+		if (night.empty()) {
+			throw operaException("espqld: Please specify --night=<directory> ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+		}
+		char *prefix = getenv("opera");
+		if (prefix != NULL) {
+			operainstalldir = string(prefix);
+		}
+		string currentfilename = directory+"/current.fits";
+		directory += night + "/";
+		if (!fileexists(directory)) {
+			throw operaException("espqld: Directory does not exist: "+directory, operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+		}
+		if (calibrationdir.empty()) {
+			calibrationdir = upenadir + "/calibrations/" + night + "/";
+		}
+		if (wavefile.empty()) {
+			wavefile = operainstalldir + "/config/wcal_ref.dat" + zipped;
+		}
+		if (resultsfile.empty()) {
+			resultsfile = upenadir + "/spectra/" + night + "/quicklook.snr";
+		}
+		if (!socketpath.empty()) {
+			listener = openListeningSocket(socketpath);
+		}
+#ifdef __linux__
+		watcher = inotify_init();
+		if (watcher >= 0 && inotify_add_watch(watcher, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			close(watcher);
+			watcher = -1;
+		}
+#endif
+		if (verbose) {
+			cout << (director?logonly:"") << "Starting quicklook daemon (espqld) in directory: '" << directory << "' calibrations: '" << calibrationdir << "' results: '" << resultsfile << "'" << (socketpath.empty()?"":" socket: '"+socketpath+"'") << (watcher < 0?" polling current.fits":"") << endl;
+		}
+		time_t oldtime = 0;
+		/*
+		 * loop forever
+		 */
+		while (true) {
+			vector<string> newframes;
+			fd_set readfds;
+			FD_ZERO(&readfds);
+			int maxfd = -1;
+			if (watcher >= 0) {
+				FD_SET(watcher, &readfds);
+				maxfd = max(maxfd, watcher);
+			}
+			if (listener >= 0) {
+				FD_SET(listener, &readfds);
+				maxfd = max(maxfd, listener);
+			}
+			struct timeval timeout;
+			timeout.tv_sec = waittime;
+			timeout.tv_usec = 0;
+			int ready = select(maxfd+1, &readfds, NULL, NULL, watcher >= 0 ? NULL : &timeout);
+			if (ready < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw operaException("espqld: ", errno, __FILE__, __FUNCTION__, __LINE__);
+			}
+			if (listener >= 0 && FD_ISSET(listener, &readfds)) {
+				int client;
+				while ((client = accept(listener, NULL, NULL)) >= 0) {
+					clients.push_back(client);
+				}
+			}
+#ifdef __linux__
+			if (watcher >= 0 && FD_ISSET(watcher, &readfds)) {
+				char buffer[16*(sizeof(struct inotify_event)+NAME_MAX+1)];
+				ssize_t length = read(watcher, buffer, sizeof(buffer));
+				for (ssize_t offset = 0; offset < length; ) {
+					struct inotify_event *event = (struct inotify_event *)(buffer + offset);
+					if (event->len > 0 && isQuicklookFrame(event->name)) {
+						newframes.push_back(event->name);
+					}
+					offset += sizeof(struct inotify_event) + event->len;
+				}
+			}
+#endif
+			if (watcher < 0 && fileexists(currentfilename)) {
+				time_t mtime = modificationTime(currentfilename);
+				string actualfilename;
+				if (mtime != oldtime && getRealFileName(currentfilename, actualfilename)) {
+					oldtime = mtime;
+					if (actualfilename.find_last_of("/") != string::npos) {
+						actualfilename = actualfilename.substr(actualfilename.find_last_of("/")+1);
+					}
+					newframes.push_back(actualfilename);
+				}
+			}
+
+			for (unsigned f=0; f<newframes.size(); f++) {
+				string basefilename = newframes[f];
+				string filename = directory + basefilename;
+				try {
+					if (!fileexists(filename)) {
+						continue;
+					}
+					double start = now();
+					operaFITSImage image(filename, tfloat, READONLY);
+					string etype = image.operaFITSGetHeaderValue("EXPTYPE");
+					if (etype != "FLAT" && etype != "ALIGN" && etype != "OBJECT") {
+						cout << (director?info4:"") << basefilename << endl;
+						image.operaFITSImageClose();
+						continue;
+					}
+					string odometer = basefilename.substr(0, basefilename.find_first_not_of("0123456789"));
+					if (verbose) {
+						cout << (director?logonly:"") << "quicklook processing image " << basefilename << endl;
+					}
+					unsigned saturatedCount = 0;
+					float peakPixelValue = 0.0;
+					unsigned maxx = image.getnaxis1();
+					unsigned maxy = image.getnaxis2();
+					for (unsigned j=0; j<maxy; j++) {
+						for (unsigned i=0; i<maxx; i++) {
+							float fluxValue = image[j][i];
+							if (fluxValue >= saturation) {
+								saturatedCount++;
+							}
+							if (fluxValue >= peakPixelValue) {
+								peakPixelValue = fluxValue;
+							}
+						}
+					}
+					int peakSaturation = (int)(peakPixelValue/saturation*100.0);
+					if (etype == "FLAT" || etype == "ALIGN") {
+						cout << (director?info4:"") << basefilename << ": " << (saturatedCount==0?"zero":itos(saturatedCount)) << " saturated pixels, peak saturation: " << peakSaturation << "%" << endl;
+						publish(basefilename + " EXPTYPE=" + etype + " SATURATED=" + itos(saturatedCount) + " PEAKSAT=" + itos(peakSaturation), resultsfile, clients);
+					}
+					if (saturatedCount > maxSaturatedCount) {
+						cout << (director?info4:"") << "warning: " << basefilename << ": " << saturatedCount << " pixels above saturation limit of " << saturation << " ADU." << endl;
+					}
+					if (etype != "OBJECT") {
+						image.operaFITSImageClose();
+						continue;
+					}
+					unsigned polarSequence = 0;
+					string instmode = image.operaFITSGetHeaderValue("INSTMODE");
+					isPolar = instmode.find("Polarimetry") != string::npos;
+					if (isPolar) {
+						string polarsequencestring = image.operaFITSGetHeaderValue("CMMTSEQ"); // QUIV exposure i, sequence m of n
+						polarSequence = atoi(polarsequencestring.substr(11,1).c_str());
+					}
+					string mode;
+					string qualifiers = getQualifiers(image, mode);
+
+					/*
+					 * find the resident calibrations, (re)loading them when the geometry is new
+					 */
+					quicklookCalibration *calibration = calibrations[qualifiers];
+					string geometryfile = calibrationdir + qualifiers + ".geom" + zipped;
+					if (calibration != NULL && calibration->geometryTime != modificationTime(geometryfile)) {
+						delete calibration;
+						calibration = calibrations[qualifiers] = NULL;
+					}
+					if (calibration == NULL) {
+						float modeAperture = aperture;
+						if (modeAperture == 0.0) {
+							modeAperture = (mode == "sp2" ? 30.0 : 32.0);	// harness sp1/sp2/pol_apertureWidth
+						}
+						calibration = calibrations[qualifiers] = loadCalibration(calibrationdir, qualifiers, zipped, wavefile, modeAperture, ordernumber);
+						if (calibration == NULL) {
+							cout << (director?info4:"") << basefilename << ": no calibrations for " << qualifiers << " in " << calibrationdir << endl;
+							image.operaFITSImageClose();
+							continue;
+						}
+						if (verbose) {
+							cout << (director?logonly:"") << "Loaded calibrations " << qualifiers << " (" << calibration->orders.size() << " orders)" << endl;
+						}
+					}
+					if (calibration->bias != NULL && calibration->bias->getnaxis1() == maxx && calibration->bias->getnaxis2() == maxy) {
+						image -= *calibration->bias;
+					} else {
+						image -= defaultBias;
+					}
+
+					quicklookFrame frame;
+					frame.calibration = calibration;
+					frame.image = &image;
+					frame.upperlowerbounds = upperlowerbounds;
+					frame.snr.resize(calibration->orders.size(), 0.0);
+					operaThreadPool::getSharedPool().parallelFor(calibration->orders.size(), reduceOrder, (void *)&frame);
+					image.operaFITSImageClose();
+
+					float peak = 0.0;
+					unsigned orderofmax = 0;
+					for (unsigned o=0; o<calibration->orders.size(); o++) {
+						if (peak < frame.snr[o]) {
+							peak = frame.snr[o];
+							orderofmax = calibration->orders[o];
+						}
+						if (verbose) {
+							cout << (director?logonly:"") << "Peak SNR for " << basefilename << " order " << calibration->orders[o] << " : " << frame.snr[o] << " / " << ftos(frame.snr[o]*ccdbin) << endl;
+						}
+					}
+					peak *= ccdbin;	// per spectral bin / per CCD bin
+					if (isPolar) {
+						polarAccumulatedSNR += peak*ccdbin;
+					} else {
+						polarAccumulatedSNR = 0.0;
+					}
+					double seconds = now() - start;
+					if (updatelogbook) {
+						systemf("%s/bin/wiropdb \"update op..xexp set snr=%d where _obsid=%d\"", operainstalldir.c_str(), (int)(peak+0.5), atoi(odometer.c_str()));
+					}
+					cout << (director?info4:"") << basefilename << ": peak saturation: " << peakSaturation << "%, " << "SNR: " << ((int)peak) << " / " << itos((int)(peak*ccdbin+0.5)) << (isPolar?(" ACC "+itos(polarSequence)+"/4: "+itos((int)polarAccumulatedSNR)):"") << endl;
+					if (verbose) {
+						cout << (director?logonly:"") << "Reduction of " << basefilename << " complete in " << ftos(seconds) << "s." << endl;
+					}
+					ostringstream line;
+					line << basefilename << " EXPTYPE=OBJECT QUALIFIERS=" << qualifiers << " SATURATED=" << saturatedCount << " PEAKSAT=" << peakSaturation << " SNR=" << (int)peak << " SNRCCD=" << (int)(peak*ccdbin+0.5) << " ORDER=" << orderofmax;
+					if (isPolar) {
+						line << " POLARSEQ=" << polarSequence << " ACCSNR=" << (int)polarAccumulatedSNR;
+					}
+					line << " SECONDS=" << seconds;
+					publish(line.str(), resultsfile, clients);
+					if (isPolar && polarSequence == 4) {
+						polarAccumulatedSNR = 0.0;
+					}
+				}
+				catch (const operaException &e) {
+					if (verbose) {
+						cout << (director?logonly:"") << "espqld: " << basefilename << ": " << e.getFormattedMessage() << endl;
+					}
+					// keep going....
+				}
+				catch (...) {
+					// keep going....
+				}
+			}
+		}
+	}
+	catch (const operaException &e) {
+		cerr << "espqld: " << e.getFormattedMessage() << endl;
+		return EXIT_FAILURE;
+	}
+	catch (...) {
+		cerr << "espqld: " << operaStrError(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+/*******************************************************************
+ ****                  MODULE FOR OPERA v1.0                    ****
+ *******************************************************************
+ Module name: operaBuildLineDatabase
+ Version: 1.0
+ Description: Convert a reference line list or atlas to a memory-mappable line database
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2011  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+#include "libraries/operaArgumentHandler.h"
+#include "libraries/operaException.h"
+#include "libraries/operaLineDatabase.h"
+
+/*! \file operaBuildLineDatabase.cpp */
+
+/*!
+ * operaBuildLineDatabase
+ * \brief Convert a reference line list or atlas to a memory-mappable line database
+ * \details The output defaults to operaLineDatabase::getBinaryFilename(input), where the modules
+ * look for it. It is used as long as it is not older than the text file.
+ * \arg argc
+ * \arg argv
+ * \note --input=...
+ * \note --output=...
+ * \note --format=hitran|raw|thar|atlas
+ * \throws operaException operaErrorNoInput
+ * \throws operaException operaErrorNoOuput
+ * \return EXIT_STATUS
+ * \ingroup tools
+ */
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+	operaArgumentHandler args;
+
+	string input;
+	string output;
+	string format;
+	args.AddRequiredArgument("input", input, "text line list or atlas, may be gzipped");
+	args.AddOptionalArgument("output", output, string(), "line database to write, defaults to the input without .gz plus " LINEDATABASE_EXTENSION);
+	args.AddRequiredArgument("format", format, "hitran (telluric HITRAN), raw (wavelength intensity), thar (ThAr atlas lines) or atlas (atlas spectrum)");
+
+	try {
+		args.Parse(argc, argv);
+
+		if (input.empty()) {
+			throw operaException("operaBuildLineDatabase: ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+		}
+		operaLineFormat_t lineformat;
+		if (format == "hitran") lineformat = LineFormatHITRAN;
+		else if (format == "raw") lineformat = LineFormatRaw;
+		else if (format == "thar") lineformat = LineFormatThAr;
+		else if (format == "atlas") lineformat = LineFormatAtlasSpectrum;
+		else {
+			throw operaException("operaBuildLineDatabase: "+format+" ", operaErrorInvalidParameter, __FILE__, __FUNCTION__, __LINE__);
+		}
+		if (output.empty()) {
+			output = operaLineDatabase::getBinaryFilename(input);
+		}
+
+		operaSpectrum table = operaLineDatabase::readText(input, lineformat);
+		if (table.empty()) {
+			throw operaException("operaBuildLineDatabase: "+input+" ", operaErrorNoInput, __FILE__, __FUNCTION__, __LINE__);
+		}
+		operaLineDatabase::write(output, table, operaLineDatabase::hasVarianceColumn(lineformat));
+
+		if (args.verbose) {
+			printf("operaBuildLineDatabase: %s: %u rows wl0=%.4f wlf=%.4f -> %s\n", input.c_str(), table.size(), table.firstwl(), table.lastwl(), output.c_str());
+		}
+	}
+	catch (const operaException &e) {
+		cerr << "operaBuildLineDatabase: " << e.getFormattedMessage() << endl;
+		return EXIT_FAILURE;
+	}
+	catch (...) {
+		cerr << "operaBuildLineDatabase: " << operaStrError(errno) << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
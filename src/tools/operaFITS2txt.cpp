@@ -48,12 +48,64 @@
 #include "fitsio.h"
 #include "globaldefines.h"
 #include "operaError.h"
-#include "libraries/operaLib.h"
+#include "libraries/operaLib.h"			// for formatFixed, formatScientific
+#include "libraries/operaThreadPool.h"
 #include "tools/operaFits2txt.h"
 
 /*! \file operaFits2txt.cpp */
 /*! \author Eder Maritoli */
 
+/*
+ * The Libre-Esprit text files of a product, one per option (normalized or not, with or without autowave),
+ * the ncols columns of option k being rows k*ncols to (k+1)*ncols-1 of pixels.
+ */
+class fits2txtJob {
+public:
+	long npixels;
+	int ncols;
+	const double *pixels;
+	const char *object;
+	unsigned int col;								// print column names
+	char *outputs[4];
+	char keycol[4][MAXCOLS][FLEN_VALUE];
+	
+	/*
+	 * write the rows of one option as "  %8.4f" then " %11.4e" per column
+	 */
+	static void writeOption(unsigned long option, void *context) {
+		fits2txtJob *job = (fits2txtJob *)context;
+		const long npixels = job->npixels;
+		const int ncols = job->ncols;
+		const double *wlpix = job->pixels + option*ncols*npixels;
+		FILE *fout = fopen(job->outputs[option],"w");
+		if (fout == NULL)
+			return;
+		
+		fprintf(fout,"***Reduced spectrum of %s\n",job->object);  
+		fprintf(fout," %ld %d\n",npixels,ncols-1);
+		if (job->col == 1) {      
+			fprintf(fout,"%s",job->keycol[option][0]);
+			for(int i=1;i<ncols;i++)
+				fprintf(fout," %s",job->keycol[option][i]);
+			fprintf(fout,"\n");      
+		}  
+		char line[320*MAXCOLS+4];		// %f of the largest double has 316 characters
+		for(long ii=0; ii< npixels; ii++) {
+			unsigned length = 0;
+			line[length++] = ' ';
+			line[length++] = ' ';
+			length += formatFixed(line+length, sizeof(line)-length, wlpix[ii], 8, 4);
+			for(int i=1;i<ncols;i++) {
+				line[length++] = ' ';
+				length += formatScientific(line+length, sizeof(line)-length, wlpix[i*npixels+ii], 11, 4);
+			}
+			line[length++] = '\n';
+			fwrite(line, 1, length, fout);
+		}
+		fclose(fout);
+	}
+};
+
 /*! 
  * operaFits2txt
  * \brief command line interface to create Libre-Esprit-compatible text files from packed FITS.
@@ -78,17 +130,15 @@ int main(int argc, char *argv[])
 	unsigned int isCompressed = 0; // we may received either compressed or uncompressed files as input
 	
 	int status = 0;
-	int naxis = 0, ii = 0, ncols = 0;
+	int naxis = 0, ncols = 0;
 	long naxes[2] = {1,1};
 	long npixels = 1, firstpix[2] = {1,1};
 	fitsfile *fptr = NULL;
 	char keyobjname[FLEN_VALUE], comment[FLEN_COMMENT], keyobsmode[FLEN_VALUE];
 	char pol_str[FLEN_VALUE], sp1_str[FLEN_VALUE], sp2_str[FLEN_VALUE];
-	char keycolwl[FLEN_VALUE], keycol[MAXCOLS][FLEN_VALUE];
 	char colnamewl[FLEN_VALUE], colname[MAXCOLS][FLEN_VALUE];
 	FILE *fout = NULL;
 	double *wlpix = NULL; 
-	double *pix[MAXCOLS];    
 	int option=0, nopt=0;  
 	int curKey=0, numKey=0, ord=0, nord=0, wl=0, snr1=0, snr2=0;
 	char card[FLEN_CARD], skip[FLEN_CARD];
@@ -378,7 +428,14 @@ int main(int argc, char *argv[])
 			return(EXIT_FAILURE);       
 		}
 		
-		wlpix = new double[npixels]; /* mem for 1 row */
+		if (polar == 0) {
+			nopt = 4;
+		} else if (polar == 1) {
+			nopt = 2;
+		}   
+		
+		/* the ncols columns of each of the nopt spectra are consecutive rows of the image, read them all as one block */
+		wlpix = new double[npixels*ncols*nopt]; /* mem for ncols rows per option */
 		if (wlpix == NULL) {
 			if (debug)
 				fprintf(stderr, "\nError: (%s:%s:%d)\n", __FILE__, __func__, __LINE__);    
@@ -386,22 +443,6 @@ int main(int argc, char *argv[])
 			return(EXIT_FAILURE); 
 		}
 		
-		for (i=1; i<ncols; i++) {
-			pix[i] = new double[npixels]; /* mem for 1 row */
-			if (pix[i] == NULL) {
-				if (debug)
-					fprintf(stderr, "\nError: (%s:%s:%d)\n", __FILE__, __func__, __LINE__);    
-				print_operaFits2txt_err(7);  
-				return(EXIT_FAILURE); 
-			}    
-		}
-		
-		if (polar == 0) {
-			nopt = 4;
-		} else if (polar == 1) {
-			nopt = 2;
-		}   
-		
 		if (fits_get_hdrspace(fptr, &numKey, NULL, &status))
 			printerror( status );
 		
@@ -438,65 +479,39 @@ int main(int argc, char *argv[])
 		}
 		fclose(fout);
 		
-		for(option=0;option<nopt;option++)
-		{
-			/********* Read data *************/  
-			firstpix[1] = option*ncols + 1;
-			if (fits_read_pix(fptr, TDOUBLE, firstpix, npixels, NULL, wlpix,NULL, &status)) 
-				printerror( status );  
-			
-			if (col == 1) {
-				sprintf(colnamewl,"COL%ld",firstpix[1]);
-				if (fits_read_keyword(fptr,colnamewl, keycolwl, comment, &status) )
+		/********* Read data *************/  
+		firstpix[1] = 1;
+		if (fits_read_pix(fptr, TDOUBLE, firstpix, npixels*ncols*nopt, NULL, wlpix,NULL, &status)) 
+			printerror( status );  
+		
+		fits2txtJob job;
+		job.npixels = npixels;
+		job.ncols = ncols;
+		job.pixels = wlpix;
+		job.object = keyobjname;
+		job.col = col;
+		job.outputs[0] = outputn;	//norm, wave
+		job.outputs[1] = outputu;	//no-norm, wave
+		job.outputs[2] = outputnw;	//norm; no-wave
+		job.outputs[3] = outputuw;	//no-norm; no-wave
+		
+		if (col == 1) {
+			for(option=0;option<nopt;option++) {
+				sprintf(colnamewl,"COL%d",option*ncols + 1);
+				if (fits_read_keyword(fptr,colnamewl, job.keycol[option][0], comment, &status) )
 					printerror( status );
-			}
-			
-			for(i=1; i<ncols; i++) {  
-				firstpix[1] = option*ncols + i + 1;
-				if (fits_read_pix(fptr, TDOUBLE, firstpix, npixels, NULL, pix[i],NULL, &status)) 
-					printerror( status );
-				
-				if (col == 1) {
-					sprintf(colname[i],"COL%ld",firstpix[1]);
-					if (fits_read_keyword(fptr,colname[i], keycol[i], comment, &status) )
+				for(i=1; i<ncols; i++) {  
+					sprintf(colname[i],"COL%d",option*ncols + i + 1);
+					if (fits_read_keyword(fptr,colname[i], job.keycol[option][i], comment, &status) )
 						printerror( status ); 
 				}     
 			}       
-			
-			/*********************************/   
-			//--- Write output file ---------              
-			if (option == 0) { //norm, wave
-				fout = fopen(outputn,"w");        
-			} else if (option == 1) { //no-norm, wave
-				fout = fopen(outputu,"w");
-			} else if (option == 2) { //norm; no-wave
-				fout = fopen(outputnw,"w");
-			} else if (option == 3) { //no-norm; no-wave
-				fout = fopen(outputuw,"w");
-			}      
-			
-			fprintf(fout,"***Reduced spectrum of %s\n",keyobjname);  
-			fprintf(fout," %ld %d\n",npixels,ncols-1);
-			if (col == 1) {      
-				fprintf(fout,"%s",keycolwl);
-				for(i=1;i<ncols;i++)
-					fprintf(fout," %s",keycol[i]);
-				fprintf(fout,"\n");      
-			}  
-			//-------------------------------
-			for(ii=0; ii< npixels; ii++) {
-				fprintf(fout,"  %8.4f",wlpix[ii]);
-				for(i=1;i<ncols;i++)
-					fprintf(fout," %11.4e",pix[i][ii]);
-				fprintf(fout,"\n");      
-			}
-			fclose(fout);
-			//--------------------------------  
 		}
 		
-		free(wlpix);
-		for(i=1;i<ncols;i++)
-			free(pix[i]);
+		/* the nopt output files are independent, format them concurrently */
+		operaThreadPool::getSharedPool().parallelFor(nopt, fits2txtJob::writeOption, &job);
+		
+		delete[] wlpix;
 		
 		if ( fits_close_file(fptr, &status) )
 			printerror( status );
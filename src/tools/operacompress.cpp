@@ -42,6 +42,7 @@
 #include "operaError.h"
 #include "libraries/operaException.h"
 #include "libraries/operaFITSImage.h"
+#include "libraries/operaFITSTileCompression.h"
 
 /*! \file operacompress.cpp */
 
@@ -159,6 +160,7 @@ int main(int argc, char *argv[])
 					break;    
 				case 'u':
 					uncompress = true;
+					compression = cNone;
 					break;
 					
 				case 'v':
@@ -291,40 +293,64 @@ int main(int argc, char *argv[])
 							break;
 					}
 					
-					bytepix = abs(bitpix) / 8;
+					/*
+					 * Single-plane integer images are compressed / decompressed tile-parallel
+					 * in one piece, everything else is streamed through cfitsio below.
+					 */
+					bool copied = false;
+					int equivtype = 0;
+					fits_get_img_equivtype(infptr, &equivtype, &status);
+					edatatype tiledatatype = (equivtype == USHORT_IMG ? tushort : (equivtype == SHORT_IMG ? tshort : tbyte));
+					if (naxis == 2 && (equivtype == BYTE_IMG || equivtype == SHORT_IMG || equivtype == USHORT_IMG) && !status) {
+						void *image = malloc(totpix * sizeof(short));
+						if (image) {
+							if (!operaReadTileCompressedPixels(infptr, tiledatatype, image, totpix)) {
+								fits_read_img(infptr, tiledatatype, 1, totpix, NULL, image, &anynul, &status);
+							}
+							if (!status && !operaWriteTileCompressedPixels(outfptr, tiledatatype, image, totpix)) {
+								fits_write_img(outfptr, tiledatatype, 1, totpix, image, &status);
+							}
+							free(image);
+							copied = true;
+						}
+					}
 					
-					npix = totpix;
-					iteration = 0;
+					if (!copied) {
+						bytepix = abs(bitpix) / 8;
 					
-					/* try to allocate memory for the entire image */
-					/* use double type to force memory alignment */
-					array = (double *) calloc(npix, bytepix);
+						npix = totpix;
+						iteration = 0;
 					
-					/* if allocation failed, divide size by 2 and try again */
-					while (!array && iteration < 10)  {
-						iteration++;
-						npix = npix / 2;
+						/* try to allocate memory for the entire image */
+						/* use double type to force memory alignment */
 						array = (double *) calloc(npix, bytepix);
-					}
 					
-					if (!array)  {
-						printf("operacompress: Memory allocation error\n");
-						return(EXIT_FAILURE);
-					}
+						/* if allocation failed, divide size by 2 and try again */
+						while (!array && iteration < 10)  {
+							iteration++;
+							npix = npix / 2;
+							array = (double *) calloc(npix, bytepix);
+						}
+					
+						if (!array)  {
+							printf("operacompress: Memory allocation error\n");
+							return(EXIT_FAILURE);
+						}
 					
-					/* turn off any scaling so that we copy the raw pixel values */
-					fits_set_bscale(infptr,  bscale, bzero, &status);
-					fits_set_bscale(outfptr, bscale, bzero, &status);
+						/* turn off any scaling so that we copy the raw pixel values */
+						fits_set_bscale(infptr,  bscale, bzero, &status);
+						fits_set_bscale(outfptr, bscale, bzero, &status);
 					
-					first = 1;
-					while (totpix > 0 && !status) {
-						/* read all or part of image then write it back to the output file */
-						fits_read_img(infptr, datatype, first, npix, &nulval, array, &anynul, &status);
-						fits_write_img(outfptr, datatype, first, npix, array, &status);
-						totpix = totpix - npix;
-						first  = first  + npix;
+						first = 1;
+						while (totpix > 0 && !status) {
+							/* read all or part of image then write it back to the output file */
+							fits_read_img(infptr, datatype, first, npix, &nulval, array, &anynul, &status);
+							fits_write_img(outfptr, datatype, first, npix, array, &status);
+							totpix = totpix - npix;
+							first  = first  + npix;
+						}
+						free(array);
 					}
-					free(array);
 				}
 				
 				if (single) 
@@ -344,7 +370,7 @@ int main(int argc, char *argv[])
 #endif
 		}
 	}
-	catch (operaException e) {
+	catch (const operaException &e) {
 		cerr << "operacompress: " << e.getFormattedMessage() << endl;
 		return EXIT_FAILURE;
 	}
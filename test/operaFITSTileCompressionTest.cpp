@@ -0,0 +1,134 @@
+/*******************************************************************
+ ****                  MODULE FOR OPERA v1.0                    ****
+ *******************************************************************
+ Module name: operaFITSTileCompressionTest
+ Version: 1.0
+ Description: Round trip images through the tile-parallel compression and through cfitsio.
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2016  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <iostream>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaFITSImage.h"
+#include "libraries/operaFITSTileCompression.h"
+
+/*! \file operaFITSTileCompressionTest.cpp */
+
+using namespace std;
+
+/*!
+ * operaFITSTileCompressionTest
+ * \author Doug Teeple
+ * \brief Compress a ushort image tile by tile in parallel with each lossless method, read it back
+ * \brief with cfitsio, then compress it with cfitsio and read it back tile by tile in parallel.
+ * \note The image is 517x263 in tiles of 100x37, so the last tiles are partial.
+ * \return EXIT_STATUS
+ * \ingroup test
+ */
+int main()
+{
+	const long naxis1 = 517, naxis2 = 263;
+	const unsigned long npixels = naxis1*naxis2;
+	long naxes[2] = {naxis1, naxis2};
+	long tiles[2] = {100, 37};
+	long fpixel[2] = {1, 1};
+	int compressions[3] = {RICE_1, GZIP_1, HCOMPRESS_1};
+	string names[3] = {"RICE_1", "GZIP_1", "HCOMPRESS_1"};
+	string filename = "/tmp/operaFITSTileCompressionTest.fits.fz";
+
+	unsigned short *image = (unsigned short *)malloc(npixels*sizeof(unsigned short));
+	unsigned short *readback = (unsigned short *)malloc(npixels*sizeof(unsigned short));
+	srand(time(NULL));
+	for (long y=0; y<naxis2; y++) {
+		for (long x=0; x<naxis1; x++) {
+			image[y*naxis1+x] = (unsigned short)(30000 + 20000*sin(x/40.0)*cos(y/25.0) + rand()%500);
+		}
+	}
+	image[0] = 65535;
+
+	try {
+		for (unsigned c=0; c<3; c++) {
+			fitsfile *fptr;
+			int status = 0, hdutype;
+			bool handled;
+
+			fits_create_file(&fptr, ("!"+filename).c_str(), &status);
+			fits_set_compression_type(fptr, compressions[c], &status);
+			fits_set_tile_dim(fptr, 2, tiles, &status);
+			fits_create_img(fptr, USHORT_IMG, 2, naxes, &status);
+			handled = operaWriteTileCompressedPixels(fptr, tushort, image, npixels);
+			fits_close_file(fptr, &status);
+			memset(readback, 0, npixels*sizeof(unsigned short));
+			fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+			fits_movabs_hdu(fptr, 2, &hdutype, &status);
+			fits_read_pix(fptr, TUSHORT, fpixel, npixels, NULL, readback, NULL, &status);
+			fits_close_file(fptr, &status);
+			if (status) {
+				throw operaException("operaFITSTileCompressionTest: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+			}
+			cout << names[c] << " parallel compression " << (handled ? "done" : "not handled") << ", read back by cfitsio: "
+				<< (memcmp(image, readback, npixels*sizeof(unsigned short)) ? "DIFFERENT" : "identical") << endl;
+
+			fits_create_file(&fptr, ("!"+filename).c_str(), &status);
+			fits_set_compression_type(fptr, compressions[c], &status);
+			fits_set_tile_dim(fptr, 2, tiles, &status);
+			fits_create_img(fptr, USHORT_IMG, 2, naxes, &status);
+			fits_write_pix(fptr, TUSHORT, fpixel, npixels, image, &status);
+			fits_close_file(fptr, &status);
+			memset(readback, 0, npixels*sizeof(unsigned short));
+			fits_open_file(&fptr, filename.c_str(), READONLY, &status);
+			fits_movabs_hdu(fptr, 2, &hdutype, &status);
+			handled = operaReadTileCompressedPixels(fptr, tushort, readback, npixels);
+			fits_close_file(fptr, &status);
+			if (status) {
+				throw operaException("operaFITSTileCompressionTest: cfitsio error "+filename+" ", (operaErrorCode)status, __FILE__, __FUNCTION__, __LINE__);
+			}
+			cout << names[c] << " cfitsio compression, parallel decompression " << (handled ? "done" : "not handled") << ": "
+				<< (memcmp(image, readback, npixels*sizeof(unsigned short)) ? "DIFFERENT" : "identical") << endl;
+		}
+	}
+	catch (operaException &e) {
+		cerr << "operaFITSTileCompressionTest: " << e.getFormattedMessage() << endl;
+		return EXIT_FAILURE;
+	}
+	remove(filename.c_str());
+	free(image);
+	free(readback);
+
+	return EXIT_SUCCESS;
+}
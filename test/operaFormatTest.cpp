@@ -0,0 +1,123 @@
+/*******************************************************************
+ ****                  MODULE FOR OPERA v1.0                    ****
+ *******************************************************************
+ Module name: operaFormatTest
+ Version: 1.0
+ Description: Compare formatFixed and formatScientific to snprintf.
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2016  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <limits>
+#include <iostream>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaLib.h"
+
+/*! \file operaFormatTest.cpp */
+
+using namespace std;
+
+/*!
+ * operaFormatTest
+ * \author Doug Teeple
+ * \brief Format edge values, floats of random bits and flux-like floats with formatFixed and formatScientific,
+ * \brief and into buffers too small for them, and count the results that differ from snprintf.
+ * \return EXIT_STATUS
+ * \ingroup test
+ */
+int main()
+{
+	const double edges[] = {
+		0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375, 1.0, 9.5, 99.5, 0.05, 0.25, 0.0625,
+		9.9999995, 0.99999994, 999999.94, 1e-5, 1e-7, 1e-10, 1e-30, 1e10, 1e20, 3.4028235e38,
+		1.17549435e-38, 1.4e-45, 16777216.0, 16777217.0, 4503599627370496.0, 123456.789,
+		0.1, 0.2, 0.3, 1.0/3.0, M_PI, -M_E, 6.02214076e23,
+		numeric_limits<double>::infinity(), -numeric_limits<double>::infinity(), numeric_limits<double>::quiet_NaN()
+	};
+	const unsigned nedges = sizeof(edges)/sizeof(edges[0]);
+	const unsigned nrandom = 200000;
+	char expected[512], actual[512];
+	unsigned long comparisons = 0, differences = 0;
+
+	srand(time(NULL));
+	for (unsigned i=0; i<nedges*30+nrandom*2; i++) {
+		double value;
+		unsigned width, precision, size = sizeof(actual);
+		if (i < nedges*30) {
+			/* each edge value as a double and as a float, to 14 places, right and left of a width */
+			value = (i/15) & 1 ? (float)edges[i/30] : edges[i/30];
+			precision = i % 15;
+			width = i % 4 ? 0 : 24;
+		} else if (i & 1) {
+			unsigned bits = (unsigned)rand() << 16 ^ (unsigned)rand();
+			float f;
+			memcpy(&f, &bits, sizeof(f));
+			value = f;
+			precision = rand() % 12;
+			width = rand() % 16;
+		} else {
+			/* flux-like floats, where the formatter is exact */
+			value = (float)((double)rand()/RAND_MAX * pow(10.0, rand() % 12 - 6));
+			precision = rand() % 12;
+			width = rand() % 16;
+		}
+		if (i >= nedges*30+nrandom*2-30) {
+			/* the last few into buffers that are too small */
+			size = 1 + i % 15;
+		}
+
+		snprintf(expected, size, "%*.*f", (int)width, (int)precision, value);
+		unsigned length = formatFixed(actual, size, value, width, precision);
+		comparisons++;
+		if (strcmp(expected, actual) != 0 || length != strlen(actual)) {
+			if (differences++ < 20) {
+				cout << "%" << width << "." << precision << "f of " << value << " in " << size << " bytes: \"" << actual << "\", snprintf \"" << expected << "\"" << endl;
+			}
+		}
+		snprintf(expected, size, "%*.*e", (int)width, (int)precision, value);
+		length = formatScientific(actual, size, value, width, precision);
+		comparisons++;
+		if (strcmp(expected, actual) != 0 || length != strlen(actual)) {
+			if (differences++ < 20) {
+				cout << "%" << width << "." << precision << "e of " << value << " in " << size << " bytes: \"" << actual << "\", snprintf \"" << expected << "\"" << endl;
+			}
+		}
+	}
+	cout << comparisons << " values formatted, " << differences << " different from snprintf" << endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*******************************************************************
+****                  MODULE FOR OPERA v1.0                     ****
+********************************************************************
+Module name: operaKeyValueStoreTest
+Version: 1.0
+Description: Test the operaKeyValueStore library functions.
+Author(s): CFHT OPERA team
+Affiliation: Canada France Hawaii Telescope
+Location: Hawaii USA
+Date: Oct/2016
+Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2016  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+
+********************************************************************/
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#define _POSIX_C_SOURCE 200809L		// mkstemp and fdopen under -std=c99
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaKeyValueStore.h"
+
+/*! \file operaKeyValueStoreTest.c */
+
+/*!
+ * operaKeyValueStoreTest
+ * \author Doug Teeple
+ * \brief Test the operaKeyValueStore library functions.
+ * \arg argc
+ * \arg argv
+ * \return EXIT_STATUS
+ * \ingroup test
+ */
+
+int main(int argc, char *argv[])
+{
+	char filename[] = "/tmp/operaKeyValueStoreTestXXXXXX";
+	char name[32], value[32];
+	const char *found;
+	unsigned i, nfound = 0;
+	operaKeyValueStore store;
+	FILE *fp;
+	int fd;
+
+	fd = mkstemp(filename);
+	if (fd < 0 || (fp = fdopen(fd, "w")) == NULL) {
+		printf("Cannot create %s\n", filename);
+		return EXIT_FAILURE;
+	}
+	fprintf(fp, "# a parameter file\n");
+	fprintf(fp, "spectralResolution := 65000	# a comment\n");
+	fprintf(fp, "padded   :=   a padded value   \n");
+	fprintf(fp, "optional ?= 1.5\n");
+	fprintf(fp, "notanentry = 3\n");
+	fprintf(fp, "spectralResolution := 80000\n");
+	for (i=0; i<1000; i++) {
+		fprintf(fp, "key%u := value%u\n", i, i);
+	}
+	fclose(fp);
+
+	memset(&store, 0, sizeof(store));
+	if (operaKeyValueStoreLoad(&store, filename, 1024) != operaErrorCodeOK) {
+		printf("Cannot load %s\n", filename);
+		return EXIT_FAILURE;
+	}
+	printf("Loaded %u entries into a table of %u slots\n", store.count, store.tablesize);
+
+	found = operaKeyValueStoreFind(&store, "spectralResolution");
+	printf("spectralResolution = \"%s\" (the first entry, 65000)\n", found ? found : "(not found)");
+	found = operaKeyValueStoreFind(&store, "padded");
+	printf("padded = \"%s\" (a padded value)\n", found ? found : "(not found)");
+	found = operaKeyValueStoreFind(&store, "optional");
+	printf("optional = \"%s\" (1.5)\n", found ? found : "(not found)");
+	found = operaKeyValueStoreFind(&store, "notanentry");
+	printf("notanentry = \"%s\" (not found)\n", found ? found : "(not found)");
+	for (i=0; i<1000; i++) {
+		sprintf(name, "key%u", i);
+		sprintf(value, "value%u", i);
+		found = operaKeyValueStoreFind(&store, name);
+		if (found && strcmp(found, value) == 0) {
+			nfound++;
+		}
+	}
+	printf("%u of 1000 numbered entries found\n", nfound);
+
+	fp = fopen(filename, "w");
+	fprintf(fp, "spectralResolution := 80000\n");
+	fclose(fp);
+	operaKeyValueStoreLoad(&store, filename, 1024);
+	found = operaKeyValueStoreFind(&store, "spectralResolution");
+	printf("After rewriting the file spectralResolution = \"%s\" (80000) in %u entries\n", found ? found : "(not found)", store.count);
+
+	unlink(filename);
+	printf("Loading the removed file returns %d\n", operaKeyValueStoreLoad(&store, filename, 1024));
+	operaKeyValueStoreFree(&store);
+
+	return EXIT_SUCCESS;
+}
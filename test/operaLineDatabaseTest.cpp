@@ -0,0 +1,133 @@
+/*******************************************************************
+ ****                  MODULE FOR OPERA v1.0                    ****
+ *******************************************************************
+ Module name: operaLineDatabaseTest
+ Version: 1.0
+ Description: Read a line list as text and through its binary table, and query wavelength ranges.
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2016  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#include <stdlib.h>
+#include <time.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaLineDatabase.h"
+
+/*! \file operaLineDatabaseTest.cpp */
+
+using namespace std;
+
+/*!
+ * operaLineDatabaseTest
+ * \author Doug Teeple
+ * \brief Write an unsorted raw line list, open it as text and through the binary table built from it,
+ * \brief and compare the range queries of both to a scan of the rows.
+ * \return EXIT_STATUS
+ * \ingroup test
+ */
+int main()
+{
+	const unsigned nlines = 2000;
+	string textfilename = "/tmp/operaLineDatabaseTest.txt";
+	string binaryfilename = operaLineDatabase::getBinaryFilename(textfilename);
+
+	try {
+		srand(time(NULL));
+		ofstream fout(textfilename.c_str());
+		fout << "# wavelength(nm) intensity" << endl << setprecision(17);
+		for (unsigned i=0; i<nlines; i++) {
+			fout << 350.0 + 700.0*rand()/RAND_MAX << ' ' << (double)rand()/RAND_MAX << endl;
+		}
+		fout.close();
+		remove(binaryfilename.c_str());
+
+		operaLineDatabase text(textfilename, LineFormatRaw);
+		unsigned unsorted = 0;
+		for (unsigned i=1; i<text.size(); i++) {
+			if (text.getwavelength(i) < text.getwavelength(i-1)) unsorted++;
+		}
+		cout << "Text: " << text.size() << " lines of " << nlines << ", " << unsorted << " out of order, "
+			<< (text.isMapped() ? "mapped" : "parsed") << endl;
+
+		operaLineDatabase::write(binaryfilename, operaLineDatabase::readText(textfilename, LineFormatRaw), false);
+		operaLineDatabase binary(textfilename, LineFormatRaw);
+		unsigned different = 0;
+		for (unsigned i=0; i<binary.size() && i<text.size(); i++) {
+			if (binary.getwavelength(i) != text.getwavelength(i) || binary.getintensity(i) != text.getintensity(i)) different++;
+		}
+		cout << "Binary table: " << binary.size() << " lines, " << different << " different from the text, "
+			<< (binary.isMapped() ? "mapped" : "parsed") << endl;
+
+		double ranges[5][2] = {{300.0, 340.0}, {500.0, 510.0}, {700.0, 700.5}, {1000.0, 1100.0}, {600.0, 590.0}};
+		for (unsigned r=0; r<5; r++) {
+			unsigned first, last, count = 0;
+			binary.getRange(ranges[r][0], ranges[r][1], first, last);
+			for (unsigned i=0; i<text.size(); i++) {
+				if (text.getwavelength(i) >= ranges[r][0] && text.getwavelength(i) <= ranges[r][1]) count++;
+			}
+			cout << "Range " << ranges[r][0] << " to " << ranges[r][1] << " nm: rows " << first << " to " << last
+				<< ", " << last-first << " lines, " << count << " by scanning, "
+				<< binary.getLineList(operaWavelengthRange(ranges[r][0], ranges[r][1])).center.size() << " in the line list" << endl;
+		}
+
+		try {
+			operaLineDatabase missing("/tmp/operaLineDatabaseTest.missing", LineFormatRaw);
+			cout << "A missing file was opened" << endl;
+		}
+		catch (operaException &e) {
+			cout << "A missing file throws: " << e.getFormattedMessage() << endl;
+		}
+		ofstream bad((textfilename + ".bad" + LINEDATABASE_EXTENSION).c_str());
+		bad << "OPERALDB truncated";
+		bad.close();
+		try {
+			operaLineDatabase truncated(textfilename + ".bad" + LINEDATABASE_EXTENSION, LineFormatRaw);
+			cout << "A truncated table was opened" << endl;
+		}
+		catch (operaException &e) {
+			cout << "A truncated table throws: " << e.getFormattedMessage() << endl;
+		}
+		remove((textfilename + ".bad" + LINEDATABASE_EXTENSION).c_str());
+	}
+	catch (operaException &e) {
+		cerr << "operaLineDatabaseTest: " << e.getFormattedMessage() << endl;
+		return EXIT_FAILURE;
+	}
+	remove(textfilename.c_str());
+	remove(binaryfilename.c_str());
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/*******************************************************************
+ ****                  MODULE FOR OPERA v1.0                    ****
+ *******************************************************************
+ Module name: operaRadialVelocityLineFitTest
+ Version: 1.0
+ Description: Recover a known radial velocity from synthetic absorption lines.
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2016  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <iostream>
+#include <iomanip>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaLibCommon.h"			// for SPEED_OF_LIGHT_M
+#include "libraries/operaStats.h"
+#include "libraries/mpfit.h"					// for the status codes
+#include "libraries/operaRadialVelocityLineFit.h"
+
+/*! \file operaRadialVelocityLineFitTest.cpp */
+
+using namespace std;
+
+/*!
+ * operaRadialVelocityLineFitTest
+ * \author Doug Teeple
+ * \brief Fit a shared radial velocity to synthetic Gaussian lines without noise, with noise, and with
+ * \brief outliers under the Huber and Tukey weightings, then fit with no lines and with no degrees of freedom.
+ * \return EXIT_STATUS
+ * \ingroup test
+ */
+int main()
+{
+	const unsigned nlines = 40, pointsperline = 31;
+	const double rv = 12345.0, offset = -3000.0, noise = 0.005;		// m/s, m/s, flux
+	const double shift = (rv + offset)/SPEED_OF_LIGHT_M;
+	const char *names[] = {"noiseless", "noisy", "outliers, Huber", "outliers, Tukey"};
+	const operaRobustWeighting_t weightings[] = {RobustWeightingNone, RobustWeightingNone, RobustWeightingHuber, RobustWeightingTukey};
+
+	srand(time(NULL));
+	cout << "Input rv " << rv << " m/s" << endl << fixed << setprecision(4);
+	for (unsigned c=0; c<4; c++) {
+		operaRadialVelocityLineFit fit;
+		fit.setRadialVelocity(rv - 2000.0);
+		fit.setVelocityOffset(offset);
+		for (unsigned l=0; l<nlines; l++) {
+			double wl0 = 400.0 + 10.0*l + operaUniformRand(0.0, 5.0);
+			double level = operaUniformRand(-0.01, 0.01);
+			double amplitude = operaUniformRand(0.3, 0.6);
+			double sigma = wl0*1.5e-5;							// about R = 28000
+			double center = wl0/(1.0 - shift);
+			unsigned line = fit.addLine(wl0, 0.0, 0.4, 1.2*sigma);
+			for (unsigned i=0; i<pointsperline; i++) {
+				double wl = center + (i - 0.5*(pointsperline-1))*sigma/3.0;
+				double d = wl - wl0 - shift*wl;
+				double flux = 1.0 + level - amplitude*exp(-d*d/(2.0*sigma*sigma));
+				if (c > 0) {
+					double u1 = (rand() + 1.0)/(RAND_MAX + 2.0), u2 = (double)rand()/RAND_MAX;
+					flux += noise*sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2);
+				}
+				if (c > 1 && (l*pointsperline + i) % 17 == 0) {
+					flux += 20.0*noise;							// an outlier
+				}
+				fit.addDataPoint(line, wl, flux, noise*noise);
+			}
+		}
+		fit.fit(weightings[c]);
+		cout << setw(16) << names[c] << ": status " << fit.getStatus() << " rv " << fit.getRadialVelocity()
+			<< " +/- " << fit.getRadialVelocityError() << " m/s chi2 " << fit.getChisqr() << endl;
+	}
+
+	operaRadialVelocityLineFit empty;
+	empty.fit();
+	cout << "No lines: status " << empty.getStatus() << " (MP_ERR_NPOINTS " << MP_ERR_NPOINTS << ")" << endl;
+
+	operaRadialVelocityLineFit underdetermined;
+	unsigned line = underdetermined.addLine(500.0, 0.0, 0.4, 0.01);
+	for (unsigned i=0; i<RVLINEFIT_MINPOINTS; i++) {
+		underdetermined.addDataPoint(line, 500.0 + 0.01*i, 0.9, noise*noise);
+	}
+	underdetermined.fit();
+	cout << "No degrees of freedom: status " << underdetermined.getStatus() << " (MP_ERR_DOF " << MP_ERR_DOF << ")" << endl;
+
+	return EXIT_SUCCESS;
+}
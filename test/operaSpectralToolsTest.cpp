@@ -0,0 +1,163 @@
+/*******************************************************************
+ ****                  MODULE FOR OPERA v1.0                    ****
+ *******************************************************************
+ Module name: operaSpectralToolsTest
+ Version: 1.0
+ Description: Compare the Gaussian convolution and correlation of operaSpectralTools to a direct evaluation.
+ Author(s): CFHT OPERA team
+ Affiliation: Canada France Hawaii Telescope
+ Location: Hawaii USA
+ Date: Oct/2016
+ Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2016  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+ ********************************************************************/
+
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <iostream>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaException.h"
+#include "libraries/operaSpectralTools.h"
+
+/*! \file operaSpectralToolsTest.cpp */
+
+using namespace std;
+
+/*!
+ * operaSpectralToolsTest
+ * \author Doug Teeple
+ * \brief Convolve absorption line spectra on an unevenly sampled grid with a constant sigma, a constant
+ * \brief resolution, a resolution varying along the spectrum and as a batch, and print the largest
+ * \brief difference from the convolution over the same window evaluated with exp.
+ * \brief Correlate a spectrum with a Gaussian and print the largest difference from building the
+ * \brief template for every point and correlating it with operaCrossCorrelation.
+ * \return EXIT_STATUS
+ * \ingroup test
+ */
+int main()
+{
+	const unsigned np = 6000, nspectra = 4;
+	const double sigmas[] = {0.001, 0.01, 0.05};
+	const char *names[] = {"convolveSpectrumWithGaussian sigma 0.001", "convolveSpectrumWithGaussian sigma 0.01",
+		"convolveSpectrumWithGaussian sigma 0.05", "convolveSpectrumWithGaussianByResolution 65000",
+		"convolveSpectrumWithGaussianByResolution varying", "convolveSpectraWithGaussianByResolution"};
+
+	try {
+		srand(time(NULL));
+		operaVector wavelength(np);
+		wavelength[0] = 500.0;
+		for (unsigned i=1; i<np; i++) {
+			wavelength[i] = wavelength[i-1] + 0.002*(1.0 + 0.5*sin(i/300.0)) + 0.0002*rand()/RAND_MAX;
+		}
+		vector<operaVector> fluxes(nspectra, operaVector(np));
+		operaVector resolution(np);
+		for (unsigned s=0; s<nspectra; s++) {
+			for (unsigned i=0; i<np; i++) {
+				fluxes[s][i] = 1000.0*(1.0 + 0.01*s) + 5.0*rand()/RAND_MAX;
+			}
+			for (unsigned l=0; l<60; l++) {			// narrow lines, sharper than the kernels
+				double center = wavelength[0] + (wavelength[np-1] - wavelength[0])*rand()/RAND_MAX;
+				double depth = 800.0*rand()/RAND_MAX;
+				for (unsigned i=0; i<np; i++) {
+					double d = (wavelength[i] - center)/0.003;
+					if (fabs(d) < 8) fluxes[s][i] -= depth*exp(-0.5*d*d);
+				}
+			}
+		}
+		for (unsigned i=0; i<np; i++) {
+			resolution[i] = 20000.0 + 60000.0*i/np;
+		}
+		vector<operaVector> batch = convolveSpectraWithGaussianByResolution(wavelength, fluxes, resolution);
+
+		for (unsigned c=0; c<5+nspectra; c++) {
+			unsigned s = c < 5 ? 0 : c-5;
+			operaVector sigma(np), convolved;
+			for (unsigned i=0; i<np; i++) {
+				sigma[i] = c < 3 ? sigmas[c] : c == 3 ? wavelength[i]/65000.0 : wavelength[i]/resolution[i];
+			}
+			if (c < 3) convolved = convolveSpectrumWithGaussian(wavelength, fluxes[s], sigmas[c]);
+			else if (c == 3) convolved = convolveSpectrumWithGaussianByResolution(wavelength, fluxes[s], 65000.0);
+			else if (c == 4) convolved = convolveSpectrumWithGaussianByResolution(wavelength, fluxes[s], resolution);
+			else convolved = batch[s];
+
+			double maxdiff = 0.0;
+			for (unsigned i=0; i<np; i++) {
+				double step = i == 0 ? wavelength[1] - wavelength[0] : i == np-1 ? wavelength[i] - wavelength[i-1] : (wavelength[i+1] - wavelength[i-1])/2.0;
+				unsigned window = (unsigned)ceil(2*sigma[i]/step);
+				if (window > np/2) window = np/2;
+				double sum = 0.0, weightSum = 0.0;
+				for (unsigned j=(i > window ? i-window : 0); j<i+window && j<np; j++) {
+					double d = wavelength[j] - wavelength[i];
+					double weight = exp(-d*d/(2*sigma[i]*sigma[i]));
+					sum += fluxes[s][j]*weight;
+					weightSum += weight;
+				}
+				double diff = fabs(convolved[i] - sum/weightSum);
+				if (!(diff <= maxdiff)) maxdiff = diff;
+			}
+			cout << names[c < 5 ? c : 5];
+			if (c >= 5) cout << " spectrum " << s;
+			cout << ": max difference " << maxdiff/1100.0 << " of the continuum" << endl;
+		}
+
+		for (unsigned c=0; c<4; c++) {
+			double sigma = c < 3 ? sigmas[c] : 0.05;
+			unsigned n = c < 3 ? np : 15;			// the windows of the short spectrum are truncated to half of it
+			operaVector shortWavelength, shortFlux;
+			for (unsigned i=0; i<n; i++) {
+				shortWavelength.insert(wavelength[i]);
+				shortFlux.insert(fluxes[2][i]);
+			}
+			operaVector xcorr = calculateXCorrWithGaussian(shortWavelength, shortFlux, sigma);
+
+			double maxdiff = 0.0;
+			for (unsigned i=0; i<n; i++) {
+				double step = i == 0 ? wavelength[1] - wavelength[0] : i == n-1 ? wavelength[i] - wavelength[i-1] : (wavelength[i+1] - wavelength[i-1])/2.0;
+				unsigned window = (unsigned)ceil(2*sigma/step);
+				if (window > n/2) window = n/2;
+				operaVector windowFunc, mainFunc;
+				for (unsigned j=(i > window ? i-window : 0); j<i+window && j<n; j++) {
+					double x = ((double)j - (double)i)/(window/2.0);
+					windowFunc.insert(exp(-x*x/2.0)/(window/2.0*sqrt(2.0*M_PI)));
+					mainFunc.insert(fluxes[2][j]);
+				}
+				double diff = fabs(xcorr[i] - operaCrossCorrelation(windowFunc, mainFunc));
+				if (!(diff <= maxdiff)) maxdiff = diff;
+			}
+			cout << "calculateXCorrWithGaussian sigma " << sigma << " of " << n << " points: max difference " << maxdiff << endl;
+		}
+	}
+	catch (operaException &e) {
+		cerr << "operaSpectralToolsTest: " << e.getFormattedMessage() << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
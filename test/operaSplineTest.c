@@ -0,0 +1,136 @@
+/*******************************************************************
+****                  MODULE FOR OPERA v1.0                     ****
+********************************************************************
+Module name: operaSplineTest
+Version: 1.0
+Description: Compare operaSpline_t to cubicsplineDouble and splineinterpolateDouble.
+Author(s): CFHT OPERA team
+Affiliation: Canada France Hawaii Telescope
+Location: Hawaii USA
+Date: Oct/2016
+Contact: opera@cfht.hawaii.edu
+
+ Copyright (C) 2016  Opera Pipeline team, Canada France Hawaii Telescope
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see:
+ http://software.cfht.hawaii.edu/licenses
+ -or-
+ http://www.gnu.org/licenses/gpl-3.0.html
+
+********************************************************************/
+// $Date$
+// $Id$
+// $Revision$
+// $Locker$
+// $Log$
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "globaldefines.h"
+#include "operaError.h"
+#include "libraries/operaFit.h"
+#include "libraries/operaStats.h"
+
+/*! \file operaSplineTest.c */
+
+#define SPLINE_TOLERANCE 1e-10		// relative, the interval polynomials are expanded from the same second derivatives
+
+/*!
+ * operaSplineTest
+ * \author Doug Teeple
+ * \brief Evaluate a spline through unevenly spaced knots at random and at sorted abscissas, some of them
+ * \brief outside the knots, and compare it to splineinterpolateDouble with the same second derivatives.
+ * \arg argc
+ * \arg argv
+ * \return EXIT_STATUS
+ * \ingroup test
+ */
+
+int main(int argc, char *argv[])
+{
+	unsigned i, j, n = 500, nout = 20000;
+	double *x = (double *)malloc(n * sizeof(double));
+	double *y = (double *)malloc(n * sizeof(double));
+	double *y2 = (double *)malloc(n * sizeof(double));
+	double *xout = (double *)malloc(nout * sizeof(double));
+	double *yout = (double *)malloc(nout * sizeof(double));
+	double yp1, ypn, expected, diff, maxdiff;
+	operaSpline_t *spline;
+
+	srand(time(NULL));
+	x[0] = 370.0;
+	y[0] = 0.0;
+	for (i=1; i<n; i++) {
+		x[i] = x[i-1] + 0.01 + operaUniformRand(0.0, 2.0)*i/n;	// knots denser at the start
+		y[i] = 1000.0*sin(x[i]/7.0) + operaUniformRand(0.0, 50.0);
+	}
+	yp1 = (y[1] - y[0])/(x[1] - x[0]);
+	ypn = (y[n-1] - y[n-2])/(x[n-1] - x[n-2]);
+	cubicsplineDouble(x, y, n, yp1, ypn, y2);
+	spline = operaSplineCreate(n, x, y, yp1, ypn);
+
+	for (i=0; i<nout; i++) {
+		xout[i] = operaUniformRand(x[0] - 10.0, x[n-1] + 10.0);
+	}
+	for (j=0; j<2; j++) {
+		if (j == 1) {
+			for (i=0; i<nout; i++) {
+				xout[i] = x[0] - 10.0 + (x[n-1] - x[0] + 20.0)*i/nout;
+			}
+		}
+		operaSplineEvaluate(spline, nout, xout, yout);
+		maxdiff = 0.0;
+		for (i=0; i<nout; i++) {
+			splineinterpolateDouble(x, y, y2, n, xout[i], &expected);
+			diff = fabs(yout[i] - expected)/(1.0 + fabs(expected));
+			if (diff > maxdiff) maxdiff = diff;
+		}
+		printf("%s queries: max relative difference %g %s\n", j ? "Sorted" : "Random", maxdiff, maxdiff <= SPLINE_TOLERANCE ? "(agree)" : "(DIFFER)");
+	}
+
+	maxdiff = 0.0;
+	for (i=0; i<n; i++) {
+		diff = fabs(operaSplineValue(spline, x[i]) - y[i])/(1.0 + fabs(y[i]));
+		if (diff > maxdiff) maxdiff = diff;
+	}
+	printf("At the knots: max relative difference %g %s\n", maxdiff, maxdiff <= SPLINE_TOLERANCE ? "(agree)" : "(DIFFER)");
+
+	for (i=0; i<n; i++) {
+		y[i] = 0.01*x[i]*x[i] - 3.0*cos(x[i]);
+	}
+	yp1 = (y[1] - y[0])/(x[1] - x[0]);
+	ypn = (y[n-1] - y[n-2])/(x[n-1] - x[n-2]);
+	cubicsplineDouble(x, y, n, yp1, ypn, y2);
+	operaSplineSetValues(spline, y, yp1, ypn);
+	operaSplineEvaluate(spline, nout, xout, yout);
+	maxdiff = 0.0;
+	for (i=0; i<nout; i++) {
+		splineinterpolateDouble(x, y, y2, n, xout[i], &expected);
+		diff = fabs(yout[i] - expected)/(1.0 + fabs(expected));
+		if (diff > maxdiff) maxdiff = diff;
+	}
+	printf("New values at the same knots: max relative difference %g %s\n", maxdiff, maxdiff <= SPLINE_TOLERANCE ? "(agree)" : "(DIFFER)");
+
+	operaSplineDelete(spline);
+	free(x);
+	free(y);
+	free(y2);
+	free(xout);
+	free(yout);
+
+	return EXIT_SUCCESS;
+}